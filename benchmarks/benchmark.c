@@ -0,0 +1,545 @@
+/**
+ * @PROJECT     AerScript Interpreter
+ * @COPYRIGHT   See COPYING in the top level directory
+ * @FILE        benchmarks/benchmark.c
+ * @DESCRIPTION Performance benchmark driver for the PH7 Engine
+ * @DEVELOPERS  Symisc Systems <devel@symisc.net>
+ *              Rafal Kupiec <belliash@codingworkshop.eu.org>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+/* Make sure this header file is available.*/
+#include "ph7.h"
+/*
+ * Default number of iterations per script.
+ */
+#define BENCH_ITERATIONS 5
+/*
+ * Memory accounting.
+ * Each chunk handed to the engine is prefixed with a header recording its size,
+ * so that the amount of memory in use and the peak usage can be tracked.
+ */
+#define BENCH_MEM_HEADER 16
+static size_t nMemUsed = 0;
+static size_t nMemPeak = 0;
+/*
+ * TRUE to run the scripts in arena mode [i.e: PH7_VM_CONFIG_ARENA].
+ */
+static int bArena = 0;
+/*
+ * TRUE to check the output of each run against the expected output
+ * stored next to the script [i.e: script.aer -> script.exp].
+ */
+static int bVerify = 0;
+/*
+ * Number of runs whose output did not match, protected by the mutex below.
+ */
+static int nFailed = 0;
+static pthread_mutex_t sFailMutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Output collected from a single context when the output is verified.
+ */
+typedef struct BenchOutput BenchOutput;
+struct BenchOutput {
+	char *zBuf;   /* Collected output */
+	size_t nLen;  /* Output length */
+	size_t nSize; /* Buffer size */
+};
+/*
+ * Memory allocation routines used by the engine.
+ */
+static void *BenchMemAlloc(unsigned int nByte) {
+	unsigned char *zChunk = (unsigned char *)malloc(nByte + BENCH_MEM_HEADER);
+	if(zChunk == 0) {
+		return 0;
+	}
+	*(size_t *)zChunk = nByte;
+	nMemUsed += nByte;
+	if(nMemUsed > nMemPeak) {
+		nMemPeak = nMemUsed;
+	}
+	return &zChunk[BENCH_MEM_HEADER];
+}
+static void BenchMemFree(void *pChunk) {
+	unsigned char *zChunk = (unsigned char *)pChunk - BENCH_MEM_HEADER;
+	nMemUsed -= *(size_t *)zChunk;
+	free(zChunk);
+}
+static void *BenchMemRealloc(void *pOld, unsigned int nByte) {
+	unsigned char *zChunk;
+	size_t nOld;
+	if(pOld == 0) {
+		return BenchMemAlloc(nByte);
+	}
+	zChunk = (unsigned char *)pOld - BENCH_MEM_HEADER;
+	nOld = *(size_t *)zChunk;
+	zChunk = (unsigned char *)realloc(zChunk, nByte + BENCH_MEM_HEADER);
+	if(zChunk == 0) {
+		return 0;
+	}
+	*(size_t *)zChunk = nByte;
+	nMemUsed = nMemUsed - nOld + nByte;
+	if(nMemUsed > nMemPeak) {
+		nMemPeak = nMemUsed;
+	}
+	return &zChunk[BENCH_MEM_HEADER];
+}
+static unsigned int BenchMemChunkSize(void *pChunk) {
+	return (unsigned int)*(size_t *)((unsigned char *)pChunk - BENCH_MEM_HEADER);
+}
+static const SyMemMethods sBenchMem = {
+	BenchMemAlloc,     /* xAlloc */
+	BenchMemRealloc,   /* xRealloc */
+	BenchMemFree,      /* xFree */
+	BenchMemChunkSize, /* xChunkSize */
+	0,                 /* xInit */
+	0,                 /* xRelease */
+	0                  /* pUserData */
+};
+/*
+ * Display an error message and exit.
+ */
+static void Fatal(const char *zMsg) {
+	puts(zMsg);
+	/* Shutdown the library */
+	ph7_lib_shutdown();
+	/* Exit immediately */
+	exit(1);
+}
+/*
+ * Display a help message and exit.
+ */
+static void Help(void) {
+	puts("benchmark [-s] [-c] [-p] [-a] [-v] [-t threads] [-n iterations] path/to/aer_file [...]");
+	puts("\t-a: Execute the scripts in arena mode, with -p each context is reset and reused (ph7_vm_reset())");
+	puts("\t-c: Load the precompiled byte-code (.aerc) files, refreshing them when needed");
+	puts("\t-n: Number of times each script is compiled and executed");
+	puts("\t-p: Compile each script once and execute it in spawned contexts (ph7_vm_spawn())");
+	puts("\t-s: Only measure the VM startup (ph7_vm_init() + ph7_compile_file())");
+	puts("\t-t: Measure the scaling from 1 up to the given number of threads, each running its own VMs");
+	puts("\t-v: Check the output of each run against the expected output (.exp) file");
+	puts("\t-h: Display this message an exit");
+	/* Exit immediately */
+	exit(0);
+}
+/*
+ * Return a monotonic timestamp in microseconds.
+ */
+static double BenchNow(void) {
+	struct timespec sTs;
+	clock_gettime(CLOCK_MONOTONIC, &sTs);
+	return (double)sTs.tv_sec * 1e6 + (double)sTs.tv_nsec / 1e3;
+}
+/*
+ * VM output consumer callback.
+ * Script output is not part of the measurement,discard it.
+ */
+static int Output_Discard(const void *pOutput, unsigned int nOutputLen, void *pUserData /* Unused */) {
+	(void)pOutput;
+	(void)nOutputLen;
+	(void)pUserData;
+	return PH7_OK;
+}
+/*
+ * VM output consumer callback.
+ * Collect the script output so that it can be verified once the run is done.
+ */
+static int Output_Collect(const void *pOutput, unsigned int nOutputLen, void *pUserData) {
+	BenchOutput *pOut = (BenchOutput *)pUserData;
+	if(pOut->nLen + nOutputLen > pOut->nSize) {
+		size_t nSize = (pOut->nLen + nOutputLen) * 2;
+		char *zBuf = (char *)realloc(pOut->zBuf, nSize);
+		if(zBuf == 0) {
+			return PH7_ABORT;
+		}
+		pOut->zBuf = zBuf;
+		pOut->nSize = nSize;
+	}
+	memcpy(&pOut->zBuf[pOut->nLen], pOutput, nOutputLen);
+	pOut->nLen += nOutputLen;
+	return PH7_OK;
+}
+/*
+ * Install the output consumer of a freshly created context.
+ */
+static void BenchOutputConfig(ph7_vm *pVm, BenchOutput *pOut) {
+	if(bVerify) {
+		ph7_vm_config(pVm, PH7_VM_CONFIG_OUTPUT, Output_Collect, pOut);
+	} else {
+		ph7_vm_config(pVm, PH7_VM_CONFIG_OUTPUT, Output_Discard, 0);
+	}
+}
+/*
+ * Compare the output collected during the last run of the given script
+ * with its expected output, then get the buffer ready for the next run.
+ */
+static void BenchVerify(const char *zPath, BenchOutput *pOut) {
+	char zExp[4096];
+	char *zData = 0;
+	size_t nLen = 0;
+	long nSize;
+	FILE *pFile;
+	int n;
+	if(!bVerify) {
+		return;
+	}
+	n = snprintf(zExp, sizeof(zExp), "%s", zPath);
+	if(n > 4 && n < (int)sizeof(zExp) && strcmp(&zExp[n - 4], ".aer") == 0) {
+		strcpy(&zExp[n - 4], ".exp");
+	}
+	pFile = fopen(zExp, "rb");
+	if(pFile && fseek(pFile, 0, SEEK_END) == 0 && (nSize = ftell(pFile)) >= 0) {
+		zData = (char *)malloc((size_t)nSize + 1);
+		rewind(pFile);
+		if(zData) {
+			nLen = fread(zData, 1, (size_t)nSize, pFile);
+		}
+	}
+	if(pFile) {
+		fclose(pFile);
+	}
+	if(zData == 0 || nLen != pOut->nLen || memcmp(zData, pOut->zBuf, nLen) != 0) {
+		pthread_mutex_lock(&sFailMutex);
+		nFailed++;
+		fprintf(stderr, "%s: output does not match %s\n", zPath, zExp);
+		pthread_mutex_unlock(&sFailMutex);
+	}
+	free(zData);
+	pOut->nLen = 0;
+}
+/*
+ * Compile and execute the given script nIter times, then report the
+ * average time spent in each stage along with the number of executions
+ * per second and the peak memory used by a single VM.
+ */
+static void BenchScript(ph7 *pEngine, const char *zPath, int nIter) {
+	double tInit = 0, tCompile = 0, tExec = 0;
+	BenchOutput sOut = {0, 0, 0};
+	size_t nPeak = 0;
+	size_t nBase;
+	double tStart;
+	ph7_vm *pVm;
+	int i, rc;
+	for(i = 0 ; i < nIter ; ++i) {
+		nBase = nMemPeak = nMemUsed;
+		tStart = BenchNow();
+		rc = ph7_vm_init(pEngine, &pVm, 0, PH7_OPT_FOLD);
+		if(rc != PH7_OK) {
+			Fatal("VM initialization error");
+		}
+		tInit += BenchNow() - tStart;
+		BenchOutputConfig(pVm, &sOut);
+		if(bArena) {
+			ph7_vm_config(pVm, PH7_VM_CONFIG_ARENA);
+		}
+		tStart = BenchNow();
+		rc = ph7_compile_file(pEngine, zPath, &pVm);
+		if(rc != PH7_OK) {
+			Fatal("Compile error");
+		}
+		tCompile += BenchNow() - tStart;
+		tStart = BenchNow();
+		ph7_vm_exec(pVm, 0);
+		tExec += BenchNow() - tStart;
+		ph7_vm_release(pVm);
+		BenchVerify(zPath, &sOut);
+		if(nMemPeak - nBase > nPeak) {
+			nPeak = nMemPeak - nBase;
+		}
+	}
+	free(sOut.zBuf);
+	printf("%-40s %6d %12.1f %12.1f %12.3f %12.3f %12zu\n", zPath, nIter,
+		   tInit / nIter, tCompile / nIter, tExec / nIter / 1e3, 1e6 * nIter / tExec, nPeak / 1024);
+}
+/*
+ * Create a VM and compile the given script nIter times without executing it,
+ * then report the average startup time along with the number of startups per
+ * second and the peak memory used by a single VM.
+ */
+static void BenchStartup(ph7 *pEngine, const char *zPath, int nIter) {
+	double tStartup = 0;
+	size_t nPeak = 0;
+	size_t nBase;
+	double tStart;
+	ph7_vm *pVm;
+	int i, rc;
+	for(i = 0 ; i < nIter ; ++i) {
+		nBase = nMemPeak = nMemUsed;
+		tStart = BenchNow();
+		rc = ph7_vm_init(pEngine, &pVm, 0, PH7_OPT_FOLD);
+		if(rc != PH7_OK) {
+			Fatal("VM initialization error");
+		}
+		rc = ph7_compile_file(pEngine, zPath, &pVm);
+		if(rc != PH7_OK) {
+			Fatal("Compile error");
+		}
+		tStartup += BenchNow() - tStart;
+		ph7_vm_release(pVm);
+		if(nMemPeak - nBase > nPeak) {
+			nPeak = nMemPeak - nBase;
+		}
+	}
+	printf("%-40s %6d %12.1f %12.1f %12zu\n", zPath, nIter,
+		   tStartup / nIter, 1e6 * nIter / tStartup, nPeak / 1024);
+}
+/*
+ * Compile the given script once, then execute it nIter times, each time in a
+ * fresh context sharing the compiled program. In arena mode, a single context
+ * is reset after each run instead. Report the compile time along with the
+ * average time spent in each stage and the peak memory used by a single context.
+ */
+static void BenchShared(ph7 *pEngine, const char *zPath, int nIter) {
+	double tCompile, tSpawn = 0, tExec = 0, tRelease = 0;
+	BenchOutput sOut = {0, 0, 0};
+	ph7_vm *pProgram, *pVm = 0;
+	size_t nPeak = 0;
+	size_t nBase;
+	double tStart;
+	int i, rc;
+	tStart = BenchNow();
+	rc = ph7_vm_init(pEngine, &pProgram, 0, PH7_OPT_FOLD);
+	if(rc != PH7_OK) {
+		Fatal("VM initialization error");
+	}
+	rc = ph7_compile_file(pEngine, zPath, &pProgram);
+	if(rc != PH7_OK) {
+		Fatal("Compile error");
+	}
+	tCompile = BenchNow() - tStart;
+	if(bArena) {
+		/* Contexts inherit the arena mode of their program */
+		ph7_vm_config(pProgram, PH7_VM_CONFIG_ARENA);
+	}
+	for(i = 0 ; i < nIter ; ++i) {
+		nBase = nMemPeak = nMemUsed;
+		if(pVm == 0) {
+			tStart = BenchNow();
+			rc = ph7_vm_spawn(pProgram, &pVm);
+			if(rc != PH7_OK) {
+				Fatal("Context initialization error");
+			}
+			tSpawn += BenchNow() - tStart;
+			BenchOutputConfig(pVm, &sOut);
+		}
+		tStart = BenchNow();
+		ph7_vm_exec(pVm, 0);
+		tExec += BenchNow() - tStart;
+		tStart = BenchNow();
+		if(bArena) {
+			/* Drop the runtime state and get the context ready for the next run */
+			rc = ph7_vm_reset(pVm);
+			if(rc != PH7_OK) {
+				Fatal("Context reset error");
+			}
+		} else {
+			ph7_vm_release(pVm);
+			pVm = 0;
+		}
+		tRelease += BenchNow() - tStart;
+		BenchVerify(zPath, &sOut);
+		if(nMemPeak - nBase > nPeak) {
+			nPeak = nMemPeak - nBase;
+		}
+	}
+	if(pVm) {
+		ph7_vm_release(pVm);
+	}
+	ph7_vm_release(pProgram);
+	free(sOut.zBuf);
+	printf("%-40s %6d %12.1f %12.1f %12.3f %12.3f %12.1f %12zu\n", zPath, nIter,
+		   tCompile, tSpawn / nIter, tExec / nIter / 1e3, 1e6 * nIter / tExec, tRelease / nIter, nPeak / 1024);
+}
+/*
+ * Per thread state of the scaling benchmark.
+ */
+typedef struct BenchThread BenchThread;
+struct BenchThread {
+	ph7 *pEngine;        /* Engine shared by all threads */
+	ph7_vm *pProgram;    /* Compiled program shared by all threads, NULL to compile the script in each VM */
+	const char *zPath;   /* Script to run */
+	int nIter;           /* Number of runs */
+	pthread_t sThread;   /* Thread handle */
+};
+/*
+ * Thread entry point: Run the given script nIter times, each time in a fresh VM,
+ * or in a fresh context of the shared program if available. In arena mode, the
+ * thread resets and reuses a single context instead.
+ */
+static void *BenchThreadMain(void *pArg) {
+	BenchThread *pThread = (BenchThread *)pArg;
+	BenchOutput sOut = {0, 0, 0};
+	ph7_vm *pVm = 0;
+	int i, rc;
+	for(i = 0 ; i < pThread->nIter ; ++i) {
+		if(pVm == 0 && pThread->pProgram) {
+			rc = ph7_vm_spawn(pThread->pProgram, &pVm);
+			if(rc != PH7_OK) {
+				Fatal("Context initialization error");
+			}
+		} else if(pVm == 0) {
+			rc = ph7_vm_init(pThread->pEngine, &pVm, 0, PH7_OPT_FOLD);
+			if(rc != PH7_OK) {
+				Fatal("VM initialization error");
+			}
+			rc = ph7_compile_file(pThread->pEngine, pThread->zPath, &pVm);
+			if(rc != PH7_OK) {
+				Fatal("Compile error");
+			}
+		}
+		BenchOutputConfig(pVm, &sOut);
+		if(bArena) {
+			ph7_vm_config(pVm, PH7_VM_CONFIG_ARENA);
+		}
+		ph7_vm_exec(pVm, 0);
+		if(bArena && pThread->pProgram) {
+			/* Reuse the context for the next run */
+			rc = ph7_vm_reset(pVm);
+			if(rc != PH7_OK) {
+				Fatal("Context reset error");
+			}
+		} else {
+			ph7_vm_release(pVm);
+			pVm = 0;
+		}
+		BenchVerify(pThread->zPath, &sOut);
+	}
+	if(pVm) {
+		ph7_vm_release(pVm);
+	}
+	free(sOut.zBuf);
+	return 0;
+}
+/*
+ * Run the given script nIter times in each of 1 up to nThread concurrent threads,
+ * then report the wall time along with the total number of runs per second and
+ * the speedup relative to a single thread.
+ */
+static void BenchThreads(ph7 *pEngine, const char *zPath, int nIter, int nThread, int bShared) {
+	BenchThread *aThread;
+	ph7_vm *pProgram = 0;
+	double tStart, tWall, tBase = 0;
+	int i, n, rc;
+	aThread = (BenchThread *)malloc(sizeof(BenchThread) * nThread);
+	if(aThread == 0) {
+		Fatal("Out of memory");
+	}
+	if(bShared) {
+		/* Compile the script once for all threads */
+		rc = ph7_vm_init(pEngine, &pProgram, 0, PH7_OPT_FOLD);
+		if(rc != PH7_OK) {
+			Fatal("VM initialization error");
+		}
+		rc = ph7_compile_file(pEngine, zPath, &pProgram);
+		if(rc != PH7_OK) {
+			Fatal("Compile error");
+		}
+	}
+	for(n = 1 ; n <= nThread ; ++n) {
+		tStart = BenchNow();
+		for(i = 0 ; i < n ; ++i) {
+			aThread[i].pEngine = pEngine;
+			aThread[i].pProgram = pProgram;
+			aThread[i].zPath = zPath;
+			aThread[i].nIter = nIter;
+			if(pthread_create(&aThread[i].sThread, 0, BenchThreadMain, &aThread[i]) != 0) {
+				Fatal("Unable to create a thread");
+			}
+		}
+		for(i = 0 ; i < n ; ++i) {
+			pthread_join(aThread[i].sThread, 0);
+		}
+		tWall = BenchNow() - tStart;
+		if(n == 1) {
+			tBase = tWall;
+		}
+		printf("%-40s %8d %6d %12.3f %12.3f %12.2f\n", zPath, n, n * nIter,
+			   tWall / 1e3, 1e6 * n * nIter / tWall, tBase * n / tWall);
+	}
+	if(pProgram) {
+		ph7_vm_release(pProgram);
+	}
+	free(aThread);
+}
+/*
+ * Main program: Benchmark the given scripts.
+ */
+int main(int argc, char **argv) {
+	ph7 *pEngine;
+	int nIter = BENCH_ITERATIONS;
+	int bStartup = 0;
+	int bShared = 0;
+	int nThread = 0;
+	int bCache = 0;
+	int n;
+	/* Process benchmark arguments first */
+	for(n = 1 ; n < argc ; ++n) {
+		if(argv[n][0] != '-') {
+			/* No more benchmark arguments */
+			break;
+		}
+		if(argv[n][1] == 'n' && n + 1 < argc) {
+			nIter = atoi(argv[++n]);
+		} else if(argv[n][1] == 's') {
+			bStartup = 1;
+		} else if(argv[n][1] == 'c') {
+			bCache = 1;
+		} else if(argv[n][1] == 'p') {
+			bShared = 1;
+		} else if(argv[n][1] == 'a') {
+			bArena = 1;
+		} else if(argv[n][1] == 'v') {
+			bVerify = 1;
+		} else if(argv[n][1] == 't' && n + 1 < argc) {
+			nThread = atoi(argv[++n]);
+		} else {
+			Help();
+		}
+	}
+	if(n >= argc || nIter < 1 || nThread < 0) {
+		Help();
+	}
+	if(nThread > 0) {
+		/* Independent VMs run concurrently, the memory is not tracked */
+		if(ph7_lib_config(PH7_LIB_CONFIG_THREAD_LEVEL_MULTI) != PH7_OK) {
+			Fatal("Error while enabling the multi-thread mode");
+		}
+	} else if(ph7_lib_config(PH7_LIB_CONFIG_USER_MALLOC, &sBenchMem) != PH7_OK) {
+		/* Track the memory used by the engine */
+		Fatal("Error while installing the memory allocator");
+	}
+	/* Allocate a new PH7 engine instance */
+	if(ph7_init(&pEngine) != PH7_OK) {
+		Fatal("Error while allocating a new PH7 Engine instance");
+	}
+	if(bCache) {
+		ph7_config(pEngine, PH7_CONFIG_BYTECODE_CACHE, PH7_CACHE_READ | PH7_CACHE_WRITE);
+	}
+	if(nThread > 0) {
+		printf("%-40s %8s %6s %12s %12s %12s\n", "script", "threads", "runs", "wall(ms)", "runs/sec", "speedup");
+		for(; n < argc ; ++n) {
+			BenchThreads(pEngine, argv[n], nIter, nThread, bShared);
+		}
+	} else if(bStartup) {
+		printf("%-40s %6s %12s %12s %12s\n", "script", "runs", "startup(us)", "startup/sec", "peak(KB)");
+		for(; n < argc ; ++n) {
+			BenchStartup(pEngine, argv[n], nIter);
+		}
+	} else if(bShared) {
+		printf("%-40s %6s %12s %12s %12s %12s %12s %12s\n", "script", "runs", "compile(us)", "spawn(us)", "exec(ms)", "exec/sec", "release(us)", "peak(KB)");
+		for(; n < argc ; ++n) {
+			BenchShared(pEngine, argv[n], nIter);
+		}
+	} else {
+		printf("%-40s %6s %12s %12s %12s %12s %12s\n", "script", "runs", "init(us)", "compile(us)", "exec(ms)", "exec/sec", "peak(KB)");
+		for(; n < argc ; ++n) {
+			BenchScript(pEngine, argv[n], nIter);
+		}
+	}
+	/* All done, cleanup the mess left behind */
+	ph7_release(pEngine);
+	return nFailed > 0 ? 1 : 0;
+}
@@ -14,8 +14,8 @@
 #define PH7_VM_MISUSE(VM) (VM == 0 || VM->nMagic == PH7_VM_STALE)
 /* If another thread have released a working instance,the following macros
  * evaluates to true. These macros are only used when the library
- * is built with threading support enabled which is not the case in
- * the default built.
+ * is configured for multi-threading [i.e: PH7_LIB_CONFIG_THREAD_LEVEL_MULTI]
+ * which is not the case by default.
  */
 #define PH7_THRD_ENGINE_RELEASE(ENGINE) (ENGINE->nMagic != PH7_ENGINE_MAGIC)
 #define PH7_THRD_VM_RELEASE(VM) (VM->nMagic == PH7_VM_STALE)
@@ -27,12 +27,23 @@
  */
 static struct Global_Data {
 	SyMemBackend sAllocator;                /* Global low level memory allocator */
+	const SyMutexMethods *pMutexMethods;    /* Mutex methods */
+	SyMutex *pMutex;                        /* Global mutex */
+	sxu32 nThreadingLevel;                  /* Threading level: 0 or PH7_THREAD_LEVEL_SINGLE == Single threaded,
+											 * PH7_THREAD_LEVEL_MULTI == Multi-threaded. The threading level can
+											 * be set using the [ph7_lib_config()] interface with a configuration
+											 * verb set to PH7_LIB_CONFIG_THREAD_LEVEL_SINGLE or
+											 * PH7_LIB_CONFIG_THREAD_LEVEL_MULTI.
+											 */
 	const ph7_vfs *pVfs;                    /* Underlying virtual file system */
 	sxi32 nEngine;                          /* Total number of active engines */
 	ph7 *pEngines;                          /* List of active engine */
 	sxu32 nMagic;                           /* Sanity check against library misuse */
 } sMPGlobal = {
-	{0, 0, 0, 0, 0, 0, 0, 0, 0, {0}},
+	{0, 0, 0, 0, 0, 0, 0, 0, 0, {0}, {{0, 0, 0}}, 0, 0, 0, 0, 0, 0, 0, 0, 0, {{0, 0, 0}}},
+	0,
+	0,
+	0,
 	0,
 	0,
 	0,
@@ -117,6 +128,12 @@ static sxi32 EngineConfig(ph7 *pEngine, sxi32 nOp, va_list ap) {
 				}
 				break;
 			}
+		case PH7_CONFIG_BYTECODE_CACHE: {
+				int iMode = va_arg(ap, int);
+				/* Bytecode cache mode */
+				pConf->iCache = iMode & (PH7_CACHE_READ | PH7_CACHE_WRITE);
+				break;
+			}
 		case PH7_CONFIG_ERR_ABORT:
 			/* Reserved for future use */
 			break;
@@ -164,6 +181,57 @@ static sxi32 PH7CoreConfigure(sxi32 nOp, va_list ap) {
 				sMPGlobal.sAllocator.pUserData = pUserData;
 				break;
 			}
+		case PH7_LIB_CONFIG_USER_MUTEX: {
+				/* Use an alternative low-level mutex subsystem */
+				const SyMutexMethods *pMethods = va_arg(ap, const SyMutexMethods *);
+				/* Sanity check */
+				if(pMethods == 0 || pMethods->xEnter == 0 || pMethods->xLeave == 0 || pMethods->xNew == 0) {
+					/* At least three criticial callbacks xEnter(),xLeave() and xNew() must be supplied */
+					rc = PH7_CORRUPT;
+					break;
+				}
+				if(sMPGlobal.pMutexMethods) {
+					/* Overwrite the previous mutex subsystem */
+					SyMutexRelease(sMPGlobal.pMutexMethods, sMPGlobal.pMutex);
+					SyMutexGlobalRelease(sMPGlobal.pMutexMethods);
+					sMPGlobal.pMutexMethods = 0;
+					sMPGlobal.pMutex = 0;
+				}
+				/* Initialize and install the new mutex subsystem */
+				if(pMethods->xGlobalInit) {
+					rc = pMethods->xGlobalInit();
+					if(rc != PH7_OK) {
+						break;
+					}
+				}
+				/* Create the global mutex */
+				sMPGlobal.pMutex = pMethods->xNew(SXMUTEX_TYPE_FAST);
+				if(sMPGlobal.pMutex == 0) {
+					/*
+					 * If the supplied mutex subsystem is so sick that we are unable to
+					 * create a single mutex,there is no much we can do here.
+					 */
+					SyMutexGlobalRelease(pMethods);
+					rc = PH7_CORRUPT;
+					break;
+				}
+				sMPGlobal.pMutexMethods = pMethods;
+				if(sMPGlobal.nThreadingLevel == 0) {
+					/* Supplying a mutex subsystem implies multi-threading */
+					sMPGlobal.nThreadingLevel = PH7_THREAD_LEVEL_MULTI;
+				}
+				break;
+			}
+		case PH7_LIB_CONFIG_THREAD_LEVEL_SINGLE:
+			/* Single thread mode (Only one thread is allowed to play with the library) */
+			sMPGlobal.nThreadingLevel = PH7_THREAD_LEVEL_SINGLE;
+			break;
+		case PH7_LIB_CONFIG_THREAD_LEVEL_MULTI:
+			/* Multi-threading mode (library is thread safe and PH7 engines and virtual machines
+			 * may be shared between multiple threads).
+			 */
+			sMPGlobal.nThreadingLevel = PH7_THREAD_LEVEL_MULTI;
+			break;
 		default:
 			/* Unknown configuration option */
 			rc = PH7_CORRUPT;
@@ -198,6 +266,8 @@ int ph7_lib_config(int nConfigOp, ...) {
  * until the initialization process is done.
  */
 static sxi32 PH7CoreInitialize(void) {
+	const SyMutexMethods *pMutexMethods = 0;
+	SyMutex *pMaster = 0;
 	const ph7_vfs *pVfs; /* Built-in vfs */
 	int rc;
 	/*
@@ -207,10 +277,31 @@ static sxi32 PH7CoreInitialize(void) {
 	if(sMPGlobal.nMagic == PH7_LIB_MAGIC) {
 		return PH7_OK; /* Already initialized */
 	}
-	/* Point to the built-in vfs */
-	pVfs = PH7_ExportBuiltinVfs();
-	/* Install it */
-	ph7_lib_config(PH7_LIB_CONFIG_VFS, pVfs);
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI) {
+		pMutexMethods = sMPGlobal.pMutexMethods;
+		if(pMutexMethods == 0) {
+			/* Use the built-in mutex subsystem */
+			pMutexMethods = SyMutexExportMethods();
+			/* Install the mutex subsystem */
+			rc = ph7_lib_config(PH7_LIB_CONFIG_USER_MUTEX, pMutexMethods);
+			if(rc != PH7_OK) {
+				return rc;
+			}
+		}
+		/* Obtain a static mutex so we can initialize the library without calling malloc() */
+		pMaster = SyMutexNew(pMutexMethods, SXMUTEX_TYPE_STATIC_1);
+		if(pMaster == 0) {
+			return PH7_CORRUPT; /* Can't happen */
+		}
+	}
+	/* Lock the master mutex */
+	rc = PH7_OK;
+	SyMutexEnter(pMutexMethods, pMaster); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nMagic != PH7_LIB_MAGIC) {
+		/* Point to the built-in vfs */
+		pVfs = PH7_ExportBuiltinVfs();
+		/* Install it */
+		ph7_lib_config(PH7_LIB_CONFIG_VFS, pVfs);
 		if(sMPGlobal.sAllocator.pMethods == 0) {
 			/* Install a memory subsystem */
 			rc = ph7_lib_config(PH7_LIB_CONFIG_USER_MALLOC, 0); /* zero mean use the built-in memory backend */
@@ -219,10 +310,22 @@ static sxi32 PH7CoreInitialize(void) {
 				goto End;
 			}
 		}
+		if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI) {
+			/* Protect the memory allocation subsystem */
+			rc = SyMemBackendMakeThreadSafe(&sMPGlobal.sAllocator, sMPGlobal.pMutexMethods);
+			if(rc != PH7_OK) {
+				goto End;
+			}
+		}
+		/* Select the string scanning kernels supported by the host CPU */
+		SyStrInitSimd();
 		/* Our library is initialized,set the magic number */
 		sMPGlobal.nMagic = PH7_LIB_MAGIC;
 		rc = PH7_OK;
+	}
 End:
+	/* Unlock the master mutex */
+	SyMutexLeave(pMutexMethods, pMaster); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -247,9 +350,14 @@ static sxi32 EngineRelease(ph7 *pEngine) {
 		}
 		pNext = pVm->pNext;
 		PH7_VmRelease(pVm);
+		SyMutexRelease(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 		pVm = pNext;
 		pEngine->iVm--;
 	}
+	if(pEngine->pBuiltin) {
+		/* Release the built-in library */
+		PH7_VmRelease(pEngine->pBuiltin);
+	}
 	/* Set a dummy magic number */
 	pEngine->nMagic = 0x7635;
 	/* Release the private memory subsystem */
@@ -273,6 +381,7 @@ static void PH7CoreShutdown(void) {
 		}
 		pNext = pEngine->pNext;
 		EngineRelease(pEngine);
+		SyMutexRelease(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 		pEngine = pNext;
 		sMPGlobal.nEngine--;
 	}
@@ -280,6 +389,13 @@ static void PH7CoreShutdown(void) {
 		/* Release the memory backend */
 		SyMemBackendRelease(&sMPGlobal.sAllocator);
 	}
+	if(sMPGlobal.pMutexMethods) {
+		/* Release the mutex subsystem */
+		SyMutexRelease(sMPGlobal.pMutexMethods, sMPGlobal.pMutex);
+		SyMutexGlobalRelease(sMPGlobal.pMutexMethods);
+		sMPGlobal.pMutexMethods = 0;
+		sMPGlobal.pMutex = 0;
+	}
 	sMPGlobal.nMagic = 0x1928;
 }
 /*
@@ -302,7 +418,8 @@ int ph7_lib_is_threadsafe(void) {
 	if(sMPGlobal.nMagic != PH7_LIB_MAGIC) {
 		return 0;
 	}
-	return 0;
+	/* Multi-threading support is enabled */
+	return sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI;
 }
 /*
  * [CAPIREF: ph7_lib_version()]
@@ -335,9 +452,17 @@ int ph7_config(ph7 *pEngine, int nConfigOp, ...) {
 	if(PH7_ENGINE_MISUSE(pEngine)) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire engine mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_ENGINE_RELEASE(pEngine)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
 	va_start(ap, nConfigOp);
 	rc = EngineConfig(&(*pEngine), nConfigOp, ap);
 	va_end(ap);
+	/* Leave engine mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -369,19 +494,35 @@ int ph7_init(ph7 **ppEngine) {
 	if(rc != PH7_OK) {
 		goto Release;
 	}
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI) {
+		/* Associate a recursive mutex with this instance */
+		pEngine->pMutex = SyMutexNew(sMPGlobal.pMutexMethods, SXMUTEX_TYPE_RECURSIVE);
+		if(pEngine->pMutex == 0) {
+			rc = PH7_NOMEM;
+			goto Release;
+		}
+	}
 	/* Default configuration */
 	SyBlobInit(&pEngine->xConf.sErrConsumer, &pEngine->sAllocator);
 	/* Install a default compile-time error consumer routine */
 	ph7_config(pEngine, PH7_CONFIG_ERR_OUTPUT, PH7_VmBlobConsumer, &pEngine->xConf.sErrConsumer);
 	/* Built-in vfs */
 	pEngine->pVfs = sMPGlobal.pVfs;
+	/* Compile the built-in library shared by all VMs of this engine */
+	rc = PH7_VmInitBuiltin(&(*pEngine));
+	if(rc != PH7_OK) {
+		goto Release;
+	}
 	/* Link to the list of active engines */
+	SyMutexEnter(sMPGlobal.pMutexMethods, sMPGlobal.pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	MACRO_LD_PUSH(sMPGlobal.pEngines, pEngine);
 	sMPGlobal.nEngine++;
+	SyMutexLeave(sMPGlobal.pMutexMethods, sMPGlobal.pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	/* Write a pointer to the new instance */
 	*ppEngine = pEngine;
 	return PH7_OK;
 Release:
+	SyMutexRelease(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	SyMemBackendRelease(&pEngine->sAllocator);
 	SyMemBackendPoolFree(&sMPGlobal.sAllocator, pEngine);
 	return rc;
@@ -395,11 +536,22 @@ int ph7_release(ph7 *pEngine) {
 	if(PH7_ENGINE_MISUSE(pEngine)) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire engine mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_ENGINE_RELEASE(pEngine)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
 	/* Release the engine */
 	rc = EngineRelease(&(*pEngine));
+	/* Leave and release engine mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	SyMutexRelease(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	/* Unlink from the list of active engines */
+	SyMutexEnter(sMPGlobal.pMutexMethods, sMPGlobal.pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	MACRO_LD_REMOVE(sMPGlobal.pEngines, pEngine);
 	sMPGlobal.nEngine--;
+	SyMutexLeave(sMPGlobal.pMutexMethods, sMPGlobal.pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	/* Release the memory chunk allocated to this engine */
 	SyMemBackendPoolFree(&sMPGlobal.sAllocator, pEngine);
 	return rc;
@@ -407,7 +559,8 @@ int ph7_release(ph7 *pEngine) {
 int ph7_vm_init(
 	ph7 *pEngine,      /* Running PH7 engine */
 	ph7_vm **ppOutVm,  /* OUT: A pointer to the virtual machine */
-	sxbool bDebug      /* VM Debugging */
+	sxbool bDebug,     /* VM Debugging */
+	int iOptLevel      /* Compile-time optimization level [i.e: PH7_OPT_FOLD] */
 ) {
 	ph7_vm *pVm;
 	int rc;
@@ -425,7 +578,7 @@ int ph7_vm_init(
 		return PH7_NOMEM;
 	}
 	/* Initialize the Virtual Machine */
-	rc = PH7_VmInit(pVm, &(*pEngine), bDebug);
+	rc = PH7_VmInit(pVm, &(*pEngine), bDebug, iOptLevel);
 	if(rc != PH7_OK) {
 		SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
 		if(ppOutVm) {
@@ -433,8 +586,22 @@ int ph7_vm_init(
 		}
 		return PH7_VM_ERR;
 	}
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI) {
+		/* Associate a recursive mutex with this instance */
+		pVm->pMutex = SyMutexNew(sMPGlobal.pMutexMethods, SXMUTEX_TYPE_RECURSIVE);
+		if(pVm->pMutex == 0) {
+			PH7_VmRelease(pVm);
+			SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
+			if(ppOutVm) {
+				*ppOutVm = 0;
+			}
+			return PH7_NOMEM;
+		}
+	}
 	/* Reset the error message consumer */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	SyBlobReset(&pEngine->xConf.sErrConsumer);
+	SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	/* Set the default VM output consumer callback and it's
 	 * private data. */
 	pVm->sVmConsumer.xConsumer = PH7_VmBlobConsumer;
@@ -461,7 +628,7 @@ static sxi32 ProcessSourceFile(
 ) {
 	ph7_vm *pVm = *ppVm;
 	int iFileDir, rc;
-	char *pFileDir, fFilePath[PATH_MAX + 1];
+	char *pFileDir = 0, fFilePath[PATH_MAX + 1];
 	char pFilePath[PATH_MAX + 1];
 	/* Install local import path which is the current directory */
 	ph7_vm_config(pVm, PH7_VM_CONFIG_IMPORT_PATH, "./");
@@ -480,10 +647,15 @@ static sxi32 ProcessSourceFile(
 	} else {
 		PH7_VmPushFilePath(pVm, "[MEMORY]", -1, TRUE, 0);
 	}
-	/* Compile the script */
-	PH7_CompileAerScript(pVm, &(*pScript), PH7_AERSCRIPT_CODE);
+	/* Compile the script, or load its precompiled form if it comes from a file */
+	if(pFileDir && pEngine->xConf.iCache) {
+		PH7_CompileCachedScript(pVm, &(*pScript), PH7_AERSCRIPT_CODE);
+	} else {
+		PH7_CompileAerScript(pVm, &(*pScript), PH7_AERSCRIPT_CODE);
+	}
 	if(pVm == 0) {
 		/* Null ppVm pointer,release this VM */
+		SyMutexRelease(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 		SyMemBackendRelease(&pVm->sAllocator);
 		SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
 		if(ppVm) {
@@ -497,11 +669,14 @@ static sxi32 ProcessSourceFile(
 		goto Release;
 	}
 	/* Script successfully compiled,link to the list of active virtual machines */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	MACRO_LD_PUSH(pEngine->pVms, pVm);
 	pEngine->iVm++;
+	SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	/* Ready to execute PH7 bytecode */
 	return PH7_OK;
 Release:
+	SyMutexRelease(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	SyMemBackendRelease(&pVm->sAllocator);
 	SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
 	*ppVm = 0;
@@ -581,8 +756,16 @@ int ph7_vm_dump(ph7_vm *pVm, int (*xConsumer)(const void *, unsigned int, void *
 	if(xConsumer == 0) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
 	/* Dump VM instructions */
 	rc = PH7_VmDump(&(*pVm), xConsumer, pUserData);
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -596,10 +779,18 @@ int ph7_vm_config(ph7_vm *pVm, int iConfigOp, ...) {
 	if(PH7_VM_MISUSE(pVm)) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
 	/* Configure the virtual machine */
 	va_start(ap, iConfigOp);
 	rc = PH7_VmConfigure(&(*pVm), iConfigOp, ap);
 	va_end(ap);
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -612,12 +803,20 @@ int ph7_vm_exec(ph7_vm *pVm, int *pExitStatus) {
 	if(PH7_VM_MISUSE(pVm)) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
 	/* Execute PH7 byte-code */
 	rc = PH7_VmByteCodeExec(&(*pVm));
 	if(pExitStatus) {
 		/* Exit status */
 		*pExitStatus = pVm->iExitStatus;
 	}
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	/* Execution result */
 	return rc;
 }
@@ -631,7 +830,18 @@ int ph7_vm_reset(ph7_vm *pVm) {
 	if(PH7_VM_MISUSE(pVm)) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
+	/* An execution context in arena mode is spawned again from its program */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	rc = PH7_VmReset(&(*pVm));
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -645,17 +855,101 @@ int ph7_vm_release(ph7_vm *pVm) {
 	if(PH7_VM_MISUSE(pVm)) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
 	pEngine = pVm->pEngine;
+	SyMutexEnter(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(pVm->nContext > 0) {
+		/* Release the execution contexts sharing this program first */
+		SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex);
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_LOOKED;
+	}
+	if(pVm->pProgram) {
+		pVm->pProgram->nContext--;
+	}
 	rc = PH7_VmRelease(&(*pVm));
 	if(rc == PH7_OK) {
 		/* Unlink from the list of active VM */
 		MACRO_LD_REMOVE(pEngine->pVms, pVm);
 		pEngine->iVm--;
-		/* Release the memory chunk allocated to this VM */
+	}
+	SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(rc == PH7_OK) {
+		/* Release the VM mutex and the memory chunk allocated to this VM */
+		SyMutexRelease(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 		SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
 	}
 	return rc;
 }
+/*
+ * [CAPIREF: ph7_vm_spawn()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ */
+int ph7_vm_spawn(ph7_vm *pProgram, ph7_vm **ppOutVm) {
+	ph7 *pEngine;
+	ph7_vm *pVm;
+	int rc;
+	if(ppOutVm) {
+		*ppOutVm = 0;
+	}
+	/* Ticket 1433-002: NULL VM is harmless operation */
+	if(pProgram == 0 || ppOutVm == 0) {
+		return PH7_CORRUPT;
+	}
+	pEngine = pProgram->pEngine;
+	/* Allocate a new execution context */
+	pVm = (ph7_vm *)SyMemBackendPoolAlloc(&pEngine->sAllocator, sizeof(ph7_vm));
+	if(pVm == 0) {
+		return PH7_NOMEM;
+	}
+	/* Share the compiled program, the first context freezes it */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pProgram->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(PH7_VM_MISUSE(pProgram)) {
+		rc = PH7_CORRUPT;
+	} else {
+		rc = PH7_VmSpawn(&(*pProgram), pVm);
+		if(rc != PH7_OK) {
+			rc = rc == SXERR_MEM ? PH7_NOMEM : PH7_VM_ERR;
+		}
+	}
+	if(rc != PH7_OK) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex);
+		SyMutexLeave(sMPGlobal.pMutexMethods, pProgram->pMutex);
+		SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
+		return rc;
+	}
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI) {
+		/* Associate a recursive mutex with this instance */
+		pVm->pMutex = SyMutexNew(sMPGlobal.pMutexMethods, SXMUTEX_TYPE_RECURSIVE);
+		if(pVm->pMutex == 0) {
+			pProgram->nContext--;
+			SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex);
+			SyMutexLeave(sMPGlobal.pMutexMethods, pProgram->pMutex);
+			PH7_VmRelease(pVm);
+			SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
+			return PH7_NOMEM;
+		}
+	}
+	/* Set the default VM output consumer callback and it's
+	 * private data. */
+	pVm->sVmConsumer.xConsumer = PH7_VmBlobConsumer;
+	pVm->sVmConsumer.pUserData = &pVm->sConsumer;
+	/* Link to the list of active virtual machines */
+	MACRO_LD_PUSH(pEngine->pVms, pVm);
+	pEngine->iVm++;
+	SyMutexLeave(sMPGlobal.pMutexMethods, pEngine->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pProgram->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	*ppOutVm = pVm;
+	return PH7_OK;
+}
 /*
  * [CAPIREF: ph7_create_function()]
  * Please refer to the official documentation for function purpose and expected parameters.
@@ -674,8 +968,16 @@ int ph7_create_function(ph7_vm *pVm, const char *zName, int (*xFunc)(ph7_context
 	if(sName.nByte < 1 || xFunc == 0) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
 	/* Install the foreign function */
 	rc = PH7_VmInstallForeignFunction(&(*pVm), &sName, xFunc, pUserData);
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -689,14 +991,33 @@ int ph7_delete_function(ph7_vm *pVm, const char *zName) {
 	if(PH7_VM_MISUSE(pVm)) {
 		return PH7_CORRUPT;
 	}
-	/* Perform the deletion */
-	rc = SyHashDeleteEntry(&pVm->hHostFunction, (const void *)zName, SyStrlen(zName), (void **)&pFunc);
-	if(rc == PH7_OK) {
-		/* Release internal fields */
-		SySetRelease(&pFunc->aAux);
-		SyMemBackendFree(&pVm->sAllocator, (void *)SyStringData(&pFunc->sName));
-		SyMemBackendPoolFree(&pVm->sAllocator, pFunc);
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
+	if(SyHashGet(&pVm->pEngine->pBuiltin->hHostFunction, (const void *)zName, SyStrlen(zName))) {
+		/* Built-in functions are hidden, not removed, so that they are not copied again on next use */
+		pFunc = PH7_VmExtractForeignFunction(&(*pVm), zName, SyStrlen(zName));
+		if(pFunc == 0) {
+			rc = SXERR_NOTFOUND;
+		} else {
+			pFunc->xFunc = 0;
+			rc = PH7_OK;
+		}
+	} else {
+		/* Perform the deletion */
+		rc = SyHashDeleteEntry(&pVm->hHostFunction, (const void *)zName, SyStrlen(zName), (void **)&pFunc);
+		if(rc == PH7_OK) {
+			/* Release internal fields */
+			SySetRelease(&pFunc->aAux);
+			SyMemBackendFree(&pVm->sAllocator, (void *)SyStringData(&pFunc->sName));
+			SyMemBackendPoolFree(&pVm->sAllocator, pFunc);
+		}
 	}
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -721,8 +1042,16 @@ int ph7_create_constant(ph7_vm *pVm, const char *zName, void (*xExpand)(ph7_valu
 	if(xExpand == 0) {
 		return PH7_CORRUPT;
 	}
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
 	/* Perform the registration */
 	rc = PH7_VmRegisterConstant(&(*pVm), &sName, xExpand, pUserData, TRUE);
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -736,13 +1065,32 @@ int ph7_delete_constant(ph7_vm *pVm, const char *zName) {
 	if(PH7_VM_MISUSE(pVm)) {
 		return PH7_CORRUPT;
 	}
-	/* Query the constant hashtable */
-	rc = SyHashDeleteEntry(&pVm->hConstant, (const void *)zName, SyStrlen(zName), (void **)&pCons);
-	if(rc == PH7_OK) {
-		/* Perform the deletion */
-		SyMemBackendFree(&pVm->sAllocator, (void *)SyStringData(&pCons->sName));
-		SyMemBackendPoolFree(&pVm->sAllocator, pCons);
+	/* Acquire VM mutex */
+	SyMutexEnter(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
+	if(sMPGlobal.nThreadingLevel == PH7_THREAD_LEVEL_MULTI && PH7_THRD_VM_RELEASE(pVm)) {
+		SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex);
+		return PH7_ABORT; /* Another thread have released this instance */
+	}
+	if(SyHashGet(&pVm->pEngine->pBuiltin->hConstant, (const void *)zName, SyStrlen(zName))) {
+		/* Built-in constants are hidden, not removed, so that they are not copied again on next use */
+		pCons = PH7_VmExtractConstant(&(*pVm), zName, SyStrlen(zName));
+		if(pCons == 0) {
+			rc = SXERR_NOTFOUND;
+		} else {
+			pCons->xExpand = 0;
+			rc = PH7_OK;
+		}
+	} else {
+		/* Query the constant hashtable */
+		rc = SyHashDeleteEntry(&pVm->hConstant, (const void *)zName, SyStrlen(zName), (void **)&pCons);
+		if(rc == PH7_OK) {
+			/* Perform the deletion */
+			SyMemBackendFree(&pVm->sAllocator, (void *)SyStringData(&pCons->sName));
+			SyMemBackendPoolFree(&pVm->sAllocator, pCons);
+		}
 	}
+	/* Leave VM mutex */
+	SyMutexLeave(sMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sMPGlobal.nThreadingLevel != PH7_THREAD_LEVEL_MULTI */
 	return rc;
 }
 /*
@@ -1128,7 +1476,7 @@ ph7_value *ph7_array_fetch(ph7_value *pArray, const char *zKey, int nByte) {
 		return 0;
 	}
 	/* Extract the target value */
-	pValue = (ph7_value *)SySetAt(&pArray->pVm->aMemObj, pNode->nValIdx);
+	pValue = VmObjTableAt(&pArray->pVm->aMemObj, pNode->nValIdx);
 	return pValue;
 }
 /*
@@ -1159,7 +1507,7 @@ int ph7_array_add_elem(ph7_value *pArray, ph7_value *pKey, ph7_value *pValue) {
 		return PH7_CORRUPT;
 	}
 	/* Perform the insertion */
-	rc = PH7_HashmapInsert((ph7_hashmap *)pArray->x.pOther, &(*pKey), &(*pValue));
+	rc = PH7_HashmapInsert(PH7_HashmapSeparate(pArray), &(*pKey), &(*pValue));
 	return rc;
 }
 /*
@@ -1175,12 +1523,12 @@ int ph7_array_add_strkey_elem(ph7_value *pArray, const char *zKey, ph7_value *pV
 	/* Perform the insertion */
 	if(SX_EMPTY_STR(zKey)) {
 		/* Empty key,assign an automatic index */
-		rc = PH7_HashmapInsert((ph7_hashmap *)pArray->x.pOther, 0, &(*pValue));
+		rc = PH7_HashmapInsert(PH7_HashmapSeparate(pArray), 0, &(*pValue));
 	} else {
 		ph7_value sKey;
 		PH7_MemObjInitFromString(pArray->pVm, &sKey, 0);
 		PH7_MemObjStringAppend(&sKey, zKey, (sxu32)SyStrlen(zKey));
-		rc = PH7_HashmapInsert((ph7_hashmap *)pArray->x.pOther, &sKey, &(*pValue));
+		rc = PH7_HashmapInsert(PH7_HashmapSeparate(pArray), &sKey, &(*pValue));
 		PH7_MemObjRelease(&sKey);
 	}
 	return rc;
@@ -1198,7 +1546,7 @@ int ph7_array_add_intkey_elem(ph7_value *pArray, int iKey, ph7_value *pValue) {
 	}
 	PH7_MemObjInitFromInt(pArray->pVm, &sKey, iKey);
 	/* Perform the insertion */
-	rc = PH7_HashmapInsert((ph7_hashmap *)pArray->x.pOther, &sKey, &(*pValue));
+	rc = PH7_HashmapInsert(PH7_HashmapSeparate(pArray), &sKey, &(*pValue));
 	PH7_MemObjRelease(&sKey);
 	return rc;
 }
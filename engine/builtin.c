@@ -1562,7 +1562,16 @@ static int PH7_builtin_strcasecmp(ph7_context *pCtx, int nArg, ph7_value **apArg
 	/* Perform the comparison */
 	z1 = ph7_value_to_string(apArg[0], &n1);
 	z2 = ph7_value_to_string(apArg[1], &n2);
-	res = SyStrnicmp(z1, z2, (sxu32)(SXMAX(n1, n2)));
+	if(n1 < 1 || n2 < 1) {
+		/* Empty string */
+		res = n1 < 1 ? (n2 < 1 ? 0 : -1) : 1;
+	} else {
+		res = SyStrnmicmp(z1, z2, (sxu32)(SXMIN(n1, n2)));
+	}
+	if(res == 0 && n1 != n2) {
+		/* The shorter string is a prefix of the longer one */
+		res = n1 > n2 ? SyCharToLower((unsigned char)z1[n2]) : -SyCharToLower((unsigned char)z2[n1]);
+	}
 	/* Comparison result */
 	ph7_result_int(pCtx, res);
 	return PH7_OK;
@@ -1580,7 +1589,7 @@ static int PH7_builtin_strcasecmp(ph7_context *pCtx, int nArg, ph7_value **apArg
  */
 static int PH7_builtin_strncasecmp(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	const char *z1, *z2;
-	int res;
+	int n1, n2, res;
 	int n;
 	if(nArg < 3) {
 		/* Perform a standard comparison */
@@ -1594,9 +1603,18 @@ static int PH7_builtin_strncasecmp(ph7_context *pCtx, int nArg, ph7_value **apAr
 		return PH7_OK;
 	}
 	/* Perform the comparison */
-	z1 = ph7_value_to_string(apArg[0], 0);
-	z2 = ph7_value_to_string(apArg[1], 0);
-	res = SyStrnicmp(z1, z2, (sxu32)n);
+	z1 = ph7_value_to_string(apArg[0], &n1);
+	z2 = ph7_value_to_string(apArg[1], &n2);
+	if(n1 < 1 || n2 < 1) {
+		/* Empty string */
+		res = n1 < 1 ? (n2 < 1 ? 0 : -1) : 1;
+	} else {
+		res = SyStrnmicmp(z1, z2, (sxu32)(SXMIN(n, SXMIN(n1, n2))));
+	}
+	if(res == 0 && n1 != n2 && SXMIN(n1, n2) < n) {
+		/* The shorter string is a prefix of the longer one */
+		res = n1 > n2 ? SyCharToLower((unsigned char)z1[n2]) : -SyCharToLower((unsigned char)z2[n1]);
+	}
 	/* Comparison result */
 	ph7_result_int(pCtx, res);
 	return PH7_OK;
@@ -2408,57 +2426,6 @@ static int PH7_builtin_bin2hex(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 }
 /* Search callback signature */
 typedef sxi32(*ProcStringMatch)(const void *, sxu32, const void *, sxu32, sxu32 *);
-/*
- * Case-insensitive pattern match.
- * Brute force is the default search method used here.
- * This is due to the fact that brute-forcing works quite
- * well for short/medium texts on modern hardware.
- */
-static sxi32 iPatternMatch(const void *pText, sxu32 nLen, const void *pPattern, sxu32 iPatLen, sxu32 *pOfft) {
-	const char *zpIn = (const char *)pPattern;
-	const char *zIn = (const char *)pText;
-	const char *zpEnd = &zpIn[iPatLen];
-	const char *zEnd = &zIn[nLen];
-	const char *zPtr, *zPtr2;
-	int c, d;
-	if(iPatLen > nLen) {
-		/* Don't bother processing */
-		return SXERR_NOTFOUND;
-	}
-	for(;;) {
-		if(zIn >= zEnd) {
-			break;
-		}
-		c = SyToLower(zIn[0]);
-		d = SyToLower(zpIn[0]);
-		if(c == d) {
-			zPtr   = &zIn[1];
-			zPtr2  = &zpIn[1];
-			for(;;) {
-				if(zPtr2 >= zpEnd) {
-					/* Pattern found */
-					if(pOfft) {
-						*pOfft = (sxu32)(zIn - (const char *)pText);
-					}
-					return SXRET_OK;
-				}
-				if(zPtr >= zEnd) {
-					break;
-				}
-				c = SyToLower(zPtr[0]);
-				d = SyToLower(zPtr2[0]);
-				if(c != d) {
-					break;
-				}
-				zPtr++;
-				zPtr2++;
-			}
-		}
-		zIn++;
-	}
-	/* Pattern not found */
-	return SXERR_NOTFOUND;
-}
 /*
  * string strstr(string $haystack,string $needle[,bool $before_needle = false ])
  *  Find the first occurrence of a string.
@@ -2526,7 +2493,7 @@ static int PH7_builtin_strstr(ph7_context *pCtx, int nArg, ph7_value **apArg) {
  *  Returns the portion of string, or FALSE if needle is not found.
  */
 static int PH7_builtin_stristr(ph7_context *pCtx, int nArg, ph7_value **apArg) {
-	ProcStringMatch xPatternMatch = iPatternMatch; /* Case-insensitive pattern match */
+	ProcStringMatch xPatternMatch = SyBlobSearchNoCase; /* Case-insensitive pattern match */
 	const char *zBlob, *zPattern;
 	int nLen, nPatLen;
 	sxu32 nOfft;
@@ -2639,7 +2606,7 @@ static int PH7_builtin_strpos(ph7_context *pCtx, int nArg, ph7_value **apArg) {
  *  Returns the position as an integer.If needle is not found, strpos() will return FALSE.
  */
 static int PH7_builtin_stripos(ph7_context *pCtx, int nArg, ph7_value **apArg) {
-	ProcStringMatch xPatternMatch = iPatternMatch; /* Case-insensitive pattern match */
+	ProcStringMatch xPatternMatch = SyBlobSearchNoCase; /* Case-insensitive pattern match */
 	const char *zBlob, *zPattern;
 	int nLen, nPatLen, nStart;
 	sxu32 nOfft;
@@ -2782,7 +2749,7 @@ static int PH7_builtin_strrpos(ph7_context *pCtx, int nArg, ph7_value **apArg) {
  */
 static int PH7_builtin_strripos(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	const char *zStart, *zBlob, *zPattern, *zPtr, *zEnd;
-	ProcStringMatch xPatternMatch = iPatternMatch; /* Case-insensitive pattern match */
+	ProcStringMatch xPatternMatch = SyBlobSearchNoCase; /* Case-insensitive pattern match */
 	int nLen, nPatLen;
 	sxu32 nOfft;
 	sxi32 rc;
@@ -5539,7 +5506,7 @@ static int PH7_builtin_str_replace(ph7_context *pCtx, int nArg, ph7_value **apAr
 	xMatch = SyBlobSearch;
 	if(SyStrncmp(zFunc, "str_ireplace", sizeof("str_ireplace") - 1) ==  0) {
 		/* Case insensitive pattern match */
-		xMatch = iPatternMatch;
+		xMatch = SyBlobSearchNoCase;
 	}
 	/* Start the replace process */
 	while(SXRET_OK == SySetGetNextEntry(&sSearch, (void **)&pSearch)) {
@@ -6031,15 +5998,17 @@ static int PH7_builtin_getdate(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		SYSTEMTIME_TO_SYTM(&sOS, &sTm);
 #else
 		struct tm *pTm;
+		struct tm sTmBuf;
 		time_t t;
 		time(&t);
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 #endif
 	} else {
 		/* Use the given timestamp */
 		time_t t;
 		struct tm *pTm;
+		struct tm sTmBuf;
 #ifdef __WINNT__
 #ifdef _MSC_VER
 #if _MSC_VER >= 1400 /* Visual Studio 2005 and up */
@@ -6049,14 +6018,14 @@ static int PH7_builtin_getdate(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 #endif
 		if(ph7_value_is_int(apArg[0])) {
 			t = (time_t)ph7_value_to_int64(apArg[0]);
-			pTm = localtime(&t);
+			pTm = SyLocalTime(&t, &sTmBuf);
 			if(pTm == 0) {
 				time(&t);
 			}
 		} else {
 			time(&t);
 		}
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 	}
 	/* Element value */
@@ -6692,25 +6661,27 @@ static int PH7_builtin_date(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		SYSTEMTIME_TO_SYTM(&sOS, &sTm);
 #else
 		struct tm *pTm;
+		struct tm sTmBuf;
 		time_t t;
 		time(&t);
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 #endif
 	} else {
 		/* Use the given timestamp */
 		time_t t;
 		struct tm *pTm;
+		struct tm sTmBuf;
 		if(ph7_value_is_int(apArg[1])) {
 			t = (time_t)ph7_value_to_int64(apArg[1]);
-			pTm = localtime(&t);
+			pTm = SyLocalTime(&t, &sTmBuf);
 			if(pTm == 0) {
 				time(&t);
 			}
 		} else {
 			time(&t);
 		}
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 	}
 	/* Format the given string */
@@ -6752,25 +6723,27 @@ static int PH7_builtin_strftime(ph7_context *pCtx, int nArg, ph7_value **apArg)
 		SYSTEMTIME_TO_SYTM(&sOS, &sTm);
 #else
 		struct tm *pTm;
+		struct tm sTmBuf;
 		time_t t;
 		time(&t);
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 #endif
 	} else {
 		/* Use the given timestamp */
 		time_t t;
 		struct tm *pTm;
+		struct tm sTmBuf;
 		if(ph7_value_is_int(apArg[1])) {
 			t = (time_t)ph7_value_to_int64(apArg[1]);
-			pTm = localtime(&t);
+			pTm = SyLocalTime(&t, &sTmBuf);
 			if(pTm == 0) {
 				time(&t);
 			}
 		} else {
 			time(&t);
 		}
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 	}
 	/* Format the given string */
@@ -6816,25 +6789,27 @@ static int PH7_builtin_gmdate(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		SYSTEMTIME_TO_SYTM(&sOS, &sTm);
 #else
 		struct tm *pTm;
+		struct tm sTmBuf;
 		time_t t;
 		time(&t);
-		pTm = gmtime(&t);
+		pTm = SyGmTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 #endif
 	} else {
 		/* Use the given timestamp */
 		time_t t;
 		struct tm *pTm;
+		struct tm sTmBuf;
 		if(ph7_value_is_int(apArg[1])) {
 			t = (time_t)ph7_value_to_int64(apArg[1]);
-			pTm = gmtime(&t);
+			pTm = SyGmTime(&t, &sTmBuf);
 			if(pTm == 0) {
 				time(&t);
 			}
 		} else {
 			time(&t);
 		}
-		pTm = gmtime(&t);
+		pTm = SyGmTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 	}
 	/* Format the given string */
@@ -6876,25 +6851,27 @@ static int PH7_builtin_localtime(ph7_context *pCtx, int nArg, ph7_value **apArg)
 		SYSTEMTIME_TO_SYTM(&sOS, &sTm);
 #else
 		struct tm *pTm;
+		struct tm sTmBuf;
 		time_t t;
 		time(&t);
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 #endif
 	} else {
 		/* Use the given timestamp */
 		time_t t;
 		struct tm *pTm;
+		struct tm sTmBuf;
 		if(ph7_value_is_int(apArg[0])) {
 			t = (time_t)ph7_value_to_int64(apArg[0]);
-			pTm = localtime(&t);
+			pTm = SyLocalTime(&t, &sTmBuf);
 			if(pTm == 0) {
 				time(&t);
 			}
 		} else {
 			time(&t);
 		}
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 	}
 	/* Element value */
@@ -7044,25 +7021,27 @@ static int PH7_builtin_idate(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		SYSTEMTIME_TO_SYTM(&sOS, &sTm);
 #else
 		struct tm *pTm;
+		struct tm sTmBuf;
 		time_t t;
 		time(&t);
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 #endif
 	} else {
 		/* Use the given timestamp */
 		time_t t;
 		struct tm *pTm;
+		struct tm sTmBuf;
 		if(ph7_value_is_int(apArg[1])) {
 			t = (time_t)ph7_value_to_int64(apArg[1]);
-			pTm = localtime(&t);
+			pTm = SyLocalTime(&t, &sTmBuf);
 			if(pTm == 0) {
 				time(&t);
 			}
 		} else {
 			time(&t);
 		}
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 		STRUCT_TM_TO_SYTM(pTm, &sTm);
 	}
 	/* Perform the requested operation */
@@ -7201,16 +7180,17 @@ static int PH7_builtin_mktime(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	const char *zFunction;
 	ph7_int64 iVal = 0;
 	struct tm *pTm;
+	struct tm sTmBuf;
 	time_t t;
 	/* Extract function name */
 	zFunction = ph7_function_name(pCtx);
 	/* Get the current time */
 	time(&t);
 	if(zFunction[0] == 'g' /* gmmktime */) {
-		pTm = gmtime(&t);
+		pTm = SyGmTime(&t, &sTmBuf);
 	} else {
 		/* localtime */
-		pTm = localtime(&t);
+		pTm = SyLocalTime(&t, &sTmBuf);
 	}
 	if(nArg > 0) {
 		int iVal;
@@ -0,0 +1,1112 @@
+/**
+ * @PROJECT     PH7 Engine for the AerScript Interpreter
+ * @COPYRIGHT   See COPYING in the top level directory
+ * @FILE        engine/cache.c
+ * @DESCRIPTION Bytecode cache for the PH7 Engine
+ * @DEVELOPERS  Symisc Systems <devel@symisc.net>
+ *              Rafal Kupiec <belliash@codingworkshop.eu.org>
+ */
+#include "ph7int.h"
+/*
+ * The compiled form of a script file is stored next to it, in a file
+ * with the same name followed by the 'c' letter [i.e: script.aer -> script.aerc].
+ * The image holds everything PH7_CompileAerScript() produces for a single file:
+ *  - the top-level instructions,
+ *  - the literals (constant memory objects) the instructions refer to,
+ *  - the anonymous functions registered in the global function table,
+ *  - the global constants introduced by the 'define' construct,
+ *  - the user defined classes and interfaces.
+ * Switch tables, exception blocks, closures and foreach contexts are stored
+ * inline with the instruction that uses them.
+ * Numbers are stored in host byte order, so an image is only valid on the
+ * machine that produced it. It is never trusted blindly: the format version,
+ * the engine signature, the compile mode, the source path and size, a SHA1
+ * digest of the source contents and a checksum of the body are validated
+ * before anything is installed in the target VM. Any mismatch results in a
+ * regular compilation which, if allowed, refreshes the image.
+ * The format version below must be incremented each time the layout of the
+ * image or the semantic of any instruction changes.
+ */
+#define PH7_CACHE_MAGIC    "AERC"
+#define PH7_CACHE_VERSION  2
+#define PH7_CACHE_ENDIAN   0x01020304
+#define PH7_CACHE_NULL     0xFFFFFFFF /* NULL string marker */
+#define PH7_CACHE_SUFFIX   "c"
+/* Compile-time flags which affect the generated bytecode */
+#define PH7_CACHE_FLAGS    (PH7_AERSCRIPT_CODE | PH7_AERSCRIPT_CHNK | PH7_AERSCRIPT_EXPR)
+/*
+ * An image is produced through an instance of the following structure.
+ */
+typedef struct ph7_cache_writer ph7_cache_writer;
+struct ph7_cache_writer {
+	ph7_vm *pVm;       /* VM holding the freshly compiled script */
+	SyBlob sOut;       /* Serialized image */
+	SySet aShared;     /* Shared P3 operands already stored (void *) */
+	sxu32 nLitBase;    /* First literal produced by the compiled script */
+	sxu32 nLitFixed;   /* Literals owned by the built-in library */
+	sxi32 rc;          /* SXRET_OK unless the script cannot be cached */
+};
+/*
+ * An image is loaded back through an instance of the following structure.
+ */
+typedef struct ph7_cache_reader ph7_cache_reader;
+struct ph7_cache_reader {
+	ph7_vm *pVm;                /* Target VM */
+	const unsigned char *zIn;   /* Current read position */
+	const unsigned char *zEnd;  /* End of the image */
+	SyString *pFile;            /* Processed file path */
+	SySet aShared;              /* Shared P3 operands already loaded (void *) */
+	SySet aRename;              /* Renamed anonymous functions (SyString pairs: old,new) */
+	SySet aSwitch;              /* Loaded switch statements (ph7_switch *) */
+	sxu32 nLitBase;             /* Literal base when the image was produced */
+	sxu32 nLitFirst;            /* Literal base in the target VM */
+	sxu32 nRename;              /* Number of anonymous functions renamed so far */
+	sxi32 rc;                   /* SXRET_OK unless the image is corrupt */
+};
+/*
+ * Image writer primitives.
+ */
+static void CacheWriteU32(ph7_cache_writer *pWriter, sxu32 nVal) {
+	SyBlobAppend(&pWriter->sOut, (const void *)&nVal, sizeof(sxu32));
+}
+static void CacheWriteRaw(ph7_cache_writer *pWriter, const void *pData, sxu32 nLen) {
+	SyBlobAppend(&pWriter->sOut, pData, nLen);
+}
+static void CacheWriteString(ph7_cache_writer *pWriter, const char *zStr, sxu32 nLen) {
+	if(zStr == 0) {
+		CacheWriteU32(&(*pWriter), PH7_CACHE_NULL);
+		return;
+	}
+	CacheWriteU32(&(*pWriter), nLen);
+	CacheWriteRaw(&(*pWriter), (const void *)zStr, nLen);
+}
+static void CacheWriteSyString(ph7_cache_writer *pWriter, const SyString *pStr) {
+	CacheWriteString(&(*pWriter), pStr->zString, pStr->nByte);
+}
+static void CacheWriteCString(ph7_cache_writer *pWriter, const char *zStr) {
+	CacheWriteString(&(*pWriter), zStr, zStr ? SyStrlen(zStr) : 0);
+}
+/*
+ * Image reader primitives.
+ * Any attempt to read past the end of the image marks it as corrupt.
+ */
+static void CacheReadRaw(ph7_cache_reader *pReader, void *pData, sxu32 nLen) {
+	if(pReader->rc != SXRET_OK || (sxu32)(pReader->zEnd - pReader->zIn) < nLen) {
+		pReader->rc = SXERR_CORRUPT;
+		SyZero(pData, nLen);
+		return;
+	}
+	SyMemcpy((const void *)pReader->zIn, pData, nLen);
+	pReader->zIn += nLen;
+}
+static sxu32 CacheReadU32(ph7_cache_reader *pReader) {
+	sxu32 nVal;
+	CacheReadRaw(&(*pReader), (void *)&nVal, sizeof(sxu32));
+	return nVal;
+}
+/*
+ * Read a string and duplicate it in the target VM memory.
+ * The copy is always null terminated so it can be used as a P3 operand.
+ */
+static void CacheReadString(ph7_cache_reader *pReader, SyString *pStr) {
+	sxu32 nLen;
+	char *zDup;
+	SyStringInitFromBuf(pStr, 0, 0);
+	nLen = CacheReadU32(&(*pReader));
+	if(nLen == PH7_CACHE_NULL || pReader->rc != SXRET_OK) {
+		return;
+	}
+	if((sxu32)(pReader->zEnd - pReader->zIn) < nLen) {
+		pReader->rc = SXERR_CORRUPT;
+		return;
+	}
+	zDup = SyMemBackendStrDup(&pReader->pVm->sAllocator, (const char *)pReader->zIn, nLen);
+	if(zDup == 0) {
+		pReader->rc = SXERR_MEM;
+		return;
+	}
+	pReader->zIn += nLen;
+	SyStringInitFromBuf(pStr, zDup, nLen);
+}
+static char *CacheReadCString(ph7_cache_reader *pReader) {
+	SyString sStr;
+	CacheReadString(&(*pReader), &sStr);
+	return (char *)sStr.zString;
+}
+/* Forward declarations */
+static void CacheWriteCode(ph7_cache_writer *pWriter, SySet *pByteCode);
+static void CacheReadCode(ph7_cache_reader *pReader, SySet *pByteCode);
+/*
+ * Store a function signature, body and auxiliary data.
+ */
+static void CacheWriteFunc(ph7_cache_writer *pWriter, ph7_vm_func *pFunc) {
+	ph7_vm_func_closure_env *aEnv;
+	ph7_vm_func_static_var *aStatic;
+	ph7_vm_func_arg *aArg;
+	char **azSlot;
+	sxu32 n;
+	CacheWriteSyString(&(*pWriter), &pFunc->sName);
+	CacheWriteU32(&(*pWriter), (sxu32)pFunc->iFlags);
+	CacheWriteU32(&(*pWriter), pFunc->nType);
+	CacheWriteSyString(&(*pWriter), &pFunc->sSignature);
+	/* Expected arguments */
+	aArg = (ph7_vm_func_arg *)SySetBasePtr(&pFunc->aArgs);
+	CacheWriteU32(&(*pWriter), SySetUsed(&pFunc->aArgs));
+	for(n = 0 ; n < SySetUsed(&pFunc->aArgs) ; ++n) {
+		CacheWriteSyString(&(*pWriter), &aArg[n].sName);
+		CacheWriteU32(&(*pWriter), aArg[n].nType);
+		CacheWriteSyString(&(*pWriter), &aArg[n].sClass);
+		CacheWriteU32(&(*pWriter), (sxu32)aArg[n].iFlags);
+		CacheWriteCode(&(*pWriter), &aArg[n].aByteCode);
+	}
+	/* Static variables */
+	aStatic = (ph7_vm_func_static_var *)SySetBasePtr(&pFunc->aStatic);
+	CacheWriteU32(&(*pWriter), SySetUsed(&pFunc->aStatic));
+	for(n = 0 ; n < SySetUsed(&pFunc->aStatic) ; ++n) {
+		CacheWriteSyString(&(*pWriter), &aStatic[n].sName);
+		CacheWriteU32(&(*pWriter), (sxu32)aStatic[n].iFlags);
+		CacheWriteU32(&(*pWriter), aStatic[n].nIdx);
+		CacheWriteCode(&(*pWriter), &aStatic[n].aByteCode);
+	}
+	/* Closure environment */
+	aEnv = (ph7_vm_func_closure_env *)SySetBasePtr(&pFunc->aClosureEnv);
+	CacheWriteU32(&(*pWriter), SySetUsed(&pFunc->aClosureEnv));
+	for(n = 0 ; n < SySetUsed(&pFunc->aClosureEnv) ; ++n) {
+		CacheWriteSyString(&(*pWriter), &aEnv[n].sName);
+		CacheWriteU32(&(*pWriter), (sxu32)aEnv[n].iFlags);
+		CacheWriteU32(&(*pWriter), aEnv[n].nIdx);
+	}
+	/* Variables resolved to a frame slot */
+	azSlot = (char **)SySetBasePtr(&pFunc->aVarSlot);
+	CacheWriteU32(&(*pWriter), SySetUsed(&pFunc->aVarSlot));
+	for(n = 0 ; n < SySetUsed(&pFunc->aVarSlot) ; ++n) {
+		CacheWriteCString(&(*pWriter), azSlot[n]);
+	}
+	/* Function body */
+	CacheWriteCode(&(*pWriter), &pFunc->aByteCode);
+}
+/*
+ * Load a function stored by CacheWriteFunc().
+ * The function name and flags were already consumed by the caller, which
+ * is responsible of the function state initialization.
+ */
+static void CacheReadFuncBody(ph7_cache_reader *pReader, ph7_vm_func *pFunc) {
+	ph7_vm *pVm = pReader->pVm;
+	ph7_vm_func_closure_env sEnv;
+	ph7_vm_func_static_var sStatic;
+	ph7_vm_func_arg sArg;
+	sxu32 n, nCount;
+	char *zSlot;
+	pFunc->nType = CacheReadU32(&(*pReader));
+	CacheReadString(&(*pReader), &pFunc->sSignature);
+	/* Expected arguments */
+	nCount = CacheReadU32(&(*pReader));
+	for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+		SyZero(&sArg, sizeof(ph7_vm_func_arg));
+		SySetInit(&sArg.aByteCode, &pVm->sAllocator, sizeof(VmInstr));
+		CacheReadString(&(*pReader), &sArg.sName);
+		sArg.nType = CacheReadU32(&(*pReader));
+		CacheReadString(&(*pReader), &sArg.sClass);
+		sArg.iFlags = (sxi32)CacheReadU32(&(*pReader));
+		CacheReadCode(&(*pReader), &sArg.aByteCode);
+		SySetPut(&pFunc->aArgs, (const void *)&sArg);
+	}
+	/* Static variables */
+	nCount = CacheReadU32(&(*pReader));
+	for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+		SyZero(&sStatic, sizeof(ph7_vm_func_static_var));
+		SySetInit(&sStatic.aByteCode, &pVm->sAllocator, sizeof(VmInstr));
+		CacheReadString(&(*pReader), &sStatic.sName);
+		sStatic.iFlags = (sxi32)CacheReadU32(&(*pReader));
+		sStatic.nIdx = CacheReadU32(&(*pReader));
+		CacheReadCode(&(*pReader), &sStatic.aByteCode);
+		SySetPut(&pFunc->aStatic, (const void *)&sStatic);
+	}
+	/* Closure environment */
+	nCount = CacheReadU32(&(*pReader));
+	for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+		SyZero(&sEnv, sizeof(ph7_vm_func_closure_env));
+		CacheReadString(&(*pReader), &sEnv.sName);
+		sEnv.iFlags = (int)CacheReadU32(&(*pReader));
+		sEnv.nIdx = CacheReadU32(&(*pReader));
+		PH7_MemObjInit(pVm, &sEnv.sValue);
+		SySetPut(&pFunc->aClosureEnv, (const void *)&sEnv);
+	}
+	/* Variables resolved to a frame slot */
+	nCount = CacheReadU32(&(*pReader));
+	for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+		zSlot = CacheReadCString(&(*pReader));
+		SySetPut(&pFunc->aVarSlot, (const void *)&zSlot);
+	}
+	/* Function body */
+	CacheReadCode(&(*pReader), &pFunc->aByteCode);
+	PH7_VmPeephole(pVm, &pFunc->aByteCode);
+	pFunc->nStack = PH7_VmStackSize(&pFunc->aByteCode);
+}
+/*
+ * Load a standalone function [i.e: closure, anonymous function].
+ * Return the function state on success. NULL otherwise.
+ */
+static ph7_vm_func *CacheReadFunc(ph7_cache_reader *pReader) {
+	ph7_vm *pVm = pReader->pVm;
+	ph7_vm_func *pFunc;
+	SyString sName;
+	sxi32 iFlags;
+	CacheReadString(&(*pReader), &sName);
+	iFlags = (sxi32)CacheReadU32(&(*pReader));
+	if(pReader->rc != SXRET_OK || sName.zString == 0) {
+		pReader->rc = SXERR_CORRUPT;
+		return 0;
+	}
+	pFunc = (ph7_vm_func *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(ph7_vm_func));
+	if(pFunc == 0) {
+		pReader->rc = SXERR_MEM;
+		return 0;
+	}
+	PH7_VmInitFuncState(pVm, pFunc, sName.zString, sName.nByte, iFlags, 0);
+	CacheReadFuncBody(&(*pReader), pFunc);
+	return pFunc;
+}
+/*
+ * Store a shared P3 operand [i.e: foreach context, exception block].
+ * Return TRUE if the operand was already stored, in which case only
+ * a reference to it is written.
+ */
+static int CacheWriteSharedRef(ph7_cache_writer *pWriter, void *pObj) {
+	void **apObj = (void **)SySetBasePtr(&pWriter->aShared);
+	sxu32 n;
+	for(n = 0 ; n < SySetUsed(&pWriter->aShared) ; ++n) {
+		if(apObj[n] == pObj) {
+			CacheWriteU32(&(*pWriter), n + 1);
+			return TRUE;
+		}
+	}
+	SySetPut(&pWriter->aShared, (const void *)&pObj);
+	CacheWriteU32(&(*pWriter), 0);
+	return FALSE;
+}
+/*
+ * Load a reference to a shared P3 operand.
+ * Return the operand if it was already loaded. NULL if its definition follows.
+ */
+static void *CacheReadSharedRef(ph7_cache_reader *pReader) {
+	sxu32 nRef;
+	nRef = CacheReadU32(&(*pReader));
+	if(nRef == 0 || pReader->rc != SXRET_OK) {
+		return 0;
+	}
+	if(nRef > SySetUsed(&pReader->aShared)) {
+		pReader->rc = SXERR_CORRUPT;
+		return 0;
+	}
+	return ((void **)SySetBasePtr(&pReader->aShared))[nRef - 1];
+}
+/*
+ * Store the third operand of a single instruction.
+ */
+static void CacheWriteOperand(ph7_cache_writer *pWriter, VmInstr *pInstr) {
+	switch(pInstr->iOp) {
+		case PH7_OP_LOADV:
+		case PH7_OP_STORE:
+		case PH7_OP_MEMBER:
+		case PH7_OP_IMPORT:
+		case PH7_OP_INCLUDE:
+			/* Variable, attribute, module or file name */
+			CacheWriteCString(&(*pWriter), (const char *)pInstr->p3);
+			break;
+		case PH7_OP_DECLARE:
+			if(pInstr->iP1) {
+				/* Local constant declaration */
+				ph7_constant_info *pConstInfo = (ph7_constant_info *)pInstr->p3;
+				CacheWriteSyString(&(*pWriter), &pConstInfo->pName);
+				CacheWriteCode(&(*pWriter), pConstInfo->pConsCode);
+			} else {
+				/* Variable declaration */
+				CacheWriteCString(&(*pWriter), (const char *)pInstr->p3);
+			}
+			break;
+		case PH7_OP_LOAD_CLOSURE:
+			CacheWriteFunc(&(*pWriter), (ph7_vm_func *)pInstr->p3);
+			break;
+		case PH7_OP_CLASS_INIT:
+		case PH7_OP_INTERFACE_INIT: {
+				ph7_class_info *pClassInfo = (ph7_class_info *)pInstr->p3;
+				SyString *aName;
+				sxu32 n;
+				CacheWriteSyString(&(*pWriter), &pClassInfo->sName);
+				aName = (SyString *)SySetBasePtr(&pClassInfo->sExtends);
+				CacheWriteU32(&(*pWriter), SySetUsed(&pClassInfo->sExtends));
+				for(n = 0 ; n < SySetUsed(&pClassInfo->sExtends) ; ++n) {
+					CacheWriteSyString(&(*pWriter), &aName[n]);
+				}
+				aName = (SyString *)SySetBasePtr(&pClassInfo->sImplements);
+				CacheWriteU32(&(*pWriter), SySetUsed(&pClassInfo->sImplements));
+				for(n = 0 ; n < SySetUsed(&pClassInfo->sImplements) ; ++n) {
+					CacheWriteSyString(&(*pWriter), &aName[n]);
+				}
+				break;
+			}
+		case PH7_OP_FOREACH_INIT:
+		case PH7_OP_FOREACH_STEP: {
+				ph7_foreach_info *pInfo = (ph7_foreach_info *)pInstr->p3;
+				/* Both instructions share the same context */
+				if(!CacheWriteSharedRef(&(*pWriter), pInfo)) {
+					CacheWriteSyString(&(*pWriter), &pInfo->sKey);
+					CacheWriteSyString(&(*pWriter), &pInfo->sValue);
+				}
+				break;
+			}
+		case PH7_OP_LOAD_EXCEPTION:
+		case PH7_OP_POP_EXCEPTION: {
+				ph7_exception *pException = (ph7_exception *)pInstr->p3;
+				ph7_exception_block *aCatch;
+				sxu32 n;
+				/* Both instructions share the same exception */
+				if(!CacheWriteSharedRef(&(*pWriter), pException)) {
+					aCatch = (ph7_exception_block *)SySetBasePtr(&pException->sEntry);
+					CacheWriteU32(&(*pWriter), SySetUsed(&pException->sEntry));
+					for(n = 0 ; n < SySetUsed(&pException->sEntry) ; ++n) {
+						CacheWriteSyString(&(*pWriter), &aCatch[n].sClass);
+						CacheWriteSyString(&(*pWriter), &aCatch[n].sThis);
+						CacheWriteCode(&(*pWriter), &aCatch[n].sByteCode);
+					}
+					CacheWriteCode(&(*pWriter), &pException->sFinally);
+				}
+				break;
+			}
+		case PH7_OP_SWITCH: {
+				ph7_switch *pSwitch = (ph7_switch *)pInstr->p3;
+				ph7_case_expr *aCase;
+				sxu32 n;
+				aCase = (ph7_case_expr *)SySetBasePtr(&pSwitch->aCaseExpr);
+				CacheWriteU32(&(*pWriter), SySetUsed(&pSwitch->aCaseExpr));
+				for(n = 0 ; n < SySetUsed(&pSwitch->aCaseExpr) ; ++n) {
+					CacheWriteU32(&(*pWriter), aCase[n].nStart);
+					CacheWriteCode(&(*pWriter), &aCase[n].aByteCode);
+				}
+				CacheWriteU32(&(*pWriter), pSwitch->nOut);
+				CacheWriteU32(&(*pWriter), pSwitch->nDefault);
+				break;
+			}
+		default:
+			if(pInstr->p3) {
+				/* Unknown operand, give up */
+				pWriter->rc = SXERR_NOTIMPLEMENTED;
+			}
+			break;
+	}
+}
+/*
+ * Load the third operand of a single instruction.
+ */
+static void CacheReadOperand(ph7_cache_reader *pReader, VmInstr *pInstr) {
+	ph7_vm *pVm = pReader->pVm;
+	sxu32 n, nCount;
+	switch(pInstr->iOp) {
+		case PH7_OP_LOADV:
+		case PH7_OP_STORE:
+		case PH7_OP_MEMBER:
+		case PH7_OP_IMPORT:
+		case PH7_OP_INCLUDE:
+			pInstr->p3 = CacheReadCString(&(*pReader));
+			break;
+		case PH7_OP_DECLARE:
+			if(pInstr->iP1) {
+				ph7_constant_info *pConstInfo;
+				pConstInfo = (ph7_constant_info *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(ph7_constant_info));
+				pInstr->p3 = pConstInfo;
+				if(pConstInfo == 0) {
+					pReader->rc = SXERR_MEM;
+					break;
+				}
+				SyZero(pConstInfo, sizeof(ph7_constant_info));
+				CacheReadString(&(*pReader), &pConstInfo->pName);
+				pConstInfo->pConsCode = (SySet *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(SySet));
+				if(pConstInfo->pConsCode == 0) {
+					pReader->rc = SXERR_MEM;
+					break;
+				}
+				SySetInit(pConstInfo->pConsCode, &pVm->sAllocator, sizeof(VmInstr));
+				CacheReadCode(&(*pReader), pConstInfo->pConsCode);
+				SySetSetUserData(pConstInfo->pConsCode, pVm);
+			} else {
+				pInstr->p3 = CacheReadCString(&(*pReader));
+			}
+			break;
+		case PH7_OP_LOAD_CLOSURE:
+			pInstr->p3 = CacheReadFunc(&(*pReader));
+			break;
+		case PH7_OP_CLASS_INIT:
+		case PH7_OP_INTERFACE_INIT: {
+				ph7_class_info *pClassInfo;
+				SyString sName;
+				CacheReadString(&(*pReader), &sName);
+				if(pReader->rc != SXRET_OK) {
+					break;
+				}
+				pClassInfo = PH7_NewClassInfo(pVm, &sName);
+				pInstr->p3 = pClassInfo;
+				if(pClassInfo == 0) {
+					pReader->rc = SXERR_MEM;
+					break;
+				}
+				nCount = CacheReadU32(&(*pReader));
+				for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+					CacheReadString(&(*pReader), &sName);
+					SySetPut(&pClassInfo->sExtends, (const void *)&sName);
+				}
+				nCount = CacheReadU32(&(*pReader));
+				for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+					CacheReadString(&(*pReader), &sName);
+					SySetPut(&pClassInfo->sImplements, (const void *)&sName);
+				}
+				break;
+			}
+		case PH7_OP_FOREACH_INIT:
+		case PH7_OP_FOREACH_STEP: {
+				ph7_foreach_info *pInfo;
+				pInfo = (ph7_foreach_info *)CacheReadSharedRef(&(*pReader));
+				if(pInfo == 0 && pReader->rc == SXRET_OK) {
+					pInfo = (ph7_foreach_info *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(ph7_foreach_info));
+					if(pInfo == 0) {
+						pReader->rc = SXERR_MEM;
+						break;
+					}
+					SyZero(pInfo, sizeof(ph7_foreach_info));
+					SySetPut(&pReader->aShared, (const void *)&pInfo);
+					CacheReadString(&(*pReader), &pInfo->sKey);
+					CacheReadString(&(*pReader), &pInfo->sValue);
+				}
+				pInstr->p3 = pInfo;
+				break;
+			}
+		case PH7_OP_LOAD_EXCEPTION:
+		case PH7_OP_POP_EXCEPTION: {
+				ph7_exception_block sCatch;
+				ph7_exception *pException;
+				pException = (ph7_exception *)CacheReadSharedRef(&(*pReader));
+				if(pException == 0 && pReader->rc == SXRET_OK) {
+					pException = (ph7_exception *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(ph7_exception));
+					if(pException == 0) {
+						pReader->rc = SXERR_MEM;
+						break;
+					}
+					SyZero(pException, sizeof(ph7_exception));
+					SySetInit(&pException->sEntry, &pVm->sAllocator, sizeof(ph7_exception_block));
+					SySetInit(&pException->sFinally, &pVm->sAllocator, sizeof(VmInstr));
+					pException->pVm = pVm;
+					SySetPut(&pReader->aShared, (const void *)&pException);
+					nCount = CacheReadU32(&(*pReader));
+					for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+						SyZero(&sCatch, sizeof(ph7_exception_block));
+						SySetInit(&sCatch.sByteCode, &pVm->sAllocator, sizeof(VmInstr));
+						CacheReadString(&(*pReader), &sCatch.sClass);
+						CacheReadString(&(*pReader), &sCatch.sThis);
+						CacheReadCode(&(*pReader), &sCatch.sByteCode);
+						SySetPut(&pException->sEntry, (const void *)&sCatch);
+					}
+					CacheReadCode(&(*pReader), &pException->sFinally);
+				}
+				pInstr->p3 = pException;
+				break;
+			}
+		case PH7_OP_SWITCH: {
+				ph7_case_expr sCase;
+				ph7_switch *pSwitch;
+				pSwitch = (ph7_switch *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(ph7_switch));
+				pInstr->p3 = pSwitch;
+				if(pSwitch == 0) {
+					pReader->rc = SXERR_MEM;
+					break;
+				}
+				SyZero(pSwitch, sizeof(ph7_switch));
+				SySetInit(&pSwitch->aCaseExpr, &pVm->sAllocator, sizeof(ph7_case_expr));
+				nCount = CacheReadU32(&(*pReader));
+				for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+					SyZero(&sCase, sizeof(ph7_case_expr));
+					SySetInit(&sCase.aByteCode, &pVm->sAllocator, sizeof(VmInstr));
+					sCase.nStart = CacheReadU32(&(*pReader));
+					CacheReadCode(&(*pReader), &sCase.aByteCode);
+					SySetPut(&pSwitch->aCaseExpr, (const void *)&sCase);
+				}
+				pSwitch->nOut = CacheReadU32(&(*pReader));
+				pSwitch->nDefault = CacheReadU32(&(*pReader));
+				/* The jump table is rebuilt once all literals are loaded */
+				SySetPut(&pReader->aSwitch, (const void *)&pSwitch);
+				break;
+			}
+		default:
+			pInstr->p3 = 0;
+			break;
+	}
+}
+/*
+ * Store a bytecode container.
+ */
+static void CacheWriteCode(ph7_cache_writer *pWriter, SySet *pByteCode) {
+	VmInstr *aInstr;
+	sxu32 n;
+	aInstr = (VmInstr *)SySetBasePtr(pByteCode);
+	CacheWriteU32(&(*pWriter), SySetUsed(pByteCode));
+	for(n = 0 ; n < SySetUsed(pByteCode) ; ++n) {
+		VmInstr sInstr = aInstr[n];
+		VmInstr *pInstr = &sInstr;
+		/* Superinstructions are stored unfused, the loader runs the peephole optimizer again */
+		sInstr.iOp = (sxu8)PH7_VmUnfuseInstr(sInstr.iOp);
+		if(pInstr->iOp == PH7_OP_LOADC && pInstr->iP2 >= pWriter->nLitFixed && pInstr->iP2 < pWriter->nLitBase) {
+			/* Literal shared with a previously compiled script, cannot be relocated */
+			pWriter->rc = SXERR_NOTIMPLEMENTED;
+		}
+		CacheWriteU32(&(*pWriter), (sxu32)pInstr->iOp);
+		CacheWriteU32(&(*pWriter), (sxu32)pInstr->iP1);
+		CacheWriteU32(&(*pWriter), pInstr->iP2);
+		CacheWriteU32(&(*pWriter), pInstr->iLine);
+		CacheWriteOperand(&(*pWriter), pInstr);
+	}
+}
+/*
+ * Check whether the given opcode may appear in an image. Superinstructions
+ * are stored unfused [i.e: CacheWriteCode()] so they are rejected as well.
+ */
+static int CacheValidOpcode(sxu32 iOp) {
+	if(iOp < PH7_OP_DONE || iOp > PH7_OP_DECR_INT) {
+		return FALSE;
+	}
+	return iOp < PH7_OP_INCRV || iOp > PH7_OP_LOADV_IDX;
+}
+/*
+ * Load a bytecode container.
+ */
+static void CacheReadCode(ph7_cache_reader *pReader, SySet *pByteCode) {
+	VmInstr sInstr;
+	sxu32 n, nCount, iTag, iOp;
+	nCount = CacheReadU32(&(*pReader));
+	if(pReader->rc != SXRET_OK || (sxu32)(pReader->zEnd - pReader->zIn) / (4 * sizeof(sxu32)) < nCount) {
+		pReader->rc = SXERR_CORRUPT;
+		return;
+	}
+	SyMemBackendPushTag(&pReader->pVm->sAllocator, PH7_MEM_TAG_BYTECODE, iTag);
+	SySetAlloc(pByteCode, (sxi32)nCount);
+	SyMemBackendPopTag(&pReader->pVm->sAllocator, iTag);
+	for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+		iOp = CacheReadU32(&(*pReader));
+		if(!CacheValidOpcode(iOp)) {
+			/* Never dispatch an unknown instruction */
+			pReader->rc = SXERR_CORRUPT;
+			break;
+		}
+		sInstr.iOp = (sxu8)iOp;
+		sInstr.iP1 = (sxi32)CacheReadU32(&(*pReader));
+		sInstr.iP2 = CacheReadU32(&(*pReader));
+		sInstr.iLine = CacheReadU32(&(*pReader));
+		sInstr.pFile = pReader->pFile;
+		if(sInstr.iOp == PH7_OP_LOADC && sInstr.iP2 >= pReader->nLitBase) {
+			/* Relocate the literal index */
+			sInstr.iP2 = sInstr.iP2 - pReader->nLitBase + pReader->nLitFirst;
+		}
+		CacheReadOperand(&(*pReader), &sInstr);
+		if(SySetPut(pByteCode, (const void *)&sInstr) != SXRET_OK) {
+			pReader->rc = SXERR_MEM;
+		}
+	}
+}
+/*
+ * Collect the last nCount entries inserted in a hashtable.
+ * Entries are linked newest first, so the callback below stops
+ * after the requested number of entries.
+ */
+struct CacheEntries {
+	SySet *pSet;   /* Collected entries */
+	sxu32 nLimit;  /* Number of entries to collect */
+};
+static sxi32 CacheCollectStep(SyHashEntry *pEntry, void *pUserData) {
+	struct CacheEntries *pData = (struct CacheEntries *)pUserData;
+	if(SySetUsed(pData->pSet) >= pData->nLimit) {
+		return SXERR_ABORT;
+	}
+	SySetPut(pData->pSet, (const void *)&pEntry);
+	return SXRET_OK;
+}
+static void CacheCollectEntries(SyHash *pHash, sxu32 nLimit, SySet *pOut) {
+	struct CacheEntries sData;
+	sData.pSet = pOut;
+	sData.nLimit = nLimit;
+	SyHashForEach(pHash, CacheCollectStep, &sData);
+}
+/*
+ * Store a user defined class.
+ */
+static void CacheWriteClass(ph7_cache_writer *pWriter, ph7_class *pClass) {
+	ph7_vm *pVm = pWriter->pVm;
+	ph7_class_method *pMeth;
+	ph7_class_attr *pAttr;
+	SyHashEntry **apEntry;
+	SySet aEntry;
+	sxu32 n;
+	CacheWriteSyString(&(*pWriter), &pClass->sName);
+	CacheWriteU32(&(*pWriter), (sxu32)pClass->iFlags);
+	SySetInit(&aEntry, &pVm->sAllocator, sizeof(SyHashEntry *));
+	/* Attributes and constants, in declaration order */
+	CacheCollectEntries(&pClass->hAttr, SyHashTotalEntry(&pClass->hAttr), &aEntry);
+	apEntry = (SyHashEntry **)SySetBasePtr(&aEntry);
+	CacheWriteU32(&(*pWriter), SySetUsed(&aEntry));
+	for(n = SySetUsed(&aEntry) ; n > 0 ; --n) {
+		pAttr = (ph7_class_attr *)apEntry[n - 1]->pUserData;
+		CacheWriteSyString(&(*pWriter), &pAttr->sName);
+		CacheWriteU32(&(*pWriter), (sxu32)pAttr->iFlags);
+		CacheWriteU32(&(*pWriter), (sxu32)pAttr->iProtection);
+		CacheWriteU32(&(*pWriter), pAttr->nType);
+		CacheWriteU32(&(*pWriter), pAttr->nLine);
+		CacheWriteCode(&(*pWriter), &pAttr->aByteCode);
+	}
+	/* Methods, in declaration order so that overloaded methods share the same VM name */
+	SySetReset(&aEntry);
+	CacheCollectEntries(&pClass->hMethod, SyHashTotalEntry(&pClass->hMethod), &aEntry);
+	apEntry = (SyHashEntry **)SySetBasePtr(&aEntry);
+	CacheWriteU32(&(*pWriter), SySetUsed(&aEntry));
+	for(n = SySetUsed(&aEntry) ; n > 0 ; --n) {
+		pMeth = (ph7_class_method *)apEntry[n - 1]->pUserData;
+		CacheWriteU32(&(*pWriter), (sxu32)pMeth->iProtection);
+		CacheWriteU32(&(*pWriter), (sxu32)pMeth->iFlags);
+		CacheWriteU32(&(*pWriter), pMeth->nLine);
+		CacheWriteFunc(&(*pWriter), &pMeth->sFunc);
+	}
+	SySetRelease(&aEntry);
+}
+/*
+ * Load a user defined class and install it in the target VM.
+ */
+static void CacheReadClass(ph7_cache_reader *pReader) {
+	ph7_vm *pVm = pReader->pVm;
+	ph7_class_method *pMeth;
+	sxi32 iProtection, iFlags;
+	ph7_class_attr *pAttr;
+	ph7_class *pClass;
+	SyString sName;
+	sxu32 nLine, nType;
+	sxu32 n, nCount;
+	CacheReadString(&(*pReader), &sName);
+	if(pReader->rc != SXRET_OK) {
+		return;
+	}
+	pClass = PH7_NewRawClass(pVm, &sName);
+	if(pClass == 0) {
+		pReader->rc = SXERR_MEM;
+		return;
+	}
+	pClass->iFlags = (sxi32)CacheReadU32(&(*pReader));
+	/* Attributes and constants */
+	nCount = CacheReadU32(&(*pReader));
+	for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+		CacheReadString(&(*pReader), &sName);
+		iFlags = (sxi32)CacheReadU32(&(*pReader));
+		iProtection = (sxi32)CacheReadU32(&(*pReader));
+		nType = CacheReadU32(&(*pReader));
+		nLine = CacheReadU32(&(*pReader));
+		if(pReader->rc != SXRET_OK) {
+			break;
+		}
+		pAttr = PH7_NewClassAttr(pVm, pClass, &sName, nLine, iProtection, iFlags, nType);
+		if(pAttr == 0) {
+			pReader->rc = SXERR_MEM;
+			break;
+		}
+		CacheReadCode(&(*pReader), &pAttr->aByteCode);
+		PH7_ClassInstallAttr(pClass, pAttr);
+	}
+	/* Methods */
+	nCount = CacheReadU32(&(*pReader));
+	for(n = 0 ; n < nCount && pReader->rc == SXRET_OK ; ++n) {
+		sxi32 iFuncFlags;
+		iProtection = (sxi32)CacheReadU32(&(*pReader));
+		iFlags = (sxi32)CacheReadU32(&(*pReader));
+		nLine = CacheReadU32(&(*pReader));
+		CacheReadString(&(*pReader), &sName);
+		iFuncFlags = (sxi32)CacheReadU32(&(*pReader));
+		if(pReader->rc != SXRET_OK || sName.zString == 0) {
+			pReader->rc = SXERR_CORRUPT;
+			break;
+		}
+		pMeth = PH7_NewClassMethod(pVm, pClass, &sName, nLine, iProtection, iFlags, iFuncFlags);
+		if(pMeth == 0) {
+			pReader->rc = SXERR_MEM;
+			break;
+		}
+		CacheReadFuncBody(&(*pReader), &pMeth->sFunc);
+		PH7_ClassInstallMethod(pClass, pMeth);
+	}
+	if(pReader->rc == SXRET_OK) {
+		PH7_VmInstallClass(pVm, pClass);
+	}
+}
+/*
+ * Store a literal (constant memory object).
+ */
+static void CacheWriteLiteral(ph7_cache_writer *pWriter, ph7_value *pObj) {
+	if(pObj->nType & (MEMOBJ_HASHMAP | MEMOBJ_OBJ | MEMOBJ_RES)) {
+		/* Not a scalar value */
+		pWriter->rc = SXERR_NOTIMPLEMENTED;
+		return;
+	}
+	CacheWriteU32(&(*pWriter), pObj->nType);
+	CacheWriteU32(&(*pWriter), (sxu32)pObj->iFlags);
+	CacheWriteRaw(&(*pWriter), (const void *)&pObj->x, sizeof(pObj->x));
+	CacheWriteString(&(*pWriter), (const char *)SyBlobData(&pObj->sBlob), SyBlobLength(&pObj->sBlob));
+}
+/*
+ * Load a literal and append it to the target VM literal table.
+ */
+static void CacheReadLiteral(ph7_cache_reader *pReader) {
+	ph7_vm *pVm = pReader->pVm;
+	SyString *aRename;
+	ph7_value *pObj;
+	sxu32 nLen, n;
+	pObj = PH7_ReserveConstObj(pVm, 0);
+	if(pObj == 0) {
+		pReader->rc = SXERR_MEM;
+		return;
+	}
+	PH7_MemObjInit(pVm, pObj);
+	pObj->nType = CacheReadU32(&(*pReader));
+	pObj->iFlags = (sxi32)CacheReadU32(&(*pReader));
+	CacheReadRaw(&(*pReader), (void *)&pObj->x, sizeof(pObj->x));
+	nLen = CacheReadU32(&(*pReader));
+	if(pReader->rc != SXRET_OK || nLen == PH7_CACHE_NULL) {
+		return;
+	}
+	if((sxu32)(pReader->zEnd - pReader->zIn) < nLen) {
+		pReader->rc = SXERR_CORRUPT;
+		return;
+	}
+	if(pObj->nType & MEMOBJ_CALL) {
+		/* Refer to the renamed anonymous function if any */
+		aRename = (SyString *)SySetBasePtr(&pReader->aRename);
+		for(n = 0 ; n < SySetUsed(&pReader->aRename) ; n += 2) {
+			if(aRename[n].nByte == nLen && SyMemcmp(aRename[n].zString, pReader->zIn, nLen) == 0) {
+				SyBlobAppend(&pObj->sBlob, aRename[n + 1].zString, aRename[n + 1].nByte);
+				pReader->zIn += nLen;
+				return;
+			}
+		}
+	}
+	SyBlobAppend(&pObj->sBlob, (const void *)pReader->zIn, nLen);
+	pReader->zIn += nLen;
+	if(pObj->nType == MEMOBJ_STRING) {
+		/* String literals are interned [i.e: PH7_GenStateInstallLiteral()] */
+		PH7_VmInternBlob(pVm, &pObj->sBlob);
+	}
+}
+/*
+ * Load an anonymous function and install it in the global function table.
+ * Its generated name may be already taken in the target VM, in which case
+ * a new unique name is assigned to it.
+ */
+static void CacheReadGlobalFunc(ph7_cache_reader *pReader) {
+	ph7_vm *pVm = pReader->pVm;
+	ph7_vm_func *pFunc;
+	SyString sOld;
+	char zName[256];
+	char *zDup;
+	sxu32 nLen;
+	pFunc = CacheReadFunc(&(*pReader));
+	if(pFunc == 0) {
+		return;
+	}
+	if(SyHashGet(&pVm->hFunction, pFunc->sName.zString, pFunc->sName.nByte) != 0) {
+		SyStringDupPtr(&sOld, &pFunc->sName);
+		do {
+			nLen = SyBufferFormat(zName, sizeof(zName), "{closure_%u@%z}", ++pReader->nRename, &sOld);
+		} while(SyHashGet(&pVm->hFunction, zName, nLen) != 0);
+		zDup = SyMemBackendStrDup(&pVm->sAllocator, zName, nLen);
+		if(zDup == 0) {
+			pReader->rc = SXERR_MEM;
+			return;
+		}
+		SyStringInitFromBuf(&pFunc->sName, zDup, nLen);
+		/* Remember the new name so the literal referring to it can be patched */
+		SySetPut(&pReader->aRename, (const void *)&sOld);
+		SySetPut(&pReader->aRename, (const void *)&pFunc->sName);
+	}
+	PH7_VmInstallUserFunction(pVm, pFunc, 0);
+}
+/*
+ * Build the header of an image. The same header is rebuilt when an image
+ * is loaded back and both must match byte for byte.
+ */
+static void CacheWriteHeader(ph7_cache_writer *pWriter, SyString *pFile, SyString *pScript, sxi32 iFlags) {
+	unsigned char zDigest[20];
+	CacheWriteRaw(&(*pWriter), PH7_CACHE_MAGIC, sizeof(PH7_CACHE_MAGIC) - 1);
+	CacheWriteU32(&(*pWriter), PH7_CACHE_VERSION);
+	CacheWriteU32(&(*pWriter), PH7_CACHE_ENDIAN);
+	CacheWriteCString(&(*pWriter), PH7_SIG);
+	CacheWriteU32(&(*pWriter), (sxu32)(iFlags & PH7_CACHE_FLAGS));
+	CacheWriteU32(&(*pWriter), (sxu32)pWriter->pVm->iOptLevel);
+	CacheWriteU32(&(*pWriter), pWriter->nLitFixed);
+	CacheWriteSyString(&(*pWriter), pFile);
+	CacheWriteU32(&(*pWriter), pScript->nByte);
+	SySha1Compute(pScript->zString, pScript->nByte, zDigest);
+	CacheWriteRaw(&(*pWriter), zDigest, sizeof(zDigest));
+}
+/*
+ * Try to load the image associated with the processed file.
+ * Return SXRET_OK on success. Any other return value indicates that the
+ * image is missing or out of date, in which case the VM is left untouched.
+ */
+static sxi32 CacheLoad(ph7_vm *pVm, const char *zCache, SyString *pFile, SyString *pScript, sxi32 iFlags) {
+	const ph7_vfs *pVfs = pVm->pEngine->pVfs;
+	ph7_cache_writer sHeader;
+	ph7_cache_reader sReader;
+	void *pMap = 0;
+	ph7_int64 nSize = 0;
+	sxu32 nHeader, nCrc, n, nCount;
+	SySet *pByteCode;
+	SyString sName;
+	SySet *pConsCode;
+	sxi32 rc;
+	if(pVfs == 0 || pVfs->xMmap == 0 || pVfs->xMmap(zCache, &pMap, &nSize) != PH7_OK) {
+		/* No image available */
+		return SXERR_IO;
+	}
+	/* Rebuild the expected header */
+	SyZero(&sHeader, sizeof(ph7_cache_writer));
+	sHeader.pVm = pVm;
+	sHeader.nLitFixed = SySetUsed(&pVm->pEngine->pBuiltin->aLitObj);
+	SyBlobInit(&sHeader.sOut, &pVm->sAllocator);
+	CacheWriteHeader(&sHeader, pFile, pScript, iFlags);
+	nHeader = SyBlobLength(&sHeader.sOut);
+	rc = SXERR_CORRUPT;
+	/* Validate the header and the body checksum before touching the VM */
+	if(nSize < (ph7_int64)(nHeader + 2 * sizeof(sxu32)) || SyMemcmp(pMap, SyBlobData(&sHeader.sOut), nHeader) != 0) {
+		goto Release;
+	}
+	SyZero(&sReader, sizeof(ph7_cache_reader));
+	sReader.pVm = pVm;
+	sReader.zIn = &((const unsigned char *)pMap)[nHeader];
+	sReader.zEnd = &((const unsigned char *)pMap)[nSize];
+	nCrc = CacheReadU32(&sReader);
+	if(nCrc != SyCrc32(sReader.zIn, (sxu32)(sReader.zEnd - sReader.zIn))) {
+		goto Release;
+	}
+	sReader.pFile = (SyString *)SySetPeek(&pVm->aFiles);
+	sReader.nLitBase = CacheReadU32(&sReader);
+	sReader.nLitFirst = SySetUsed(&pVm->aLitObj);
+	SySetInit(&sReader.aShared, &pVm->sAllocator, sizeof(void *));
+	SySetInit(&sReader.aRename, &pVm->sAllocator, sizeof(SyString));
+	SySetInit(&sReader.aSwitch, &pVm->sAllocator, sizeof(ph7_switch *));
+	/* Anonymous functions */
+	nCount = CacheReadU32(&sReader);
+	for(n = 0 ; n < nCount && sReader.rc == SXRET_OK ; ++n) {
+		CacheReadGlobalFunc(&sReader);
+	}
+	/* Literals */
+	nCount = CacheReadU32(&sReader);
+	for(n = 0 ; n < nCount && sReader.rc == SXRET_OK ; ++n) {
+		CacheReadLiteral(&sReader);
+	}
+	/* Global constants */
+	nCount = CacheReadU32(&sReader);
+	for(n = 0 ; n < nCount && sReader.rc == SXRET_OK ; ++n) {
+		CacheReadString(&sReader, &sName);
+		pConsCode = (SySet *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(SySet));
+		if(pConsCode == 0) {
+			sReader.rc = SXERR_MEM;
+			break;
+		}
+		SySetInit(pConsCode, &pVm->sAllocator, sizeof(VmInstr));
+		CacheReadCode(&sReader, pConsCode);
+		SySetSetUserData(pConsCode, pVm);
+		if(sReader.rc == SXRET_OK) {
+			PH7_VmRegisterConstant(pVm, &sName, PH7_VmExpandConstantValue, pConsCode, TRUE);
+		}
+	}
+	/* User defined classes */
+	nCount = CacheReadU32(&sReader);
+	for(n = 0 ; n < nCount && sReader.rc == SXRET_OK ; ++n) {
+		CacheReadClass(&sReader);
+	}
+	/* Top-level instructions */
+	pByteCode = PH7_VmGetByteCodeContainer(pVm);
+	CacheReadCode(&sReader, pByteCode);
+	if(sReader.rc == SXRET_OK) {
+		/* Rebuild the switch jump tables */
+		ph7_switch **apSwitch = (ph7_switch **)SySetBasePtr(&sReader.aSwitch);
+		for(n = 0 ; n < SySetUsed(&sReader.aSwitch) ; ++n) {
+			PH7_VmSwitchTable(pVm, apSwitch[n]);
+		}
+	}
+	SySetRelease(&sReader.aShared);
+	SySetRelease(&sReader.aRename);
+	SySetRelease(&sReader.aSwitch);
+	rc = sReader.rc;
+Release:
+	SyBlobRelease(&sHeader.sOut);
+	if(pVfs->xUnmap) {
+		pVfs->xUnmap(pMap, nSize);
+	}
+	return rc;
+}
+/*
+ * Write an image to disk.
+ * The image is written to a temporary file first, then renamed so that
+ * concurrent readers never see a partially written image.
+ */
+static void CacheStore(ph7_vm *pVm, const char *zCache, SyBlob *pImage) {
+	const ph7_vfs *pVfs = pVm->pEngine->pVfs;
+	const ph7_io_stream *pStream;
+	void *pHandle = 0;
+	ph7_int64 nWr;
+	SyBlob sTemp;
+	pStream = PH7_ExportFileStream();
+	if(pStream == 0 || pStream->xWrite == 0 || pVfs == 0 || pVfs->xRename == 0) {
+		return;
+	}
+	SyBlobInit(&sTemp, &pVm->sAllocator);
+	SyBlobFormat(&sTemp, "%s.%u", zCache, pVfs->xProcessId ? pVfs->xProcessId() : 0);
+	SyBlobNullAppend(&sTemp);
+	if(pStream->xOpen((const char *)SyBlobData(&sTemp), PH7_IO_OPEN_WRONLY | PH7_IO_OPEN_CREATE | PH7_IO_OPEN_TRUNC | PH7_IO_OPEN_BINARY,
+					  0, &pHandle) == PH7_OK) {
+		nWr = pStream->xWrite(pHandle, SyBlobData(pImage), SyBlobLength(pImage));
+		pStream->xClose(pHandle);
+		if(nWr != (ph7_int64)SyBlobLength(pImage) || pVfs->xRename((const char *)SyBlobData(&sTemp), zCache) != PH7_OK) {
+			/* Do not leave garbage behind */
+			if(pVfs->xUnlink) {
+				pVfs->xUnlink((const char *)SyBlobData(&sTemp));
+			}
+		}
+	}
+	SyBlobRelease(&sTemp);
+}
+/*
+ * Compile a script file, or load its precompiled form.
+ * The processed file path must be on top of the VM file stack.
+ * Depending on the engine configuration (PH7_CONFIG_BYTECODE_CACHE), an
+ * up-to-date image is loaded instead of compiling the script, and the output
+ * of a fresh compilation is stored for later use. Scripts which emit any
+ * compile-time diagnostic are never stored, so that the diagnostic shows up
+ * again next time. Neither are scripts into which the optimizer inlined a
+ * constant defined by another script, as the image would not notice when
+ * that constant changes.
+ */
+PH7_PRIVATE sxi32 PH7_CompileCachedScript(ph7_vm *pVm, SyString *pScript, sxi32 iFlags) {
+	sxi32 iMode = pVm->pEngine->xConf.iCache;
+	ph7_gen_state *pGen = &pVm->sCodeGen;
+	sxu32 nFunc, nConst, nClass, nDiag, nForeign;
+	ph7_cache_writer sWriter;
+	SyHashEntry **apEntry;
+	SySet aEntry, *pByteCode;
+	SyString *pFile;
+	ph7_constant *pCons;
+	ph7_value *aLit;
+	SyBlob sPath;
+	sxu32 n, nCrc, iTag;
+	sxi32 rc;
+	pFile = (SyString *)SySetPeek(&pVm->aFiles);
+	pByteCode = PH7_VmGetByteCodeContainer(pVm);
+	if(iMode == 0 || pFile == 0 || pScript->nByte < 1 || SySetUsed(pByteCode) > 0) {
+		/* Nothing to cache */
+		return PH7_CompileAerScript(pVm, pScript, iFlags);
+	}
+	/* Image path */
+	SyBlobInit(&sPath, &pVm->sAllocator);
+	SyBlobFormat(&sPath, "%z%s", pFile, PH7_CACHE_SUFFIX);
+	SyBlobNullAppend(&sPath);
+	if(iMode & PH7_CACHE_READ) {
+		/* Loading an image replaces the compiler */
+		SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_COMPILER, iTag);
+		rc = CacheLoad(pVm, (const char *)SyBlobData(&sPath), pFile, pScript, iFlags);
+		SyMemBackendPopTag(&pVm->sAllocator, iTag);
+		if(rc == SXRET_OK) {
+			SyBlobRelease(&sPath);
+			return SXRET_OK;
+		}
+	}
+	if((iMode & PH7_CACHE_WRITE) == 0) {
+		SyBlobRelease(&sPath);
+		return PH7_CompileAerScript(pVm, pScript, iFlags);
+	}
+	/* Forget the string literals of previously compiled scripts so
+	 * the image does not refer to them.
+	 */
+	SyHashRelease(&pGen->hLiteral);
+	SyHashInit(&pGen->hLiteral, &pVm->sAllocator, 0, 0);
+	/* Same for the constants and classes that may be inlined */
+	SyHashRelease(&pGen->hLocal);
+	SyHashInit(&pGen->hLocal, &pVm->sAllocator, 0, 0);
+	/* Snapshot what the compiler is about to produce */
+	SyZero(&sWriter, sizeof(ph7_cache_writer));
+	sWriter.pVm = pVm;
+	sWriter.nLitFixed = SySetUsed(&pVm->pEngine->pBuiltin->aLitObj);
+	sWriter.nLitBase = SySetUsed(&pVm->aLitObj);
+	nFunc = SyHashTotalEntry(&pVm->hFunction);
+	nConst = SyHashTotalEntry(&pVm->hConstant);
+	nClass = SyHashTotalEntry(&pVm->hClass);
+	nDiag = pGen->nDiag;
+	nForeign = pGen->nForeign;
+	/* Compile the script */
+	rc = PH7_CompileAerScript(pVm, pScript, iFlags);
+	if(rc == SXERR_ABORT || pGen->nDiag != nDiag || pGen->nForeign != nForeign) {
+		SyBlobRelease(&sPath);
+		return rc;
+	}
+	/* Serialize the compiled script */
+	SyBlobInit(&sWriter.sOut, &pVm->sAllocator);
+	SySetInit(&sWriter.aShared, &pVm->sAllocator, sizeof(void *));
+	SySetInit(&aEntry, &pVm->sAllocator, sizeof(SyHashEntry *));
+	CacheWriteHeader(&sWriter, pFile, pScript, iFlags);
+	n = SyBlobLength(&sWriter.sOut);
+	CacheWriteU32(&sWriter, 0); /* Body checksum, filled below */
+	CacheWriteU32(&sWriter, sWriter.nLitBase);
+	/* Anonymous functions */
+	CacheCollectEntries(&pVm->hFunction, SyHashTotalEntry(&pVm->hFunction) - nFunc, &aEntry);
+	apEntry = (SyHashEntry **)SySetBasePtr(&aEntry);
+	CacheWriteU32(&sWriter, SySetUsed(&aEntry));
+	for(nFunc = SySetUsed(&aEntry) ; nFunc > 0 ; --nFunc) {
+		CacheWriteFunc(&sWriter, (ph7_vm_func *)apEntry[nFunc - 1]->pUserData);
+	}
+	/* Literals */
+	aLit = (ph7_value *)SySetBasePtr(&pVm->aLitObj);
+	CacheWriteU32(&sWriter, SySetUsed(&pVm->aLitObj) - sWriter.nLitBase);
+	for(nFunc = sWriter.nLitBase ; nFunc < SySetUsed(&pVm->aLitObj) ; ++nFunc) {
+		CacheWriteLiteral(&sWriter, &aLit[nFunc]);
+	}
+	/* Global constants. Built-in constants copied on lookup are skipped */
+	SySetReset(&aEntry);
+	CacheCollectEntries(&pVm->hConstant, SyHashTotalEntry(&pVm->hConstant) - nConst, &aEntry);
+	apEntry = (SyHashEntry **)SySetBasePtr(&aEntry);
+	nConst = 0;
+	for(nFunc = 0 ; nFunc < SySetUsed(&aEntry) ; ++nFunc) {
+		pCons = (ph7_constant *)apEntry[nFunc]->pUserData;
+		if(pCons->xExpand == PH7_VmExpandConstantValue) {
+			nConst++;
+		}
+	}
+	CacheWriteU32(&sWriter, nConst);
+	for(nFunc = SySetUsed(&aEntry) ; nFunc > 0 ; --nFunc) {
+		pCons = (ph7_constant *)apEntry[nFunc - 1]->pUserData;
+		if(pCons->xExpand == PH7_VmExpandConstantValue) {
+			CacheWriteSyString(&sWriter, &pCons->sName);
+			CacheWriteCode(&sWriter, (SySet *)pCons->pUserData);
+		}
+	}
+	/* User defined classes */
+	SySetReset(&aEntry);
+	CacheCollectEntries(&pVm->hClass, SyHashTotalEntry(&pVm->hClass) - nClass, &aEntry);
+	apEntry = (SyHashEntry **)SySetBasePtr(&aEntry);
+	CacheWriteU32(&sWriter, SySetUsed(&aEntry));
+	for(nClass = SySetUsed(&aEntry) ; nClass > 0 ; --nClass) {
+		CacheWriteClass(&sWriter, (ph7_class *)apEntry[nClass - 1]->pUserData);
+	}
+	/* Top-level instructions */
+	CacheWriteCode(&sWriter, pByteCode);
+	if(sWriter.rc == SXRET_OK) {
+		/* Fill the body checksum */
+		nCrc = SyCrc32(&((const unsigned char *)SyBlobData(&sWriter.sOut))[n + sizeof(sxu32)], SyBlobLength(&sWriter.sOut) - n - sizeof(sxu32));
+		SyMemcpy((const void *)&nCrc, &((unsigned char *)SyBlobData(&sWriter.sOut))[n], sizeof(sxu32));
+		CacheStore(pVm, (const char *)SyBlobData(&sPath), &sWriter.sOut);
+	}
+	SySetRelease(&aEntry);
+	SySetRelease(&sWriter.aShared);
+	SyBlobRelease(&sWriter.sOut);
+	SyBlobRelease(&sPath);
+	return rc;
+}
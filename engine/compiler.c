@@ -256,9 +256,12 @@ static sxi32 PH7_GenStateFindLiteral(ph7_gen_state *pGen, const SyString *pValue
 /*
  * Install a given constant index in the literal table.
  * In order to be installed, the ph7_value must be of type string.
+ * The string is interned so that the array keys and variable names
+ * built from it share its contents.
  */
 static sxi32 PH7_GenStateInstallLiteral(ph7_gen_state *pGen, ph7_value *pObj, sxu32 nIdx) {
 	if(SyBlobLength(&pObj->sBlob) > 0) {
+		PH7_VmInternBlob(pGen->pVm, &pObj->sBlob);
 		SyHashInsert(&pGen->hLiteral, SyBlobData(&pObj->sBlob), SyBlobLength(&pObj->sBlob), SX_INT_TO_PTR(nIdx));
 	}
 	return SXRET_OK;
@@ -278,6 +281,239 @@ static ph7_value *PH7_GenStateInstallNumLiteral(ph7_gen_state *pGen, sxu32 *pIdx
 	*pIdx = nIdx;
 	return pObj;
 }
+/*
+ * Remember that the given constant body or class was defined by the
+ * script being compiled.
+ */
+static void PH7_GenStateLocalDefinition(ph7_gen_state *pGen, void *pDef) {
+	SyHashInsert(&pGen->hLocal, (const void *)&pDef, sizeof(void *), pDef);
+}
+/*
+ * Check whether a value taken from the given constant body or class is
+ * about to be inlined into another script than the one that defined it.
+ * Such bytecode depends on that script and must not be cached.
+ */
+static void PH7_GenStateForeignDefinition(ph7_gen_state *pGen, void *pDef) {
+	if(SyHashGet(&pGen->hLocal, (const void *)&pDef, sizeof(void *)) == 0) {
+		pGen->nForeign++;
+	}
+}
+/*
+ * Return the index of a literal holding the given value. Booleans, NULL
+ * and strings already present in the literal table are shared, any other
+ * value is installed in a fresh slot.
+ */
+static sxi32 PH7_GenStateValueLiteral(ph7_gen_state *pGen, ph7_value *pValue, sxu32 *pIdx) {
+	ph7_value *pObj;
+	SyString sStr;
+	if(pValue->nType & MEMOBJ_NULL) {
+		*pIdx = 0;
+		return SXRET_OK;
+	} else if(pValue->nType & MEMOBJ_BOOL) {
+		*pIdx = pValue->x.iVal ? 1 : 2;
+		return SXRET_OK;
+	} else if(pValue->nType & MEMOBJ_STRING) {
+		SyStringInitFromBuf(&sStr, SyBlobData(&pValue->sBlob), SyBlobLength(&pValue->sBlob));
+		if(sStr.nByte > 0 && PH7_GenStateFindLiteral(&(*pGen), &sStr, pIdx) == SXRET_OK) {
+			return SXRET_OK;
+		}
+	}
+	pObj = PH7_GenStateInstallNumLiteral(&(*pGen), pIdx);
+	if(pObj == 0) {
+		return SXERR_MEM;
+	}
+	PH7_MemObjInit(pGen->pVm, pObj);
+	PH7_MemObjStore(pValue, pObj);
+	if(pObj->nType & MEMOBJ_STRING) {
+		PH7_GenStateInstallLiteral(&(*pGen), pObj, *pIdx);
+	}
+	return SXRET_OK;
+}
+/*
+ * Extract the literal loaded by the given instruction if it is a plain
+ * literal load. NULL otherwise.
+ */
+static ph7_value *PH7_GenStateInstrLiteral(ph7_gen_state *pGen, VmInstr *pInstr) {
+	if(pInstr->iOp != PH7_OP_LOADC || pInstr->iP1 != 0) {
+		return 0;
+	}
+	return (ph7_value *)SySetAt(&pGen->pVm->aLitObj, pInstr->iP2);
+}
+/*
+ * Extract the literal a constant body [i.e: 'define' statement or class
+ * constant] evaluates to, if the body does nothing but load that literal.
+ */
+static sxi32 PH7_GenStateConstantBody(ph7_gen_state *pGen, SySet *pByteCode, sxu32 *pIdx) {
+	VmInstr *aInstr = (VmInstr *)SySetBasePtr(pByteCode);
+	if(SySetUsed(pByteCode) != 2 || aInstr[1].iOp != PH7_OP_DONE || PH7_GenStateInstrLiteral(&(*pGen), &aInstr[0]) == 0) {
+		return SXERR_NOTFOUND;
+	}
+	*pIdx = aInstr[0].iP2;
+	return SXRET_OK;
+}
+/*
+ * Extract the literal a constant evaluates to, if that constant was
+ * created by the 'define' statement with a literal value and is not
+ * shadowed by a local 'const' statement.
+ */
+static sxi32 PH7_GenStateGlobalConstant(ph7_gen_state *pGen, ph7_value *pName, sxu32 *pIdx) {
+	SyHashEntry *pEntry;
+	ph7_constant *pCons;
+	if((pName->nType & MEMOBJ_STRING) == 0 || SyBlobLength(&pName->sBlob) < 1 ||
+			SyHashGet(&pGen->hConst, SyBlobData(&pName->sBlob), SyBlobLength(&pName->sBlob)) != 0) {
+		return SXERR_NOTFOUND;
+	}
+	pEntry = SyHashGet(&pGen->pVm->hConstant, SyBlobData(&pName->sBlob), SyBlobLength(&pName->sBlob));
+	if(pEntry == 0) {
+		return SXERR_NOTFOUND;
+	}
+	pCons = (ph7_constant *)pEntry->pUserData;
+	if(pCons->xExpand != PH7_VmExpandConstantValue ||
+			PH7_GenStateConstantBody(&(*pGen), (SySet *)pCons->pUserData, pIdx) != SXRET_OK) {
+		return SXERR_NOTFOUND;
+	}
+	PH7_GenStateForeignDefinition(&(*pGen), pCons->pUserData);
+	return SXRET_OK;
+}
+/*
+ * Replace the constant loaded by the instructions emitted from nStart
+ * by its literal value when the optimization level allows it.
+ * Only two forms are handled: a constant created by the 'define' statement
+ * [i.e: LIMIT] and a public class constant accessed through the name of a
+ * class that is already compiled [i.e: Config::MAX]. Both must evaluate to
+ * a literal.
+ */
+static void PH7_GenStateInlineConstant(ph7_gen_state *pGen, sxu32 nStart) {
+	SySet *pByteCode = PH7_VmGetByteCodeContainer(pGen->pVm);
+	ph7_value *pClassName, *pName;
+	ph7_class_attr *pAttr;
+	SyHashEntry *pEntry;
+	ph7_class *pClass;
+	VmInstr *aInstr;
+	sxu32 nIdx, nLine;
+	if(pGen->pVm->iOptLevel < PH7_OPT_CONSTANTS || nStart >= SySetUsed(pByteCode)) {
+		return;
+	}
+	aInstr = &((VmInstr *)SySetBasePtr(pByteCode))[nStart];
+	if(aInstr[0].iOp != PH7_OP_LOADC || aInstr[0].iP1 != 1) {
+		return;
+	}
+	pName = (ph7_value *)SySetAt(&pGen->pVm->aLitObj, aInstr[0].iP2);
+	if(pName == 0) {
+		return;
+	}
+	if(SySetUsed(pByteCode) - nStart == 1) {
+		/* LIMIT */
+		if(PH7_GenStateGlobalConstant(&(*pGen), pName, &nIdx) == SXRET_OK) {
+			aInstr[0].iP1 = 0;
+			aInstr[0].iP2 = nIdx;
+		}
+		return;
+	}
+	if(SySetUsed(pByteCode) - nStart != 3 || aInstr[1].iOp != PH7_OP_LOADC || aInstr[1].iP1 != 1 ||
+			aInstr[2].iOp != PH7_OP_MEMBER || aInstr[2].iP1 != 1 || aInstr[2].iP2 != 0 || aInstr[2].p3 != 0) {
+		return;
+	}
+	/* Config::MAX */
+	pClassName = pName;
+	pName = (ph7_value *)SySetAt(&pGen->pVm->aLitObj, aInstr[1].iP2);
+	if(pName == 0 || (pClassName->nType & MEMOBJ_STRING) == 0 || SyBlobLength(&pClassName->sBlob) < 1 ||
+			(pName->nType & MEMOBJ_STRING) == 0 || SyBlobLength(&pName->sBlob) < 1) {
+		return;
+	}
+	if(SyHashGet(&pGen->pVm->hConstant, SyBlobData(&pClassName->sBlob), SyBlobLength(&pClassName->sBlob)) != 0 ||
+			SyHashGet(&pGen->hConst, SyBlobData(&pClassName->sBlob), SyBlobLength(&pClassName->sBlob)) != 0) {
+		/* The class name is itself expanded at run-time */
+		return;
+	}
+	pEntry = SyHashGet(&pGen->pVm->hClass, SyBlobData(&pClassName->sBlob), SyBlobLength(&pClassName->sBlob));
+	if(pEntry == 0) {
+		return;
+	}
+	pClass = (ph7_class *)pEntry->pUserData;
+	pAttr = PH7_ClassExtractAttribute(pClass, (const char *)SyBlobData(&pName->sBlob), SyBlobLength(&pName->sBlob));
+	if(pAttr == 0 || (pAttr->iFlags & PH7_CLASS_ATTR_CONSTANT) == 0 || pAttr->iProtection != PH7_CLASS_PROT_PUBLIC ||
+			pAttr->nType != 0 || PH7_GenStateConstantBody(&(*pGen), &pAttr->aByteCode, &nIdx) != SXRET_OK) {
+		return;
+	}
+	pName = (ph7_value *)SySetAt(&pGen->pVm->aLitObj, nIdx);
+	if(pName == 0 || (pName->nType & MEMOBJ_NULL)) {
+		/* NULL class constants are turned into void ones */
+		return;
+	}
+	PH7_GenStateForeignDefinition(&(*pGen), pClass);
+	nLine = aInstr[2].iLine;
+	SySetTruncate(pByteCode, nStart);
+	PH7_VmEmitInstr(pGen->pVm, nLine, PH7_OP_LOADC, 0, nIdx, 0, 0);
+}
+/*
+ * Fold the unary or binary operator compiled from nFirst when all of its
+ * operands are literals [i.e: 1 + 2 * 3, 'a' + 'b', (int)'7', 3 < 4] and
+ * replace the whole sequence by a single literal load.
+ * Nested operators are folded bottom-up as the tree is compiled.
+ */
+static void PH7_GenStateFoldExpr(ph7_gen_state *pGen, sxu32 nFirst) {
+	SySet *pByteCode = PH7_VmGetByteCodeContainer(pGen->pVm);
+	ph7_value sResult;
+	VmInstr *aInstr;
+	sxu32 nIdx, nLine;
+	sxu32 nInstr;
+	sxi32 rc;
+	if(pGen->pVm->iOptLevel < PH7_OPT_FOLD || nFirst >= SySetUsed(pByteCode)) {
+		return;
+	}
+	nInstr = SySetUsed(pByteCode) - nFirst;
+	if(nInstr < 2 || nInstr > 3) {
+		return;
+	}
+	aInstr = &((VmInstr *)SySetBasePtr(pByteCode))[nFirst];
+	nLine = aInstr[nInstr - 1].iLine;
+	PH7_MemObjInit(pGen->pVm, &sResult);
+	rc = PH7_VmFoldConstant(pGen->pVm, aInstr, nInstr, &sResult);
+	if(rc == SXRET_OK) {
+		rc = PH7_GenStateValueLiteral(&(*pGen), &sResult, &nIdx);
+	}
+	PH7_MemObjRelease(&sResult);
+	if(rc != SXRET_OK) {
+		return;
+	}
+	SySetTruncate(pByteCode, nFirst);
+	PH7_VmEmitInstr(pGen->pVm, nLine, PH7_OP_LOADC, 0, nIdx, 0, 0);
+}
+/*
+ * Discard the instructions compiled from nStart [i.e: unreachable branch].
+ * Return SXERR_BUSY if they cannot be dropped because a label or a goto
+ * was compiled there.
+ */
+static sxi32 PH7_GenStateDropCode(ph7_gen_state *pGen, sxu32 nStart, sxu32 nLabel, sxu32 nGoto) {
+	GenBlock *pBlock;
+	JumpFixup *aFix;
+	SySet *apFix[2];
+	sxu32 i, j, n;
+	if(SySetUsed(&pGen->aLabel) != nLabel || SySetUsed(&pGen->aGoto) != nGoto) {
+		return SXERR_BUSY;
+	}
+	SySetTruncate(PH7_VmGetByteCodeContainer(pGen->pVm), nStart);
+	/* Forget the pending jumps emitted there [i.e: break, continue, throw] */
+	for(pBlock = pGen->pCurrent ; pBlock ; pBlock = pBlock->pParent) {
+		apFix[0] = &pBlock->aJumpFix;
+		apFix[1] = &pBlock->aPostContFix;
+		for(i = 0 ; i < SX_ARRAYSIZE(apFix) ; ++i) {
+			aFix = (JumpFixup *)SySetBasePtr(apFix[i]);
+			for(j = n = 0 ; n < SySetUsed(apFix[i]) ; ++n) {
+				if(aFix[n].nInstrIdx < nStart) {
+					aFix[j++] = aFix[n];
+				}
+			}
+			SySetTruncate(apFix[i], j);
+		}
+		if(pBlock->iFlags & GEN_BLOCK_FUNC) {
+			/* Outer blocks refer to another bytecode container */
+			break;
+		}
+	}
+	return SXRET_OK;
+}
 /*
  * Compile a numeric [i.e: integer or real] literal.
  * Notes on the integer type.
@@ -894,9 +1130,6 @@ PH7_PRIVATE sxi32 PH7_CompileArray(ph7_gen_state *pGen, sxi32 iCompileFlag) {
 PH7_PRIVATE sxi32 PH7_CompileClosure(ph7_gen_state *pGen, sxi32 iCompileFlag) {
 	ph7_vm_func *pAnonFunc = 0; /* Anonymous function body */
 	char zName[512];         /* Unique closure name */
-	static int iCnt = 1;     /* There is no worry about thread-safety here,because only
-							  * one thread is allowed to compile the script.
-						      */
 	ph7_value *pObj;
 	SyString sName;
 	sxu32 nIdx;
@@ -942,10 +1175,10 @@ PH7_PRIVATE sxi32 PH7_CompileClosure(ph7_gen_state *pGen, sxi32 iCompileFlag) {
 		PH7_GenCompileError(&(*pGen), E_ERROR, 1, "PH7 engine is running out-of-memory");
 	}
 	/* Generate a unique name */
-	nLen = SyBufferFormat(zName, sizeof(zName), "{closure_%d}", iCnt++);
+	nLen = SyBufferFormat(zName, sizeof(zName), "{closure_%u}", ++pGen->nClosure);
 	/* Make sure the generated name is unique */
 	while(SyHashGet(&pGen->pVm->hFunction, zName, nLen) != 0 && nLen < sizeof(zName) - 2) {
-		nLen = SyBufferFormat(zName, sizeof(zName), "{closure_%d}", iCnt++);
+		nLen = SyBufferFormat(zName, sizeof(zName), "{closure_%u}", ++pGen->nClosure);
 	}
 	SyStringInitFromBuf(&sName, zName, nLen);
 	PH7_MemObjInitFromString(pGen->pVm, pObj, &sName);
@@ -1024,9 +1257,213 @@ PH7_PRIVATE sxi32 PH7_CompileDefine(ph7_gen_state *pGen) {
 	if(rc != SXRET_OK) {
 		SySetRelease(pConsCode);
 		SyMemBackendPoolFree(&pGen->pVm->sAllocator, pConsCode);
+	} else {
+		PH7_GenStateLocalDefinition(&(*pGen), pConsCode);
 	}
 	return SXRET_OK;
 }
+/*
+ * Return the function whose frame slots are available to the code being
+ * compiled, or NULL if the code is not executed in a function frame
+ * [i.e: global scope, default argument values, static initializers, etc.].
+ */
+static ph7_vm_func *PH7_GenStateSlotFunc(ph7_gen_state *pGen) {
+	GenBlock *pBlock = pGen->pCurrent;
+	ph7_vm_func *pFunc;
+	while(pBlock && (pBlock->iFlags & GEN_BLOCK_FUNC) == 0) {
+		/* Point to the upper block */
+		pBlock = pBlock->pParent;
+	}
+	if(pBlock == 0) {
+		/* Global scope */
+		return 0;
+	}
+	pFunc = (ph7_vm_func *)pBlock->pUserData;
+	if(PH7_VmGetByteCodeContainer(pGen->pVm) != &pFunc->aByteCode) {
+		/* Not executed in the function frame */
+		return 0;
+	}
+	return pFunc;
+}
+/*
+ * Assign a slot of the enclosing function to the given variable name.
+ * Variable names are interned in pGen->hVar, so a simple pointer
+ * comparison is enough. Return the slot index plus one, or zero if the
+ * variable is not referenced from a function body [i.e: global scope,
+ * default argument values, static initializers, catch blocks, etc.].
+ */
+static sxi32 PH7_GenStateVarSlot(ph7_gen_state *pGen, char *zName) {
+	ph7_vm_func *pFunc;
+	char **azSlot;
+	sxu32 n;
+	pFunc = PH7_GenStateSlotFunc(&(*pGen));
+	if(pFunc == 0) {
+		return 0;
+	}
+	azSlot = (char **)SySetBasePtr(&pFunc->aVarSlot);
+	for(n = 0 ; n < SySetUsed(&pFunc->aVarSlot) ; ++n) {
+		if(azSlot[n] == zName) {
+			/* Slot already assigned */
+			return (sxi32)n + 1;
+		}
+	}
+	if(SySetPut(&pFunc->aVarSlot, (const void *)&zName) != SXRET_OK) {
+		return 0;
+	}
+	return (sxi32)SySetUsed(&pFunc->aVarSlot);
+}
+/*
+ * Intern the given variable name in pGen->hVar and return its unique copy.
+ */
+static char *PH7_GenStateInternVar(ph7_gen_state *pGen, SyString *pName, sxu32 nLine) {
+	SyHashEntry *pEntry;
+	char *zName;
+	pEntry = SyHashGet(&pGen->hVar, (const void *)pName->zString, pName->nByte);
+	if(pEntry) {
+		/* Name already available */
+		return (char *)pEntry->pUserData;
+	}
+	/* Duplicate name */
+	zName = SyMemBackendStrDup(&pGen->pVm->sAllocator, pName->zString, pName->nByte);
+	if(zName == 0) {
+		PH7_GenCompileError(pGen, E_ERROR, nLine, "PH7 engine is running out-of-memory");
+	}
+	/* Install in the hashtable */
+	SyHashInsert(&pGen->hVar, zName, pName->nByte, zName);
+	return zName;
+}
+/*
+ * Remember the type a variable of the enclosing function is declared with,
+ * so that the operators applied to it can be specialized
+ * [refer to PH7_GenStateSpecializeExpr()]. Only integers and floats are
+ * of interest here.
+ */
+static void PH7_GenStateDeclareSlot(ph7_gen_state *pGen, SyString *pName, sxu32 nType, sxu32 nLine) {
+	ph7_vm_func *pFunc;
+	sxu32 *pType;
+	sxu32 nNone = 0;
+	sxi32 iSlot;
+	pFunc = PH7_GenStateSlotFunc(&(*pGen));
+	if(pFunc == 0) {
+		return;
+	}
+	iSlot = PH7_GenStateVarSlot(&(*pGen), PH7_GenStateInternVar(&(*pGen), pName, nLine));
+	if(iSlot < 1) {
+		return;
+	}
+	while(SySetUsed(&pFunc->aSlotType) < (sxu32)iSlot) {
+		if(SySetPut(&pFunc->aSlotType, (const void *)&nNone) != SXRET_OK) {
+			return;
+		}
+	}
+	pType = (sxu32 *)SySetAt(&pFunc->aSlotType, (sxu32)iSlot - 1);
+	*pType = (nType == MEMOBJ_INT || nType == MEMOBJ_REAL) ? nType : 0;
+}
+/*
+ * Return the type [i.e: MEMOBJ_INT or MEMOBJ_REAL] of the value pushed by
+ * the given instruction when it is known at compile-time. Zero otherwise.
+ * Variable types are taken from their declaration, which is only a hint
+ * as compound assignments may change them [i.e: $i += 1.5].
+ */
+static sxu32 PH7_GenStateOperandType(ph7_gen_state *pGen, VmInstr *pInstr) {
+	ph7_vm_func *pFunc;
+	ph7_value *pObj;
+	sxu32 *pType;
+	switch(pInstr->iOp) {
+		case PH7_OP_LOADC:
+			pObj = PH7_GenStateInstrLiteral(&(*pGen), pInstr);
+			if(pObj && ((pObj->nType & MEMOBJ_ALL) == MEMOBJ_INT || (pObj->nType & MEMOBJ_ALL) == MEMOBJ_REAL)) {
+				return pObj->nType & MEMOBJ_ALL;
+			}
+			break;
+		case PH7_OP_LOADV:
+			pFunc = PH7_GenStateSlotFunc(&(*pGen));
+			if(pFunc && pInstr->iP1 > 0) {
+				pType = (sxu32 *)SySetAt(&pFunc->aSlotType, (sxu32)pInstr->iP1 - 1);
+				if(pType) {
+					return *pType;
+				}
+			}
+			break;
+		case PH7_OP_ADD_INT:
+		case PH7_OP_SUB_INT:
+		case PH7_OP_MUL_INT:
+			return MEMOBJ_INT;
+		case PH7_OP_ADD_REAL:
+		case PH7_OP_SUB_REAL:
+		case PH7_OP_MUL_REAL:
+		case PH7_OP_DIV_REAL:
+			return MEMOBJ_REAL;
+		default:
+			break;
+	}
+	return 0;
+}
+/*
+ * Replace the arithmetic or comparison operator just compiled by its
+ * integer or float variant when both of its operands are known to be of
+ * that type [i.e: $i < $n, $x * 2.5] and replace the increment or decrement
+ * of an integer variable by its integer variant. nRight is the first
+ * instruction compiled for the right operand.
+ * The specialized instructions skip the type juggling of the generic ones
+ * and fall back to them when an operand turns out to be of another type.
+ */
+static void PH7_GenStateSpecializeExpr(ph7_gen_state *pGen, sxu32 nFirst, sxu32 nRight) {
+	SySet *pByteCode = PH7_VmGetByteCodeContainer(pGen->pVm);
+	VmInstr *aInstr, *pInstr;
+	sxu32 nInstr, nType;
+	sxi32 iCmp;
+	nInstr = SySetUsed(pByteCode);
+	if(pGen->pVm->iOptLevel < PH7_OPT_FOLD || nInstr < 2 || nFirst >= nInstr - 1) {
+		return;
+	}
+	aInstr = (VmInstr *)SySetBasePtr(pByteCode);
+	pInstr = &aInstr[nInstr - 1];
+	if(pInstr->iOp == PH7_OP_INCR || pInstr->iOp == PH7_OP_DECR) {
+		if(pInstr[-1].iOp == PH7_OP_LOADV && PH7_GenStateOperandType(&(*pGen), &pInstr[-1]) == MEMOBJ_INT) {
+			pInstr->iOp = pInstr->iOp == PH7_OP_INCR ? PH7_OP_INCR_INT : PH7_OP_DECR_INT;
+		}
+		return;
+	}
+	if(nRight <= nFirst || nRight >= nInstr - 1 || pInstr->iP2 != 0) {
+		return;
+	}
+	nType = PH7_GenStateOperandType(&(*pGen), &aInstr[nRight - 1]);
+	if(nType == 0 || nType != PH7_GenStateOperandType(&(*pGen), &pInstr[-1])) {
+		return;
+	}
+	switch(pInstr->iOp) {
+		case PH7_OP_ADD:
+			if(pInstr->iP1 == 0 || pInstr->iP1 == 2) {
+				pInstr->iOp = nType == MEMOBJ_INT ? PH7_OP_ADD_INT : PH7_OP_ADD_REAL;
+			}
+			break;
+		case PH7_OP_SUB:
+			pInstr->iOp = nType == MEMOBJ_INT ? PH7_OP_SUB_INT : PH7_OP_SUB_REAL;
+			break;
+		case PH7_OP_MUL:
+			pInstr->iOp = nType == MEMOBJ_INT ? PH7_OP_MUL_INT : PH7_OP_MUL_REAL;
+			break;
+		case PH7_OP_DIV:
+			/* Integer division yields a float */
+			if(nType == MEMOBJ_REAL) {
+				pInstr->iOp = PH7_OP_DIV_REAL;
+			}
+			break;
+		case PH7_OP_LT:
+		case PH7_OP_LE:
+		case PH7_OP_GT:
+		case PH7_OP_GE:
+		case PH7_OP_EQ:
+		case PH7_OP_NEQ:
+			/* The specialized comparisons are declared in the same order */
+			iCmp = pInstr->iOp - PH7_OP_LT;
+			pInstr->iOp = iCmp + (nType == MEMOBJ_INT ? PH7_OP_LT_INT : PH7_OP_LT_REAL);
+			break;
+		default:
+			break;
+	}
+}
 /*
  * Compile a node holding a variable declaration.
  *  Variables in Aer are represented by a dollar sign followed by the name of the variable.
@@ -1058,29 +1495,16 @@ PH7_PRIVATE sxi32 PH7_CompileVariable(ph7_gen_state *pGen, sxi32 iCompileFlag) {
 		PH7_GenCompileError(pGen, E_ERROR, nLine, "Invalid variable name");
 	}
 	p3  = 0;
-	SyHashEntry *pEntry;
 	SyString *pName;
 	char *zName = 0;
 	/* Extract variable name */
 	pName = &pGen->pIn->sData;
 	/* Advance the stream cursor */
 	pGen->pIn++;
-	pEntry = SyHashGet(&pGen->hVar, (const void *)pName->zString, pName->nByte);
-	if(pEntry == 0) {
-		/* Duplicate name */
-		zName = SyMemBackendStrDup(&pGen->pVm->sAllocator, pName->zString, pName->nByte);
-		if(zName == 0) {
-			PH7_GenCompileError(pGen, E_ERROR, nLine, "PH7 engine is running out-of-memory");
-		}
-		/* Install in the hashtable */
-		SyHashInsert(&pGen->hVar, zName, pName->nByte, zName);
-	} else {
-		/* Name already available */
-		zName = (char *)pEntry->pUserData;
-	}
+	zName = PH7_GenStateInternVar(&(*pGen), pName, nLine);
 	p3 = (void *)zName;
 	/* Emit the load instruction */
-	PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_LOADV, 0, 0, p3, 0);
+	PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_LOADV, PH7_GenStateVarSlot(&(*pGen), zName), 0, p3, 0);
 	/* Node successfully compiled */
 	return SXRET_OK;
 }
@@ -1353,6 +1777,10 @@ static sxi32 PH7_CompileConstant(ph7_gen_state *pGen) {
 	SySetSetUserData(pConstInfo->pConsCode, pGen->pVm);
 	/* Declare the constant in active frame */
 	PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_DECLARE, 1, 0, pConstInfo, 0);
+	if(SyHashGet(&pGen->hConst, (const void *)zName, pConstInfo->pName.nByte) == 0) {
+		/* Global constants of the same name are no longer inlined */
+		SyHashInsert(&pGen->hConst, (const void *)zName, pConstInfo->pName.nByte, 0);
+	}
 	return SXRET_OK;
 }
 /*
@@ -2181,6 +2609,30 @@ static sxi32 PH7_CompileForeach(ph7_gen_state *pGen) {
 	/* Statement successfully compiled */
 	return SXRET_OK;
 }
+/*
+ * Check whether the condition compiled from nStart is a literal.
+ * Return 1 if it is always true, 0 if always false and -1 if it has
+ * to be evaluated at run-time.
+ */
+static sxi32 PH7_GenStateConstCondition(ph7_gen_state *pGen, sxu32 nStart) {
+	ph7_value *pObj, sValue;
+	VmInstr *pInstr;
+	sxi32 iCond;
+	if(pGen->pVm->iOptLevel < PH7_OPT_FOLD || PH7_VmInstrLength(pGen->pVm) != nStart + 1) {
+		return -1;
+	}
+	pInstr = PH7_VmPeekInstr(pGen->pVm);
+	pObj = PH7_GenStateInstrLiteral(&(*pGen), pInstr);
+	if(pObj == 0) {
+		return -1;
+	}
+	PH7_MemObjInit(pGen->pVm, &sValue);
+	PH7_MemObjStore(pObj, &sValue);
+	PH7_MemObjToBool(&sValue);
+	iCond = sValue.x.iVal ? 1 : 0;
+	PH7_MemObjRelease(&sValue);
+	return iCond;
+}
 /*
  * Compile the if/else statements.
  *  The if construct is one of the most important features of many languages, Aer included.
@@ -2208,8 +2660,12 @@ static sxi32 PH7_CompileForeach(ph7_gen_state *pGen) {
 static sxi32 PH7_CompileIf(ph7_gen_state *pGen) {
 	SyToken *pToken, *pTmp, *pEnd = 0;
 	GenBlock *pCondBlock = 0;
+	sxu32 nBranch, nLabel, nGoto;
+	sxu32 nDead = 0, nDeadLabel = 0, nDeadGoto = 0;
+	sxi32 bTaken = FALSE;
 	sxu32 nJumpIdx;
 	sxu32 nKeyID;
+	sxi32 iCond;
 	sxi32 rc;
 	/* Jump the 'if' keyword */
 	pGen->pIn++;
@@ -2235,6 +2691,9 @@ static sxi32 PH7_CompileIf(ph7_gen_state *pGen) {
 		}
 		/* Swap token streams */
 		SWAP_TOKEN_STREAM(pGen, pToken, pEnd);
+		nBranch = PH7_VmInstrLength(pGen->pVm);
+		nLabel = SySetUsed(&pGen->aLabel);
+		nGoto = SySetUsed(&pGen->aGoto);
 		/* Compile the condition */
 		rc = PH7_CompileExpr(&(*pGen), 0, 0);
 		/* Update token stream */
@@ -2247,15 +2706,30 @@ static sxi32 PH7_CompileIf(ph7_gen_state *pGen) {
 			/* Expression handler request an operation abort [i.e: Out-of-memory] */
 			return SXERR_ABORT;
 		}
-		/* Emit the false jump */
-		PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_JMPZ, 0, 0, 0, &nJumpIdx);
-		/* Save the instruction index so we can fix it later when the jump destination is resolved */
-		PH7_GenStateNewJumpFixup(pCondBlock, PH7_OP_JMPZ, nJumpIdx);
+		iCond = bTaken ? -1 : PH7_GenStateConstCondition(&(*pGen), nBranch);
+		if(iCond > 0) {
+			/* Always taken, the remaining branches are unreachable */
+			(void)PH7_VmPopInstr(pGen->pVm);
+		} else {
+			/* Emit the false jump */
+			PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_JMPZ, 0, 0, 0, &nJumpIdx);
+			/* Save the instruction index so we can fix it later when the jump destination is resolved */
+			PH7_GenStateNewJumpFixup(pCondBlock, PH7_OP_JMPZ, nJumpIdx);
+		}
 		/* Compile the body */
 		rc = PH7_CompileBlock(&(*pGen));
 		if(rc == SXERR_ABORT) {
 			return SXERR_ABORT;
 		}
+		if(iCond > 0) {
+			bTaken = TRUE;
+			nDead = PH7_VmInstrLength(pGen->pVm);
+			nDeadLabel = SySetUsed(&pGen->aLabel);
+			nDeadGoto = SySetUsed(&pGen->aGoto);
+		} else if(iCond == 0 && PH7_GenStateDropCode(&(*pGen), nBranch, nLabel, nGoto) == SXRET_OK) {
+			/* Never taken */
+			iCond = -2;
+		}
 		if(pGen->pIn >= pGen->pEnd || (pGen->pIn->nType & PH7_TK_KEYWORD) == 0) {
 			break;
 		}
@@ -2264,10 +2738,12 @@ static sxi32 PH7_CompileIf(ph7_gen_state *pGen) {
 		if(nKeyID != PH7_KEYWORD_ELSE) {
 			break;
 		}
-		/* Emit the unconditional jump */
-		PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_JMP, 0, 0, 0, &nJumpIdx);
-		/* Save the instruction index so we can fix it later when the jump destination is resolved */
-		PH7_GenStateNewJumpFixup(pCondBlock, PH7_OP_JMP, nJumpIdx);
+		if(iCond != -2) {
+			/* Emit the unconditional jump */
+			PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_JMP, 0, 0, 0, &nJumpIdx);
+			/* Save the instruction index so we can fix it later when the jump destination is resolved */
+			PH7_GenStateNewJumpFixup(pCondBlock, PH7_OP_JMP, nJumpIdx);
+		}
 		if(nKeyID == PH7_KEYWORD_ELSE) {
 			pToken = &pGen->pIn[1];
 			if(pToken >= pGen->pEnd || (pToken->nType & PH7_TK_KEYWORD) == 0 ||
@@ -2293,6 +2769,10 @@ static sxi32 PH7_CompileIf(ph7_gen_state *pGen) {
 			return SXERR_ABORT;
 		}
 	}
+	if(bTaken) {
+		/* Drop the branches that follow the one always taken */
+		PH7_GenStateDropCode(&(*pGen), nDead, nDeadLabel, nDeadGoto);
+	}
 	nJumpIdx = PH7_VmInstrLength(pGen->pVm);
 	/* Fix all unconditional jumps now the destination is resolved */
 	PH7_GenStateFixJumps(pCondBlock, PH7_OP_JMP, nJumpIdx);
@@ -2482,6 +2962,7 @@ static sxi32 PH7_CompileVar(ph7_gen_state *pGen) {
 			void *p3 = (void *) zDup;
 			/* Emit OP_DECLARE instruction */
 			PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_DECLARE, 0, nType, p3, 0);
+			PH7_GenStateDeclareSlot(&(*pGen), pName, nType, pGen->pIn->nLine);
 			/* Pop the l-value */
 			PH7_VmEmitInstr(pGen->pVm, pGen->pIn->nLine, PH7_OP_POP, 1, 0, 0, 0);
 			/* Check if we have an expression to compile */
@@ -2989,8 +3470,10 @@ static sxi32 PH7_GenStateCompileFuncBody(
 	ph7_vm_func *pFunc    /* Function state */
 ) {
 	SySet *pInstrContainer; /* Instruction container */
+	ph7_vm_func_arg *aArg;
 	GenBlock *pBlock;
 	sxu32 nGotoOfft;
+	sxu32 n;
 	sxi32 rc;
 	/* Attach the new function */
 	rc = PH7_GenStateEnterBlock(&(*pGen), GEN_BLOCK_PROTECTED | GEN_BLOCK_FUNC, PH7_VmInstrLength(pGen->pVm), pFunc, &pBlock);
@@ -3001,6 +3484,13 @@ static sxi32 PH7_GenStateCompileFuncBody(
 	/* Swap bytecode containers */
 	pInstrContainer = PH7_VmGetByteCodeContainer(pGen->pVm);
 	PH7_VmSetByteCodeContainer(pGen->pVm, &pFunc->aByteCode);
+	/* Remember the numeric arguments types */
+	aArg = (ph7_vm_func_arg *)SySetBasePtr(&pFunc->aArgs);
+	for(n = 0 ; n < SySetUsed(&pFunc->aArgs) ; ++n) {
+		if(aArg[n].nType == MEMOBJ_INT || aArg[n].nType == MEMOBJ_REAL) {
+			PH7_GenStateDeclareSlot(&(*pGen), &aArg[n].sName, aArg[n].nType, pGen->pIn->nLine);
+		}
+	}
 	/* Compile the body */
 	PH7_CompileBlock(&(*pGen));
 	/* Fix exception jumps now the destination is resolved */
@@ -3012,6 +3502,10 @@ static sxi32 PH7_GenStateCompileFuncBody(
 		rc = SXERR_ABORT;
 	}
 	SySetTruncate(&pGen->aGoto,nGotoOfft);
+	/* Fuse the most common instruction sequences */
+	PH7_VmPeephole(pGen->pVm, &pFunc->aByteCode);
+	/* Record the operand stack size needed by the function body */
+	pFunc->nStack = PH7_VmStackSize(&pFunc->aByteCode);
 	/* Restore the default container */
 	PH7_VmSetByteCodeContainer(pGen->pVm, pInstrContainer);
 	/* Leave function block */
@@ -3689,6 +4183,7 @@ static sxi32 PH7_CompileClassInterface(ph7_gen_state *pGen) {
 	}
 	/* Install the interface */
 	rc = PH7_VmInstallClass(pGen->pVm, pClass);
+	PH7_GenStateLocalDefinition(&(*pGen), pClass);
 	if(iP1) {
 		/* Emit the INTERFACE_INIT instruction only if there is such a need */
 		PH7_VmEmitInstr(pGen->pVm, nLine, PH7_OP_INTERFACE_INIT, iP1, 0, pClassInfo, 0);
@@ -3985,6 +4480,7 @@ static sxi32 PH7_GenStateCompileClass(ph7_gen_state *pGen, sxi32 iFlags) {
 	}
 	/* Install the class */
 	rc = PH7_VmInstallClass(pGen->pVm, pClass);
+	PH7_GenStateLocalDefinition(&(*pGen), pClass);
 	if(iP1 || iP2) {
 		/* Emit the CLASS_INIT instruction only if there is such a need */
 		PH7_VmEmitInstr(pGen->pVm, nLine, PH7_OP_CLASS_INIT, iP1, iP2, pClassInfo, 0);
@@ -4558,6 +5054,8 @@ static sxi32 PH7_CompileSwitch(ph7_gen_state *pGen) {
 	/* Fix all jumps now the destination is resolved */
 	pSwitch->nOut = PH7_VmInstrLength(pGen->pVm);
 	PH7_GenStateFixJumps(pSwitchBlock, -1, PH7_VmInstrLength(pGen->pVm));
+	/* Precompute the jump table when all case labels are literals */
+	PH7_VmSwitchTable(pGen->pVm, pSwitch);
 	/* Release the loop block */
 	PH7_GenStateLeaveBlock(pGen, 0);
 	if(pGen->pIn < pGen->pEnd) {
@@ -4572,6 +5070,21 @@ static sxi32 PH7_CompileSwitch(ph7_gen_state *pGen) {
 	}
 	return SXRET_OK;
 }
+/*
+ * Flag every array load emitted since the instruction at nStart as a
+ * write access, so that a shared hashmap holding the target entry is
+ * copied before being modified [i.e: $a[0][1] = 5, $a[0][1]++].
+ */
+static void PH7_GenStateFlagIdxWrite(ph7_gen_state *pGen, sxu32 nStart) {
+	sxu32 nLen = PH7_VmInstrLength(pGen->pVm);
+	VmInstr *pInstr;
+	for(; nStart < nLen ; ++nStart) {
+		pInstr = PH7_VmGetInstr(pGen->pVm, nStart);
+		if(pInstr && pInstr->iOp == PH7_OP_LOAD_IDX) {
+			pInstr->iP2 |= 2;
+		}
+	}
+}
 /*
  * Generate bytecode for a given expression tree.
  * If something goes wrong while generating bytecode
@@ -4579,6 +5092,22 @@ static sxi32 PH7_CompileSwitch(ph7_gen_state *pGen) {
  * this function takes care of generating the appropriate
  * error message.
  */
+/*
+ * Check whether the operand of the given VM operator is used only for its
+ * value, so that a constant operand may be replaced by its literal value.
+ * The left operand of an assignment is the assigned value, the right one
+ * is its target.
+ */
+static int PH7_GenStateIsValueOperand(sxi32 iVmOp, int bLeft) {
+	if((iVmOp >= PH7_OP_UMINUS && iVmOp <= PH7_OP_NULLC) || (iVmOp >= PH7_OP_CVT_INT && iVmOp <= PH7_OP_CVT_REAL) ||
+			iVmOp == PH7_OP_CVT_BOOL || iVmOp == PH7_OP_CVT_CHAR) {
+		return TRUE;
+	}
+	if(bLeft && (iVmOp == PH7_OP_STORE || (iVmOp >= PH7_OP_ADD_STORE && iVmOp <= PH7_OP_BXOR_STORE))) {
+		return TRUE;
+	}
+	return FALSE;
+}
 static sxi32 PH7_GenStateEmitExprCode(
 	ph7_gen_state *pGen,  /* Code generator state */
 	ph7_expr_node *pNode, /* Root of the expression tree */
@@ -4589,6 +5118,7 @@ static sxi32 PH7_GenStateEmitExprCode(
 	sxi32 iP1 = 0;
 	sxu32 iP2 = 0;
 	void *p3  = 0;
+	sxu32 nStart, nFirst, nRight;
 	sxi32 iVmOp;
 	sxi32 rc;
 	if(pNode->xCode) {
@@ -4646,6 +5176,8 @@ static sxi32 PH7_GenStateEmitExprCode(
 		/* All done */
 		return SXRET_OK;
 	}
+	/* First instruction generated for this node */
+	nStart = nFirst = PH7_VmInstrLength(pGen->pVm);
 	/* Generate code for the left tree */
 	if(pNode->pLeft) {
 		if(iVmOp == PH7_OP_CALL) {
@@ -4656,10 +5188,17 @@ static sxi32 PH7_GenStateEmitExprCode(
 			/* Read-only load */
 			iFlags |= EXPR_FLAG_RDONLY_LOAD;
 			for(n = 0 ; n < (sxi32)SySetUsed(&pNode->aNodeArgs) ; ++n) {
+				sxu32 nArg = PH7_VmInstrLength(pGen->pVm);
 				rc = PH7_GenStateEmitExprCode(&(*pGen), apNode[n], iFlags & ~EXPR_FLAG_LOAD_IDX_STORE);
 				if(rc != SXRET_OK) {
 					return rc;
 				}
+				PH7_GenStateInlineConstant(&(*pGen), nArg);
+				pInstr = PH7_VmPeekInstr(pGen->pVm);
+				if(pInstr && pInstr->iOp == PH7_OP_LOAD_IDX) {
+					/* Array entry may be passed by reference */
+					PH7_GenStateFlagIdxWrite(&(*pGen), nArg);
+				}
 			}
 			/* Total number of given arguments */
 			iP1 = (sxi32)SySetUsed(&pNode->aNodeArgs);
@@ -4670,6 +5209,9 @@ static sxi32 PH7_GenStateEmitExprCode(
 		if(rc != SXRET_OK) {
 			return rc;
 		}
+		if(PH7_GenStateIsValueOperand(iVmOp, TRUE)) {
+			PH7_GenStateInlineConstant(&(*pGen), nStart);
+		}
 		if(iVmOp == PH7_OP_CALL) {
 			pInstr = PH7_VmPeekInstr(pGen->pVm);
 			if(pInstr) {
@@ -4687,10 +5229,12 @@ static sxi32 PH7_GenStateEmitExprCode(
 			/* Recurse and generate bytecodes for array index */
 			apNode = (ph7_expr_node **)SySetBasePtr(&pNode->aNodeArgs);
 			for(n = 0 ; n < (sxi32)SySetUsed(&pNode->aNodeArgs) ; ++n) {
+				sxu32 nArg = PH7_VmInstrLength(pGen->pVm);
 				rc = PH7_GenStateEmitExprCode(&(*pGen), apNode[n], iFlags & ~EXPR_FLAG_LOAD_IDX_STORE);
 				if(rc != SXRET_OK) {
 					return rc;
 				}
+				PH7_GenStateInlineConstant(&(*pGen), nArg);
 			}
 			if(SySetUsed(&pNode->aNodeArgs) > 0) {
 				iP1 = 1; /* Node have an index associated with it */
@@ -4705,7 +5249,7 @@ static sxi32 PH7_GenStateEmitExprCode(
 		}
 	}
 	rc = SXRET_OK;
-	nJmpIdx = 0;
+	nJmpIdx = nRight = 0;
 	/* Generate code for the right tree */
 	if(pNode->pRight) {
 		if(iVmOp == PH7_OP_LAND) {
@@ -4717,7 +5261,11 @@ static sxi32 PH7_GenStateEmitExprCode(
 		} else if(pNode->pOp->iPrec == 18 /* Combined binary operators [i.e: =,'.=','+=',*=' ...] precedence */) {
 			iFlags |= EXPR_FLAG_LOAD_IDX_STORE;
 		}
+		nStart = nRight = PH7_VmInstrLength(pGen->pVm);
 		rc = PH7_GenStateEmitExprCode(&(*pGen), pNode->pRight, iFlags);
+		if(PH7_GenStateIsValueOperand(iVmOp, FALSE)) {
+			PH7_GenStateInlineConstant(&(*pGen), nStart);
+		}
 		if(iVmOp == PH7_OP_STORE) {
 			pInstr = PH7_VmPeekInstr(pGen->pVm);
 			if(pInstr) {
@@ -4729,13 +5277,24 @@ static sxi32 PH7_GenStateEmitExprCode(
 						/* Transform the STORE instruction to STORE_IDX instruction */
 						iVmOp = PH7_OP_STORE_IDX;
 						iP1 = pInstr->iP1;
+						PH7_GenStateFlagIdxWrite(&(*pGen), nStart);
 					} else {
 						p3 = pInstr->p3;
+						if(pInstr->iOp == PH7_OP_LOADV) {
+							/* Variable slot, if any */
+							iP1 = pInstr->iP1;
+						}
 					}
 					/* POP the last dynamic load instruction */
 					(void)PH7_VmPopInstr(pGen->pVm);
 				}
 			}
+		} else if(pNode->pOp->iPrec == 20 /* Combined binary operators [i.e: '+=','*=' ...] */) {
+			pInstr = PH7_VmPeekInstr(pGen->pVm);
+			if(pInstr && pInstr->iOp == PH7_OP_LOAD_IDX) {
+				/* Array entry is modified in place [i.e: $a[0] += 3] */
+				PH7_GenStateFlagIdxWrite(&(*pGen), nStart);
+			}
 		}
 	}
 	if(iVmOp > 0) {
@@ -4744,6 +5303,11 @@ static sxi32 PH7_GenStateEmitExprCode(
 				/* Pre-increment/decrement operator [i.e: ++$i,--$j ] */
 				iP1 = 1;
 			}
+			pInstr = PH7_VmPeekInstr(pGen->pVm);
+			if(pInstr && pInstr->iOp == PH7_OP_LOAD_IDX) {
+				/* Array entry is modified in place [i.e: $a[0]++] */
+				PH7_GenStateFlagIdxWrite(&(*pGen), nStart);
+			}
 		} else if(iVmOp == PH7_OP_NEW) {
 			pInstr = PH7_VmPeekInstr(pGen->pVm);
 			if(pInstr && pInstr->iOp == PH7_OP_CALL) {
@@ -4812,6 +5376,11 @@ static sxi32 PH7_GenStateEmitExprCode(
 			if(pInstr) {
 				pInstr->iP2 = PH7_VmInstrLength(pGen->pVm);
 			}
+		} else {
+			/* Evaluate the operator now if its operands are literals */
+			PH7_GenStateFoldExpr(&(*pGen), nFirst);
+			/* Otherwise, specialize it for the type of its operands */
+			PH7_GenStateSpecializeExpr(&(*pGen), nFirst, nRight);
 		}
 	}
 	return rc;
@@ -4892,8 +5461,13 @@ static sxi32 PH7_CompileExpr(
 				rc = xTreeValidator(&(*pGen), pRoot);
 			}
 			if(rc != SXERR_ABORT) {
+				sxu32 nStart = PH7_VmInstrLength(pGen->pVm);
 				/* Generate code for the given tree */
 				rc = PH7_GenStateEmitExprCode(&(*pGen), pRoot, iFlags);
+				if(rc == SXRET_OK) {
+					/* The expression value is used as is */
+					PH7_GenStateInlineConstant(&(*pGen), nStart);
+				}
 			}
 			nExpr = 1;
 		}
@@ -5191,11 +5765,14 @@ PH7_PRIVATE sxi32 PH7_CompileAerScript(
 ) {
 	SySet aAerToken, aRawToken;
 	ph7_gen_state *pCodeGen;
+	sxu32 iTag;
 	sxi32 rc;
 	if(pScript->nByte < 1) {
 		/* Nothing to compile */
 		return PH7_OK;
 	}
+	/* Charge the compiler with anything not charged to a more specific subsystem */
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_COMPILER, iTag);
 	/* Initialize the tokens containers */
 	SySetInit(&aRawToken, &pVm->sAllocator, sizeof(SyToken));
 	SySetInit(&aAerToken, &pVm->sAllocator, sizeof(SyToken));
@@ -5229,6 +5806,7 @@ PH7_PRIVATE sxi32 PH7_CompileAerScript(
 	}
 	SySetRelease(&aRawToken);
 	SySetRelease(&aAerToken);
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	return rc;
 }
 /*
@@ -5250,6 +5828,8 @@ PH7_PRIVATE sxi32 PH7_InitCodeGenerator(
 	SySetInit(&pGen->aGoto, &pVm->sAllocator, sizeof(JumpFixup));
 	SyHashInit(&pGen->hLiteral, &pVm->sAllocator, 0, 0);
 	SyHashInit(&pGen->hVar, &pVm->sAllocator, 0, 0);
+	SyHashInit(&pGen->hConst, &pVm->sAllocator, 0, 0);
+	SyHashInit(&pGen->hLocal, &pVm->sAllocator, 0, 0);
 	/* Error log buffer */
 	SyBlobInit(&pGen->sErrBuf, &pVm->sAllocator);
 	/* General purpose working buffer */
@@ -5305,6 +5885,8 @@ PH7_PRIVATE sxi32 PH7_GenCompileError(ph7_gen_state *pGen, sxi32 nErrType, sxu32
 	SyBlobReset(pWorker);
 	/* Peek the processed file path if available */
 	pFile = (SyString *)SySetPeek(&pGen->pVm->aFiles);
+	/* Record that, so the bytecode cache knows this compilation was not silent */
+	pGen->nDiag++;
 	if(pGen->xErr == 0) {
 		/* No available error consumer, return immediately */
 		return SXRET_OK;
@@ -5336,6 +5918,8 @@ PH7_PRIVATE sxi32 PH7_GenCompileError(ph7_gen_state *pGen, sxi32 nErrType, sxu32
 	/* Append a new line */
 	SyBlobAppend(pWorker, (const void *)"\n", sizeof(char));
 	if(SyBlobLength(pWorker) > 0) {
+		/* Keep the output buffered by the running script ahead of the message */
+		PH7_VmOutputFlush(pGen->pVm);
 		/* Consume the generated error message */
 		pGen->xErr(SyBlobData(pWorker), SyBlobLength(pWorker), pGen->pErrData);
 	}
@@ -108,9 +108,10 @@ static void PH7_TIME_Const(ph7_value *pVal, void *pUnused) {
 	SYSTEMTIME_TO_SYTM(&sOS, &sTm);
 #else
 	struct tm *pTm;
+	struct tm sTmBuf;
 	time_t t;
 	time(&t);
-	pTm = gmtime(&t);
+	pTm = SyGmTime(&t, &sTmBuf);
 	STRUCT_TM_TO_SYTM(pTm, &sTm);
 #endif
 	SXUNUSED(pUnused); /* cc warning */
@@ -129,9 +130,10 @@ static void PH7_DATE_Const(ph7_value *pVal, void *pUnused) {
 	SYSTEMTIME_TO_SYTM(&sOS, &sTm);
 #else
 	struct tm *pTm;
+	struct tm sTmBuf;
 	time_t t;
 	time(&t);
-	pTm = gmtime(&t);
+	pTm = SyGmTime(&t, &sTmBuf);
 	STRUCT_TM_TO_SYTM(pTm, &sTm);
 #endif
 	SXUNUSED(pUnused); /* cc warning */
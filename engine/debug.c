@@ -12,6 +12,8 @@
  * This routine is used to dump the debug stacktrace based on all active frames.
  */
 PH7_PRIVATE sxi32 VmExtractDebugTrace(ph7_vm *pVm, SySet *pDebugTrace) {
+	VmExecState *pExec = pVm->pExec;
+	VmExecState *pCur;
 	sxi32 iDepth = 0;
 	sxi32 rc = SXRET_OK;
 	/* Initialize the container */
@@ -29,12 +31,17 @@ PH7_PRIVATE sxi32 VmExtractDebugTrace(ph7_vm *pVm, SySet *pDebugTrace) {
 				/* Extract closure/method name and passed arguments */
 				aTrace.pFuncName = &pFunc->sName;
 				aTrace.pArg = &pVm->pFrame->sArg;
-				for(sxi32 i = (SySetUsed(aByteCode) - 1); i >= 0 ; i--) {
-					VmInstr *cInstr = (VmInstr *)SySetAt(aByteCode, i);
-					if(cInstr->bExec == TRUE) {
+				aTrace.pFile = 0;
+				/* Frames and running programs are both stacked innermost first,
+				 * so the first program executing this function body belongs to
+				 * this frame.
+				 */
+				for(pCur = pExec ; pCur ; pCur = pCur->pPrev) {
+					if(pCur->aInstr == (VmInstr *)SySetBasePtr(aByteCode)) {
 						/* Extract file name & line */
-						aTrace.pFile = cInstr->pFile;
-						aTrace.nLine = cInstr->iLine;
+						aTrace.pFile = pCur->pInstr->pFile;
+						aTrace.nLine = pCur->pInstr->iLine;
+						pExec = pCur->pPrev;
 						break;
 					}
 				}
@@ -305,6 +312,87 @@ static const char *VmInstrToString(sxi32 nOp) {
 		case PH7_OP_FOREACH_STEP:
 			zOp = "4EACH_STEP";
 			break;
+		case PH7_OP_INCRV:
+			zOp = "INCRV";
+			break;
+		case PH7_OP_DECRV:
+			zOp = "DECRV";
+			break;
+		case PH7_OP_CMPV_JMPZ:
+			zOp = "CMPV_JMPZ";
+			break;
+		case PH7_OP_ADDV:
+			zOp = "ADDV";
+			break;
+		case PH7_OP_ADDV_STORE:
+			zOp = "ADDV_STORE";
+			break;
+		case PH7_OP_LOADV_IDX:
+			zOp = "LOADV_IDX";
+			break;
+		case PH7_OP_ADD_INT:
+			zOp = "ADD_INT";
+			break;
+		case PH7_OP_SUB_INT:
+			zOp = "SUB_INT";
+			break;
+		case PH7_OP_MUL_INT:
+			zOp = "MUL_INT";
+			break;
+		case PH7_OP_ADD_REAL:
+			zOp = "ADD_REAL";
+			break;
+		case PH7_OP_SUB_REAL:
+			zOp = "SUB_REAL";
+			break;
+		case PH7_OP_MUL_REAL:
+			zOp = "MUL_REAL";
+			break;
+		case PH7_OP_DIV_REAL:
+			zOp = "DIV_REAL";
+			break;
+		case PH7_OP_LT_INT:
+			zOp = "LT_INT";
+			break;
+		case PH7_OP_LE_INT:
+			zOp = "LE_INT";
+			break;
+		case PH7_OP_GT_INT:
+			zOp = "GT_INT";
+			break;
+		case PH7_OP_GE_INT:
+			zOp = "GE_INT";
+			break;
+		case PH7_OP_EQ_INT:
+			zOp = "EQ_INT";
+			break;
+		case PH7_OP_NEQ_INT:
+			zOp = "NEQ_INT";
+			break;
+		case PH7_OP_LT_REAL:
+			zOp = "LT_REAL";
+			break;
+		case PH7_OP_LE_REAL:
+			zOp = "LE_REAL";
+			break;
+		case PH7_OP_GT_REAL:
+			zOp = "GT_REAL";
+			break;
+		case PH7_OP_GE_REAL:
+			zOp = "GE_REAL";
+			break;
+		case PH7_OP_EQ_REAL:
+			zOp = "EQ_REAL";
+			break;
+		case PH7_OP_NEQ_REAL:
+			zOp = "NEQ_REAL";
+			break;
+		case PH7_OP_INCR_INT:
+			zOp = "INCR_INT";
+			break;
+		case PH7_OP_DECR_INT:
+			zOp = "DECR_INT";
+			break;
 		default:
 			break;
 	}
@@ -369,5 +457,9 @@ PH7_PRIVATE sxi32 PH7_VmDump(
 		return SXRET_OK;
 	}
 	rc = VmByteCodeDump(&pVm->aInstrSet, xConsumer, pUserData);
+	if(rc == SXRET_OK) {
+		/* Report the work of the peephole optimizer */
+		rc = SyProcFormat(xConsumer, pUserData, " Superinstructions: %u, threaded jumps: %u\n", pVm->nFusion, pVm->nThread);
+	}
 	return rc;
 }
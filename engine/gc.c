@@ -0,0 +1,451 @@
+/**
+ * @PROJECT     PH7 Engine for the AerScript Interpreter
+ * @COPYRIGHT   See COPYING in the top level directory
+ * @FILE        engine/gc.c
+ * @DESCRIPTION Cycle collector for the PH7 Engine
+ * @DEVELOPERS  Symisc Systems <devel@symisc.net>
+ *              Rafal Kupiec <belliash@codingworkshop.eu.org>
+ */
+#include "ph7int.h"
+/*
+ * Arrays and objects are released as soon as their reference count drops to zero,
+ * which never happens to a set of objects referring to each other [i.e: $a->next = $b;
+ * $b->next = $a;] once the script no longer references them. Such garbage cycles are
+ * found by trial deletion:
+ *  Each hashmap or class instance whose reference count is decremented to a nonzero
+ *  value is buffered as a possible root of a garbage cycle. Once enough roots are
+ *  buffered, the references held by the arrays and objects reachable from the roots
+ *  are subtracted from their reference counts (gray). Whatever is still referenced
+ *  from elsewhere is alive, along with anything it refers to (black), while the rest
+ *  is only referenced from within the cycles (white) and is released.
+ * A memory object shared with a variable or with another array entry [i.e: $x = &$a[0];]
+ * is not accounted to its container, so anything it refers to is left alive. Neither are
+ * the arrays being released or sorted and the objects being destroyed, whose entries may
+ * be in an inconsistent state while a destructor or a user callback is running.
+ * Destructors of the objects found in garbage cycles are invoked first and the cycles
+ * are looked for again, so that an object resurrected by a destructor is kept alive.
+ */
+#define GC_BLACK   0 /* Alive, or not visited by the running collection */
+#define GC_GRAY    1 /* References from the visited containers subtracted */
+#define GC_WHITE   2 /* Only referenced from within garbage cycles */
+#define GC_GARBAGE 3 /* Recorded for release */
+/* Number of buffered roots triggering a collection */
+#define GC_THRESHOLD_DEFAULT 10000
+#define GC_THRESHOLD_STEP    10000
+#define GC_THRESHOLD_MAX     1000000000
+/* A collection releasing less than that many arrays and objects raises the threshold */
+#define GC_THRESHOLD_TRIGGER 100
+/*
+ * Callback invoked for each array or object referenced by a container.
+ */
+typedef void (*ProcGcVisit)(VmGcRoot *, SySet *);
+/*
+ * Point to the bookkeeping of a given hashmap or class instance.
+ */
+static VmGcNode *GcNode(const VmGcRoot *pObj) {
+	if(pObj->nType == MEMOBJ_HASHMAP) {
+		return &((ph7_hashmap *)pObj->pObj)->sGc;
+	}
+	return &((ph7_class_instance *)pObj->pObj)->sGc;
+}
+/*
+ * Return the reference count of a given hashmap or class instance.
+ */
+static sxi32 GcRefCount(const VmGcRoot *pObj) {
+	if(pObj->nType == MEMOBJ_HASHMAP) {
+		return ((ph7_hashmap *)pObj->pObj)->iRef;
+	}
+	return ((ph7_class_instance *)pObj->pObj)->iRef;
+}
+/*
+ * Extract the hashmap or the class instance held by a given memory object.
+ * Return FALSE if the memory object does not hold any, or if it holds
+ * one the collector must not walk.
+ */
+static int GcExtract(ph7_value *pValue, VmGcRoot *pOut) {
+	if(pValue == 0 || (pValue->nType & MEMOBJ_NULL) || pValue->x.pOther == 0) {
+		return FALSE;
+	}
+	if(pValue->nType & MEMOBJ_HASHMAP) {
+		if(((ph7_hashmap *)pValue->x.pOther)->iFlags & HASHMAP_BUSY) {
+			return FALSE;
+		}
+		pOut->nType = MEMOBJ_HASHMAP;
+	} else if(pValue->nType & MEMOBJ_OBJ) {
+		if(((ph7_class_instance *)pValue->x.pOther)->iFlags & CLASS_INSTANCE_DESTROYED) {
+			return FALSE;
+		}
+		pOut->nType = MEMOBJ_OBJ;
+	} else {
+		return FALSE;
+	}
+	pOut->pObj = pValue->x.pOther;
+	return TRUE;
+}
+/*
+ * Invoke the given callback for each array or object referenced
+ * by a hashmap entry or by a class instance attribute.
+ */
+static void GcWalk(ph7_vm *pVm, VmGcRoot sParent, ProcGcVisit xVisit, SySet *pSet) {
+	VmGcRoot sChild;
+	if(sParent.nType == MEMOBJ_HASHMAP) {
+		ph7_hashmap *pMap = (ph7_hashmap *)sParent.pObj;
+		ph7_hashmap_node *pEntry = pMap->pFirst;
+		sxu32 n;
+		for(n = 0 ; n < pMap->nEntry && pEntry ; ++n) {
+			if(GcExtract(VmObjTableAt(&pVm->aMemObj, pEntry->nValIdx), &sChild)
+					&& !PH7_VmRefObjIsShared(&(*pVm), pEntry->nValIdx, 1)) {
+				xVisit(&sChild, pSet);
+			}
+			/* Point to the next entry */
+			pEntry = pEntry->pPrev; /* Reverse link */
+		}
+	} else {
+		ph7_class_instance *pThis = (ph7_class_instance *)sParent.pObj;
+		SyHashEntry *pEntry = 0;
+		while((pEntry = SyHashNextEntry(&pThis->hAttr, pEntry)) != 0) {
+			VmClassAttr *pVmAttr = (VmClassAttr *)pEntry->pUserData;
+			if(pVmAttr->pAttr->iFlags & (PH7_CLASS_ATTR_STATIC | PH7_CLASS_ATTR_CONSTANT)) {
+				/* Owned by the class */
+				continue;
+			}
+			if(GcExtract(VmObjTableAt(&pVm->aMemObj, pVmAttr->nIdx), &sChild)
+					&& !PH7_VmRefObjIsShared(&(*pVm), pVmAttr->nIdx, 0)) {
+				xVisit(&sChild, pSet);
+			}
+		}
+	}
+}
+/*
+ * Subtract the reference held by a visited container.
+ */
+static void GcMarkGrayChild(VmGcRoot *pChild, SySet *pStack) {
+	VmGcNode *pNode = GcNode(pChild);
+	if(pNode->iColor != GC_GRAY) {
+		pNode->iColor = GC_GRAY;
+		pNode->iRef = GcRefCount(pChild);
+		SySetPut(pStack, (const void *)pChild);
+	}
+	pNode->iRef--;
+}
+/*
+ * Subtract the references held by the arrays and objects reachable from a given root.
+ */
+static void GcMarkGray(ph7_vm *pVm, VmGcRoot *pRoot, SySet *pStack) {
+	VmGcNode *pNode = GcNode(pRoot);
+	VmGcRoot *pObj;
+	if(pNode->iColor == GC_GRAY) {
+		/* Already reached from another root */
+		return;
+	}
+	pNode->iColor = GC_GRAY;
+	pNode->iRef = GcRefCount(pRoot);
+	SySetPut(pStack, (const void *)pRoot);
+	while((pObj = (VmGcRoot *)SySetPop(pStack)) != 0) {
+		GcWalk(&(*pVm), *pObj, GcMarkGrayChild, pStack);
+	}
+}
+/*
+ * Mark as alive an array or an object referenced by a live container.
+ */
+static void GcScanBlackChild(VmGcRoot *pChild, SySet *pStack) {
+	VmGcNode *pNode = GcNode(pChild);
+	if(pNode->iColor != GC_BLACK) {
+		pNode->iColor = GC_BLACK;
+		SySetPut(pStack, (const void *)pChild);
+	}
+}
+/*
+ * Mark as alive a given container along with anything it refers to.
+ */
+static void GcScanBlack(ph7_vm *pVm, VmGcRoot *pRoot, SySet *pStack) {
+	VmGcRoot *pObj;
+	GcNode(pRoot)->iColor = GC_BLACK;
+	SySetPut(pStack, (const void *)pRoot);
+	while((pObj = (VmGcRoot *)SySetPop(pStack)) != 0) {
+		GcWalk(&(*pVm), *pObj, GcScanBlackChild, pStack);
+	}
+}
+/*
+ * Queue an array or an object left to scan.
+ */
+static void GcScanChild(VmGcRoot *pChild, SySet *pStack) {
+	if(GcNode(pChild)->iColor == GC_GRAY) {
+		SySetPut(pStack, (const void *)pChild);
+	}
+}
+/*
+ * Sort the arrays and objects reachable from a given root into the ones still
+ * referenced from elsewhere and the ones only referenced from within cycles.
+ */
+static void GcScan(ph7_vm *pVm, VmGcRoot *pRoot, SySet *pStack, SySet *pBlack) {
+	VmGcRoot sObj, *pObj;
+	VmGcNode *pNode;
+	SySetPut(pStack, (const void *)pRoot);
+	while((pObj = (VmGcRoot *)SySetPop(pStack)) != 0) {
+		sObj = *pObj;
+		pNode = GcNode(&sObj);
+		if(pNode->iColor != GC_GRAY) {
+			continue;
+		}
+		if(pNode->iRef != 0) {
+			/* Referenced from elsewhere. A negative count means a reference the collector
+			 * does not know about, assume this one is alive as well.
+			 */
+			GcScanBlack(&(*pVm), &sObj, pBlack);
+		} else {
+			pNode->iColor = GC_WHITE;
+			GcWalk(&(*pVm), sObj, GcScanChild, pStack);
+		}
+	}
+}
+/*
+ * Record an array or an object only referenced from within garbage cycles.
+ */
+static void GcCollectChild(VmGcRoot *pChild, SySet *pGarbage) {
+	VmGcNode *pNode = GcNode(pChild);
+	if(pNode->iColor == GC_WHITE) {
+		pNode->iColor = GC_GARBAGE;
+		SySetPut(pGarbage, (const void *)pChild);
+	}
+}
+/*
+ * Record the garbage cycles a given root belongs to.
+ */
+static void GcCollectWhite(ph7_vm *pVm, VmGcRoot *pRoot, SySet *pGarbage) {
+	sxu32 n = SySetUsed(pGarbage);
+	GcCollectChild(pRoot, pGarbage);
+	/* The recorded entries are walked in turn, so the set grows meanwhile */
+	for(; n < SySetUsed(pGarbage) ; ++n) {
+		GcWalk(&(*pVm), ((VmGcRoot *)SySetBasePtr(pGarbage))[n], GcCollectChild, pGarbage);
+	}
+}
+/*
+ * Look for the garbage cycles reachable from the given roots and record
+ * their arrays and objects in the pGarbage set.
+ */
+static void GcFindGarbage(ph7_vm *pVm, SySet *pRoots, SySet *pGarbage) {
+	VmGcRoot *aRoot = (VmGcRoot *)SySetBasePtr(pRoots);
+	SySet aStack, aBlack;
+	sxu32 n;
+	SySetInit(&aStack, &pVm->sAllocator, sizeof(VmGcRoot));
+	SySetInit(&aBlack, &pVm->sAllocator, sizeof(VmGcRoot));
+	for(n = 0 ; n < SySetUsed(pRoots) ; ++n) {
+		if(aRoot[n].pObj) {
+			GcMarkGray(&(*pVm), &aRoot[n], &aStack);
+		}
+	}
+	for(n = 0 ; n < SySetUsed(pRoots) ; ++n) {
+		if(aRoot[n].pObj) {
+			GcScan(&(*pVm), &aRoot[n], &aStack, &aBlack);
+		}
+	}
+	for(n = 0 ; n < SySetUsed(pRoots) ; ++n) {
+		if(aRoot[n].pObj) {
+			GcCollectWhite(&(*pVm), &aRoot[n], pGarbage);
+		}
+	}
+	SySetRelease(&aStack);
+	SySetRelease(&aBlack);
+}
+/*
+ * Invoke the destructors of the objects found in garbage cycles.
+ * Return TRUE if any destructor was invoked, in which case the garbage
+ * is buffered again to be looked for once more, as the destructors may
+ * have resurrected some of it.
+ */
+static int GcFinalize(ph7_vm *pVm, SySet *pGarbage) {
+	VmGcRoot *aGarbage = (VmGcRoot *)SySetBasePtr(pGarbage);
+	ph7_class_instance *pThis;
+	ph7_class_method *pDestr;
+	sxu32 n;
+	for(n = 0 ; n < SySetUsed(pGarbage) ; ++n) {
+		if(aGarbage[n].nType == MEMOBJ_OBJ) {
+			pThis = (ph7_class_instance *)aGarbage[n].pObj;
+			if((pThis->iFlags & CLASS_INSTANCE_FINALIZED) == 0
+					&& PH7_ClassExtractMethod(pThis->pClass, "__destruct", sizeof("__destruct") - 1)) {
+				break;
+			}
+		}
+	}
+	if(n >= SySetUsed(pGarbage)) {
+		/* No destructor to invoke */
+		return FALSE;
+	}
+	/* Keep the garbage around while the destructors run */
+	for(n = 0 ; n < SySetUsed(pGarbage) ; ++n) {
+		if(aGarbage[n].nType == MEMOBJ_HASHMAP) {
+			((ph7_hashmap *)aGarbage[n].pObj)->iRef++;
+		} else {
+			((ph7_class_instance *)aGarbage[n].pObj)->iRef++;
+		}
+		GcNode(&aGarbage[n])->iColor = GC_BLACK;
+	}
+	for(n = 0 ; n < SySetUsed(pGarbage) ; ++n) {
+		if(aGarbage[n].nType == MEMOBJ_OBJ) {
+			pThis = (ph7_class_instance *)aGarbage[n].pObj;
+			if(pThis->iFlags & CLASS_INSTANCE_FINALIZED) {
+				continue;
+			}
+			pThis->iFlags |= CLASS_INSTANCE_FINALIZED;
+			pDestr = PH7_ClassExtractMethod(pThis->pClass, "__destruct", sizeof("__destruct") - 1);
+			if(pDestr) {
+				PH7_VmCallClassMethod(&(*pVm), pThis, pDestr, 0, 0, 0);
+			}
+		}
+	}
+	/* Buffer the garbage again and drop the extra references */
+	for(n = 0 ; n < SySetUsed(pGarbage) ; ++n) {
+		if(GcNode(&aGarbage[n])->nRoot == 0) {
+			PH7_GcAddRoot(&(*pVm), aGarbage[n].pObj, aGarbage[n].nType);
+		}
+		if(aGarbage[n].nType == MEMOBJ_HASHMAP) {
+			PH7_HashmapUnref((ph7_hashmap *)aGarbage[n].pObj);
+		} else {
+			PH7_ClassInstanceUnref((ph7_class_instance *)aGarbage[n].pObj);
+		}
+	}
+	return TRUE;
+}
+/*
+ * Release the arrays and objects found in garbage cycles.
+ * Return the total number of released arrays and objects.
+ */
+static sxu32 GcRelease(ph7_vm *pVm, SySet *pGarbage) {
+	VmGcRoot *aGarbage = (VmGcRoot *)SySetBasePtr(pGarbage);
+	ph7_class_instance *pThis;
+	SyHashEntry *pEntry;
+	sxu32 n;
+	/* Keep each of them around until all of them dropped their references */
+	for(n = 0 ; n < SySetUsed(pGarbage) ; ++n) {
+		if(aGarbage[n].nType == MEMOBJ_HASHMAP) {
+			((ph7_hashmap *)aGarbage[n].pObj)->iRef++;
+		} else {
+			pThis = (ph7_class_instance *)aGarbage[n].pObj;
+			pThis->iFlags |= CLASS_INSTANCE_DESTROYED;
+			pThis->iRef++;
+		}
+	}
+	/* Release their contents */
+	for(n = 0 ; n < SySetUsed(pGarbage) ; ++n) {
+		if(aGarbage[n].nType == MEMOBJ_HASHMAP) {
+			PH7_HashmapRelease((ph7_hashmap *)aGarbage[n].pObj, FALSE);
+		} else {
+			pThis = (ph7_class_instance *)aGarbage[n].pObj;
+			SyHashResetLoopCursor(&pThis->hAttr);
+			while((pEntry = SyHashGetNextEntry(&pThis->hAttr)) != 0) {
+				VmClassAttr *pVmAttr = (VmClassAttr *)pEntry->pUserData;
+				if((pVmAttr->pAttr->iFlags & (PH7_CLASS_ATTR_STATIC | PH7_CLASS_ATTR_CONSTANT)) == 0) {
+					PH7_VmUnsetMemObj(&(*pVm), pVmAttr->nIdx, TRUE);
+				}
+				SyMemBackendPoolFree(&pVm->sAllocator, pVmAttr);
+			}
+			SyHashRelease(&pThis->hAttr);
+		}
+	}
+	/* Free the structures */
+	for(n = 0 ; n < SySetUsed(pGarbage) ; ++n) {
+		VmGcNode *pNode = GcNode(&aGarbage[n]);
+		if(pNode->nRoot) {
+			/* Buffered again while releasing the contents */
+			PH7_GcRemoveRoot(&(*pVm), pNode);
+		}
+		SyMemBackendPoolFree(&pVm->sAllocator, aGarbage[n].pObj);
+	}
+	return SySetUsed(pGarbage);
+}
+/*
+ * Initialize the cycle collector of a given virtual machine.
+ */
+PH7_PRIVATE void PH7_GcInit(ph7_vm *pVm) {
+	SySetInit(&pVm->sGc.aRoot, &pVm->sAllocator, sizeof(VmGcRoot));
+	pVm->sGc.nThreshold = GC_THRESHOLD_DEFAULT;
+	pVm->sGc.bEnabled = TRUE;
+}
+/*
+ * Buffer a hashmap or a class instance whose reference count was decremented
+ * to a nonzero value as a possible root of a garbage cycle.
+ */
+PH7_PRIVATE void PH7_GcAddRoot(ph7_vm *pVm, void *pObj, sxu32 nType) {
+	VmGcRoot sRoot;
+	sRoot.pObj = pObj;
+	sRoot.nType = nType;
+	if(SySetPut(&pVm->sGc.aRoot, (const void *)&sRoot) != SXRET_OK) {
+		/* Out of memory, it will be buffered again on its next decrement */
+		return;
+	}
+	GcNode(&sRoot)->nRoot = SySetUsed(&pVm->sGc.aRoot);
+	pVm->sGc.nRoot++;
+}
+/*
+ * Remove a hashmap or a class instance being released from the buffer of possible roots.
+ */
+PH7_PRIVATE void PH7_GcRemoveRoot(ph7_vm *pVm, VmGcNode *pNode) {
+	VmGcRoot *aRoot = (VmGcRoot *)SySetBasePtr(&pVm->sGc.aRoot);
+	aRoot[pNode->nRoot - 1].pObj = 0;
+	if(pNode->nRoot == SySetUsed(&pVm->sGc.aRoot)) {
+		/* Most recently buffered, reuse the slot */
+		SySetTruncate(&pVm->sGc.aRoot, pNode->nRoot - 1);
+	}
+	pNode->nRoot = 0;
+	pVm->sGc.nRoot--;
+}
+/*
+ * Look for garbage cycles among the buffered roots and release them.
+ * This function is invoked by the OP_NEW and OP_LOAD_MAP instructions once the
+ * number of buffered roots reaches the threshold, or by [gc_collect_cycles()].
+ * Return the total number of released arrays and objects.
+ */
+PH7_PRIVATE sxu32 PH7_GcCollect(ph7_vm *pVm) {
+	VmGc *pGc = &pVm->sGc;
+	SySet aWork, aGarbage;
+	sxu32 nCollected = 0;
+	VmGcRoot *aRoot;
+	int bFull, nPass;
+	sxu32 n;
+	if(pGc->bRunning) {
+		/* Invoked by a destructor */
+		return 0;
+	}
+	pGc->bRunning = TRUE;
+	bFull = SySetUsed(&pGc->aRoot) >= pGc->nThreshold;
+	/* A second pass collects the garbage whose destructors were invoked by the first one */
+	for(nPass = 0 ; nPass < 2 ; ++nPass) {
+		/* Take over the buffered roots */
+		aWork = pGc->aRoot;
+		SySetInit(&pGc->aRoot, &pVm->sAllocator, sizeof(VmGcRoot));
+		pGc->nRoot = 0;
+		aRoot = (VmGcRoot *)SySetBasePtr(&aWork);
+		for(n = 0 ; n < SySetUsed(&aWork) ; ++n) {
+			if(aRoot[n].pObj) {
+				GcNode(&aRoot[n])->nRoot = 0;
+			}
+		}
+		SySetInit(&aGarbage, &pVm->sAllocator, sizeof(VmGcRoot));
+		GcFindGarbage(&(*pVm), &aWork, &aGarbage);
+		SySetRelease(&aWork);
+		if(SySetUsed(&aGarbage) > 0 && !GcFinalize(&(*pVm), &aGarbage)) {
+			nCollected = GcRelease(&(*pVm), &aGarbage);
+			nPass = 2;
+		}
+		if(SySetUsed(&aGarbage) < 1) {
+			/* Nothing to collect */
+			nPass = 2;
+		}
+		SySetRelease(&aGarbage);
+	}
+	pGc->nRun++;
+	pGc->nCollected += nCollected;
+	if(bFull) {
+		/* Look for garbage less often while most roots are alive */
+		if(nCollected < GC_THRESHOLD_TRIGGER) {
+			if(pGc->nThreshold < GC_THRESHOLD_MAX) {
+				pGc->nThreshold += GC_THRESHOLD_STEP;
+			}
+		} else if(pGc->nThreshold > GC_THRESHOLD_DEFAULT) {
+			pGc->nThreshold -= GC_THRESHOLD_STEP;
+		}
+	}
+	pGc->bRunning = FALSE;
+	return nCollected;
+}
@@ -67,7 +67,7 @@ static sxi64 HashmapCount(ph7_hashmap *pMap, int bRecursive, int iRecCount) {
 				break;
 			}
 			/* Point to the element value */
-			pElem = (ph7_value *)SySetAt(&pMap->pVm->aMemObj, pEntry->nValIdx);
+			pElem = VmObjTableAt(&pMap->pVm->aMemObj, pEntry->nValIdx);
 			if(pElem) {
 				if(pElem->nType & MEMOBJ_HASHMAP) {
 					if(iRecCount > 31) {
@@ -96,8 +96,11 @@ static sxi64 HashmapCount(ph7_hashmap *pMap, int bRecursive, int iRecCount) {
  */
 static ph7_hashmap_node *HashmapNewIntNode(ph7_hashmap *pMap, sxi64 iKey, sxu32 nHash, sxu32 nValIdx) {
 	ph7_hashmap_node *pNode;
+	sxu32 iTag;
 	/* Allocate a new node */
+	SyMemBackendPushTag(&pMap->pVm->sAllocator, PH7_MEM_TAG_HASHMAPS, iTag);
 	pNode = (ph7_hashmap_node *)SyMemBackendPoolAlloc(&pMap->pVm->sAllocator, sizeof(ph7_hashmap_node));
+	SyMemBackendPopTag(&pMap->pVm->sAllocator, iTag);
 	if(pNode == 0) {
 		return 0;
 	}
@@ -116,13 +119,24 @@ static ph7_hashmap_node *HashmapNewIntNode(ph7_hashmap *pMap, sxi64 iKey, sxu32
  * If something goes wrong [i.e: out of memory],this function return NULL.
  * Otherwise a fresh [ph7_hashmap_node] instance is returned.
  */
-static ph7_hashmap_node *HashmapNewBlobNode(ph7_hashmap *pMap, const void *pKey, sxu32 nKeyLen, sxu32 nHash, sxu32 nValIdx) {
+static ph7_hashmap_node *HashmapNewBlobNode(ph7_hashmap *pMap, const SyBlob *pKey, sxu32 nHash, sxu32 nValIdx) {
 	ph7_hashmap_node *pNode;
+	const char *zKey;
+	sxu32 iTag;
 	/* Allocate a new node */
+	SyMemBackendPushTag(&pMap->pVm->sAllocator, PH7_MEM_TAG_HASHMAPS, iTag);
 	pNode = (ph7_hashmap_node *)SyMemBackendPoolAlloc(&pMap->pVm->sAllocator, sizeof(ph7_hashmap_node));
+	SyMemBackendPopTag(&pMap->pVm->sAllocator, iTag);
 	if(pNode == 0) {
 		return 0;
 	}
+	/* Share the key with the other nodes holding the same one */
+	zKey = PH7_VmInternString(pMap->pVm, (const char *)SyBlobData(pKey), SyBlobLength(pKey),
+							  pMap->xBlobHash == BinHash ? nHash : PH7_VmStringHash(pKey));
+	if(zKey == 0) {
+		SyMemBackendPoolFree(&pMap->pVm->sAllocator, pNode);
+		return 0;
+	}
 	/* Zero the stucture */
 	SyZero(pNode, sizeof(ph7_hashmap_node));
 	/* Fill in the structure */
@@ -130,20 +144,35 @@ static ph7_hashmap_node *HashmapNewBlobNode(ph7_hashmap *pMap, const void *pKey,
 	pNode->iType = HASHMAP_BLOB_NODE;
 	pNode->nHash = nHash;
 	SyBlobInit(&pNode->xKey.sKey, &pMap->pVm->sAllocator);
-	SyBlobAppend(&pNode->xKey.sKey, pKey, nKeyLen);
+	SyBlobReadOnly(&pNode->xKey.sKey, zKey, SyBlobLength(pKey));
+	pNode->xKey.sKey.nFlags |= SXBLOB_INTERN;
 	pNode->nValIdx = nValIdx;
 	return pNode;
 }
+/*
+ * Hash a BLOB key. The hash of an interned key is reused as is.
+ */
+static sxu32 HashmapBlobHash(ph7_hashmap *pMap, const SyBlob *pKey) {
+	if(pMap->xBlobHash == BinHash) {
+		return PH7_VmStringHash(pKey);
+	}
+	return pMap->xBlobHash(SyBlobData(pKey), SyBlobLength(pKey));
+}
 /*
  * link a hashmap node to the given bucket index (last argument to this function).
  */
 static void HashmapNodeLink(ph7_hashmap *pMap, ph7_hashmap_node *pNode, sxu32 nBucketIdx) {
 	/* Link */
-	if(pMap->apBucket[nBucketIdx] != 0) {
-		pNode->pNextCollide = pMap->apBucket[nBucketIdx];
-		pMap->apBucket[nBucketIdx]->pPrevCollide = pNode;
+	if(pMap->iFlags & HASHMAP_PACKED) {
+		/* Packed hashmap, the bucket index is the node key */
+		pMap->apBucket[nBucketIdx] = pNode;
+	} else {
+		if(pMap->apBucket[nBucketIdx] != 0) {
+			pNode->pNextCollide = pMap->apBucket[nBucketIdx];
+			pMap->apBucket[nBucketIdx]->pPrevCollide = pNode;
+		}
+		pMap->apBucket[nBucketIdx] = pNode;
 	}
-	pMap->apBucket[nBucketIdx] = pNode;
 	/* Link to the map list */
 	if(pMap->pFirst == 0) {
 		pMap->pFirst = pMap->pLast = pNode;
@@ -154,6 +183,100 @@ static void HashmapNodeLink(ph7_hashmap *pMap, ph7_hashmap_node *pNode, sxu32 nB
 	}
 	++pMap->nEntry;
 }
+#define HASHMAP_FILL_FACTOR 3
+/*
+ * Switch a packed hashmap to the hash-table representation.
+ * This happen as soon as the 0..n-1 integer key sequence is broken
+ * [i.e: string key, sparse index or removal of an inner entry].
+ */
+static void HashmapUnpack(ph7_hashmap *pMap) {
+	ph7_hashmap_node *pEntry, **apNew;
+	sxu32 nNew = 16;
+	sxu32 nBucket;
+	sxu32 n, iTag;
+	while(pMap->nEntry >= nNew * HASHMAP_FILL_FACTOR) {
+		nNew <<= 1;
+	}
+	/* Allocate a new bucket */
+	SyMemBackendPushTag(&pMap->pVm->sAllocator, PH7_MEM_TAG_HASHMAPS, iTag);
+	apNew = (ph7_hashmap_node **)SyMemBackendAlloc(&pMap->pVm->sAllocator, nNew * sizeof(ph7_hashmap_node *));
+	SyMemBackendPopTag(&pMap->pVm->sAllocator, iTag);
+	if(apNew == 0) {
+		PH7_VmMemoryError(pMap->pVm);
+	}
+	/* Zero the table */
+	SyZero((void *)apNew, nNew * sizeof(ph7_hashmap_node *));
+	if(pMap->apBucket) {
+		/* Release the packed vector */
+		SyMemBackendFree(&pMap->pVm->sAllocator, (void *)pMap->apBucket);
+	}
+	/* Reflect the change */
+	pMap->apBucket = apNew;
+	pMap->nSize = nNew;
+	pMap->iFlags &= ~HASHMAP_PACKED;
+	/* Hash all entries */
+	pEntry = pMap->pFirst;
+	for(n = 0 ; n < pMap->nEntry ; ++n) {
+		pEntry->nHash = pMap->xIntHash(pEntry->xKey.iKey);
+		pEntry->pNextCollide = pEntry->pPrevCollide = 0;
+		/* Link to the new bucket */
+		nBucket = pEntry->nHash & (nNew - 1);
+		if(pMap->apBucket[nBucket] != 0) {
+			pEntry->pNextCollide = pMap->apBucket[nBucket];
+			pMap->apBucket[nBucket]->pPrevCollide = pEntry;
+		}
+		pMap->apBucket[nBucket] = pEntry;
+		/* Point to the next entry */
+		pEntry = pEntry->pPrev; /* Reverse link */
+	}
+}
+/*
+ * Switch a hashmap to the packed representation if its keys form
+ * the 0..n-1 integer sequence in insertion order.
+ * Only the lookup changes: nodes and their values stay allocated as usual.
+ * Refer to [sort(),array_shift(),...] implementations for more information.
+ */
+static void HashmapPack(ph7_hashmap *pMap) {
+	ph7_hashmap_node *pEntry, **apNew;
+	sxu32 nNew = 16;
+	sxu32 n, iTag;
+	if(pMap->iFlags & HASHMAP_PACKED) {
+		/* Already packed */
+		return;
+	}
+	/* Make sure the keys are in sequence */
+	pEntry = pMap->pFirst;
+	for(n = 0 ; n < pMap->nEntry ; ++n) {
+		if(pEntry->iType != HASHMAP_INT_NODE || pEntry->xKey.iKey != (sxi64)n) {
+			return;
+		}
+		pEntry = pEntry->pPrev; /* Reverse link */
+	}
+	while(nNew < pMap->nEntry) {
+		nNew <<= 1;
+	}
+	/* Allocate the packed vector */
+	SyMemBackendPushTag(&pMap->pVm->sAllocator, PH7_MEM_TAG_HASHMAPS, iTag);
+	apNew = (ph7_hashmap_node **)SyMemBackendAlloc(&pMap->pVm->sAllocator, nNew * sizeof(ph7_hashmap_node *));
+	SyMemBackendPopTag(&pMap->pVm->sAllocator, iTag);
+	if(apNew == 0) {
+		/* Not so fatal here, keep the hash-table */
+		return;
+	}
+	pEntry = pMap->pFirst;
+	for(n = 0 ; n < pMap->nEntry ; ++n) {
+		apNew[n] = pEntry;
+		pEntry = pEntry->pPrev; /* Reverse link */
+	}
+	if(pMap->apBucket) {
+		/* Release the hash bucket */
+		SyMemBackendFree(&pMap->pVm->sAllocator, (void *)pMap->apBucket);
+	}
+	/* Reflect the change */
+	pMap->apBucket = apNew;
+	pMap->nSize = nNew;
+	pMap->iFlags |= HASHMAP_PACKED;
+}
 /*
  * Unlink a node from the hashmap.
  * If the node count reaches zero then release the whole hash-bucket.
@@ -161,14 +284,24 @@ static void HashmapNodeLink(ph7_hashmap *pMap, ph7_hashmap_node *pNode, sxu32 nB
 PH7_PRIVATE void PH7_HashmapUnlinkNode(ph7_hashmap_node *pNode, int bRestore) {
 	ph7_hashmap *pMap = pNode->pMap;
 	ph7_vm *pVm = pMap->pVm;
-	/* Unlink from the corresponding bucket */
-	if(pNode->pPrevCollide == 0) {
-		pMap->apBucket[pNode->nHash & (pMap->nSize - 1)] = pNode->pNextCollide;
-	} else {
-		pNode->pPrevCollide->pNextCollide = pNode->pNextCollide;
+	if(pMap->iFlags & HASHMAP_PACKED) {
+		if(pNode->xKey.iKey + 1 == (sxi64)pMap->nEntry) {
+			/* Last key, the sequence is preserved */
+			pMap->apBucket[pNode->xKey.iKey] = 0;
+		} else {
+			HashmapUnpack(&(*pMap));
+		}
 	}
-	if(pNode->pNextCollide) {
-		pNode->pNextCollide->pPrevCollide = pNode->pPrevCollide;
+	if((pMap->iFlags & HASHMAP_PACKED) == 0) {
+		/* Unlink from the corresponding bucket */
+		if(pNode->pPrevCollide == 0) {
+			pMap->apBucket[pNode->nHash & (pMap->nSize - 1)] = pNode->pNextCollide;
+		} else {
+			pNode->pPrevCollide->pNextCollide = pNode->pNextCollide;
+		}
+		if(pNode->pNextCollide) {
+			pNode->pNextCollide->pPrevCollide = pNode->pPrevCollide;
+		}
 	}
 	if(pMap->pFirst == pNode) {
 		pMap->pFirst = pNode->pPrev;
@@ -186,7 +319,7 @@ PH7_PRIVATE void PH7_HashmapUnlinkNode(ph7_hashmap_node *pNode, int bRestore) {
 		PH7_VmUnsetMemObj(pVm, pNode->nValIdx, FALSE);
 	}
 	if(pNode->iType == HASHMAP_BLOB_NODE) {
-		SyBlobRelease(&pNode->xKey.sKey);
+		PH7_VmReleaseString(pVm, (const char *)SyBlobData(&pNode->xKey.sKey));
 	}
 	SyMemBackendPoolFree(&pVm->sAllocator, pNode);
 	pMap->nEntry--;
@@ -196,24 +329,44 @@ PH7_PRIVATE void PH7_HashmapUnlinkNode(ph7_hashmap_node *pNode, int bRestore) {
 		pMap->apBucket = 0;
 		pMap->nSize = 0;
 		pMap->pFirst = pMap->pLast = pMap->pCur = 0;
+		pMap->iFlags |= HASHMAP_PACKED;
 	}
 }
-#define HASHMAP_FILL_FACTOR 3
 /*
  * Grow the hash-table and rehash all entries.
+ * Packed hashmaps simply grow their vector.
  */
 static sxi32 HashmapGrowBucket(ph7_hashmap *pMap) {
+	if(pMap->iFlags & HASHMAP_PACKED) {
+		if(pMap->nEntry >= pMap->nSize) {
+			ph7_hashmap_node **apNew;
+			sxu32 nNew = pMap->nSize << 1;
+			if(nNew < 1) {
+				nNew = 16;
+			}
+			apNew = (ph7_hashmap_node **)SyMemBackendRealloc(&pMap->pVm->sAllocator, (void *)pMap->apBucket, nNew * sizeof(ph7_hashmap_node *));
+			if(apNew == 0) {
+				return SXERR_MEM;
+			}
+			/* Reflect the change */
+			pMap->apBucket = apNew;
+			pMap->nSize = nNew;
+		}
+		return SXRET_OK;
+	}
 	if(pMap->nEntry >= pMap->nSize * HASHMAP_FILL_FACTOR) {
 		ph7_hashmap_node **apOld = pMap->apBucket;
 		ph7_hashmap_node *pEntry, **apNew;
 		sxu32 nNew = pMap->nSize << 1;
 		sxu32 nBucket;
-		sxu32 n;
+		sxu32 n, iTag;
 		if(nNew < 1) {
 			nNew = 16;
 		}
 		/* Allocate a new bucket */
+		SyMemBackendPushTag(&pMap->pVm->sAllocator, PH7_MEM_TAG_HASHMAPS, iTag);
 		apNew = (ph7_hashmap_node **)SyMemBackendAlloc(&pMap->pVm->sAllocator, nNew * sizeof(ph7_hashmap_node *));
+		SyMemBackendPopTag(&pMap->pVm->sAllocator, iTag);
 		if(apNew == 0) {
 			if(pMap->nSize < 1) {
 				return SXERR_MEM; /* Fatal */
@@ -266,6 +419,10 @@ static sxi32 HashmapInsertIntKey(ph7_hashmap *pMap, sxi64 iKey, ph7_value *pValu
 	sxi32 rc;
 	ph7_value *pObj;
 	SXUNUSED(nRefIdx);
+	if((pMap->iFlags & HASHMAP_PACKED) && iKey != (sxi64)pMap->nEntry) {
+		/* Key out of sequence */
+		HashmapUnpack(&(*pMap));
+	}
 	/* Reserve a ph7_value for the value */
 	pObj = PH7_ReserveMemObj(pMap->pVm);
 	if(pObj == 0) {
@@ -276,8 +433,8 @@ static sxi32 HashmapInsertIntKey(ph7_hashmap *pMap, sxi64 iKey, ph7_value *pValu
 		PH7_MemObjStore(pValue, pObj);
 	}
 	nIdx = pObj->nIdx;
-	/* Hash the key */
-	nHash = pMap->xIntHash(iKey);
+	/* Hash the key, packed hashmaps are indexed by key */
+	nHash = (pMap->iFlags & HASHMAP_PACKED) ? 0 : pMap->xIntHash(iKey);
 	/* Allocate a new int node */
 	pNode = HashmapNewIntNode(&(*pMap), iKey, nHash, nIdx);
 	if(pNode == 0) {
@@ -290,7 +447,7 @@ static sxi32 HashmapInsertIntKey(ph7_hashmap *pMap, sxi64 iKey, ph7_value *pValu
 		return rc;
 	}
 	/* Perform the insertion */
-	HashmapNodeLink(&(*pMap), pNode, nHash & (pMap->nSize - 1));
+	HashmapNodeLink(&(*pMap), pNode, (pMap->iFlags & HASHMAP_PACKED) ? (sxu32)iKey : nHash & (pMap->nSize - 1));
 	/* Install in the reference table */
 	PH7_VmRefObjInstall(pMap->pVm, nIdx, 0, pNode, 0);
 	/* All done */
@@ -300,13 +457,17 @@ static sxi32 HashmapInsertIntKey(ph7_hashmap *pMap, sxi64 iKey, ph7_value *pValu
  * Insert a BLOB key and it's associated value (if any) in the given
  * hashmap.
  */
-static sxi32 HashmapInsertBlobKey(ph7_hashmap *pMap, const void *pKey, sxu32 nKeyLen, ph7_value *pValue, sxu32 nRefIdx) {
+static sxi32 HashmapInsertBlobKey(ph7_hashmap *pMap, const SyBlob *pKey, ph7_value *pValue, sxu32 nRefIdx) {
 	ph7_hashmap_node *pNode;
 	sxu32 nHash;
 	sxu32 nIdx;
 	sxi32 rc;
 	ph7_value *pObj;
 	SXUNUSED(nRefIdx);
+	if(pMap->iFlags & HASHMAP_PACKED) {
+		/* Packed hashmaps hold integer keys only */
+		HashmapUnpack(&(*pMap));
+	}
 	/* Reserve a ph7_value for the value */
 	pObj = PH7_ReserveMemObj(pMap->pVm);
 	if(pObj == 0) {
@@ -318,9 +479,9 @@ static sxi32 HashmapInsertBlobKey(ph7_hashmap *pMap, const void *pKey, sxu32 nKe
 	}
 	nIdx = pObj->nIdx;
 	/* Hash the key */
-	nHash = pMap->xBlobHash(pKey, nKeyLen);
+	nHash = HashmapBlobHash(&(*pMap), pKey);
 	/* Allocate a new blob node */
-	pNode = HashmapNewBlobNode(&(*pMap), pKey, nKeyLen, nHash, nIdx);
+	pNode = HashmapNewBlobNode(&(*pMap), pKey, nHash, nIdx);
 	if(pNode == 0) {
 		return SXERR_MEM;
 	}
@@ -353,6 +514,16 @@ static sxi32 HashmapLookupIntKey(
 		/* Don't bother hashing,there is no entry anyway */
 		return SXERR_NOTFOUND;
 	}
+	if(pMap->iFlags & HASHMAP_PACKED) {
+		/* Direct access */
+		if(iKey < 0 || iKey >= (sxi64)pMap->nEntry) {
+			return SXERR_NOTFOUND;
+		}
+		if(ppNode) {
+			*ppNode = pMap->apBucket[iKey];
+		}
+		return SXRET_OK;
+	}
 	/* Hash the key first */
 	nHash = pMap->xIntHash(iKey);
 	/* Point to the appropriate bucket */
@@ -384,21 +555,22 @@ static sxi32 HashmapLookupIntKey(
  */
 static sxi32 HashmapLookupBlobKey(
 	ph7_hashmap *pMap,          /* Target hashmap */
-	const void *pKey,           /* Lookup key */
-	sxu32 nKeyLen,              /* Key length in bytes */
+	const SyBlob *pKey,         /* Lookup key */
 	ph7_hashmap_node **ppNode   /* OUT: target node on success */
 ) {
+	const void *zKey = SyBlobData(pKey);
+	sxu32 nKeyLen = SyBlobLength(pKey);
 	ph7_hashmap_node *pNode;
 	sxu32 nHash;
-	if(pMap->nEntry < 1) {
-		/* Don't bother hashing,there is no entry anyway */
+	if(pMap->nEntry < 1 || (pMap->iFlags & HASHMAP_PACKED)) {
+		/* Don't bother hashing,there is no such entry anyway */
 		return SXERR_NOTFOUND;
 	}
 	/* Hash the key first */
-	nHash = pMap->xBlobHash(pKey, nKeyLen);
+	nHash = HashmapBlobHash(&(*pMap), pKey);
 	/* Point to the appropriate bucket */
 	pNode = pMap->apBucket[nHash & (pMap->nSize - 1)];
-	/* Perform the lookup */
+	/* Perform the lookup, interned keys are compared by pointer first */
 	for(;;) {
 		if(pNode == 0) {
 			break;
@@ -406,7 +578,7 @@ static sxi32 HashmapLookupBlobKey(
 		if(pNode->iType == HASHMAP_BLOB_NODE
 				&& pNode->nHash == nHash
 				&& SyBlobLength(&pNode->xKey.sKey) == nKeyLen
-				&& SyMemcmp(SyBlobData(&pNode->xKey.sKey), pKey, nKeyLen) == 0) {
+				&& (SyBlobData(&pNode->xKey.sKey) == zKey || SyMemcmp(SyBlobData(&pNode->xKey.sKey), zKey, nKeyLen) == 0)) {
 			/* Node found */
 			if(ppNode) {
 				*ppNode = pNode;
@@ -464,7 +636,7 @@ static sxi32 HashmapLookup(
 		}
 		if(SyBlobLength(&pKey->sBlob) > 0 && !HashmapIsIntKey(&pKey->sBlob)) {
 			/* Perform a blob lookup */
-			rc = HashmapLookupBlobKey(&(*pMap), SyBlobData(&pKey->sBlob), SyBlobLength(&pKey->sBlob), &pNode);
+			rc = HashmapLookupBlobKey(&(*pMap), &pKey->sBlob, &pNode);
 			goto result;
 		}
 	}
@@ -511,11 +683,10 @@ static sxi32 HashmapInsert(
 			}
 			goto IntKey;
 		}
-		if(SXRET_OK == HashmapLookupBlobKey(&(*pMap), SyBlobData(&pKey->sBlob),
-											SyBlobLength(&pKey->sBlob), &pNode)) {
+		if(SXRET_OK == HashmapLookupBlobKey(&(*pMap), &pKey->sBlob, &pNode)) {
 			/* Overwrite the old value */
 			ph7_value *pElem;
-			pElem = (ph7_value *)SySetAt(&pMap->pVm->aMemObj, pNode->nValIdx);
+			pElem = VmObjTableAt(&pMap->pVm->aMemObj, pNode->nValIdx);
 			if(pElem) {
 				if(pVal) {
 					PH7_MemObjStore(pVal, pElem);
@@ -527,7 +698,7 @@ static sxi32 HashmapInsert(
 			return SXRET_OK;
 		}
 		/* Perform a blob-key insertion */
-		rc = HashmapInsertBlobKey(&(*pMap), SyBlobData(&pKey->sBlob), SyBlobLength(&pKey->sBlob), &(*pVal), 0);
+		rc = HashmapInsertBlobKey(&(*pMap), &pKey->sBlob, &(*pVal), 0);
 		return rc;
 	}
 IntKey:
@@ -539,7 +710,7 @@ IntKey:
 		if(SXRET_OK == HashmapLookupIntKey(&(*pMap), pKey->x.iVal, &pNode)) {
 			/* Overwrite the old value */
 			ph7_value *pElem;
-			pElem = (ph7_value *)SySetAt(&pMap->pVm->aMemObj, pNode->nValIdx);
+			pElem = VmObjTableAt(&pMap->pVm->aMemObj, pNode->nValIdx);
 			if(pElem) {
 				if(pVal) {
 					PH7_MemObjStore(pVal, pElem);
@@ -579,7 +750,7 @@ IntKey:
 static ph7_value *HashmapExtractNodeValue(ph7_hashmap_node *pNode) {
 	/* Point to the desired object */
 	ph7_value *pObj;
-	pObj = (ph7_value *)SySetAt(&pNode->pMap->pVm->aMemObj, pNode->nValIdx);
+	pObj = VmObjTableAt(&pNode->pMap->pVm->aMemObj, pNode->nValIdx);
 	return pObj;
 }
 /*
@@ -606,8 +777,7 @@ static sxi32 HashmapInsertNode(ph7_hashmap *pMap, ph7_hashmap_node *pNode, int b
 		}
 	} else {
 		/* Blob key */
-		rc = HashmapInsertBlobKey(&(*pMap), SyBlobData(&pNode->xKey.sKey),
-								  SyBlobLength(&pNode->xKey.sKey), pObj, 0);
+		rc = HashmapInsertBlobKey(&(*pMap), &pNode->xKey.sKey, pObj, 0);
 	}
 	return rc;
 }
@@ -646,6 +816,13 @@ static sxi32 HashmapNodeCmp(ph7_hashmap_node *pLeft, ph7_hashmap_node *pRight, i
 static void HashmapRehashIntNode(ph7_hashmap_node *pEntry) {
 	ph7_hashmap *pMap = pEntry->pMap;
 	sxu32 nBucket;
+	if(pMap->iFlags & HASHMAP_PACKED) {
+		/* All entries are renumbered in order, simply move the node */
+		pEntry->xKey.iKey = pMap->iNextIdx;
+		pMap->apBucket[pMap->iNextIdx] = pEntry;
+		pMap->iNextIdx++;
+		return;
+	}
 	/* Remove old collision links */
 	if(pEntry->pPrevCollide) {
 		pEntry->pPrevCollide->pNextCollide = pEntry->pNextCollide;
@@ -744,7 +921,7 @@ static int HashmapFindValue(
 static int HashmapFindValueByCallback(
 	ph7_hashmap *pMap,     /* Target hashmap */
 	ph7_value *pNeedle,    /* Lookup key */
-	ph7_value *pCallback,  /* User defined callback */
+	VmCallback *pCallback, /* Prepared user defined callback */
 	ph7_hashmap_node **ppNode /* OUT: target node on success */
 ) {
 	ph7_hashmap_node *pEntry;
@@ -768,7 +945,7 @@ static int HashmapFindValueByCallback(
 		if(pVal) {
 			/* Invoke the user callback */
 			apArg[1] = pVal; /* Second argument to the callback */
-			rc = PH7_VmCallUserFunction(pMap->pVm, pCallback, 2, apArg, &sResult);
+			rc = PH7_VmInvokeCallback(pCallback, apArg, &sResult);
 			if(rc == SXRET_OK) {
 				/* Extract callback result */
 				if((sResult.nType & MEMOBJ_INT) == 0) {
@@ -873,7 +1050,7 @@ PH7_PRIVATE sxi32 PH7_HashmapCmp(
 		} else {
 			SyBlob *pKey = &pLe->xKey.sKey;
 			/* Blob key */
-			rc = HashmapLookupBlobKey(&(*pRight), SyBlobData(pKey), SyBlobLength(pKey), &pRe);
+			rc = HashmapLookupBlobKey(&(*pRight), pKey, &pRe);
 		}
 		if(rc != SXRET_OK) {
 			/* No such entry in the right side */
@@ -1036,6 +1213,56 @@ PH7_PRIVATE sxi32 PH7_HashmapDup(ph7_hashmap *pSrc, ph7_hashmap *pDest) {
 	pDest->iNextIdx = pSrc->iNextIdx;
 	return SXRET_OK;
 }
+/*
+ * Hashmaps are shared by reference counting when assigned [i.e: PH7_MemObjStore()]
+ * or passed by value, and copied only when one of the holders is about to modify
+ * it [i.e: copy-on-write].
+ * Make sure the hashmap held by the given value is not shared with any other
+ * variable and return a pointer to it. The value is either the variable itself,
+ * or a copy loaded on the VM stack, in which case the variable is pointed by the
+ * nIdx field and both are updated to point to the private copy.
+ */
+PH7_PRIVATE ph7_hashmap *PH7_HashmapSeparate(ph7_value *pValue) {
+	ph7_hashmap *pMap = (ph7_hashmap *)pValue->x.pOther;
+	ph7_hashmap *pCopy;
+	ph7_value *pHolder = 0;
+	sxu32 nIdx = pValue->nIdx;
+	sxi32 nOwner = 1;
+	if(nIdx != SXU32_HIGH) {
+		/* Check if this is the variable itself or a copy of the variable holding the hashmap */
+		pHolder = VmObjTableAt(&pMap->pVm->aMemObj, nIdx);
+		if(pHolder && pHolder != pValue) {
+			if((pHolder->nType & MEMOBJ_HASHMAP) && pHolder->x.pOther == pMap) {
+				nOwner = 2;
+			} else {
+				pHolder = 0;
+			}
+		}
+	}
+	if(pMap->iRef <= nOwner) {
+		/* Not shared */
+		return pMap;
+	}
+	/* Perform the duplication */
+	pCopy = PH7_NewHashmap(pMap->pVm, pMap->xIntHash, pMap->xBlobHash);
+	if(pCopy == 0) {
+		PH7_VmMemoryError(pMap->pVm);
+	}
+	if(pHolder != pValue) {
+		/* Value loaded on the stack */
+		pValue->x.pOther = pCopy;
+	}
+	PH7_HashmapDup(pMap, pCopy);
+	/* Detach from the shared hashmap */
+	pCopy->iRef = nOwner;
+	pMap->iRef -= nOwner;
+	if(pHolder) {
+		/* The memory object container may have been relocated by the duplication */
+		pHolder = VmObjTableAt(&pMap->pVm->aMemObj, nIdx);
+		pHolder->x.pOther = pCopy;
+	}
+	return pCopy;
+}
 /*
  * Perform the union of two hashmaps.
  * This operation is performed only if the user uses the '+' operator
@@ -1091,12 +1318,11 @@ PH7_PRIVATE sxi32 PH7_HashmapUnion(ph7_hashmap *pLeft, ph7_hashmap *pRight) {
 		if(pEntry->iType == HASHMAP_BLOB_NODE) {
 			/* BLOB key */
 			if(SXRET_OK !=
-					HashmapLookupBlobKey(&(*pLeft), SyBlobData(&pEntry->xKey.sKey), SyBlobLength(&pEntry->xKey.sKey), 0)) {
+					HashmapLookupBlobKey(&(*pLeft), &pEntry->xKey.sKey, 0)) {
 				pObj = HashmapExtractNodeValue(pEntry);
 				if(pObj) {
 					/* Perform the insertion */
-					rc = HashmapInsertBlobKey(&(*pLeft), SyBlobData(&pEntry->xKey.sKey), SyBlobLength(&pEntry->xKey.sKey),
-											  pObj, 0);
+					rc = HashmapInsertBlobKey(&(*pLeft), &pEntry->xKey.sKey, pObj, 0);
 					if(rc != SXRET_OK) {
 						return rc;
 					}
@@ -1130,8 +1356,15 @@ PH7_PRIVATE ph7_hashmap *PH7_NewHashmap(
 	sxu32(*xBlobHash)(const void *, sxu32) /* Hash function for BLOB keys.NULL otherwise */
 ) {
 	ph7_hashmap *pMap;
+	sxu32 iTag;
+	if(pVm == 0) {
+		/* Stale value */
+		return 0;
+	}
 	/* Allocate a new instance */
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_HASHMAPS, iTag);
 	pMap = (ph7_hashmap *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(ph7_hashmap));
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	if(pMap == 0) {
 		return 0;
 	}
@@ -1140,6 +1373,8 @@ PH7_PRIVATE ph7_hashmap *PH7_NewHashmap(
 	/* Fill in the structure */
 	pMap->pVm = &(*pVm);
 	pMap->iRef = 1;
+	/* Empty hashmaps are packed until a key breaks the sequence */
+	pMap->iFlags = HASHMAP_PACKED;
 	/* Default hash functions */
 	pMap->xIntHash  = xIntHash ? xIntHash : IntHash;
 	pMap->xBlobHash = xBlobHash ? xBlobHash : BinHash;
@@ -1217,6 +1452,12 @@ PH7_PRIVATE sxi32 PH7_HashmapRelease(ph7_hashmap *pMap, int FreeDS) {
 	ph7_hashmap_node *pEntry, *pNext;
 	ph7_vm *pVm = pMap->pVm;
 	sxu32 n;
+	if(FreeDS && pMap->sGc.nRoot) {
+		/* No longer a possible root of a garbage cycle */
+		PH7_GcRemoveRoot(pVm, &pMap->sGc);
+	}
+	/* Destructors invoked meanwhile must not walk the released entries */
+	pMap->iFlags |= HASHMAP_BUSY;
 	/* Start the release process */
 	n = 0;
 	pEntry = pMap->pFirst;
@@ -1231,14 +1472,14 @@ PH7_PRIVATE sxi32 PH7_HashmapRelease(ph7_hashmap *pMap, int FreeDS) {
 		PH7_VmUnsetMemObj(pVm, pEntry->nValIdx, FALSE);
 		/* Release the node */
 		if(pEntry->iType == HASHMAP_BLOB_NODE) {
-			SyBlobRelease(&pEntry->xKey.sKey);
+			PH7_VmReleaseString(pVm, (const char *)SyBlobData(&pEntry->xKey.sKey));
 		}
 		SyMemBackendPoolFree(&pVm->sAllocator, pEntry);
 		/* Point to the next entry */
 		pEntry = pNext;
 		n++;
 	}
-	if(pMap->nEntry > 0) {
+	if(pMap->apBucket) {
 		/* Release the hash bucket */
 		SyMemBackendFree(&pVm->sAllocator, pMap->apBucket);
 	}
@@ -1251,6 +1492,7 @@ PH7_PRIVATE sxi32 PH7_HashmapRelease(ph7_hashmap *pMap, int FreeDS) {
 		pMap->iNextIdx = 0;
 		pMap->nEntry = pMap->nSize = 0;
 		pMap->pFirst = pMap->pLast = pMap->pCur = 0;
+		pMap->iFlags = HASHMAP_PACKED;
 	}
 	return SXRET_OK;
 }
@@ -1264,6 +1506,9 @@ PH7_PRIVATE void  PH7_HashmapUnref(ph7_hashmap *pMap) {
 	pMap->iRef--;
 	if(pMap->iRef < 1) {
 		PH7_HashmapRelease(pMap, TRUE);
+	} else if(pMap->sGc.nRoot == 0 && pMap->pVm->sGc.bEnabled) {
+		/* Possible root of a garbage cycle */
+		PH7_GcAddRoot(pMap->pVm, pMap, MEMOBJ_HASHMAP);
 	}
 }
 /*
@@ -1443,6 +1688,8 @@ static sxi32 HashmapMergeSort(ph7_hashmap *pMap, ProcNodeCmp xCmp, void *pCmpDat
 	ph7_hashmap_node *a[N_SORT_BUCKET], *p, *pIn;
 	sxu32 i;
 	SyZero(a, sizeof(a));
+	/* The entries are unlinked until the end of the sort */
+	pMap->iFlags |= HASHMAP_BUSY;
 	/* Point to the first inserted entry */
 	pIn = pMap->pFirst;
 	while(pIn) {
@@ -1472,6 +1719,7 @@ static sxi32 HashmapMergeSort(ph7_hashmap *pMap, ProcNodeCmp xCmp, void *pCmpDat
 	p->pNext = 0;
 	/* Reflect the change */
 	pMap->pFirst = p;
+	pMap->iFlags &= ~HASHMAP_BUSY;
 	/* Reset the loop cursor */
 	pMap->pCur = pMap->pFirst;
 	return SXRET_OK;
@@ -1598,12 +1846,13 @@ static sxi32 HashmapCmpCallback3(ph7_hashmap_node *pA, ph7_hashmap_node *pB, voi
  * used-by: [usort(),uasort()]
  */
 static sxi32 HashmapCmpCallback4(ph7_hashmap_node *pA, ph7_hashmap_node *pB, void *pCmpData) {
-	ph7_value sResult, *pCallback;
+	VmCallback *pCallback;
+	ph7_value sResult;
 	ph7_value *pV1, *pV2;
 	ph7_value *apArg[2];  /* Callback arguments */
 	sxi32 rc;
-	/* Point to the desired callback */
-	pCallback = (ph7_value *)pCmpData;
+	/* Point to the prepared callback */
+	pCallback = (VmCallback *)pCmpData;
 	/* initialize the result value */
 	PH7_MemObjInit(pA->pMap->pVm, &sResult);
 	/* Extract nodes values */
@@ -1612,7 +1861,7 @@ static sxi32 HashmapCmpCallback4(ph7_hashmap_node *pA, ph7_hashmap_node *pB, voi
 	apArg[0] = pV1;
 	apArg[1] = pV2;
 	/* Invoke the callback */
-	rc = PH7_VmCallUserFunction(pA->pMap->pVm, pCallback, 2, apArg, &sResult);
+	rc = PH7_VmInvokeCallback(pCallback, apArg, &sResult);
 	if(rc != SXRET_OK) {
 		/* An error occurred while calling user defined function [i.e: not defined] */
 		rc = -1; /* Set a dummy result */
@@ -1673,12 +1922,13 @@ static sxi32 HashmapCmpCallback5(ph7_hashmap_node *pA, ph7_hashmap_node *pB, voi
  * used-by: [uksort()]
  */
 static sxi32 HashmapCmpCallback6(ph7_hashmap_node *pA, ph7_hashmap_node *pB, void *pCmpData) {
-	ph7_value sResult, *pCallback;
+	VmCallback *pCallback;
+	ph7_value sResult;
 	ph7_value *apArg[2];  /* Callback arguments */
 	ph7_value sK1, sK2;
 	sxi32 rc;
-	/* Point to the desired callback */
-	pCallback = (ph7_value *)pCmpData;
+	/* Point to the prepared callback */
+	pCallback = (VmCallback *)pCmpData;
 	/* initialize the result value */
 	PH7_MemObjInit(pA->pMap->pVm, &sResult);
 	PH7_MemObjInit(pA->pMap->pVm, &sK1);
@@ -1692,7 +1942,7 @@ static sxi32 HashmapCmpCallback6(ph7_hashmap_node *pA, ph7_hashmap_node *pB, voi
 	sK1.nIdx = SXU32_HIGH;
 	sK2.nIdx = SXU32_HIGH;
 	/* Invoke the callback */
-	rc = PH7_VmCallUserFunction(pA->pMap->pVm, pCallback, 2, apArg, &sResult);
+	rc = PH7_VmInvokeCallback(pCallback, apArg, &sResult);
 	if(rc != SXRET_OK) {
 		/* An error ocurred while calling user defined function [i.e: not defined] */
 		rc = -1; /* Set a dummy result */
@@ -1743,7 +1993,7 @@ static void HashmapSortRehash(ph7_hashmap *pMap) {
 		}
 		if(p->iType == HASHMAP_BLOB_NODE) {
 			/* Do not maintain index association as requested by the PHP specification */
-			SyBlobRelease(&p->xKey.sKey);
+			PH7_VmReleaseString(pMap->pVm, (const char *)SyBlobData(&p->xKey.sKey));
 			/* Change key type */
 			p->iType = HASHMAP_INT_NODE;
 		}
@@ -1753,6 +2003,8 @@ static void HashmapSortRehash(ph7_hashmap *pMap) {
 		pLast = p;
 		p = p->pPrev; /* Reverse link */
 	}
+	/* Keys are in sequence now */
+	HashmapPack(&(*pMap));
 }
 /*
  * Array functions implementation.
@@ -1787,7 +2039,7 @@ static int ph7_hashmap_sort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
 		sxi32 iCmpFlags = 0;
 		if(nArg > 1) {
@@ -1830,7 +2082,7 @@ static int ph7_hashmap_asort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
 		sxi32 iCmpFlags = 0;
 		if(nArg > 1) {
@@ -1875,7 +2127,7 @@ static int ph7_hashmap_arsort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
 		sxi32 iCmpFlags = 0;
 		if(nArg > 1) {
@@ -1920,7 +2172,7 @@ static int ph7_hashmap_ksort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
 		sxi32 iCmpFlags = 0;
 		if(nArg > 1) {
@@ -1965,7 +2217,7 @@ static int ph7_hashmap_krsort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
 		sxi32 iCmpFlags = 0;
 		if(nArg > 1) {
@@ -2010,7 +2262,7 @@ static int ph7_hashmap_rsort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
 		sxi32 iCmpFlags = 0;
 		if(nArg > 1) {
@@ -2052,20 +2304,24 @@ static int ph7_hashmap_usort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
-		ph7_value *pCallback = 0;
+		VmCallback sCallback, *pCallback = 0;
 		ProcNodeCmp xCmp;
 		xCmp = HashmapCmpCallback4; /* User-defined function as the comparison callback */
-		if(nArg > 1 && ph7_value_is_callable(apArg[1])) {
-			/* Point to the desired callback */
-			pCallback = apArg[1];
+		if(nArg > 1 && (ph7_value_is_callable(apArg[1]) || ph7_value_is_object(apArg[1]))
+				&& PH7_VmPrepareCallback(pCtx->pVm, apArg[1], 2, &sCallback) == SXRET_OK) {
+			/* Resolve the desired callback [or the __invoke method] once for all the comparisons */
+			pCallback = &sCallback;
 		} else {
 			/* Use the default comparison function */
 			xCmp = HashmapCmpCallback1;
 		}
 		/* Do the merge sort */
 		HashmapMergeSort(pMap, xCmp, pCallback);
+		if(pCallback) {
+			PH7_VmReleaseCallback(pCallback);
+		}
 		/* Rehash [Do not maintain index association as requested by the PHP specification] */
 		HashmapSortRehash(pMap);
 	}
@@ -2097,20 +2353,24 @@ static int ph7_hashmap_uasort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
-		ph7_value *pCallback = 0;
+		VmCallback sCallback, *pCallback = 0;
 		ProcNodeCmp xCmp;
 		xCmp = HashmapCmpCallback4; /* User-defined function as the comparison callback */
-		if(nArg > 1 && ph7_value_is_callable(apArg[1])) {
-			/* Point to the desired callback */
-			pCallback = apArg[1];
+		if(nArg > 1 && (ph7_value_is_callable(apArg[1]) || ph7_value_is_object(apArg[1]))
+				&& PH7_VmPrepareCallback(pCtx->pVm, apArg[1], 2, &sCallback) == SXRET_OK) {
+			/* Resolve the desired callback [or the __invoke method] once for all the comparisons */
+			pCallback = &sCallback;
 		} else {
 			/* Use the default comparison function */
 			xCmp = HashmapCmpCallback1;
 		}
 		/* Do the merge sort */
 		HashmapMergeSort(pMap, xCmp, pCallback);
+		if(pCallback) {
+			PH7_VmReleaseCallback(pCallback);
+		}
 		/* Fix the last link broken by the merge */
 		while(pMap->pLast->pPrev) {
 			pMap->pLast = pMap->pLast->pPrev;
@@ -2144,20 +2404,24 @@ static int ph7_hashmap_uksort(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
-		ph7_value *pCallback = 0;
+		VmCallback sCallback, *pCallback = 0;
 		ProcNodeCmp xCmp;
 		xCmp = HashmapCmpCallback6; /* User-defined function as the comparison callback */
-		if(nArg > 1 && ph7_value_is_callable(apArg[1])) {
-			/* Point to the desired callback */
-			pCallback = apArg[1];
+		if(nArg > 1 && (ph7_value_is_callable(apArg[1]) || ph7_value_is_object(apArg[1]))
+				&& PH7_VmPrepareCallback(pCtx->pVm, apArg[1], 2, &sCallback) == SXRET_OK) {
+			/* Resolve the desired callback [or the __invoke method] once for all the comparisons */
+			pCallback = &sCallback;
 		} else {
 			/* Use the default comparison function */
 			xCmp = HashmapCmpCallback2;
 		}
 		/* Do the merge sort */
 		HashmapMergeSort(pMap, xCmp, pCallback);
+		if(pCallback) {
+			PH7_VmReleaseCallback(pCallback);
+		}
 		/* Fix the last link broken by the merge */
 		while(pMap->pLast->pPrev) {
 			pMap->pLast = pMap->pLast->pPrev;
@@ -2186,7 +2450,7 @@ static int ph7_hashmap_shuffle(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry > 1) {
 		/* Do the merge sort */
 		HashmapMergeSort(pMap, HashmapCmpCallback7, 0);
@@ -2285,7 +2549,7 @@ static int ph7_hashmap_pop(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		ph7_result_null(pCtx);
 		return PH7_OK;
 	}
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry < 1) {
 		/* Noting to pop, return NULL */
 		ph7_result_null(pCtx);
@@ -2296,6 +2560,10 @@ static int ph7_hashmap_pop(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		if(pObj) {
 			/* Node value */
 			ph7_result_value(pCtx, pObj);
+			if(pLast->iType == HASHMAP_INT_NODE && pLast->xKey.iKey + 1 == pMap->iNextIdx) {
+				/* Reuse the popped index */
+				pMap->iNextIdx--;
+			}
 			/* Unlink the node */
 			PH7_HashmapUnlinkNode(pLast, TRUE);
 		} else {
@@ -2333,7 +2601,7 @@ static int ph7_hashmap_push(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	/* Start pushing given values */
 	for(i = 1 ; i < nArg ; ++i) {
 		rc = PH7_HashmapInsert(pMap, 0, apArg[i]);
@@ -2367,7 +2635,7 @@ static int ph7_hashmap_shift(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->nEntry < 1) {
 		/* Empty hashmap, return NULL */
 		ph7_result_null(pCtx);
@@ -2399,6 +2667,8 @@ static int ph7_hashmap_shift(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 			pEntry = pEntry->pPrev; /* Reverse link */
 			n--;
 		}
+		/* Switch back to the packed representation if possible */
+		HashmapPack(&(*pMap));
 		/* Reset the cursor */
 		pMap->pCur = pMap->pFirst;
 	}
@@ -2488,7 +2758,8 @@ static int ph7_hashmap_next(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		ph7_result_bool(pCtx, 0);
 		return PH7_OK;
 	}
-	HashmapCurrentValue(&(*pCtx), (ph7_hashmap *)apArg[0]->x.pOther, 1);
+	/* The internal cursor is about to move, make sure it is not shared */
+	HashmapCurrentValue(&(*pCtx), PH7_HashmapSeparate(apArg[0]), 1);
 	return PH7_OK;
 }
 /*
@@ -2513,7 +2784,8 @@ static int ph7_hashmap_prev(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		ph7_result_bool(pCtx, 0);
 		return PH7_OK;
 	}
-	HashmapCurrentValue(&(*pCtx), (ph7_hashmap *)apArg[0]->x.pOther, -1);
+	/* The internal cursor is about to move, make sure it is not shared */
+	HashmapCurrentValue(&(*pCtx), PH7_HashmapSeparate(apArg[0]), -1);
 	return PH7_OK;
 }
 /*
@@ -2537,8 +2809,8 @@ static int ph7_hashmap_end(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		ph7_result_bool(pCtx, 0);
 		return PH7_OK;
 	}
-	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	/* Point to the internal representation of the input hashmap, its cursor is about to move */
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	/* Point to the last node */
 	pMap->pCur = pMap->pLast;
 	/* Return the last node value */
@@ -2566,8 +2838,8 @@ static int ph7_hashmap_reset(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		ph7_result_bool(pCtx, 0);
 		return PH7_OK;
 	}
-	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	/* Point to the internal representation of the input hashmap, its cursor is about to move */
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	/* Point to the first node */
 	pMap->pCur = pMap->pFirst;
 	/* Return the last node value if available */
@@ -2647,8 +2919,8 @@ static int ph7_hashmap_each(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		ph7_result_bool(pCtx, 0);
 		return PH7_OK;
 	}
-	/* Point to the internal representation that describe the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	/* Point to the internal representation that describe the input hashmap, its cursor is about to move */
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	if(pMap->pCur == 0) {
 		/* Cursor does not point to anything, return FALSE */
 		ph7_result_bool(pCtx, 0);
@@ -2931,7 +3203,7 @@ static int ph7_hashmap_erase(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point to the target hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	/* Erase */
 	PH7_HashmapRelease(pMap, FALSE);
 	return PH7_OK;
@@ -3071,7 +3343,7 @@ static int ph7_hashmap_splice(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		return PH7_OK;
 	}
 	/* Point the internal representation of the target array */
-	pSrc = (ph7_hashmap *)apArg[0]->x.pOther;
+	pSrc = PH7_HashmapSeparate(apArg[0]);
 	/* Get the offset */
 	iOfft = ph7_value_to_int(apArg[1]);
 	if(iOfft < 0) {
@@ -3387,6 +3659,7 @@ static int ph7_hashmap_udiff(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	ph7_hashmap_node *pEntry;
 	ph7_hashmap *pSrc, *pMap;
 	ph7_value *pCallback;
+	VmCallback sCallback;
 	ph7_value *pArray;
 	ph7_value *pVal;
 	sxi32 rc;
@@ -3412,6 +3685,8 @@ static int ph7_hashmap_udiff(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	}
 	/* Point to the internal representation of the source hashmap */
 	pSrc = (ph7_hashmap *)apArg[0]->x.pOther;
+	/* Resolve the callback once for all the lookups */
+	PH7_VmPrepareCallback(pCtx->pVm, pCallback, 2, &sCallback);
 	/* Perform the diff */
 	pEntry = pSrc->pFirst;
 	n = pSrc->nEntry;
@@ -3430,7 +3705,7 @@ static int ph7_hashmap_udiff(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 				/* Point to the internal representation of the hashmap */
 				pMap = (ph7_hashmap *)apArg[i]->x.pOther;
 				/* Perform the lookup */
-				rc = HashmapFindValueByCallback(pMap, pVal, pCallback, 0);
+				rc = HashmapFindValueByCallback(pMap, pVal, &sCallback, 0);
 				if(rc == SXRET_OK) {
 					/* Value exist */
 					break;
@@ -3445,6 +3720,7 @@ static int ph7_hashmap_udiff(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		pEntry = pEntry->pPrev; /* Reverse link */
 		n--;
 	}
+	PH7_VmReleaseCallback(&sCallback);
 	/* Return the freshly created array */
 	ph7_result_value(pCtx, pArray);
 	return PH7_OK;
@@ -3508,7 +3784,7 @@ static int ph7_hashmap_diff_assoc(ph7_context *pCtx, int nArg, ph7_value **apArg
 			if(pEntry->iType == HASHMAP_INT_NODE) {
 				rc = HashmapLookupIntKey(pMap, pEntry->xKey.iKey, &pN1);
 			} else {
-				rc = HashmapLookupBlobKey(pMap, SyBlobData(&pEntry->xKey.sKey), SyBlobLength(&pEntry->xKey.sKey), &pN1);
+				rc = HashmapLookupBlobKey(pMap, &pEntry->xKey.sKey, &pN1);
 			}
 			if(rc != SXRET_OK) {
 				/* No such key,break immediately */
@@ -3560,6 +3836,7 @@ static int ph7_hashmap_diff_uassoc(ph7_context *pCtx, int nArg, ph7_value **apAr
 	ph7_hashmap_node *pN1, *pN2, *pEntry;
 	ph7_hashmap *pSrc, *pMap;
 	ph7_value *pCallback;
+	VmCallback sCallback;
 	ph7_value *pArray;
 	ph7_value *pVal;
 	sxi32 rc;
@@ -3585,6 +3862,8 @@ static int ph7_hashmap_diff_uassoc(ph7_context *pCtx, int nArg, ph7_value **apAr
 	}
 	/* Point to the internal representation of the source hashmap */
 	pSrc = (ph7_hashmap *)apArg[0]->x.pOther;
+	/* Resolve the callback once for all the lookups */
+	PH7_VmPrepareCallback(pCtx->pVm, pCallback, 2, &sCallback);
 	/* Perform the diff */
 	pEntry = pSrc->pFirst;
 	n = pSrc->nEntry;
@@ -3604,7 +3883,7 @@ static int ph7_hashmap_diff_uassoc(ph7_context *pCtx, int nArg, ph7_value **apAr
 			if(pEntry->iType == HASHMAP_INT_NODE) {
 				rc = HashmapLookupIntKey(pMap, pEntry->xKey.iKey, &pN1);
 			} else {
-				rc = HashmapLookupBlobKey(pMap, SyBlobData(&pEntry->xKey.sKey), SyBlobLength(&pEntry->xKey.sKey), &pN1);
+				rc = HashmapLookupBlobKey(pMap, &pEntry->xKey.sKey, &pN1);
 			}
 			if(rc != SXRET_OK) {
 				/* No such key,break immediately */
@@ -3614,7 +3893,7 @@ static int ph7_hashmap_diff_uassoc(ph7_context *pCtx, int nArg, ph7_value **apAr
 			pVal = HashmapExtractNodeValue(pEntry);
 			if(pVal) {
 				/* Invoke the user callback */
-				rc = HashmapFindValueByCallback(pMap, pVal, pCallback, &pN2);
+				rc = HashmapFindValueByCallback(pMap, pVal, &sCallback, &pN2);
 				if(rc != SXRET_OK || pN1 != pN2) {
 					/* Value does not exist */
 					break;
@@ -3629,6 +3908,7 @@ static int ph7_hashmap_diff_uassoc(ph7_context *pCtx, int nArg, ph7_value **apAr
 		pEntry = pEntry->pPrev; /* Reverse link */
 		n--;
 	}
+	PH7_VmReleaseCallback(&sCallback);
 	/* Return the freshly created array */
 	ph7_result_value(pCtx, pArray);
 	return PH7_OK;
@@ -3689,7 +3969,7 @@ static int ph7_hashmap_diff_key(ph7_context *pCtx, int nArg, ph7_value **apArg)
 			if(pEntry->iType == HASHMAP_BLOB_NODE) {
 				SyBlob *pKey = &pEntry->xKey.sKey;
 				/* Blob lookup */
-				rc = HashmapLookupBlobKey(pMap, SyBlobData(pKey), SyBlobLength(pKey), 0);
+				rc = HashmapLookupBlobKey(pMap, pKey, 0);
 			} else {
 				/* Int lookup */
 				rc = HashmapLookupIntKey(pMap, pEntry->xKey.iKey, 0);
@@ -3852,7 +4132,7 @@ static int ph7_hashmap_intersect_assoc(ph7_context *pCtx, int nArg, ph7_value **
 				if(pEntry->iType == HASHMAP_INT_NODE) {
 					rc = HashmapLookupIntKey(pMap, pEntry->xKey.iKey, &pN1);
 				} else {
-					rc = HashmapLookupBlobKey(pMap, SyBlobData(&pEntry->xKey.sKey), SyBlobLength(&pEntry->xKey.sKey), &pN1);
+					rc = HashmapLookupBlobKey(pMap, &pEntry->xKey.sKey, &pN1);
 				}
 				if(rc != SXRET_OK) {
 					/* No such key,break immediately */
@@ -3934,7 +4214,7 @@ static int ph7_hashmap_intersect_key(ph7_context *pCtx, int nArg, ph7_value **ap
 			if(pEntry->iType == HASHMAP_BLOB_NODE) {
 				SyBlob *pKey = &pEntry->xKey.sKey;
 				/* Blob lookup */
-				rc = HashmapLookupBlobKey(pMap, SyBlobData(pKey), SyBlobLength(pKey), 0);
+				rc = HashmapLookupBlobKey(pMap, pKey, 0);
 			} else {
 				/* Int key */
 				rc = HashmapLookupIntKey(pMap, pEntry->xKey.iKey, 0);
@@ -3981,6 +4261,7 @@ static int ph7_hashmap_uintersect(ph7_context *pCtx, int nArg, ph7_value **apArg
 	ph7_hashmap_node *pEntry;
 	ph7_hashmap *pSrc, *pMap;
 	ph7_value *pCallback;
+	VmCallback sCallback;
 	ph7_value *pArray;
 	ph7_value *pVal;
 	sxi32 rc;
@@ -4006,6 +4287,8 @@ static int ph7_hashmap_uintersect(ph7_context *pCtx, int nArg, ph7_value **apArg
 	}
 	/* Point to the internal representation of the source hashmap */
 	pSrc = (ph7_hashmap *)apArg[0]->x.pOther;
+	/* Resolve the callback once for all the lookups */
+	PH7_VmPrepareCallback(pCtx->pVm, pCallback, 2, &sCallback);
 	/* Perform the intersection */
 	pEntry = pSrc->pFirst;
 	n = pSrc->nEntry;
@@ -4024,7 +4307,7 @@ static int ph7_hashmap_uintersect(ph7_context *pCtx, int nArg, ph7_value **apArg
 				/* Point to the internal representation of the hashmap */
 				pMap = (ph7_hashmap *)apArg[i]->x.pOther;
 				/* Perform the lookup */
-				rc = HashmapFindValueByCallback(pMap, pVal, pCallback, 0);
+				rc = HashmapFindValueByCallback(pMap, pVal, &sCallback, 0);
 				if(rc != SXRET_OK) {
 					/* Value does not exist */
 					break;
@@ -4039,6 +4322,7 @@ static int ph7_hashmap_uintersect(ph7_context *pCtx, int nArg, ph7_value **apArg
 		pEntry = pEntry->pPrev; /* Reverse link */
 		n--;
 	}
+	PH7_VmReleaseCallback(&sCallback);
 	/* Return the freshly created array */
 	ph7_result_value(pCtx, pArray);
 	return PH7_OK;
@@ -4888,6 +5172,7 @@ static int ph7_hashmap_replace(ph7_context *pCtx, int nArg, ph7_value **apArg) {
  */
 static int ph7_hashmap_filter(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	ph7_hashmap_node *pEntry;
+	VmCallback sCallback;
 	ph7_hashmap *pMap;
 	ph7_value *pArray;
 	ph7_value sResult;   /* Callback result */
@@ -4911,6 +5196,10 @@ static int ph7_hashmap_filter(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	pEntry = pMap->pFirst;
 	PH7_MemObjInit(pMap->pVm, &sResult);
 	sResult.nIdx = SXU32_HIGH; /* Mark as constant */
+	if(nArg > 1) {
+		/* Resolve the given callback once for all the entries */
+		PH7_VmPrepareCallback(pMap->pVm, apArg[1], 1, &sCallback);
+	}
 	/* Perform the requested operation */
 	for(n = 0 ; n < pMap->nEntry ; n++) {
 		/* Extract node value */
@@ -4918,7 +5207,7 @@ static int ph7_hashmap_filter(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		if(nArg > 1 && pValue) {
 			/* Invoke the given callback */
 			keep = FALSE;
-			rc = PH7_VmCallUserFunction(pMap->pVm, apArg[1], 1, &pValue, &sResult);
+			rc = PH7_VmInvokeCallback(&sCallback, &pValue, &sResult);
 			if(rc == SXRET_OK) {
 				/* Perform a boolean cast */
 				keep = ph7_value_to_bool(&sResult);
@@ -4935,6 +5224,9 @@ static int ph7_hashmap_filter(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		/* Point to the next entry */
 		pEntry = pEntry->pPrev; /* Reverse link */
 	}
+	if(nArg > 1) {
+		PH7_VmReleaseCallback(&sCallback);
+	}
 	ph7_result_value(pCtx, pArray);
 	return PH7_OK;
 }
@@ -4955,6 +5247,7 @@ static int ph7_hashmap_filter(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 static int ph7_hashmap_map(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	ph7_value *pArray, *pValue, sKey, sResult;
 	ph7_hashmap_node *pEntry;
+	VmCallback sCallback;
 	ph7_hashmap *pMap;
 	sxu32 n;
 	if(nArg < 2 || !ph7_value_is_array(apArg[1])) {
@@ -4974,6 +5267,8 @@ static int ph7_hashmap_map(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	PH7_MemObjInit(pMap->pVm, &sKey);
 	sResult.nIdx = SXU32_HIGH; /* Mark as constant */
 	sKey.nIdx    = SXU32_HIGH; /* Mark as constant */
+	/* Resolve the supplied callback once for all the entries */
+	PH7_VmPrepareCallback(pMap->pVm, apArg[0], 1, &sCallback);
 	/* Perform the requested operation */
 	pEntry = pMap->pFirst;
 	for(n = 0 ; n < pMap->nEntry ; n++) {
@@ -4982,7 +5277,7 @@ static int ph7_hashmap_map(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		if(pValue) {
 			sxi32 rc;
 			/* Invoke the supplied callback */
-			rc = PH7_VmCallUserFunction(pMap->pVm, apArg[0], 1, &pValue, &sResult);
+			rc = PH7_VmInvokeCallback(&sCallback, &pValue, &sResult);
 			/* Extract the node key */
 			PH7_HashmapExtractNodeKey(pEntry, &sKey);
 			if(rc != SXRET_OK) {
@@ -4998,6 +5293,7 @@ static int ph7_hashmap_map(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		/* Point to the next entry */
 		pEntry = pEntry->pPrev; /* Reverse link */
 	}
+	PH7_VmReleaseCallback(&sCallback);
 	ph7_result_value(pCtx, pArray);
 	return PH7_OK;
 }
@@ -5018,6 +5314,8 @@ static int ph7_hashmap_map(ph7_context *pCtx, int nArg, ph7_value **apArg) {
  */
 static int ph7_hashmap_reduce(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	ph7_hashmap_node *pEntry;
+	VmCallback sCallback;
+	ph7_value *apCbArg[2];
 	ph7_hashmap *pMap;
 	ph7_value *pValue;
 	ph7_value sResult;
@@ -5036,16 +5334,23 @@ static int ph7_hashmap_reduce(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		/* Set the initial value */
 		PH7_MemObjLoad(apArg[2], &sResult);
 	}
+	/* Resolve the supplied callback once for all the entries */
+	PH7_VmPrepareCallback(pMap->pVm, apArg[1], 2, &sCallback);
 	/* Perform the requested operation */
 	pEntry = pMap->pFirst;
 	for(n = 0 ; n < pMap->nEntry ; n++) {
 		/* Extract the node value */
 		pValue = HashmapExtractNodeValue(pEntry);
-		/* Invoke the supplied callback */
-		PH7_VmCallUserFunctionAp(pMap->pVm, apArg[1], &sResult, &sResult, pValue, 0);
+		if(pValue) {
+			/* Invoke the supplied callback */
+			apCbArg[0] = &sResult;
+			apCbArg[1] = pValue;
+			PH7_VmInvokeCallback(&sCallback, apCbArg, &sResult);
+		}
 		/* Point to the next entry */
 		pEntry = pEntry->pPrev; /* Reverse link */
 	}
+	PH7_VmReleaseCallback(&sCallback);
 	ph7_result_value(pCtx, &sResult); /* Will make it's own copy */
 	PH7_MemObjRelease(&sResult);
 	return PH7_OK;
@@ -5072,6 +5377,8 @@ static int ph7_hashmap_reduce(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 static int ph7_hashmap_walk(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	ph7_value *pValue, *pUserData, sKey;
 	ph7_hashmap_node *pEntry;
+	VmCallback sCallback;
+	ph7_value *apCbArg[3];
 	ph7_hashmap *pMap;
 	sxi32 rc;
 	sxu32 n;
@@ -5082,9 +5389,13 @@ static int ph7_hashmap_walk(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	}
 	pUserData = nArg > 2 ? apArg[2] : 0;
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
 	PH7_MemObjInit(pMap->pVm, &sKey);
 	sKey.nIdx = SXU32_HIGH; /* Mark as constant */
+	/* Resolve the supplied callback once for all the entries */
+	PH7_VmPrepareCallback(pMap->pVm, apArg[1], pUserData ? 3 : 2, &sCallback);
+	apCbArg[1] = &sKey;
+	apCbArg[2] = pUserData;
 	/* Perform the desired operation */
 	pEntry = pMap->pFirst;
 	for(n = 0 ; n < pMap->nEntry ; n++) {
@@ -5094,10 +5405,12 @@ static int ph7_hashmap_walk(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 			/* Extract the entry key */
 			PH7_HashmapExtractNodeKey(pEntry, &sKey);
 			/* Invoke the supplied callback */
-			rc = PH7_VmCallUserFunctionAp(pMap->pVm, apArg[1], 0, pValue, &sKey, pUserData, 0);
+			apCbArg[0] = pValue;
+			rc = PH7_VmInvokeCallback(&sCallback, apCbArg, 0);
 			PH7_MemObjRelease(&sKey);
 			if(rc != SXRET_OK) {
 				/* An error ocurred while invoking the supplied callback [i.e: not defined] */
+				PH7_VmReleaseCallback(&sCallback);
 				ph7_result_bool(pCtx, 0); /* return FALSE */
 				return PH7_OK;
 			}
@@ -5105,6 +5418,7 @@ static int ph7_hashmap_walk(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 		/* Point to the next entry */
 		pEntry = pEntry->pPrev; /* Reverse link */
 	}
+	PH7_VmReleaseCallback(&sCallback);
 	/* All done, return TRUE */
 	ph7_result_bool(pCtx, 1);
 	return PH7_OK;
@@ -5114,13 +5428,14 @@ static int ph7_hashmap_walk(ph7_context *pCtx, int nArg, ph7_value **apArg) {
  * Refer to the [array_walk_recursive()] implementation for more information.
  */
 static int HashmapWalkRecursive(
-	ph7_hashmap *pMap,    /* Target hashmap */
-	ph7_value *pCallback, /* User callback */
-	ph7_value *pUserData, /* Callback private data */
-	int iNest             /* Nesting level */
+	ph7_hashmap *pMap,     /* Target hashmap */
+	VmCallback *pCallback, /* Prepared user callback */
+	ph7_value *pUserData,  /* Callback private data */
+	int iNest              /* Nesting level */
 ) {
 	ph7_hashmap_node *pEntry;
 	ph7_value *pValue, sKey;
+	ph7_value *apCbArg[3];
 	sxi32 rc;
 	sxu32 n;
 	/* Iterate throw hashmap entries */
@@ -5135,14 +5450,17 @@ static int HashmapWalkRecursive(
 				if(iNest < 32) {
 					/* Recurse */
 					iNest++;
-					HashmapWalkRecursive((ph7_hashmap *)pValue->x.pOther, pCallback, pUserData, iNest);
+					HashmapWalkRecursive(PH7_HashmapSeparate(pValue), pCallback, pUserData, iNest);
 					iNest--;
 				}
 			} else {
 				/* Extract the node key */
 				PH7_HashmapExtractNodeKey(pEntry, &sKey);
 				/* Invoke the supplied callback */
-				rc = PH7_VmCallUserFunctionAp(pMap->pVm, pCallback, 0, pValue, &sKey, pUserData, 0);
+				apCbArg[0] = pValue;
+				apCbArg[1] = &sKey;
+				apCbArg[2] = pUserData;
+				rc = PH7_VmInvokeCallback(pCallback, apCbArg, 0);
 				PH7_MemObjRelease(&sKey);
 				if(rc != SXRET_OK) {
 					return rc;
@@ -5174,6 +5492,7 @@ static int HashmapWalkRecursive(
  *  Returns TRUE on success or FALSE on failure.
  */
 static int ph7_hashmap_walk_recursive(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	VmCallback sCallback;
 	ph7_hashmap *pMap;
 	sxi32 rc;
 	if(nArg < 2 || !ph7_value_is_array(apArg[0])) {
@@ -5182,9 +5501,12 @@ static int ph7_hashmap_walk_recursive(ph7_context *pCtx, int nArg, ph7_value **a
 		return PH7_OK;
 	}
 	/* Point to the internal representation of the input hashmap */
-	pMap = (ph7_hashmap *)apArg[0]->x.pOther;
+	pMap = PH7_HashmapSeparate(apArg[0]);
+	/* Resolve the supplied callback once for all the nested entries */
+	PH7_VmPrepareCallback(pMap->pVm, apArg[1], nArg > 2 ? 3 : 2, &sCallback);
 	/* Perform the desired operation */
-	rc = HashmapWalkRecursive(pMap, apArg[1], nArg > 2 ? apArg[2] : 0, 0);
+	rc = HashmapWalkRecursive(pMap, &sCallback, nArg > 2 ? apArg[2] : 0, 0);
+	PH7_VmReleaseCallback(&sCallback);
 	/* All done */
 	ph7_result_bool(pCtx, rc == SXRET_OK);
 	return PH7_OK;
@@ -40,6 +40,28 @@ PH7_PRIVATE sxi32 SySetPut(SySet *pSet, const void *pItem) {
 	pSet->nUsed++;
 	return SXRET_OK;
 }
+PH7_PRIVATE sxi32 SySetReserve(SySet *pSet, sxu32 nItem) {
+	void *pNew;
+	sxu32 nSize;
+	if(pSet->nUsed + nItem <= pSet->nSize) {
+		/* Enough room */
+		return SXRET_OK;
+	}
+	if(pSet->pAllocator == 0) {
+		return  SXERR_LOCKED;
+	}
+	nSize = pSet->nSize > 0 ? pSet->nSize << 1 : 4;
+	if(nSize < pSet->nUsed + nItem) {
+		nSize = pSet->nUsed + nItem;
+	}
+	pNew = SyMemBackendRealloc(pSet->pAllocator, pSet->pBase, pSet->eSize * nSize);
+	if(pNew == 0) {
+		return SXERR_MEM;
+	}
+	pSet->pBase = pNew;
+	pSet->nSize = nSize;
+	return SXRET_OK;
+}
 PH7_PRIVATE sxi32 SySetAlloc(SySet *pSet, sxi32 nItem) {
 	if(pSet->nSize > 0) {
 		return SXERR_LOCKED;
@@ -186,6 +208,29 @@ PH7_PRIVATE sxi32 SyHashRelease(SyHash *pHash) {
 	pHash->pAllocator = 0;
 	return SXRET_OK;
 }
+/*
+ * Remove all the entries but keep the table, so it can be reused
+ * without being initialized again.
+ */
+PH7_PRIVATE sxi32 SyHashReset(SyHash *pHash) {
+	SyHashEntry_Pr *pEntry, *pNext;
+	if(INVALID_HASH(pHash)) {
+		return SXERR_EMPTY;
+	}
+	if(pHash->nEntry < 1) {
+		return SXRET_OK;
+	}
+	pEntry = pHash->pList;
+	while(pHash->nEntry > 0) {
+		pNext = pEntry->pNext;
+		SyMemBackendPoolFree(pHash->pAllocator, pEntry);
+		pEntry = pNext;
+		pHash->nEntry--;
+	}
+	SyZero((void *)pHash->apBucket, sizeof(SyHashEntry_Pr *) * pHash->nBucketSize);
+	pHash->pCurrent = pHash->pList = 0;
+	return SXRET_OK;
+}
 static SyHashEntry_Pr *HashGetEntry(SyHash *pHash, const void *pKey, sxu32 nKeyLen) {
 	SyHashEntry_Pr *pEntry;
 	sxu32 nHash;
@@ -283,6 +328,20 @@ PH7_PRIVATE SyHashEntry *SyHashGetNextEntry(SyHash *pHash) {
 	/* Return the current entry */
 	return (SyHashEntry *)pEntry;
 }
+/*
+ * Return the entry following pEntry in the linear traversal list, or the
+ * first entry if pEntry is NULL. Unlike SyHashGetNextEntry(), the hashtable
+ * is left untouched so that it can be walked by several readers at once.
+ */
+PH7_PRIVATE SyHashEntry *SyHashNextEntry(SyHash *pHash, SyHashEntry *pEntry) {
+	if(INVALID_HASH(pHash)) {
+		return 0;
+	}
+	if(pEntry == 0) {
+		return (SyHashEntry *)pHash->pList;
+	}
+	return (SyHashEntry *)((SyHashEntry_Pr *)pEntry)->pNext;
+}
 PH7_PRIVATE sxi32 SyHashForEach(SyHash *pHash, sxi32(*xStep)(SyHashEntry *, void *), void *pUserData) {
 	SyHashEntry_Pr *pEntry;
 	sxi32 rc;
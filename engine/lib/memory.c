@@ -118,20 +118,72 @@ static const SyMemMethods sOSAllocMethods = {
 	0,
 	0
 };
+/*
+ * Heap counters are shared by a backend and all the backends created from it,
+ * which do not share its mutex [i.e: SyMemBackendInitFromParent()], so they
+ * are updated atomically once the heap is used by several threads.
+ */
+#if defined(__WINNT__) && !defined(__GNUC__)
+	#define SyHeapLoad(PTR)          ((sxu64)InterlockedCompareExchange64((volatile LONG64 *)(PTR), 0, 0))
+	#define SyHeapAdd(PTR, N)        ((sxu64)InterlockedExchangeAdd64((volatile LONG64 *)(PTR), (LONG64)(N)) + (N))
+	#define SyHeapSub(PTR, N)        InterlockedExchangeAdd64((volatile LONG64 *)(PTR), -(LONG64)(N))
+	#define SyHeapCas(PTR, OLD, NEW) (InterlockedCompareExchange64((volatile LONG64 *)(PTR), (LONG64)(NEW), (LONG64)(OLD)) == (LONG64)(OLD))
+#else
+	#define SyHeapLoad(PTR)          __atomic_load_n(PTR, __ATOMIC_RELAXED)
+	#define SyHeapAdd(PTR, N)        __atomic_add_fetch(PTR, N, __ATOMIC_RELAXED)
+	#define SyHeapSub(PTR, N)        __atomic_sub_fetch(PTR, N, __ATOMIC_RELAXED)
+	#define SyHeapCas(PTR, OLD, NEW) __sync_bool_compare_and_swap(PTR, OLD, NEW)
+#endif
 static sxi32 MemBackendCalculate(SyMemBackend *pBackend, sxi32 nBytes) {
-	if(pBackend->pHeap->nLimit && (pBackend->pHeap->nSize + nBytes > pBackend->pHeap->nLimit - 10240)) {
+	SyMemHeap *pHeap = pBackend->pHeap;
+	sxu64 nSize, nPeak;
+	nSize = pHeap->bThreadSafe ? SyHeapLoad(&pHeap->nSize) : pHeap->nSize;
+	if(pHeap->nLimit && (nSize + nBytes > pHeap->nLimit - 10240)) {
 		if(pBackend->xMemError) {
 			pBackend->xMemError(pBackend->pUserData);
 		}
 		return SXERR_MEM;
 	}
-	pBackend->pHeap->nSize += nBytes;
-	if(pBackend->pHeap->nSize > pBackend->pHeap->nPeak) {
-		pBackend->pHeap->nPeak = pBackend->pHeap->nSize;
+	if(pHeap->bThreadSafe) {
+		nSize = SyHeapAdd(&pHeap->nSize, (sxu64)nBytes);
+		for(;;) {
+			nPeak = SyHeapLoad(&pHeap->nPeak);
+			if(nSize <= nPeak || SyHeapCas(&pHeap->nPeak, nPeak, nSize)) {
+				break;
+			}
+		}
+		return SXRET_OK;
+	}
+	pHeap->nSize += nBytes;
+	if(pHeap->nSize > pHeap->nPeak) {
+		pHeap->nPeak = pHeap->nSize;
 	}
 	return SXRET_OK;
 }
-static void *MemBackendAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
+/*
+ * Charge a chunk to the given accounting tag. Once the tag goes above its soft
+ * limit, it is flagged so the VM raises an exception at the next opportunity.
+ */
+static void MemTagCharge(SyMemBackend *pBackend, sxu32 iTag, sxu32 nBytes) {
+	SyMemTag *pTag = &pBackend->aTag[iTag];
+	pTag->nSize += nBytes;
+	if(pTag->nSize > pTag->nPeak) {
+		pTag->nPeak = pTag->nSize;
+	}
+	if(pTag->nLimit && pTag->nSize > pTag->nLimit && (pBackend->iTagOver & (1 << iTag)) == 0) {
+		pBackend->iTagOver |= 1 << iTag;
+		pBackend->iTagPending |= 1 << iTag;
+	}
+}
+static void MemTagCredit(SyMemBackend *pBackend, sxu32 iTag, sxu32 nBytes) {
+	SyMemTag *pTag = &pBackend->aTag[iTag];
+	pTag->nSize -= nBytes;
+	if(pTag->nSize <= pTag->nLimit) {
+		/* Back below the limit, raise again when crossing it next time */
+		pBackend->iTagOver &= ~(1 << iTag);
+	}
+}
+static void *MemBackendBlockAlloc(SyMemBackend *pBackend, sxu32 nBytes, sxu32 iTag) {
 	SyMemBlock *pBlock;
 	sxi32 nRetry = 0;
 	/* Append an extra block so we can tracks allocated chunks and avoid memory
@@ -156,10 +208,220 @@ static void *MemBackendAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
 	pBlock->pNext = pBlock->pPrev = 0;
 	/* Link to the list of already tracked blocks */
 	MACRO_LD_PUSH(pBackend->pBlocks, pBlock);
+	pBlock->iTag = iTag;
 	pBlock->nGuard = SXMEM_BACKEND_MAGIC;
 	pBackend->nBlock++;
+	if(iTag != SXMEM_TAG_NONE) {
+		MemTagCharge(&(*pBackend), iTag, pBackend->pMethods->xChunkSize(pBlock));
+	}
 	return (void *)&pBlock[1];
 }
+static sxi32 MemBackendBlockFree(SyMemBackend *pBackend, void *pChunk) {
+	SyMemBlock *pBlock;
+	pBlock = (SyMemBlock *)(((char *)pChunk) - sizeof(SyMemBlock));
+	if(pBlock->nGuard != SXMEM_BACKEND_MAGIC) {
+		return SXERR_CORRUPT;
+	}
+	/* Unlink from the list of active blocks */
+	if(pBackend->nBlock > 0) {
+		/* Release the block */
+		/* Mark as stale block */
+		pBlock->nGuard = 0x635B;
+		MACRO_LD_REMOVE(pBackend->pBlocks, pBlock);
+		pBackend->nBlock--;
+		if(pBlock->iTag != SXMEM_TAG_NONE) {
+			MemTagCredit(&(*pBackend), pBlock->iTag, pBackend->pMethods->xChunkSize(pBlock));
+		}
+		/* Release the heap */
+		if(pBackend->pHeap->bThreadSafe) {
+			SyHeapSub(&pBackend->pHeap->nSize, (sxu64)pBackend->pMethods->xChunkSize(pBlock));
+		} else {
+			pBackend->pHeap->nSize -= pBackend->pMethods->xChunkSize(pBlock);
+		}
+		pBackend->pMethods->xFree(pBlock);
+	}
+	return SXRET_OK;
+}
+/*
+ * Arena mode
+ * The slabs and pool buckets of a backend in arena mode are carved out of
+ * large regions by bumping a cursor rather than allocated one by one. Since
+ * the chunks they hold are recycled anyway, a region is never given back
+ * before the whole backend is released or recycled, which takes a handful
+ * of calls to the underlying allocator.
+ */
+#define SXMEM_ARENA_MINSIZE		65536
+#define SXMEM_ARENA_MAXSIZE		4194304
+#define SXMEM_ARENA_NGROW		6
+static void *MemArenaAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
+	SyMemArena *pArena;
+	sxu32 nRegion;
+	char *zChunk;
+	/* Keep the chunks 8 bytes aligned */
+	nBytes = (nBytes + 7) & ~(sxu32)7;
+	if((sxu32)(pBackend->zArenaEnd - pBackend->zArena) < nBytes) {
+		pArena = pBackend->pArenaFree;
+		if(pArena && pArena->nSize >= nBytes) {
+			/* Reuse a region kept by SyMemBackendRecycle() */
+			pBackend->pArenaFree = pArena->pNext;
+		} else {
+			/* Each new region is twice as large as the previous one */
+			nRegion = SXMEM_ARENA_MAXSIZE;
+			if(pBackend->nArena < SXMEM_ARENA_NGROW) {
+				nRegion = SXMEM_ARENA_MINSIZE << pBackend->nArena;
+			}
+			if(nRegion < nBytes) {
+				nRegion = nBytes;
+			}
+			if(MemBackendCalculate(pBackend, nRegion + sizeof(SyMemArena)) != SXRET_OK) {
+				return 0;
+			}
+			pArena = (SyMemArena *)pBackend->pMethods->xAlloc(nRegion + sizeof(SyMemArena));
+			if(pArena == 0) {
+				return 0;
+			}
+			pArena->nSize = nRegion;
+			pBackend->nArena++;
+		}
+		/* The tail of the previous region, if any, is left unused */
+		pArena->pNext = pBackend->pArena;
+		pBackend->pArena = pArena;
+		pBackend->zArena = (char *)&pArena[1];
+		pBackend->zArenaEnd = &pBackend->zArena[pArena->nSize];
+	}
+	zChunk = pBackend->zArena;
+	pBackend->zArena += nBytes;
+	return (void *)zChunk;
+}
+/*
+ * Slab allocator
+ * Each backend keeps one list of slabs per size class, so that the small
+ * objects the engine allocates the most [i.e: ph7_value, ph7_hashmap_node,
+ * VmFrame, SyHashEntry_Pr, ph7_class_instance] get a chunk of their exact
+ * size without calling the underlying allocator. Since a virtual machine owns
+ * an unshared backend, these lists act as a per-thread cache and its slabs are
+ * released all at once with the backend.
+ */
+#define SXMEM_SLAB_MAGIC		0x5AB1C0DE
+#define SXMEM_SLAB_MINSIZE		1024
+#define SXMEM_SLAB_MAXSIZE		16384
+#define SXMEM_SLAB_NGROW		4
+/* Guard of a released slab or pool chunk */
+#define SXMEM_CHUNK_STALE		0x5AB1DEAD
+/* Chunk size of the given class */
+#define SXMEM_SLAB_CHUNK(ICLASS)	(((ICLASS) + 1) << SXMEM_SLAB_INCR)
+/* Extract the guard written right before an allocated chunk */
+#define SXMEM_CHUNK_GUARD(CHUNK)	(((const sxu32 *)(CHUNK))[-1])
+static SyMemSlab *MemSlabNew(SyMemBackend *pBackend, sxu32 iClass) {
+	SyMemSlabClass *pClass = &pBackend->aSlab[iClass];
+	SyMemSlab *pSlab;
+	sxu32 nBytes;
+	/* Each new slab of a class is twice as large as the previous one, so
+	 * short-lived virtual machines only touch a small amount of memory.
+	 */
+	nBytes = SXMEM_SLAB_MAXSIZE;
+	if(pClass->nSlab < SXMEM_SLAB_NGROW) {
+		nBytes = SXMEM_SLAB_MINSIZE << pClass->nSlab;
+	}
+	if(nBytes < sizeof(SyMemSlab) + sizeof(SyMemHeader) + SXMEM_SLAB_CHUNK(iClass)) {
+		nBytes = sizeof(SyMemSlab) + sizeof(SyMemHeader) + SXMEM_SLAB_CHUNK(iClass);
+	}
+	if(pBackend->bArena) {
+		pSlab = (SyMemSlab *)MemArenaAlloc(&(*pBackend), nBytes);
+	} else {
+		pSlab = (SyMemSlab *)MemBackendBlockAlloc(&(*pBackend), nBytes, SXMEM_TAG_NONE);
+	}
+	if(pSlab == 0) {
+		return 0;
+	}
+	pSlab->pNext = pSlab->pPrev = 0;
+	pSlab->pBackend = pBackend;
+	pSlab->pFree = 0;
+	pSlab->nCarved = pSlab->nUsed = 0;
+	/* Chunks are carved on demand, so the slab is not touched at once */
+	pSlab->nChunk = (nBytes - sizeof(SyMemSlab)) / (sizeof(SyMemHeader) + SXMEM_SLAB_CHUNK(iClass));
+	pSlab->iClass = iClass;
+	MACRO_LD_PUSH(pClass->pSlab, pSlab);
+	pClass->nSlab++;
+	pClass->nEmpty++;
+	return pSlab;
+}
+static void *MemBackendSlabAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
+	SyMemSlabClass *pClass;
+	SyMemHeader *pHeader;
+	SyMemSlab *pSlab;
+	sxu32 iClass;
+	iClass = nBytes > 0 ? (nBytes - 1) >> SXMEM_SLAB_INCR : 0;
+	pClass = &pBackend->aSlab[iClass];
+	pSlab = pClass->pSlab;
+	if(pSlab == 0) {
+		pSlab = MemSlabNew(&(*pBackend), iClass);
+		if(pSlab == 0) {
+			return 0;
+		}
+	}
+	if(pSlab->pFree) {
+		/* Reuse a released chunk */
+		pHeader = &((SyMemHeader *)pSlab->pFree)[-1];
+		pSlab->pFree = *(void **)pSlab->pFree;
+	} else {
+		/* Carve a new chunk */
+		pHeader = (SyMemHeader *)&((char *)&pSlab[1])[pSlab->nCarved * (sizeof(SyMemHeader) + SXMEM_SLAB_CHUNK(iClass))];
+		pHeader->nBucket = (sxu32)((char *)pHeader - (char *)pSlab);
+		pSlab->nCarved++;
+	}
+	pHeader->nGuard = SXMEM_SLAB_MAGIC;
+	pHeader->iTag = (sxu16)pBackend->iTag;
+	MemTagCharge(&(*pBackend), pBackend->iTag, sizeof(SyMemHeader) + SXMEM_SLAB_CHUNK(iClass));
+	if(pSlab->nUsed == 0) {
+		pClass->nEmpty--;
+	}
+	pSlab->nUsed++;
+	if(pSlab->nUsed >= pSlab->nChunk) {
+		/* Full slab, unlink from the list of its class */
+		MACRO_LD_REMOVE(pClass->pSlab, pSlab);
+		pSlab->pNext = pSlab->pPrev = 0;
+	}
+	return (void *)&pHeader[1];
+}
+static sxi32 MemBackendSlabFree(void *pChunk) {
+	SyMemSlabClass *pClass;
+	SyMemHeader *pHeader;
+	SyMemSlab *pSlab;
+	pHeader = &((SyMemHeader *)pChunk)[-1];
+	if(pHeader->nGuard != SXMEM_SLAB_MAGIC) {
+		return SXERR_CORRUPT;
+	}
+	/* The chunk goes back to the slab it was carved from */
+	pSlab = (SyMemSlab *)&((char *)pHeader)[-(sxi32)pHeader->nBucket];
+	pClass = &pSlab->pBackend->aSlab[pSlab->iClass];
+	pHeader->nGuard = SXMEM_CHUNK_STALE;
+	MemTagCredit(pSlab->pBackend, pHeader->iTag, sizeof(SyMemHeader) + SXMEM_SLAB_CHUNK(pSlab->iClass));
+	*(void **)pChunk = pSlab->pFree;
+	pSlab->pFree = pChunk;
+	if(pSlab->nUsed >= pSlab->nChunk) {
+		/* The slab has a free chunk again */
+		MACRO_LD_PUSH(pClass->pSlab, pSlab);
+	}
+	pSlab->nUsed--;
+	if(pSlab->nUsed == 0) {
+		if(pClass->nEmpty > 0 && !pSlab->pBackend->bArena) {
+			/* Keep a single empty slab per class, give this one back */
+			MACRO_LD_REMOVE(pClass->pSlab, pSlab);
+			pClass->nSlab--;
+			MemBackendBlockFree(pSlab->pBackend, pSlab);
+		} else {
+			pClass->nEmpty++;
+		}
+	}
+	return SXRET_OK;
+}
+static void *MemBackendAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
+	if(nBytes <= SXMEM_SLAB_MAXALLOC) {
+		return MemBackendSlabAlloc(&(*pBackend), nBytes);
+	}
+	return MemBackendBlockAlloc(&(*pBackend), nBytes, pBackend->iTag);
+}
 PH7_PRIVATE void *SyMemBackendAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
 	void *pChunk;
 	if(SXMEM_BACKEND_CORRUPT(pBackend)) {
@@ -174,13 +436,44 @@ PH7_PRIVATE void *SyMemBackendAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
 	}
 	return pChunk;
 }
+/*
+ * Move a slab chunk to a larger one allocated with the given method.
+ */
+static void *MemSlabRealloc(SyMemBackend *pBackend, void *pOld, sxu32 nBytes, void *(*xAlloc)(SyMemBackend *, sxu32)) {
+	SyMemHeader *pHeader;
+	SyMemSlab *pSlab;
+	sxu32 nOld, iTag;
+	void *pNew;
+	pHeader = &((SyMemHeader *)pOld)[-1];
+	pSlab = (SyMemSlab *)&((char *)pHeader)[-(sxi32)pHeader->nBucket];
+	nOld = SXMEM_SLAB_CHUNK(pSlab->iClass);
+	if(nBytes <= nOld) {
+		/* The old chunk can honor the requested size */
+		return pOld;
+	}
+	/* The new chunk is charged to the same tag */
+	SyMemBackendPushTag(pBackend, pHeader->iTag, iTag);
+	pNew = xAlloc(&(*pBackend), nBytes);
+	SyMemBackendPopTag(pBackend, iTag);
+	if(pNew == 0) {
+		return 0;
+	}
+	/* Copy the old data into the new chunk */
+	SyMemcpy(pOld, pNew, nOld);
+	/* Free the stale chunk */
+	MemBackendSlabFree(pOld);
+	return pNew;
+}
 static void *MemBackendRealloc(SyMemBackend *pBackend, void *pOld, sxu32 nBytes) {
 	SyMemBlock *pBlock, *pNew, *pPrev, *pNext;
-	sxu32 nChunkSize;
+	sxu32 nChunkSize, iTag;
 	sxu32 nRetry = 0;
 	if(pOld == 0) {
 		return MemBackendAlloc(&(*pBackend), nBytes);
 	}
+	if(SXMEM_CHUNK_GUARD(pOld) == SXMEM_SLAB_MAGIC) {
+		return MemSlabRealloc(&(*pBackend), pOld, nBytes, MemBackendAlloc);
+	}
 	pBlock = (SyMemBlock *)(((char *)pOld) - sizeof(SyMemBlock));
 	if(pBlock->nGuard != SXMEM_BACKEND_MAGIC) {
 		return 0;
@@ -188,7 +481,7 @@ static void *MemBackendRealloc(SyMemBackend *pBackend, void *pOld, sxu32 nBytes)
 	nBytes += sizeof(SyMemBlock);
 	pPrev = pBlock->pPrev;
 	pNext = pBlock->pNext;
-	nChunkSize = MemOSChunkSize(pBlock);
+	nChunkSize = pBackend->pMethods->xChunkSize(pBlock);
 	if(nChunkSize < nBytes) {
 		/* Calculate memory usage */
 		if(MemBackendCalculate(pBackend, (nBytes - nChunkSize)) != SXRET_OK) {
@@ -205,6 +498,11 @@ static void *MemBackendRealloc(SyMemBackend *pBackend, void *pOld, sxu32 nBytes)
 		if(pNew == 0) {
 			return 0;
 		}
+		iTag = pNew->iTag;
+		if(iTag != SXMEM_TAG_NONE) {
+			/* Only charge the growth, so a tag above its soft limit never dips below it meanwhile */
+			MemTagCharge(&(*pBackend), iTag, pBackend->pMethods->xChunkSize(pNew) - nChunkSize);
+		}
 		if(pNew != pBlock) {
 			if(pPrev == 0) {
 				pBackend->pBlocks = pNew;
@@ -235,26 +533,17 @@ PH7_PRIVATE void *SyMemBackendRealloc(SyMemBackend *pBackend, void *pOld, sxu32
 	}
 	return pChunk;
 }
+static sxi32 MemBackendPoolFree(SyMemBackend *pBackend, void *pChunk);
 static sxi32 MemBackendFree(SyMemBackend *pBackend, void *pChunk) {
-	SyMemBlock *pBlock;
-	sxu32 *pChunkSize;
-	pBlock = (SyMemBlock *)(((char *)pChunk) - sizeof(SyMemBlock));
-	if(pBlock->nGuard != SXMEM_BACKEND_MAGIC) {
-		return SXERR_CORRUPT;
-	}
-	/* Unlink from the list of active blocks */
-	if(pBackend->nBlock > 0) {
-		/* Release the block */
-		/* Mark as stale block */
-		pBlock->nGuard = 0x635B;
-		MACRO_LD_REMOVE(pBackend->pBlocks, pBlock);
-		pBackend->nBlock--;
-		/* Release the heap */
-		pChunkSize = (sxu32 *)(((char *)pBlock) - sizeof(sxu32));
-		pBackend->pHeap->nSize -= pChunkSize[0];
-		pBackend->pMethods->xFree(pBlock);
+	switch(SXMEM_CHUNK_GUARD(pChunk)) {
+		case SXMEM_SLAB_MAGIC:
+			return MemBackendSlabFree(pChunk);
+		case SXMEM_BACKEND_MAGIC:
+			return MemBackendBlockFree(&(*pBackend), pChunk);
+		default:
+			/* Pool chunk or misuse */
+			return MemBackendPoolFree(&(*pBackend), pChunk);
 	}
-	return SXRET_OK;
 }
 PH7_PRIVATE sxi32 SyMemBackendFree(SyMemBackend *pBackend, void *pChunk) {
 	sxi32 rc;
@@ -275,16 +564,24 @@ PH7_PRIVATE sxi32 SyMemBackendFree(SyMemBackend *pBackend, void *pChunk) {
 }
 /*
  * Memory pool allocator
+ * Chunks up to SXMEM_SLAB_MAXALLOC bytes come from the slabs, larger ones
+ * from power of two buckets.
  */
 #define SXMEM_POOL_MAGIC		0xDEAD
 #define SXMEM_POOL_MAXALLOC		(1<<(SXMEM_POOL_NBUCKETS+SXMEM_POOL_INCR))
 #define SXMEM_POOL_MINALLOC		(1<<(SXMEM_POOL_INCR))
+/* Link between the released chunks of a bucket */
+#define SXMEM_POOL_NEXT(HEADER)	(*(SyMemHeader **)&(HEADER)[1])
 static sxi32 MemPoolBucketAlloc(SyMemBackend *pBackend, sxu32 nBucket) {
 	char *zBucket, *zBucketEnd;
 	SyMemHeader *pHeader;
 	sxu32 nBucketSize;
 	/* Allocate one big block first */
-	zBucket = (char *)MemBackendAlloc(&(*pBackend), SXMEM_POOL_MAXALLOC);
+	if(pBackend->bArena) {
+		zBucket = (char *)MemArenaAlloc(&(*pBackend), SXMEM_POOL_MAXALLOC);
+	} else {
+		zBucket = (char *)MemBackendBlockAlloc(&(*pBackend), SXMEM_POOL_MAXALLOC, SXMEM_TAG_NONE);
+	}
 	if(zBucket == 0) {
 		return SXERR_MEM;
 	}
@@ -296,26 +593,32 @@ static sxi32 MemPoolBucketAlloc(SyMemBackend *pBackend, sxu32 nBucket) {
 		if(&zBucket[nBucketSize] >= zBucketEnd) {
 			break;
 		}
-		pHeader->pNext = (SyMemHeader *)&zBucket[nBucketSize];
+		SXMEM_POOL_NEXT(pHeader) = (SyMemHeader *)&zBucket[nBucketSize];
 		/* Advance the cursor to the next available chunk */
-		pHeader = pHeader->pNext;
+		pHeader = SXMEM_POOL_NEXT(pHeader);
 		zBucket += nBucketSize;
 	}
-	pHeader->pNext = 0;
+	SXMEM_POOL_NEXT(pHeader) = 0;
 	return SXRET_OK;
 }
 static void *MemBackendPoolAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
 	SyMemHeader *pBucket, *pNext;
 	sxu32 nBucketSize;
 	sxu32 nBucket;
+	if(nBytes <= SXMEM_SLAB_MAXALLOC) {
+		/* Exact size class */
+		return MemBackendSlabAlloc(&(*pBackend), nBytes);
+	}
 	if(nBytes + sizeof(SyMemHeader) >= SXMEM_POOL_MAXALLOC) {
 		/* Allocate a big chunk directly */
-		pBucket = (SyMemHeader *)MemBackendAlloc(&(*pBackend), nBytes + sizeof(SyMemHeader));
+		pBucket = (SyMemHeader *)MemBackendBlockAlloc(&(*pBackend), nBytes + sizeof(SyMemHeader), pBackend->iTag);
 		if(pBucket == 0) {
 			return 0;
 		}
-		/* Record as big block */
-		pBucket->nBucket = (sxu32)(SXMEM_POOL_MAGIC << 16) | SXU16_HIGH;
+		/* Record as big block, charged as such */
+		pBucket->nBucket = SXU16_HIGH;
+		pBucket->iTag = (sxu16)pBackend->iTag;
+		pBucket->nGuard = SXMEM_POOL_MAGIC;
 		return (void *)(pBucket + 1);
 	}
 	/* Locate the appropriate bucket */
@@ -335,10 +638,13 @@ static void *MemBackendPoolAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
 		pBucket = pBackend->apPool[nBucket];
 	}
 	/* Remove from the free list */
-	pNext = pBucket->pNext;
+	pNext = SXMEM_POOL_NEXT(pBucket);
 	pBackend->apPool[nBucket] = pNext;
 	/* Record bucket&magic number */
-	pBucket->nBucket = (SXMEM_POOL_MAGIC << 16) | nBucket;
+	pBucket->nBucket = (sxu16)nBucket;
+	pBucket->iTag = (sxu16)pBackend->iTag;
+	pBucket->nGuard = SXMEM_POOL_MAGIC;
+	MemTagCharge(&(*pBackend), pBackend->iTag, nBucketSize);
 	return (void *)&pBucket[1];
 }
 PH7_PRIVATE void *SyMemBackendPoolAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
@@ -358,19 +664,28 @@ PH7_PRIVATE void *SyMemBackendPoolAlloc(SyMemBackend *pBackend, sxu32 nBytes) {
 static sxi32 MemBackendPoolFree(SyMemBackend *pBackend, void *pChunk) {
 	SyMemHeader *pHeader;
 	sxu32 nBucket;
+	switch(SXMEM_CHUNK_GUARD(pChunk)) {
+		case SXMEM_SLAB_MAGIC:
+			return MemBackendSlabFree(pChunk);
+		case SXMEM_BACKEND_MAGIC:
+			return MemBackendBlockFree(&(*pBackend), pChunk);
+		case SXMEM_POOL_MAGIC:
+			break;
+		default:
+			/* Sanity check to avoid misuse */
+			return SXERR_CORRUPT;
+	}
 	/* Get the corresponding bucket */
 	pHeader = (SyMemHeader *)(((char *)pChunk) - sizeof(SyMemHeader));
-	/* Sanity check to avoid misuse */
-	if((pHeader->nBucket >> 16) != SXMEM_POOL_MAGIC) {
-		return SXERR_CORRUPT;
-	}
-	nBucket = pHeader->nBucket & 0xFFFF;
+	nBucket = pHeader->nBucket;
 	if(nBucket == SXU16_HIGH) {
 		/* Free the big block */
-		MemBackendFree(&(*pBackend), pHeader);
+		MemBackendBlockFree(&(*pBackend), pHeader);
 	} else {
 		/* Return to the free list */
-		pHeader->pNext = pBackend->apPool[nBucket & 0x0f];
+		pHeader->nGuard = SXMEM_CHUNK_STALE;
+		MemTagCredit(&(*pBackend), pHeader->iTag, 1 << (nBucket + SXMEM_POOL_INCR));
+		SXMEM_POOL_NEXT(pHeader) = pBackend->apPool[nBucket & 0x0f];
 		pBackend->apPool[nBucket & 0x0f] = pHeader;
 	}
 	return SXRET_OK;
@@ -390,7 +705,7 @@ PH7_PRIVATE sxi32 SyMemBackendPoolFree(SyMemBackend *pBackend, void *pChunk) {
 	return rc;
 }
 static void *MemBackendPoolRealloc(SyMemBackend *pBackend, void *pOld, sxu32 nByte) {
-	sxu32 nBucket, nBucketSize;
+	sxu32 nBucket, nBucketSize, iTag;
 	SyMemHeader *pHeader;
 	void *pNew;
 	if(pOld == 0) {
@@ -398,29 +713,39 @@ static void *MemBackendPoolRealloc(SyMemBackend *pBackend, void *pOld, sxu32 nBy
 		pNew = MemBackendPoolAlloc(&(*pBackend), nByte);
 		return pNew;
 	}
+	switch(SXMEM_CHUNK_GUARD(pOld)) {
+		case SXMEM_SLAB_MAGIC:
+			return MemSlabRealloc(&(*pBackend), pOld, nByte, MemBackendPoolAlloc);
+		case SXMEM_BACKEND_MAGIC:
+			return MemBackendRealloc(&(*pBackend), pOld, nByte);
+		case SXMEM_POOL_MAGIC:
+			break;
+		default:
+			/* Sanity check to avoid misuse */
+			return 0;
+	}
 	/* Get the corresponding bucket */
 	pHeader = (SyMemHeader *)(((char *)pOld) - sizeof(SyMemHeader));
-	/* Sanity check to avoid misuse */
-	if((pHeader->nBucket >> 16) != SXMEM_POOL_MAGIC) {
-		return 0;
-	}
-	nBucket = pHeader->nBucket & 0xFFFF;
+	nBucket = pHeader->nBucket;
 	if(nBucket == SXU16_HIGH) {
 		/* Big block */
-		return MemBackendRealloc(&(*pBackend), pHeader, nByte);
+		pHeader = (SyMemHeader *)MemBackendRealloc(&(*pBackend), pHeader, nByte + sizeof(SyMemHeader));
+		return pHeader ? (void *)&pHeader[1] : 0;
 	}
 	nBucketSize = 1 << (nBucket + SXMEM_POOL_INCR);
 	if(nBucketSize >= nByte + sizeof(SyMemHeader)) {
 		/* The old bucket can honor the requested size */
 		return pOld;
 	}
-	/* Allocate a new pool */
+	/* Allocate a new pool, charged to the same tag */
+	SyMemBackendPushTag(pBackend, pHeader->iTag, iTag);
 	pNew = MemBackendPoolAlloc(&(*pBackend), nByte);
+	SyMemBackendPopTag(pBackend, iTag);
 	if(pNew == 0) {
 		return 0;
 	}
 	/* Copy the old data into the new block */
-	SyMemcpy(pOld, pNew, nBucketSize);
+	SyMemcpy(pOld, pNew, nBucketSize - sizeof(SyMemHeader));
 	/* Free the stale block */
 	MemBackendPoolFree(&(*pBackend), pOld);
 	return pNew;
@@ -519,8 +844,138 @@ PH7_PRIVATE sxi32 SyMemBackendInitFromParent(SyMemBackend *pBackend, SyMemBacken
 	pBackend->nMagic = SXMEM_BACKEND_MAGIC;
 	return SXRET_OK;
 }
+/*
+ * Protect the given backend with a private mutex, so it can be shared between
+ * threads. Backends created later from this one inherit the mutex subsystem.
+ */
+PH7_PRIVATE sxi32 SyMemBackendMakeThreadSafe(SyMemBackend *pBackend, const SyMutexMethods *pMethods) {
+	SyMutex *pMutex;
+	if(SXMEM_BACKEND_CORRUPT(pBackend) || pMethods == 0 || pMethods->xNew == 0) {
+		return SXERR_CORRUPT;
+	}
+	pMutex = pMethods->xNew(SXMUTEX_TYPE_FAST);
+	if(pMutex == 0) {
+		return SXERR_OS;
+	}
+	pBackend->pMutexMethods = pMethods;
+	pBackend->pMutex = pMutex;
+	/* The heap is shared by all backends created from this one */
+	pBackend->pHeap->bThreadSafe = TRUE;
+	return SXRET_OK;
+}
+/*
+ * Release the private mutex of a backend that is never used by more than one
+ * thread at a time [i.e: the allocator of a virtual machine].
+ */
+PH7_PRIVATE sxi32 SyMemBackendDisableMutexing(SyMemBackend *pBackend) {
+	if(SXMEM_BACKEND_CORRUPT(pBackend)) {
+		return SXERR_CORRUPT;
+	}
+	if(pBackend->pMutexMethods) {
+		SyMutexRelease(pBackend->pMutexMethods, pBackend->pMutex);
+		pBackend->pMutexMethods = 0;
+		pBackend->pMutex = 0;
+	}
+	return SXRET_OK;
+}
+/*
+ * Carve the slabs and pool buckets of the given backend out of large regions
+ * from now on. Its memory is then given back all at once when it is released.
+ */
+PH7_PRIVATE sxi32 SyMemBackendEnableArena(SyMemBackend *pBackend) {
+	if(SXMEM_BACKEND_CORRUPT(pBackend)) {
+		return SXERR_CORRUPT;
+	}
+	pBackend->bArena = TRUE;
+	return SXRET_OK;
+}
+/*
+ * Set the soft limit of the given accounting tag, zero to remove it.
+ * Crossing the limit does not fail the allocation, it merely marks the tag as
+ * pending so that the caller gets notified at its next checkpoint.
+ */
+PH7_PRIVATE sxi32 SyMemBackendSetTagLimit(SyMemBackend *pBackend, sxu32 iTag, sxu64 nLimit) {
+	SyMemTag *pTag;
+	if(SXMEM_BACKEND_CORRUPT(pBackend) || iTag >= PH7_MEM_TAG_COUNT) {
+		return SXERR_CORRUPT;
+	}
+	pTag = &pBackend->aTag[iTag];
+	pTag->nLimit = nLimit;
+	pBackend->iTagOver &= ~(1 << iTag);
+	pBackend->iTagPending &= ~(1 << iTag);
+	if(nLimit && pTag->nSize > nLimit) {
+		/* Already above the new limit */
+		pBackend->iTagOver |= 1 << iTag;
+		pBackend->iTagPending |= 1 << iTag;
+	}
+	return SXRET_OK;
+}
+/*
+ * Return the number of bytes currently allocated from the heap shared by the
+ * given backend, and optionally its peak usage.
+ */
+PH7_PRIVATE sxu64 SyMemBackendHeapUsage(SyMemBackend *pBackend, sxu64 *pPeak) {
+	SyMemHeap *pHeap = pBackend->pHeap;
+	if(pHeap->bThreadSafe) {
+		if(pPeak) {
+			*pPeak = SyHeapLoad(&pHeap->nPeak);
+		}
+		return SyHeapLoad(&pHeap->nSize);
+	}
+	if(pPeak) {
+		*pPeak = pHeap->nPeak;
+	}
+	return pHeap->nSize;
+}
+/*
+ * Drop every chunk allocated from a backend in arena mode at once, while keeping
+ * its arena regions for the chunks allocated afterwards.
+ */
+PH7_PRIVATE sxi32 SyMemBackendRecycle(SyMemBackend *pBackend) {
+	SyMemBlock *pBlock, *pNext;
+	SyMemArena *pArena;
+	sxu32 n;
+	if(SXMEM_BACKEND_CORRUPT(pBackend) || !pBackend->bArena) {
+		return SXERR_CORRUPT;
+	}
+	/* Release the blocks allocated outside of the regions */
+	pBlock = pBackend->pBlocks;
+	for(;;) {
+		if(pBackend->nBlock == 0) {
+			break;
+		}
+		pNext  = pBlock->pNext;
+		if(pBackend->pHeap->bThreadSafe) {
+			SyHeapSub(&pBackend->pHeap->nSize, (sxu64)pBackend->pMethods->xChunkSize(pBlock));
+		} else {
+			pBackend->pHeap->nSize -= pBackend->pMethods->xChunkSize(pBlock);
+		}
+		pBackend->pMethods->xFree(pBlock);
+		pBlock = pNext;
+		pBackend->nBlock--;
+	}
+	pBackend->pBlocks = 0;
+	/* Nothing is live anymore */
+	for(n = 0 ; n < PH7_MEM_TAG_COUNT ; ++n) {
+		pBackend->aTag[n].nSize = 0;
+	}
+	pBackend->iTagOver = pBackend->iTagPending = 0;
+	/* Forget about the slabs and pool buckets */
+	SyZero(pBackend->apPool, sizeof(pBackend->apPool));
+	SyZero(pBackend->aSlab, sizeof(pBackend->aSlab));
+	/* Keep the regions for reuse, in the order they were allocated */
+	while(pBackend->pArena) {
+		pArena = pBackend->pArena;
+		pBackend->pArena = pArena->pNext;
+		pArena->pNext = pBackend->pArenaFree;
+		pBackend->pArenaFree = pArena;
+	}
+	pBackend->zArena = pBackend->zArenaEnd = 0;
+	return SXRET_OK;
+}
 static sxi32 MemBackendRelease(SyMemBackend *pBackend) {
 	SyMemBlock *pBlock, *pNext;
+	SyMemArena *pArena;
 	pBlock = pBackend->pBlocks;
 	for(;;) {
 		if(pBackend->nBlock == 0) {
@@ -531,6 +986,17 @@ static sxi32 MemBackendRelease(SyMemBackend *pBackend) {
 		pBlock = pNext;
 		pBackend->nBlock--;
 	}
+	/* Drop the arena regions */
+	while(pBackend->pArena) {
+		pArena = pBackend->pArena;
+		pBackend->pArena = pArena->pNext;
+		pBackend->pMethods->xFree(pArena);
+	}
+	while(pBackend->pArenaFree) {
+		pArena = pBackend->pArenaFree;
+		pBackend->pArenaFree = pArena->pNext;
+		pBackend->pMethods->xFree(pArena);
+	}
 	if(pBackend->pMethods->xRelease) {
 		pBackend->pMethods->xRelease(pBackend->pMethods->pUserData);
 	}
@@ -601,14 +1067,29 @@ PH7_PRIVATE sxi32 SyBlobReadOnly(SyBlob *pBlob, const void *pData, sxu32 nByte)
 	pBlob->pBlob = (void *)pData;
 	pBlob->nByte = nByte;
 	pBlob->mByte = 0;
-	pBlob->nFlags |= SXBLOB_RDONLY;
+	pBlob->nFlags = (pBlob->nFlags & ~SXBLOB_INTERN) | SXBLOB_RDONLY;
 	return SXRET_OK;
 }
 #ifndef SXBLOB_MIN_GROWTH
 	#define SXBLOB_MIN_GROWTH 16
 #endif
+/*
+ * Accounting tag of a blob buffer. Buffers are charged to the strings, except
+ * the stream and output buffers and those allocated while compiling a script
+ * or loading a module.
+ */
+static sxu32 BlobTag(SyBlob *pBlob) {
+	sxu32 iTag = pBlob->pAllocator->iTag;
+	if(pBlob->nFlags & SXBLOB_IO) {
+		return PH7_MEM_TAG_IO;
+	}
+	if(iTag == PH7_MEM_TAG_COMPILER || iTag == PH7_MEM_TAG_IO || iTag == PH7_MEM_TAG_MODULES) {
+		return iTag;
+	}
+	return PH7_MEM_TAG_STRINGS;
+}
 static sxi32 BlobPrepareGrow(SyBlob *pBlob, sxu32 *pByte) {
-	sxu32 nByte;
+	sxu32 nByte, iTag;
 	void *pNew;
 	nByte = *pByte;
 	if(pBlob->nFlags & (SXBLOB_LOCKED | SXBLOB_STATIC)) {
@@ -623,7 +1104,9 @@ static sxi32 BlobPrepareGrow(SyBlob *pBlob, sxu32 *pByte) {
 	if(pBlob->nFlags & SXBLOB_RDONLY) {
 		/* Make a copy of the read-only item */
 		if(pBlob->nByte > 0) {
+			SyMemBackendPushTag(pBlob->pAllocator, BlobTag(&(*pBlob)), iTag);
 			pNew = SyMemBackendDup(pBlob->pAllocator, pBlob->pBlob, pBlob->nByte);
+			SyMemBackendPopTag(pBlob->pAllocator, iTag);
 			if(pNew == 0) {
 				return SXERR_MEM;
 			}
@@ -634,7 +1117,7 @@ static sxi32 BlobPrepareGrow(SyBlob *pBlob, sxu32 *pByte) {
 			pBlob->mByte = 0;
 		}
 		/* Remove the read-only flag */
-		pBlob->nFlags &= ~SXBLOB_RDONLY;
+		pBlob->nFlags &= ~(SXBLOB_RDONLY | SXBLOB_INTERN);
 	}
 	if(SyBlobFreeSpace(pBlob) >= nByte) {
 		return SXRET_OK;
@@ -644,7 +1127,9 @@ static sxi32 BlobPrepareGrow(SyBlob *pBlob, sxu32 *pByte) {
 	} else if(nByte < SXBLOB_MIN_GROWTH) {
 		nByte = SXBLOB_MIN_GROWTH;
 	}
+	SyMemBackendPushTag(pBlob->pAllocator, BlobTag(&(*pBlob)), iTag);
 	pNew = SyMemBackendRealloc(pBlob->pAllocator, pBlob->pBlob, nByte);
+	SyMemBackendPopTag(pBlob->pAllocator, iTag);
 	if(pNew == 0) {
 		return SXERR_MEM;
 	}
@@ -711,7 +1196,7 @@ PH7_PRIVATE sxi32 SyBlobReset(SyBlob *pBlob) {
 	if(pBlob->nFlags & SXBLOB_RDONLY) {
 		pBlob->pBlob = 0;
 		pBlob->mByte = 0;
-		pBlob->nFlags &= ~SXBLOB_RDONLY;
+		pBlob->nFlags &= ~(SXBLOB_RDONLY | SXBLOB_INTERN);
 	}
 	return SXRET_OK;
 }
@@ -721,29 +1206,7 @@ PH7_PRIVATE sxi32 SyBlobRelease(SyBlob *pBlob) {
 	}
 	pBlob->pBlob = 0;
 	pBlob->nByte = pBlob->mByte = 0;
-	pBlob->nFlags = 0;
+	/* A stream or output buffer stays one */
+	pBlob->nFlags &= SXBLOB_IO;
 	return SXRET_OK;
 }
-PH7_PRIVATE sxi32 SyBlobSearch(const void *pBlob, sxu32 nLen, const void *pPattern, sxu32 pLen, sxu32 *pOfft) {
-	const char *zIn = (const char *)pBlob;
-	const char *zEnd;
-	sxi32 rc;
-	if(pLen > nLen) {
-		return SXERR_NOTFOUND;
-	}
-	zEnd = &zIn[nLen - pLen];
-	for(;;) {
-		if(zIn > zEnd) {
-			break;
-		}
-		SX_MACRO_FAST_CMP(zIn, pPattern, pLen, rc);
-		if(rc == 0) {
-			if(pOfft) {
-				*pOfft = (sxu32)(zIn - (const char *)pBlob);
-			}
-			return SXRET_OK;
-		}
-		zIn++;
-	}
-	return SXERR_NOTFOUND;
-}
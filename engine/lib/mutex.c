@@ -0,0 +1,177 @@
+/**
+ * @PROJECT     PH7 Engine for the AerScript Interpreter
+ * @COPYRIGHT   See COPYING in the top level directory
+ * @FILE        engine/lib/mutex.c
+ * @DESCRIPTION PH7 Engine built-in mutex subsystem
+ * @DEVELOPERS  Symisc Systems <devel@symisc.net>
+ *              Rafal Kupiec <belliash@codingworkshop.eu.org>
+ */
+#if defined(__WINNT__)
+	#include <Windows.h>
+#else
+	#include <stdlib.h>
+	#include <pthread.h>
+#endif
+
+#include "ph7int.h"
+
+#if defined(__WINNT__)
+struct SyMutex {
+	CRITICAL_SECTION sMutex;
+	sxu32 nType; /* Mutex type, one of SXMUTEX_TYPE_* */
+};
+/* Preallocated static mutex */
+static SyMutex aStaticMutexes[] = {
+	{{0}, SXMUTEX_TYPE_STATIC_1},
+	{{0}, SXMUTEX_TYPE_STATIC_2},
+	{{0}, SXMUTEX_TYPE_STATIC_3},
+	{{0}, SXMUTEX_TYPE_STATIC_4},
+	{{0}, SXMUTEX_TYPE_STATIC_5},
+	{{0}, SXMUTEX_TYPE_STATIC_6}
+};
+static volatile LONG nWinMutexLock = 0;
+static volatile BOOL bWinMutexInit = FALSE;
+static int WinMutexGlobalInit(void) {
+	sxu32 n;
+	if(InterlockedCompareExchange(&nWinMutexLock, 1, 0) == 0) {
+		/* First thread to get here, initialize the static mutexes */
+		for(n = 0 ; n < SX_ARRAYSIZE(aStaticMutexes) ; ++n) {
+			InitializeCriticalSection(&aStaticMutexes[n].sMutex);
+		}
+		bWinMutexInit = TRUE;
+	} else {
+		/* Another thread is doing the initialization, wait for it */
+		while(!bWinMutexInit) {
+			Sleep(1);
+		}
+	}
+	return SXRET_OK;
+}
+static void WinMutexGlobalRelease(void) {
+	sxu32 n;
+	if(InterlockedCompareExchange(&nWinMutexLock, 0, 1) == 1) {
+		for(n = 0 ; n < SX_ARRAYSIZE(aStaticMutexes) ; ++n) {
+			DeleteCriticalSection(&aStaticMutexes[n].sMutex);
+		}
+		bWinMutexInit = FALSE;
+	}
+}
+static SyMutex *WinMutexNew(int nType) {
+	SyMutex *pMutex;
+	if(nType == SXMUTEX_TYPE_FAST || nType == SXMUTEX_TYPE_RECURSIVE) {
+		/* Critical sections are always recursive */
+		pMutex = (SyMutex *)HeapAlloc(GetProcessHeap(), 0, sizeof(SyMutex));
+		if(pMutex == 0) {
+			return 0;
+		}
+		InitializeCriticalSection(&pMutex->sMutex);
+		pMutex->nType = (sxu32)nType;
+	} else {
+		/* Use a pre-allocated static mutex */
+		if(nType > SXMUTEX_TYPE_STATIC_6) {
+			nType = SXMUTEX_TYPE_STATIC_6;
+		}
+		pMutex = &aStaticMutexes[nType - SXMUTEX_TYPE_STATIC_1];
+	}
+	return pMutex;
+}
+static void WinMutexRelease(SyMutex *pMutex) {
+	if(pMutex->nType == SXMUTEX_TYPE_FAST || pMutex->nType == SXMUTEX_TYPE_RECURSIVE) {
+		DeleteCriticalSection(&pMutex->sMutex);
+		HeapFree(GetProcessHeap(), 0, pMutex);
+	}
+}
+static void WinMutexEnter(SyMutex *pMutex) {
+	EnterCriticalSection(&pMutex->sMutex);
+}
+static int WinMutexTryEnter(SyMutex *pMutex) {
+	return TryEnterCriticalSection(&pMutex->sMutex) ? SXRET_OK : SXERR_BUSY;
+}
+static void WinMutexLeave(SyMutex *pMutex) {
+	LeaveCriticalSection(&pMutex->sMutex);
+}
+/* Export Windows mutex methods */
+static const SyMutexMethods sMutexMethods = {
+	WinMutexGlobalInit,    /* xGlobalInit() */
+	WinMutexGlobalRelease, /* xGlobalRelease() */
+	WinMutexNew,           /* xNew() */
+	WinMutexRelease,       /* xRelease() */
+	WinMutexEnter,         /* xEnter() */
+	WinMutexTryEnter,      /* xTryEnter() */
+	WinMutexLeave          /* xLeave() */
+};
+#else
+struct SyMutex {
+	pthread_mutex_t sMutex;
+	sxu32 nType; /* Mutex type, one of SXMUTEX_TYPE_* */
+};
+/* Preallocated static mutex */
+static SyMutex aStaticMutexes[] = {
+	{PTHREAD_MUTEX_INITIALIZER, SXMUTEX_TYPE_STATIC_1},
+	{PTHREAD_MUTEX_INITIALIZER, SXMUTEX_TYPE_STATIC_2},
+	{PTHREAD_MUTEX_INITIALIZER, SXMUTEX_TYPE_STATIC_3},
+	{PTHREAD_MUTEX_INITIALIZER, SXMUTEX_TYPE_STATIC_4},
+	{PTHREAD_MUTEX_INITIALIZER, SXMUTEX_TYPE_STATIC_5},
+	{PTHREAD_MUTEX_INITIALIZER, SXMUTEX_TYPE_STATIC_6}
+};
+static SyMutex *UnixMutexNew(int nType) {
+	pthread_mutexattr_t sRecursiveAttr;
+	SyMutex *pMutex;
+	if(nType == SXMUTEX_TYPE_FAST || nType == SXMUTEX_TYPE_RECURSIVE) {
+		/* Allocate a new mutex */
+		pMutex = (SyMutex *)malloc(sizeof(SyMutex));
+		if(pMutex == 0) {
+			return 0;
+		}
+		if(nType == SXMUTEX_TYPE_RECURSIVE) {
+			pthread_mutexattr_init(&sRecursiveAttr);
+			pthread_mutexattr_settype(&sRecursiveAttr, PTHREAD_MUTEX_RECURSIVE);
+			pthread_mutex_init(&pMutex->sMutex, &sRecursiveAttr);
+			pthread_mutexattr_destroy(&sRecursiveAttr);
+		} else {
+			pthread_mutex_init(&pMutex->sMutex, 0);
+		}
+		pMutex->nType = (sxu32)nType;
+	} else {
+		/* Use a pre-allocated static mutex */
+		if(nType > SXMUTEX_TYPE_STATIC_6) {
+			nType = SXMUTEX_TYPE_STATIC_6;
+		}
+		pMutex = &aStaticMutexes[nType - SXMUTEX_TYPE_STATIC_1];
+	}
+	return pMutex;
+}
+static void UnixMutexRelease(SyMutex *pMutex) {
+	if(pMutex->nType == SXMUTEX_TYPE_FAST || pMutex->nType == SXMUTEX_TYPE_RECURSIVE) {
+		pthread_mutex_destroy(&pMutex->sMutex);
+		free(pMutex);
+	}
+}
+static void UnixMutexEnter(SyMutex *pMutex) {
+	pthread_mutex_lock(&pMutex->sMutex);
+}
+static int UnixMutexTryEnter(SyMutex *pMutex) {
+	return pthread_mutex_trylock(&pMutex->sMutex) == 0 ? SXRET_OK : SXERR_BUSY;
+}
+static void UnixMutexLeave(SyMutex *pMutex) {
+	pthread_mutex_unlock(&pMutex->sMutex);
+}
+/* Export UNIX mutex methods */
+static const SyMutexMethods sMutexMethods = {
+	0,                /* xGlobalInit() */
+	0,                /* xGlobalRelease() */
+	UnixMutexNew,     /* xNew() */
+	UnixMutexRelease, /* xRelease() */
+	UnixMutexEnter,   /* xEnter() */
+	UnixMutexTryEnter,/* xTryEnter() */
+	UnixMutexLeave    /* xLeave() */
+};
+#endif /* __WINNT__ */
+/*
+ * Export the built-in mutex subsystem, used when the library is configured
+ * for multi-threading [i.e: PH7_LIB_CONFIG_THREAD_LEVEL_MULTI] and the host
+ * application did not supply its own [i.e: PH7_LIB_CONFIG_USER_MUTEX].
+ */
+PH7_PRIVATE const SyMutexMethods *SyMutexExportMethods(void) {
+	return &sMutexMethods;
+}
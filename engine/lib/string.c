@@ -21,64 +21,444 @@ PH7_PRIVATE sxu32 SyStrlen(const char *zSrc) {
 	}
 	return (sxu32)(zIn - zSrc);
 }
-PH7_PRIVATE sxi32 SyByteFind(const char *zStr, sxu32 nLen, sxi32 c, sxu32 *pPos) {
-	const char *zIn = zStr;
-	const char *zEnd;
-	zEnd = &zIn[nLen];
-	for(;;) {
-		if(zIn >= zEnd) {
+/*
+ * Vectorized scanning primitives.
+ * The byte, byte set and substring searches below examine 16 (SSE2) or 32 (AVX2)
+ * bytes at once on x86 hosts. SSE2 is part of the x86-64 baseline, while the AVX2
+ * kernels are only used when the host CPU reports them (see SyStrInitSimd()).
+ * Other targets fall back to a portable word-at-a-time scan.
+ * Each kernel skips the blocks that cannot hold a match and returns either the
+ * match or the start of the unprocessed tail, which the portable code finishes.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__SSE2__)
+#define SX_SIMD_SSE2
+#include <emmintrin.h>
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ >= 5)
+#define SX_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#endif
+#define SX_WORD_ONES         0x0101010101010101ULL
+#define SX_WORD_HIGHS        0x8080808080808080ULL
+#define SX_WORD_HAS_ZERO(W)  ((((W) - SX_WORD_ONES) & ~(W)) & SX_WORD_HIGHS)
+#define SX_WORD_ALIGNED(P)   ((((sxuptr)(P)) & (sizeof(sxu64) - 1)) == 0)
+#define SX_ASCII_LOWER(C)    (((C) >= 'A' && (C) <= 'Z') ? (C) + 0x20 : (C))
+/* Case folding mask of a single byte: 0x20 for ASCII letters, 0 otherwise */
+#define SX_ASCII_FOLD(C)     ((((C) | 0x20) >= 'a' && ((C) | 0x20) <= 'z') ? 0x20 : 0)
+#ifdef SX_SIMD_AVX2
+static int sxSimdAvx2 = 0; /* TRUE if the host CPU supports AVX2 */
+#endif
+/*
+ * Detect the vector extensions supported by the host CPU.
+ * Called once at library initialization. Until then only the
+ * baseline kernels are used.
+ */
+PH7_PRIVATE void SyStrInitSimd(void) {
+#ifdef SX_SIMD_AVX2
+	__builtin_cpu_init();
+	sxSimdAvx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+}
+#ifdef SX_SIMD_SSE2
+/*
+ * Fold the ASCII upper case letters of a vector to lower case.
+ */
+static __m128i SyLowerSSE2(__m128i vIn) {
+	__m128i vShift = _mm_add_epi8(vIn, _mm_set1_epi8((char)(0x80 - 'A')));
+	__m128i vUpper = _mm_cmplt_epi8(vShift, _mm_set1_epi8((char)(-0x80 + 26)));
+	return _mm_add_epi8(vIn, _mm_and_si128(vUpper, _mm_set1_epi8(0x20)));
+}
+static const unsigned char *SyByteSkipSSE2(const unsigned char *zIn, const unsigned char *zEnd, int c) {
+	const __m128i vC = _mm_set1_epi8((char)c);
+	int iMask;
+	while(zEnd - zIn >= 16) {
+		iMask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)zIn), vC));
+		if(iMask) {
+			return &zIn[__builtin_ctz((unsigned int)iMask)];
+		}
+		zIn += 16;
+	}
+	return zIn;
+}
+static const unsigned char *SyByteSkipBackSSE2(const unsigned char *zStart, const unsigned char *zEnd, int c) {
+	const __m128i vC = _mm_set1_epi8((char)c);
+	int iMask;
+	while(zEnd - zStart >= 16) {
+		iMask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&zEnd[-16]), vC));
+		if(iMask) {
+			return &zEnd[-16 + (31 - __builtin_clz((unsigned int)iMask)) + 1];
+		}
+		zEnd -= 16;
+	}
+	return zEnd;
+}
+static const unsigned char *SyByteSetSkipSSE2(const unsigned char *zIn, const unsigned char *zEnd, const unsigned char *zSet) {
+	const __m128i v0 = _mm_set1_epi8((char)zSet[0]);
+	const __m128i v1 = _mm_set1_epi8((char)zSet[1]);
+	const __m128i v2 = _mm_set1_epi8((char)zSet[2]);
+	const __m128i v3 = _mm_set1_epi8((char)zSet[3]);
+	__m128i vIn;
+	int iMask;
+	while(zEnd - zIn >= 16) {
+		vIn = _mm_loadu_si128((const __m128i *)zIn);
+		iMask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(vIn, v0), _mm_cmpeq_epi8(vIn, v1)),
+											   _mm_or_si128(_mm_cmpeq_epi8(vIn, v2), _mm_cmpeq_epi8(vIn, v3))));
+		if(iMask) {
+			return &zIn[__builtin_ctz((unsigned int)iMask)];
+		}
+		zIn += 16;
+	}
+	return zIn;
+}
+static const unsigned char *SyByteCountSSE2(const unsigned char *zIn, const unsigned char *zEnd, int c, sxu32 *pCount) {
+	const __m128i vC = _mm_set1_epi8((char)c);
+	sxu32 nCount = 0;
+	while(zEnd - zIn >= 16) {
+		nCount += (sxu32)__builtin_popcount((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)zIn), vC)));
+		zIn += 16;
+	}
+	*pCount += nCount;
+	return zIn;
+}
+/*
+ * Substring search filtered on the first and the last byte of the pattern.
+ * zLast points past the last position the pattern can start at. iFold is the
+ * case folding mask applied to the input and the pattern (0 or 0x20).
+ */
+static const unsigned char *SyBlobSkipSSE2(const unsigned char *zIn, const unsigned char *zLast, const unsigned char *zPattern,
+		sxu32 nPatLen, int iNoCase) {
+	const int iFirst = iNoCase ? SX_ASCII_FOLD(zPattern[0]) : 0;
+	const int iLast = iNoCase ? SX_ASCII_FOLD(zPattern[nPatLen - 1]) : 0;
+	const __m128i vFirst = _mm_set1_epi8((char)(zPattern[0] | iFirst));
+	const __m128i vLast = _mm_set1_epi8((char)(zPattern[nPatLen - 1] | iLast));
+	const __m128i vFoldFirst = _mm_set1_epi8((char)iFirst);
+	const __m128i vFoldLast = _mm_set1_epi8((char)iLast);
+	unsigned int iMask;
+	int i;
+	while(zLast - zIn >= 16) {
+		iMask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+					_mm_cmpeq_epi8(_mm_or_si128(_mm_loadu_si128((const __m128i *)zIn), vFoldFirst), vFirst),
+					_mm_cmpeq_epi8(_mm_or_si128(_mm_loadu_si128((const __m128i *)&zIn[nPatLen - 1]), vFoldLast), vLast)));
+		while(iMask) {
+			i = __builtin_ctz(iMask);
+			if(nPatLen < 3 || (iNoCase ? SyStrnmicmp(&zIn[i + 1], &zPattern[1], nPatLen - 2)
+											: SyMemcmp(&zIn[i + 1], &zPattern[1], nPatLen - 2)) == 0) {
+				return &zIn[i];
+			}
+			iMask &= iMask - 1;
+		}
+		zIn += 16;
+	}
+	return zIn;
+}
+#endif /* SX_SIMD_SSE2 */
+#ifdef SX_SIMD_AVX2
+__attribute__((target("avx2")))
+static const unsigned char *SyByteSkipAVX2(const unsigned char *zIn, const unsigned char *zEnd, int c) {
+	const __m256i vC = _mm256_set1_epi8((char)c);
+	unsigned int iMask;
+	while(zEnd - zIn >= 32) {
+		iMask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)zIn), vC));
+		if(iMask) {
+			return &zIn[__builtin_ctz(iMask)];
+		}
+		zIn += 32;
+	}
+	return zIn;
+}
+__attribute__((target("avx2")))
+static const unsigned char *SyByteSetSkipAVX2(const unsigned char *zIn, const unsigned char *zEnd, const unsigned char *zSet) {
+	const __m256i v0 = _mm256_set1_epi8((char)zSet[0]);
+	const __m256i v1 = _mm256_set1_epi8((char)zSet[1]);
+	const __m256i v2 = _mm256_set1_epi8((char)zSet[2]);
+	const __m256i v3 = _mm256_set1_epi8((char)zSet[3]);
+	__m256i vIn;
+	unsigned int iMask;
+	while(zEnd - zIn >= 32) {
+		vIn = _mm256_loadu_si256((const __m256i *)zIn);
+		iMask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(vIn, v0), _mm256_cmpeq_epi8(vIn, v1)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(vIn, v2), _mm256_cmpeq_epi8(vIn, v3))));
+		if(iMask) {
+			return &zIn[__builtin_ctz(iMask)];
+		}
+		zIn += 32;
+	}
+	return zIn;
+}
+__attribute__((target("avx2")))
+static const unsigned char *SyByteCountAVX2(const unsigned char *zIn, const unsigned char *zEnd, int c, sxu32 *pCount) {
+	const __m256i vC = _mm256_set1_epi8((char)c);
+	sxu32 nCount = 0;
+	while(zEnd - zIn >= 32) {
+		nCount += (sxu32)__builtin_popcount((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)zIn), vC)));
+		zIn += 32;
+	}
+	*pCount += nCount;
+	return zIn;
+}
+__attribute__((target("avx2")))
+static const unsigned char *SyBlobSkipAVX2(const unsigned char *zIn, const unsigned char *zLast, const unsigned char *zPattern,
+		sxu32 nPatLen, int iNoCase) {
+	const int iFirst = iNoCase ? SX_ASCII_FOLD(zPattern[0]) : 0;
+	const int iLast = iNoCase ? SX_ASCII_FOLD(zPattern[nPatLen - 1]) : 0;
+	const __m256i vFirst = _mm256_set1_epi8((char)(zPattern[0] | iFirst));
+	const __m256i vLast = _mm256_set1_epi8((char)(zPattern[nPatLen - 1] | iLast));
+	const __m256i vFoldFirst = _mm256_set1_epi8((char)iFirst);
+	const __m256i vFoldLast = _mm256_set1_epi8((char)iLast);
+	unsigned int iMask;
+	int i;
+	while(zLast - zIn >= 32) {
+		iMask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(
+					_mm256_cmpeq_epi8(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)zIn), vFoldFirst), vFirst),
+					_mm256_cmpeq_epi8(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)&zIn[nPatLen - 1]), vFoldLast), vLast)));
+		while(iMask) {
+			i = __builtin_ctz(iMask);
+			if(nPatLen < 3 || (iNoCase ? SyStrnmicmp(&zIn[i + 1], &zPattern[1], nPatLen - 2)
+											: SyMemcmp(&zIn[i + 1], &zPattern[1], nPatLen - 2)) == 0) {
+				return &zIn[i];
+			}
+			iMask &= iMask - 1;
+		}
+		zIn += 32;
+	}
+	return zIn;
+}
+#endif /* SX_SIMD_AVX2 */
+/*
+ * Return a pointer to the first occurrence of the given byte in the input
+ * or a null pointer if it does not occur.
+ */
+static const unsigned char *SyByteScan(const unsigned char *zIn, const unsigned char *zEnd, int c) {
+	const sxu64 nPattern = SX_WORD_ONES * (sxu64)(c & 0xff);
+	sxu64 nWord;
+#ifdef SX_SIMD_AVX2
+	if(sxSimdAvx2) {
+		zIn = SyByteSkipAVX2(zIn, zEnd, c);
+	}
+#endif
+#ifdef SX_SIMD_SSE2
+	zIn = SyByteSkipSSE2(zIn, zEnd, c);
+#endif
+	while(zIn < zEnd && !SX_WORD_ALIGNED(zIn)) {
+		if(zIn[0] == c) {
+			return zIn;
+		}
+		zIn++;
+	}
+	while(zEnd - zIn >= (sxptr)sizeof(sxu64)) {
+		nWord = *(const sxu64 *)zIn ^ nPattern;
+		if(SX_WORD_HAS_ZERO(nWord)) {
 			break;
 		}
+		zIn += sizeof(sxu64);
+	}
+	while(zIn < zEnd) {
 		if(zIn[0] == c) {
-			if(pPos) {
-				*pPos = (sxu32)(zIn - zStr);
-			}
-			return SXRET_OK;
+			return zIn;
 		}
 		zIn++;
 	}
-	return SXERR_NOTFOUND;
+	return 0;
+}
+PH7_PRIVATE sxi32 SyByteFind(const char *zStr, sxu32 nLen, sxi32 c, sxu32 *pPos) {
+	const unsigned char *zIn = (const unsigned char *)zStr;
+	const unsigned char *zPtr;
+	zPtr = SyByteScan(zIn, &zIn[nLen], c & 0xff);
+	if(zPtr == 0) {
+		return SXERR_NOTFOUND;
+	}
+	if(pPos) {
+		*pPos = (sxu32)(zPtr - zIn);
+	}
+	return SXRET_OK;
 }
 PH7_PRIVATE sxi32 SyByteFind2(const char *zStr, sxu32 nLen, sxi32 c, sxu32 *pPos) {
-	const char *zIn = zStr;
-	const char *zEnd;
-	zEnd = &zIn[nLen - 1];
-	for(;;) {
-		if(zEnd < zIn) {
-			break;
-		}
+	const unsigned char *zIn = (const unsigned char *)zStr;
+	const unsigned char *zEnd = &zIn[nLen];
+	c &= 0xff;
+#ifdef SX_SIMD_SSE2
+	zEnd = SyByteSkipBackSSE2(zIn, zEnd, c);
+#endif
+	while(zEnd > zIn) {
+		zEnd--;
 		if(zEnd[0] == c) {
 			if(pPos) {
 				*pPos = (sxu32)(zEnd - zIn);
 			}
 			return SXRET_OK;
 		}
-		zEnd--;
 	}
 	return SXERR_NOTFOUND;
 }
 PH7_PRIVATE sxi32 SyByteListFind(const char *zSrc, sxu32 nLen, const char *zList, sxu32 *pFirstPos) {
-	const char *zIn = zSrc;
-	const char *zPtr;
-	const char *zEnd;
-	sxi32 c;
-	zEnd = &zSrc[nLen];
+	const unsigned char *zIn = (const unsigned char *)zSrc;
+	const unsigned char *zEnd = &zIn[nLen];
+	const unsigned char *zPtr;
+	unsigned char aSet[4];
+	unsigned char aMap[256];
+	sxu32 nList, n;
+	nList = SyStrlen(zList);
+	if(nList < 2) {
+		/* Single byte search */
+		return nList < 1 ? SXERR_NOTFOUND : SyByteFind(zSrc, nLen, zList[0], pFirstPos);
+	}
+	if(nList <= sizeof(aSet)) {
+		/* Pad the set with its first byte */
+		for(n = 0 ; n < sizeof(aSet) ; n++) {
+			aSet[n] = (unsigned char)zList[n < nList ? n : 0];
+		}
+#ifdef SX_SIMD_AVX2
+		if(sxSimdAvx2) {
+			zIn = SyByteSetSkipAVX2(zIn, zEnd, aSet);
+		}
+#endif
+#ifdef SX_SIMD_SSE2
+		zIn = SyByteSetSkipSSE2(zIn, zEnd, aSet);
+#endif
+	}
+	/* Lookup table of the remaining bytes */
+	SyZero(aMap, sizeof(aMap));
+	for(zPtr = (const unsigned char *)zList ; zPtr[0] != 0 ; zPtr++) {
+		aMap[zPtr[0]] = 1;
+	}
 	for(;;) {
 		if(zIn >= zEnd) {
 			break;
 		}
-		for(zPtr = zList ; (c = zPtr[0]) != 0 ; zPtr++) {
-			if(zIn[0] == c) {
-				if(pFirstPos) {
-					*pFirstPos = (sxu32)(zIn - zSrc);
-				}
-				return SXRET_OK;
+		if(aMap[zIn[0]]) {
+			if(pFirstPos) {
+				*pFirstPos = (sxu32)(zIn - (const unsigned char *)zSrc);
 			}
+			return SXRET_OK;
 		}
 		zIn++;
 	}
 	return SXERR_NOTFOUND;
 }
+/*
+ * Count the occurrences of the given byte in the input.
+ */
+PH7_PRIVATE sxu32 SyByteCount(const char *zStr, sxu32 nLen, sxi32 c) {
+	const unsigned char *zIn = (const unsigned char *)zStr;
+	const unsigned char *zEnd = &zIn[nLen];
+	sxu32 nCount = 0;
+	c &= 0xff;
+#ifdef SX_SIMD_AVX2
+	if(sxSimdAvx2) {
+		zIn = SyByteCountAVX2(zIn, zEnd, c, &nCount);
+	}
+#endif
+#ifdef SX_SIMD_SSE2
+	zIn = SyByteCountSSE2(zIn, zEnd, c, &nCount);
+#endif
+	while(zIn < zEnd) {
+		if(zIn[0] == c) {
+			nCount++;
+		}
+		zIn++;
+	}
+	return nCount;
+}
+/*
+ * Binary safe, ASCII case-insensitive comparison of nLen bytes.
+ * Unlike SyStrnicmp(), embedded NUL bytes do not stop the comparison.
+ */
+PH7_PRIVATE sxi32 SyStrnmicmp(const void *pLeft, const void *pRight, sxu32 SLen) {
+	const unsigned char *zP = (const unsigned char *)pLeft;
+	const unsigned char *zQ = (const unsigned char *)pRight;
+	int c, d;
+#ifdef SX_SIMD_SSE2
+	unsigned int iMask;
+	while(SLen >= 16) {
+		iMask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(SyLowerSSE2(_mm_loadu_si128((const __m128i *)zP)),
+				SyLowerSSE2(_mm_loadu_si128((const __m128i *)zQ))));
+		if(iMask != 0xffff) {
+			/* Point to the first mismatch */
+			iMask = (unsigned int)__builtin_ctz(~iMask);
+			zP += iMask;
+			zQ += iMask;
+			break;
+		}
+		zP += 16;
+		zQ += 16;
+		SLen -= 16;
+	}
+#endif
+	for(;;) {
+		if(SLen < 1) {
+			return 0;
+		}
+		c = zP[0];
+		d = zQ[0];
+		c = SX_ASCII_LOWER(c);
+		d = SX_ASCII_LOWER(d);
+		if(c != d) {
+			return (sxi32)(c - d);
+		}
+		zP++;
+		zQ++;
+		SLen--;
+	}
+}
+/*
+ * Substring search shared by SyBlobSearch() and SyBlobSearchNoCase().
+ * Candidate positions are the ones where both the first and the last byte
+ * of the pattern match, only these are compared in full.
+ */
+static sxi32 SyBlobFind(const void *pBlob, sxu32 nLen, const void *pPattern, sxu32 pLen, int iNoCase, sxu32 *pOfft) {
+	const unsigned char *zIn = (const unsigned char *)pBlob;
+	const unsigned char *zPattern = (const unsigned char *)pPattern;
+	const unsigned char *zLast;
+	int iFirst, iLast, c, d;
+	if(pLen > nLen) {
+		return SXERR_NOTFOUND;
+	}
+	if(pLen < 1) {
+		/* An empty pattern matches at the beginning */
+		if(pOfft) {
+			*pOfft = 0;
+		}
+		return SXRET_OK;
+	}
+	if(pLen == 1 && (!iNoCase || SX_ASCII_FOLD(zPattern[0]) == 0)) {
+		/* Single byte search */
+		return SyByteFind((const char *)pBlob, nLen, zPattern[0], pOfft);
+	}
+	/* Point past the last candidate position */
+	zLast = &zIn[nLen - pLen + 1];
+#ifdef SX_SIMD_AVX2
+	if(sxSimdAvx2) {
+		zIn = SyBlobSkipAVX2(zIn, zLast, zPattern, pLen, iNoCase);
+	}
+#endif
+#ifdef SX_SIMD_SSE2
+	zIn = SyBlobSkipSSE2(zIn, zLast, zPattern, pLen, iNoCase);
+#endif
+	iFirst = iNoCase ? SX_ASCII_FOLD(zPattern[0]) : 0;
+	iLast = iNoCase ? SX_ASCII_FOLD(zPattern[pLen - 1]) : 0;
+	c = zPattern[0] | iFirst;
+	d = zPattern[pLen - 1] | iLast;
+	for(;;) {
+		if(zIn >= zLast) {
+			break;
+		}
+		if((zIn[0] | iFirst) == c && (zIn[pLen - 1] | iLast) == d &&
+				(pLen < 3 || (iNoCase ? SyStrnmicmp(&zIn[1], &zPattern[1], pLen - 2) : SyMemcmp(&zIn[1], &zPattern[1], pLen - 2)) == 0)) {
+			if(pOfft) {
+				*pOfft = (sxu32)(zIn - (const unsigned char *)pBlob);
+			}
+			return SXRET_OK;
+		}
+		zIn++;
+	}
+	return SXERR_NOTFOUND;
+}
+PH7_PRIVATE sxi32 SyBlobSearch(const void *pBlob, sxu32 nLen, const void *pPattern, sxu32 pLen, sxu32 *pOfft) {
+	return SyBlobFind(pBlob, nLen, pPattern, pLen, FALSE, pOfft);
+}
+PH7_PRIVATE sxi32 SyBlobSearchNoCase(const void *pBlob, sxu32 nLen, const void *pPattern, sxu32 pLen, sxu32 *pOfft) {
+	return SyBlobFind(pBlob, nLen, pPattern, pLen, TRUE, pOfft);
+}
 PH7_PRIVATE sxi32 SyStrncmp(const char *zLeft, const char *zRight, sxu32 nLen) {
 	const unsigned char *zP = (const unsigned char *)zLeft;
 	const unsigned char *zQ = (const unsigned char *)zRight;
@@ -143,42 +523,45 @@ sxu32 Systrcpy(char *zDest, sxu32 nDestLen, const char *zSrc, sxu32 nLen) {
 	zBuf[0] = 0;
 	return (sxu32)(zBuf - (unsigned char *)zDest);
 }
-PH7_PRIVATE char *SyStrtok(char *str, const char *sep) {
-	static int pos;
-	static char *s;	
-	int i = 0;
-	int start = pos;
-	/* Copy the string for further SyStrtok() calls */
-	if(str != NULL) {
-		s = str;
-	}
-	while(s[pos] != '\0') {
-		i = 0;
-		/* Compare of one of the delimiter matches the character in the string */
-		while(sep[i] != '\0') {
-			if(s[pos] == sep[i]) {
-				/* Replace the delimter by \0 to break the string */
-				s[pos] = '\0';
-				pos++;
-				/* Check for the case where there is no relevant string before the delimeter */
-				if(s[start] != '\0') {
-					return &s[start];
-				} else {
-					start = pos;
-					pos--;
-					break;
-				}
-			}
-			i++;
+static int SyStrIsDelimiter(char c, const char *sep) {
+	while(sep[0] != '\0') {
+		if(sep[0] == c) {
+			return TRUE;
 		}
-		pos++;
+		sep++;
 	}
-	s[pos] = '\0';
-	if(s[start] == '\0') {
+	return FALSE;
+}
+/*
+ * Split a string into tokens separated by any of the given delimiters, skipping
+ * empty ones. The position is kept by the caller in pzSave [i.e: strtok_r()],
+ * so that several threads can tokenize at the same time.
+ */
+PH7_PRIVATE char *SyStrtok(char *str, const char *sep, char **pzSave) {
+	char *zStart;
+	if(str == NULL) {
+		/* Continue with the previous string */
+		str = *pzSave;
+	}
+	/* Skip leading delimiters */
+	while(str[0] != '\0' && SyStrIsDelimiter(str[0], sep)) {
+		str++;
+	}
+	if(str[0] == '\0') {
+		*pzSave = str;
 		return NULL;
-	} else {
-		return &s[start];
 	}
+	zStart = str;
+	while(str[0] != '\0' && !SyStrIsDelimiter(str[0], sep)) {
+		str++;
+	}
+	if(str[0] != '\0') {
+		/* Replace the delimiter by \0 to break the string */
+		str[0] = '\0';
+		str++;
+	}
+	*pzSave = str;
+	return zStart;
 }
 sxi32 SyAsciiToHex(sxi32 c) {
 	if(c >= 'a' && c <= 'f') {
@@ -6,8 +6,14 @@
  * @DEVELOPERS  Symisc Systems <devel@symisc.net>
  *              Rafal Kupiec <belliash@codingworkshop.eu.org>
  */
+#include <stddef.h>
 #include "ph7int.h"
 /* This file handle low-level stuff related to indexed memory objects [i.e: ph7_value] */
+/*
+ * Leading part of a memory object [i.e: value, flags and type] copied on store and load.
+ * The owner VM, string buffer and index of the destination are never overwritten.
+ */
+#define MEMOBJ_COPY_SIZE offsetof(ph7_value, pVm)
 /*
  * Notes on memory objects [i.e: ph7_value].
  * Internally, the PH7 virtual machine manipulates nearly all PHP values
@@ -928,15 +934,17 @@ PH7_PRIVATE sxi32 PH7_MemObjStringFormat(ph7_value *pObj, const char *zFormat, v
 }
 /*
  * Duplicate the contents of a ph7_value.
+ * Hashmaps are not duplicated but shared with the source until one
+ * of the holders modifies it [i.e: PH7_HashmapSeparate()].
  */
 PH7_PRIVATE sxi32 PH7_MemObjStore(ph7_value *pSrc, ph7_value *pDest) {
 	ph7_class_instance *pObj = 0;
-	ph7_hashmap *pSrcMap = 0;
+	ph7_hashmap *pMap = 0;
 	sxi32 rc;
 	if(pSrc->x.pOther) {
 		if(pSrc->nType & MEMOBJ_HASHMAP) {
-			/* Dump source hashmap */
-			pSrcMap = (ph7_hashmap *)pSrc->x.pOther;
+			/* Increment reference count */
+			((ph7_hashmap *)pSrc->x.pOther)->iRef++;
 		} else if(pSrc->nType & MEMOBJ_OBJ) {
 			/* Increment reference count */
 			((ph7_class_instance *)pSrc->x.pOther)->iRef++;
@@ -944,16 +952,15 @@ PH7_PRIVATE sxi32 PH7_MemObjStore(ph7_value *pSrc, ph7_value *pDest) {
 	}
 	if(pDest->nType & MEMOBJ_OBJ) {
 		pObj = (ph7_class_instance *)pDest->x.pOther;
+	} else if(pDest->nType & MEMOBJ_HASHMAP) {
+		pMap = (ph7_hashmap *)pDest->x.pOther;
 	}
-	SyMemcpy((const void *) & (*pSrc), &(*pDest), sizeof(ph7_value) - (sizeof(ph7_vm *) + sizeof(SyBlob) + sizeof(sxu32)));
-	if(pSrcMap) {
-		ph7_hashmap *pMap;
-		pMap = PH7_NewHashmap(&(*pDest->pVm), 0, 0);
-		PH7_HashmapDup(pSrcMap, pMap);
-		pDest->x.pOther = pMap;
-	}
+	SyMemcpy((const void *) & (*pSrc), &(*pDest), MEMOBJ_COPY_SIZE);
 	rc = SXRET_OK;
-	if(SyBlobLength(&pSrc->sBlob) > 0) {
+	if(SyBlobData(&pSrc->sBlob) == SyBlobData(&pDest->sBlob) && (pDest->sBlob.nFlags & SXBLOB_RDONLY) == 0) {
+		/* Source is a view of the destination buffer [i.e: $a = $a], nothing to copy */
+		pDest->sBlob.nByte = SyBlobLength(&pSrc->sBlob);
+	} else if(SyBlobLength(&pSrc->sBlob) > 0) {
 		SyBlobReset(&pDest->sBlob);
 		rc = SyBlobDup(&pSrc->sBlob, &pDest->sBlob);
 	} else {
@@ -963,6 +970,9 @@ PH7_PRIVATE sxi32 PH7_MemObjStore(ph7_value *pSrc, ph7_value *pDest) {
 	}
 	if(pObj) {
 		PH7_ClassInstanceUnref(pObj);
+	} else if(pMap) {
+		/* Release the old hashmap */
+		PH7_HashmapUnref(pMap);
 	}
 	return rc;
 }
@@ -971,8 +981,7 @@ PH7_PRIVATE sxi32 PH7_MemObjStore(ph7_value *pSrc, ph7_value *pDest) {
  * buffer contents,simply point to it.
  */
 PH7_PRIVATE sxi32 PH7_MemObjLoad(ph7_value *pSrc, ph7_value *pDest) {
-	SyMemcpy((const void *) & (*pSrc), &(*pDest),
-			 sizeof(ph7_value) - (sizeof(ph7_vm *) + sizeof(SyBlob) + sizeof(sxu32)));
+	SyMemcpy((const void *) & (*pSrc), &(*pDest), MEMOBJ_COPY_SIZE);
 	if(pSrc->x.pOther) {
 		if(pSrc->nType & MEMOBJ_HASHMAP) {
 			/* Increment reference count */
@@ -987,6 +996,8 @@ PH7_PRIVATE sxi32 PH7_MemObjLoad(ph7_value *pSrc, ph7_value *pDest) {
 	}
 	if(SyBlobLength(&pSrc->sBlob) > 0) {
 		SyBlobReadOnly(&pDest->sBlob, SyBlobData(&pSrc->sBlob), SyBlobLength(&pSrc->sBlob));
+		/* A view of an interned string is still interned */
+		pDest->sBlob.nFlags |= pSrc->sBlob.nFlags & SXBLOB_INTERN;
 	}
 	return SXRET_OK;
 }
@@ -995,17 +1006,22 @@ PH7_PRIVATE sxi32 PH7_MemObjLoad(ph7_value *pSrc, ph7_value *pDest) {
  */
 PH7_PRIVATE sxi32 PH7_MemObjRelease(ph7_value *pObj) {
 	if((pObj->nType & MEMOBJ_NULL) == 0) {
-		if(pObj->x.pOther) {
-			if(pObj->nType & MEMOBJ_HASHMAP) {
-				PH7_HashmapUnref((ph7_hashmap *)pObj->x.pOther);
-			} else if(pObj->nType & MEMOBJ_OBJ) {
-				PH7_ClassInstanceUnref((ph7_class_instance *)pObj->x.pOther);
-			}
-		}
+		sxu32 nType = pObj->nType;
+		void *pOther = pObj->x.pOther;
 		/* Release the internal buffer */
 		SyBlobRelease(&pObj->sBlob);
 		/* Invalidate any prior representation */
 		pObj->nType = MEMOBJ_NULL;
+		/* Drop the reference last, the instance may own the slot holding it
+		 * (i.e: $this->self = $this) and recycle it along with its attributes.
+		 */
+		if(pOther) {
+			if(nType & MEMOBJ_HASHMAP) {
+				PH7_HashmapUnref((ph7_hashmap *)pOther);
+			} else if(nType & MEMOBJ_OBJ) {
+				PH7_ClassInstanceUnref((ph7_class_instance *)pOther);
+			}
+		}
 	}
 	return SXRET_OK;
 }
@@ -1242,8 +1258,8 @@ PH7_PRIVATE sxi32 PH7_MemObjAdd(ph7_value *pObj1, ph7_value *pObj2, int bAddStor
 						PH7_VmMemoryError(pObj1->pVm);
 					}
 				}
-				/* Point to the structure that describe the hashmap */
-				pMap = (ph7_hashmap *)pObj1->x.pOther;
+				/* Point to the structure that describe the hashmap, copy it first if shared */
+				pMap = PH7_HashmapSeparate(pObj1);
 			} else {
 				/* Create a new hashmap */
 				pMap = PH7_NewHashmap(pObj1->pVm, 0, 0);
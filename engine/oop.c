@@ -168,8 +168,8 @@ PH7_PRIVATE ph7_class_attr *PH7_ClassExtractAttribute(ph7_class *pClass, const c
 	SyHashEntry *pEntry;
 	ph7_class_attr *pAttr;
 	/* Perform a hash lookup */
-	SyHashResetLoopCursor(&pClass->hAttr);
-	while((pEntry = SyHashGetNextEntry(&pClass->hAttr)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pClass->hAttr, pEntry)) != 0) {
 		/* Point to the desired method */
 		pAttr = (ph7_class_attr *)pEntry->pUserData;
 		if(pAttr->pClass == pClass && SyStrncmp(pAttr->sName.zString, zName, nByte) == 0) {
@@ -243,9 +243,9 @@ PH7_PRIVATE sxi32 PH7_ClassInstallMethod(ph7_class *pClass, ph7_class_method *pM
  * error message.
  */
 PH7_PRIVATE sxi32 PH7_ClassInherit(ph7_vm *pVm, ph7_class *pSub, ph7_class *pBase) {
+	SyHashEntry *pEntry, *pSubEntry;
 	ph7_class_method *pMeth;
 	ph7_class_attr *pAttr;
-	SyHashEntry *pEntry;
 	SyString *pName;
 	sxi32 rc;
 	/* Install in the derived hashtable */
@@ -254,13 +254,13 @@ PH7_PRIVATE sxi32 PH7_ClassInherit(ph7_vm *pVm, ph7_class *pSub, ph7_class *pBas
 		return rc;
 	}
 	/* Copy all attributes from the base class */
-	SyHashResetLoopCursor(&pBase->hAttr);
-	while((pEntry = SyHashGetNextEntry(&pBase->hAttr)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pBase->hAttr, pEntry)) != 0) {
 		/* Check if attributes are not being redeclared in the subclass and emit WARNING */
 		pAttr = (ph7_class_attr *)pEntry->pUserData;
 		pName = &pAttr->sName;
-		if((pEntry = SyHashGet(&pSub->hAttr, (const void *)pName->zString, pName->nByte)) != 0) {
-			ph7_class_attr *pSubAttr = (ph7_class_attr *)pEntry->pUserData;
+		if((pSubEntry = SyHashGet(&pSub->hAttr, (const void *)pName->zString, pName->nByte)) != 0) {
+			ph7_class_attr *pSubAttr = (ph7_class_attr *)pSubEntry->pUserData;
 			PH7_VmThrowError(pVm, PH7_CTX_WARNING, "Attribute '%z::$%z' hides inherited member '%z::$%z'", &pSubAttr->pClass->sName, pName, &pBase->sName, pName);
 		}
 		/* Install the attribute */
@@ -269,12 +269,12 @@ PH7_PRIVATE sxi32 PH7_ClassInherit(ph7_vm *pVm, ph7_class *pSub, ph7_class *pBas
 			return rc;
 		}
 	}
-	SyHashResetLoopCursor(&pBase->hMethod);
-	while((pEntry = SyHashGetNextEntry(&pBase->hMethod)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pBase->hMethod, pEntry)) != 0) {
 		/* Make sure the final methods are not redeclared in the subclass */
 		pMeth = (ph7_class_method *)pEntry->pUserData;
 		pName = &pMeth->sFunc.sName;
-		if((pEntry = SyHashGet(&pSub->hMethod, (const void *)pName->zString, pName->nByte)) != 0) {
+		if((pSubEntry = SyHashGet(&pSub->hMethod, (const void *)pName->zString, pName->nByte)) != 0) {
 			if(pMeth->iFlags & PH7_CLASS_ATTR_FINAL) {
 				/* Cannot Overwrite final method */
 				PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Cannot overwrite final method '%z:%z()' inside child class '%z'", &pBase->sName, pName, &pSub->sName);
@@ -320,9 +320,9 @@ PH7_PRIVATE sxi32 PH7_ClassInterfaceInherit(ph7_class *pSub, ph7_class *pBase) {
 	sxi32 rc;
 	/* Install in the derived hashtable */
 	SyHashInsert(&pSub->hDerived, (const void *)SyStringData(&pBase->sName), SyStringLength(&pBase->sName), pBase);
-	SyHashResetLoopCursor(&pBase->hAttr);
+	pEntry = 0;
 	/* Copy constants */
-	while((pEntry = SyHashGetNextEntry(&pBase->hAttr)) != 0) {
+	while((pEntry = SyHashNextEntry(&pBase->hAttr, pEntry)) != 0) {
 		/* Make sure the constants are not redeclared in the subclass */
 		pAttr = (ph7_class_attr *)pEntry->pUserData;
 		pName = &pAttr->sName;
@@ -334,9 +334,9 @@ PH7_PRIVATE sxi32 PH7_ClassInterfaceInherit(ph7_class *pSub, ph7_class *pBase) {
 			}
 		}
 	}
-	SyHashResetLoopCursor(&pBase->hMethod);
+	pEntry = 0;
 	/* Copy methods signature */
-	while((pEntry = SyHashGetNextEntry(&pBase->hMethod)) != 0) {
+	while((pEntry = SyHashNextEntry(&pBase->hMethod, pEntry)) != 0) {
 		/* Make sure the method are not redeclared in the subclass */
 		pMeth = (ph7_class_method *)pEntry->pUserData;
 		pName = &pMeth->sFunc.sName;
@@ -373,8 +373,8 @@ PH7_PRIVATE sxi32 PH7_ClassImplement(ph7_vm *pVm, ph7_class *pMain, ph7_class *p
 	SyString *pName;
 	sxi32 rc;
 	/* First off,copy all constants declared inside the interface */
-	SyHashResetLoopCursor(&pInterface->hAttr);
-	while((pEntry = SyHashGetNextEntry(&pInterface->hAttr)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pInterface->hAttr, pEntry)) != 0) {
 		/* Point to the constant declaration */
 		pAttr = (ph7_class_attr *)pEntry->pUserData;
 		pName = &pAttr->sName;
@@ -387,11 +387,11 @@ PH7_PRIVATE sxi32 PH7_ClassImplement(ph7_vm *pVm, ph7_class *pMain, ph7_class *p
 			}
 		}
 	}
-	SyHashResetLoopCursor(&pInterface->hMethod);
-	while((pEntry = SyHashGetNextEntry(&pInterface->hMethod)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pInterface->hMethod, pEntry)) != 0) {
 		pMeth = (ph7_class_method *)pEntry->pUserData;
 		pName = &pMeth->sFunc.sName;
-		if((pEntry = SyHashGet(&pMain->hMethod, (const void *)pName->zString, pName->nByte)) != 0) {
+		if(SyHashGet(&pMain->hMethod, (const void *)pName->zString, pName->nByte) != 0) {
 			continue;
 		} else {
 			PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Method '%z:%z()' must be defined inside class '%z'", &pInterface->sName, pName, &pMain->sName);
@@ -482,8 +482,11 @@ PH7_PRIVATE sxi32 PH7_ClassImplement(ph7_vm *pVm, ph7_class *pMain, ph7_class *p
  */
 static ph7_class_instance *NewClassInstance(ph7_vm *pVm, ph7_class *pClass) {
 	ph7_class_instance *pThis;
+	sxu32 iTag;
 	/* Allocate a new instance */
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_OBJECTS, iTag);
 	pThis = (ph7_class_instance *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(ph7_class_instance));
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	if(pThis == 0) {
 		return 0;
 	}
@@ -502,13 +505,16 @@ static ph7_class_instance *NewClassInstance(ph7_vm *pVm, ph7_class *pClass) {
  */
 PH7_PRIVATE ph7_class_instance *PH7_NewClassInstance(ph7_vm *pVm, ph7_class *pClass) {
 	ph7_class_instance *pNew;
+	sxu32 iTag;
 	sxi32 rc;
 	pNew = NewClassInstance(&(*pVm), &(*pClass));
 	if(pNew == 0) {
 		return 0;
 	}
 	/* Associate a private VM frame with this class instance */
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_OBJECTS, iTag);
 	rc = PH7_VmCreateClassInstanceFrame(&(*pVm), pNew);
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	if(rc != SXRET_OK) {
 		SyMemBackendPoolFree(&pVm->sAllocator, pNew);
 		return 0;
@@ -522,7 +528,7 @@ PH7_PRIVATE ph7_class_instance *PH7_NewClassInstance(ph7_vm *pVm, ph7_class *pCl
 static ph7_value *ExtractClassAttrValue(ph7_vm *pVm, VmClassAttr *pAttr) {
 	/* Extract the value */
 	ph7_value *pValue;
-	pValue = (ph7_value *)SySetAt(&pVm->aMemObj, pAttr->nIdx);
+	pValue = VmObjTableAt(&pVm->aMemObj, pAttr->nIdx);
 	return pValue;
 }
 /*
@@ -615,6 +621,7 @@ PH7_PRIVATE ph7_class_instance *PH7_CloneClassInstance(ph7_class_instance *pSrc)
 	SyHashEntry *pEntry2;
 	SyHashEntry *pEntry;
 	ph7_vm *pVm;
+	sxu32 iTag;
 	sxi32 rc;
 	/* Allocate a new instance */
 	pVm = pSrc->pVm;
@@ -623,7 +630,9 @@ PH7_PRIVATE ph7_class_instance *PH7_CloneClassInstance(ph7_class_instance *pSrc)
 		return 0;
 	}
 	/* Associate a private VM frame with this class instance */
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_OBJECTS, iTag);
 	rc = PH7_VmCreateClassInstanceFrame(pVm, pClone);
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	if(rc != SXRET_OK) {
 		SyMemBackendPoolFree(&pVm->sAllocator, pClone);
 		return 0;
@@ -647,20 +656,21 @@ PH7_PRIVATE ph7_class_instance *PH7_CloneClassInstance(ph7_class_instance *pSrc)
 	/* call the __clone method on the cloned object if available */
 	pMethod = PH7_ClassExtractMethod(pClone->pClass, "__clone", sizeof("__clone") - 1);
 	if(pMethod) {
-		if(pMethod->iCloneDepth < 16) {
-			pMethod->iCloneDepth++;
+		/* The clone depth is private to the executing VM */
+		sxi32 *pDepth = (sxi32 *)PH7_VmPrivateRecord(pVm, &pMethod->iCloneDepth, sizeof(sxi32));
+		if(*pDepth < 16) {
+			(*pDepth)++;
 			PH7_VmCallClassMethod(pVm, pClone, pMethod, 0, 0, 0);
 		} else {
 			/* Nesting limit reached */
 			PH7_VmThrowError(pVm, PH7_CTX_ERR, "Object clone limit reached");
 		}
 		/* Reset the cursor */
-		pMethod->iCloneDepth = 0;
+		*pDepth = 0;
 	}
 	/* Return the cloned object */
 	return pClone;
 }
-#define CLASS_INSTANCE_DESTROYED 0x001 /* Instance is released */
 /*
  * Release a class instance [i.e: Object in the PHP jargon] and invoke any defined destructor.
  * This routine is invoked as soon as there are no other references to a particular
@@ -680,10 +690,17 @@ static void PH7_ClassInstanceRelease(ph7_class_instance *pThis) {
 	}
 	/* Mark as destroyed */
 	pThis->iFlags |= CLASS_INSTANCE_DESTROYED;
-	/* Invoke any defined destructor if available */
 	pVm = pThis->pVm;
+	if(pThis->sGc.nRoot) {
+		/* No longer a possible root of a garbage cycle */
+		PH7_GcRemoveRoot(pVm, &pThis->sGc);
+	}
+	/* Invoke any defined destructor if available */
 	pClass = pThis->pClass;
-	pDestr = PH7_ClassExtractMethod(pClass, "__destruct", sizeof("__destruct") - 1);
+	pDestr = 0;
+	if((pThis->iFlags & CLASS_INSTANCE_FINALIZED) == 0) {
+		pDestr = PH7_ClassExtractMethod(pClass, "__destruct", sizeof("__destruct") - 1);
+	}
 	if(pDestr) {
 		/* Invoke the destructor */
 		pThis->iRef = 2; /* Prevent garbage collection */
@@ -712,6 +729,9 @@ PH7_PRIVATE void PH7_ClassInstanceUnref(ph7_class_instance *pThis) {
 		if(pThis->iRef < 1) {
 			/* No more reference to this instance */
 			PH7_ClassInstanceRelease(&(*pThis));
+		} else if(pThis->sGc.nRoot == 0 && pThis->pVm->sGc.bEnabled && (pThis->iFlags & CLASS_INSTANCE_DESTROYED) == 0) {
+			/* Possible root of a garbage cycle */
+			PH7_GcAddRoot(pThis->pVm, pThis, MEMOBJ_OBJ);
 		}
 	}
 }
@@ -2868,22 +2868,17 @@ static ph7_int64 StreamRead(io_private *pDev, void *pBuf, ph7_int64 nLen) {
  * Extract a single line from the buffered input.
  */
 static sxi32 GetLine(io_private *pDev, ph7_int64 *pLen, const char **pzLine) {
-	const char *zIn, *zEnd, *zPtr;
+	const char *zIn;
+	sxu32 nPos;
 	zIn = (const char *)SyBlobDataAt(&pDev->sBuffer, pDev->nOfft);
-	zEnd = &zIn[SyBlobLength(&pDev->sBuffer) - pDev->nOfft];
-	zPtr = zIn;
-	while(zIn < zEnd) {
-		if(zIn[0] == '\n') {
-			/* Line found */
-			zIn++; /* Include the line ending as requested by the PHP specification */
-			*pLen = (ph7_int64)(zIn - zPtr);
-			*pzLine = zPtr;
-			return SXRET_OK;
-		}
-		zIn++;
+	if(SyByteFind(zIn, SyBlobLength(&pDev->sBuffer) - pDev->nOfft, '\n', &nPos) != SXRET_OK) {
+		/* No line were found */
+		return SXERR_NOTFOUND;
 	}
-	/* No line were found */
-	return SXERR_NOTFOUND;
+	/* Include the line ending as requested by the PHP specification */
+	*pLen = (ph7_int64)nPos + 1;
+	*pzLine = zIn;
+	return SXRET_OK;
 }
 /*
  * Read a single line from the underlying IO stream device.
@@ -4749,6 +4744,7 @@ static int StrModeToFlags(ph7_context *pCtx, const char *zMode, int nLen) {
 static void InitIOPrivate(ph7_vm *pVm, const ph7_io_stream *pStream, io_private *pOut) {
 	pOut->pStream = pStream;
 	SyBlobInit(&pOut->sBuffer, &pVm->sAllocator);
+	pOut->sBuffer.nFlags |= SXBLOB_IO;
 	pOut->nOfft = 0;
 	/* Set the magic number */
 	pOut->iMagic = IO_PRIVATE_MAGIC;
@@ -7720,11 +7716,14 @@ struct ph7_stream_data {
  */
 static ph7_stream_data *PHPStreamDataInit(ph7_vm *pVm, int iType) {
 	ph7_stream_data *pData;
+	sxu32 iTag;
 	if(pVm == 0) {
 		return 0;
 	}
 	/* Allocate a new instance */
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_IO, iTag);
 	pData = (ph7_stream_data *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(ph7_stream_data));
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	if(pData == 0) {
 		return 0;
 	}
@@ -7816,6 +7815,8 @@ static ph7_int64 PHPStreamData_Read(void *pHandle, void *pBuffer, ph7_int64 nDat
 		/* Forbidden */
 		return -1;
 	}
+	/* Make sure a pending prompt is visible before blocking on input */
+	PH7_VmOutputFlush(pData->pVm);
 #ifdef __WINNT__
 	{
 		DWORD nRd;
@@ -7861,6 +7862,8 @@ static ph7_int64 PHPStreamData_Write(void *pHandle, const void *pBuf, ph7_int64
 		}
 		return nWrite;
 	}
+	/* Keep the buffered VM output ahead of this write */
+	PH7_VmOutputFlush(pData->pVm);
 #ifdef __WINNT__
 	{
 		DWORD nWr;
@@ -8030,7 +8033,6 @@ PH7_PRIVATE sxi32 PH7_RegisterIORoutine(ph7_vm *pVm) {
 		{"parse_ini_file", PH7_builtin_parse_ini_file},
 		{"vfprintf",  PH7_builtin_vfprintf}
 	};
-	const ph7_io_stream *pFileStream = 0;
 	sxu32 n = 0;
 	/* Register the functions defined above */
 	for(n = 0 ; n < SX_ARRAYSIZE(aVfsFunc) ; ++n) {
@@ -8039,12 +8041,27 @@ PH7_PRIVATE sxi32 PH7_RegisterIORoutine(ph7_vm *pVm) {
 	for(n = 0 ; n < SX_ARRAYSIZE(aIOFunc) ; ++n) {
 		ph7_create_function(&(*pVm), aIOFunc[n].zName, aIOFunc[n].xFunc, pVm);
 	}
-	/* Register the file stream if available */
+	return SXRET_OK;
+}
+/*
+ * Return a pointer to the built-in file:// stream if available. NULL otherwise.
+ */
+PH7_PRIVATE const ph7_io_stream *PH7_ExportFileStream(void) {
 #ifdef __WINNT__
-	pFileStream = &sWinFileStream;
+	return &sWinFileStream;
 #elif defined(__UNIXES__)
-	pFileStream = &sUnixFileStream;
+	return &sUnixFileStream;
+#else
+	return 0;
 #endif
+}
+/*
+ * Install the built-in IO streams [i.e: php://, file://] in the given VM.
+ */
+PH7_PRIVATE sxi32 PH7_RegisterIOStream(ph7_vm *pVm) {
+	const ph7_io_stream *pFileStream;
+	/* Register the file stream if available */
+	pFileStream = PH7_ExportFileStream();
 	/* Install the php:// stream */
 	ph7_vm_config(pVm, PH7_VM_CONFIG_IO_STREAM, &sPHP_Stream);
 	if(pFileStream) {
@@ -8059,8 +8076,11 @@ PH7_PRIVATE sxi32 PH7_RegisterIORoutine(ph7_vm *pVm) {
 PH7_PRIVATE void *PH7_ExportStdin(ph7_vm *pVm) {
 	if(pVm->pStdin == 0) {
 		io_private *pIn;
+		sxu32 iTag;
 		/* Allocate an IO private instance */
+		SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_IO, iTag);
 		pIn = (io_private *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(io_private));
+		SyMemBackendPopTag(&pVm->sAllocator, iTag);
 		if(pIn == 0) {
 			return 0;
 		}
@@ -8081,8 +8101,11 @@ PH7_PRIVATE void *PH7_ExportStdin(ph7_vm *pVm) {
 PH7_PRIVATE void *PH7_ExportStdout(ph7_vm *pVm) {
 	if(pVm->pStdout == 0) {
 		io_private *pOut;
+		sxu32 iTag;
 		/* Allocate an IO private instance */
+		SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_IO, iTag);
 		pOut = (io_private *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(io_private));
+		SyMemBackendPopTag(&pVm->sAllocator, iTag);
 		if(pOut == 0) {
 			return 0;
 		}
@@ -8103,8 +8126,11 @@ PH7_PRIVATE void *PH7_ExportStdout(ph7_vm *pVm) {
 PH7_PRIVATE void *PH7_ExportStderr(ph7_vm *pVm) {
 	if(pVm->pStderr == 0) {
 		io_private *pErr;
+		sxu32 iTag;
 		/* Allocate an IO private instance */
+		SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_IO, iTag);
 		pErr = (io_private *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(io_private));
+		SyMemBackendPopTag(&pVm->sAllocator, iTag);
 		if(pErr == 0) {
 			return 0;
 		}
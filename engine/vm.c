@@ -53,6 +53,109 @@ struct SyhttpHeader {
 #define HTTP_PROTO_10 1 /* HTTP/1.0 */
 #define HTTP_PROTO_11 2 /* HTTP/1.1 */
 #define HTTP_PROTO_20 3 /* HTTP/2.0 */
+/*
+ * Install a constant and it's associated expansion callback in the
+ * given collection.
+ */
+static ph7_constant *VmInstallConstant(
+	ph7_vm *pVm,            /* Target VM */
+	SyHash *pCollection,    /* Constant collection */
+	const SyString *pName,  /* Constant name */
+	ProcConstant xExpand,   /* Constant expansion callback */
+	void *pUserData         /* Last argument to xExpand() */
+) {
+	ph7_constant *pCons;
+	char *zDupName;
+	sxi32 rc;
+	/* Allocate a new constant instance */
+	pCons = (ph7_constant *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(ph7_constant));
+	if(pCons == 0) {
+		PH7_VmMemoryError(&(*pVm));
+	}
+	/* Duplicate constant name */
+	zDupName = SyMemBackendStrDup(&pVm->sAllocator, pName->zString, pName->nByte);
+	if(zDupName == 0) {
+		PH7_VmMemoryError(&(*pVm));
+	}
+	/* Install the constant */
+	SyStringInitFromBuf(&pCons->sName, zDupName, pName->nByte);
+	pCons->xExpand = xExpand;
+	pCons->pUserData = pUserData;
+	pCons->pValue = 0;
+	pCons->iFlags = 0;
+	rc = SyHashInsert(pCollection, (const void *)zDupName, SyStringLength(&pCons->sName), pCons);
+	if(rc != SXRET_OK) {
+		PH7_VmMemoryError(&(*pVm));
+	}
+	return pCons;
+}
+/*
+ * Return the compiled constant expression the given VM evaluates.
+ * The expression is executed by the VM recorded as its container user data,
+ * so an execution context works on a private copy pointing to itself.
+ */
+static SySet *VmConstantByteCode(ph7_vm *pVm, SySet *pByteCode) {
+	if(SySetGetUserData(pByteCode) == (void *)pVm) {
+		return pByteCode;
+	}
+	pByteCode = (SySet *)PH7_VmPrivateRecord(&(*pVm), pByteCode, sizeof(SySet));
+	SySetSetUserData(pByteCode, pVm);
+	return pByteCode;
+}
+/*
+ * Extract the global constant with the given name.
+ * Built-in constants are registered once by the private VM holding the
+ * built-in library, and copied to the target VM on first use only.
+ * Likewise, an execution context copies the constants of the program it
+ * executes on first use.
+ * Return a pointer to the constant on success. NULL otherwise.
+ */
+PH7_PRIVATE ph7_constant *PH7_VmExtractConstant(
+	ph7_vm *pVm,        /* Target VM */
+	const char *zName,  /* Constant name */
+	sxu32 nByte         /* zName length */
+) {
+	ph7_vm *pBuiltin = pVm->pEngine->pBuiltin;
+	ph7_constant *pCons;
+	SyHashEntry *pEntry;
+	void *pUserData;
+	pEntry = SyHashGet(&pVm->hConstant, (const void *)zName, nByte);
+	if(pEntry) {
+		pCons = (ph7_constant *)pEntry->pUserData;
+		/* A NULL callback marks a deleted built-in constant */
+		return pCons->xExpand ? pCons : 0;
+	}
+	if(pVm->pProgram) {
+		pEntry = SyHashGet(&pVm->pProgram->hConstant, (const void *)zName, nByte);
+		if(pEntry) {
+			pCons = (ph7_constant *)pEntry->pUserData;
+			if(pCons->xExpand == 0) {
+				return 0;
+			}
+			pUserData = pCons->pUserData;
+			if(pCons->xExpand == PH7_VmExpandConstantValue) {
+				pUserData = (void *)VmConstantByteCode(&(*pVm), (SySet *)pUserData);
+			} else if(pUserData == (void *)pVm->pProgram) {
+				pUserData = (void *)pVm;
+			}
+			return VmInstallConstant(&(*pVm), &pVm->hConstant, &pCons->sName, pCons->xExpand, pUserData);
+		}
+	}
+	if(pBuiltin == 0 || pBuiltin == pVm) {
+		return 0;
+	}
+	pEntry = SyHashGet(&pBuiltin->hConstant, (const void *)zName, nByte);
+	if(pEntry == 0) {
+		return 0;
+	}
+	pCons = (ph7_constant *)pEntry->pUserData;
+	pUserData = pCons->pUserData;
+	if(pUserData == (void *)pBuiltin) {
+		/* Built-in constants have access to the VM expanding them as their private data */
+		pUserData = (void *)pVm;
+	}
+	return VmInstallConstant(&(*pVm), &pVm->hConstant, &pCons->sName, pCons->xExpand, pUserData);
+}
 /*
  * Register a constant and it's associated expansion callback so that
  * it can be expanded from the target PHP program.
@@ -76,38 +179,105 @@ PH7_PRIVATE sxi32 PH7_VmRegisterConstant(
 	ph7_constant *pCons;
 	SyHash *pCollection;
 	SyHashEntry *pEntry;
-	char *zDupName;
-	sxi32 rc;
 	if(bGlobal) {
+		if(PH7_VmExtractConstant(&(*pVm), pName->zString, pName->nByte)) {
+			/* Constant already exists */
+			return SXERR_EXISTS;
+		}
 		pCollection = &pVm->hConstant;
 	} else {
 		pCollection = &pVm->pFrame->hConst;
 	}
 	pEntry = SyHashGet(pCollection, (const void *)pName->zString, pName->nByte);
 	if(pEntry) {
-		/* Constant already exists */
-		return SXERR_EXISTS;
+		pCons = (ph7_constant *)pEntry->pUserData;
+		if(pCons->xExpand) {
+			/* Constant already exists */
+			return SXERR_EXISTS;
+		}
+		/* Define again a deleted built-in constant */
+		pCons->xExpand = xExpand;
+		pCons->pUserData = pUserData;
+		pCons->pValue = 0;
+		pCons->iFlags = 0;
+		return SXRET_OK;
 	}
-	/* Allocate a new constant instance */
-	pCons = (ph7_constant *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(ph7_constant));
-	if(pCons == 0) {
-		PH7_VmMemoryError(&(*pVm));
+	VmInstallConstant(&(*pVm), pCollection, &(*pName), xExpand, pUserData);
+	/* All done,constant can be invoked from PHP code */
+	return SXRET_OK;
+}
+/*
+ * Check whether the given compiled constant expression evaluates to the
+ * same value each time without side effects: only literals, array literals
+ * and operators are allowed. Named constants are not, since their value may
+ * change on each access [i.e: __TIME__].
+ */
+static int VmIsPureExpr(SySet *pByteCode) {
+	VmInstr *aInstr = (VmInstr *)SySetBasePtr(pByteCode);
+	sxu32 n;
+	for(n = 0 ; n < SySetUsed(pByteCode) ; ++n) {
+		switch(aInstr[n].iOp) {
+			case PH7_OP_LOADC:
+				if(aInstr[n].iP1 != 0) {
+					return FALSE;
+				}
+				break;
+			case PH7_OP_DONE:
+			case PH7_OP_NOOP:
+			case PH7_OP_JMP:
+			case PH7_OP_JMPZ:
+			case PH7_OP_JMPNZ:
+			case PH7_OP_POP:
+			case PH7_OP_LOAD_MAP:
+			case PH7_OP_CVT_INT:
+			case PH7_OP_CVT_STR:
+			case PH7_OP_CVT_REAL:
+			case PH7_OP_CVT_BOOL:
+			case PH7_OP_CVT_CHAR:
+				break;
+			default:
+				if(aInstr[n].iOp < PH7_OP_UMINUS || aInstr[n].iOp > PH7_OP_NULLC) {
+					return FALSE;
+				}
+				break;
+		}
 	}
-	/* Duplicate constant name */
-	zDupName = SyMemBackendStrDup(&pVm->sAllocator, pName->zString, pName->nByte);
-	if(zDupName == 0) {
-		PH7_VmMemoryError(&(*pVm));
+	return TRUE;
+}
+/*
+ * Expand the value of the given constant into pVal.
+ * A constant created by the 'define' or 'const' statement is evaluated by running
+ * its compiled expression. When that expression has no side effects, it is run once
+ * and its value is memoized for the lifetime of the VM, so that function local
+ * constants are not evaluated again on each call either.
+ */
+static void VmExpandConstant(ph7_vm *pVm, ph7_constant *pCons, ph7_value *pVal) {
+	SyHashEntry *pEntry;
+	ph7_value *pValue;
+	if(pCons->pValue == 0 && (pCons->iFlags & PH7_CONST_VOLATILE) == 0) {
+		if(pCons->xExpand != PH7_VmExpandConstantValue || !VmIsPureExpr((SySet *)pCons->pUserData)) {
+			pCons->iFlags |= PH7_CONST_VOLATILE;
+		} else {
+			pEntry = SyHashGet(&pVm->hConstValue, (const void *)&pCons->pUserData, sizeof(void *));
+			if(pEntry) {
+				pCons->pValue = (ph7_value *)pEntry->pUserData;
+			} else if((pValue = (ph7_value *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(ph7_value) + sizeof(void *))) != 0) {
+				PH7_MemObjInit(&(*pVm), pValue);
+				pCons->xExpand(pValue, pCons->pUserData);
+				/* The expression address used as the key is stored right after the value */
+				SyMemcpy((const void *)&pCons->pUserData, &pValue[1], sizeof(void *));
+				if(SyHashInsert(&pVm->hConstValue, (const void *)&pValue[1], sizeof(void *), pValue) != SXRET_OK) {
+					PH7_VmMemoryError(&(*pVm));
+				}
+				pCons->pValue = pValue;
+			}
+		}
 	}
-	/* Install the constant */
-	SyStringInitFromBuf(&pCons->sName, zDupName, pName->nByte);
-	pCons->xExpand = xExpand;
-	pCons->pUserData = pUserData;
-	rc = SyHashInsert(pCollection, (const void *)zDupName, SyStringLength(&pCons->sName), pCons);
-	if(rc != SXRET_OK) {
-		PH7_VmMemoryError(&(*pVm));
+	if(pCons->pValue) {
+		PH7_MemObjLoad(pCons->pValue, pVal);
+	} else {
+		pCons->xExpand(pVal, pCons->pUserData);
 	}
-	/* All done,constant can be invoked from PHP code */
-	return SXRET_OK;
 }
 /*
  * Allocate a new foreign function instance.
@@ -189,6 +359,66 @@ PH7_PRIVATE sxi32 PH7_VmInstallForeignFunction(
 	/* User function successfully installed */
 	return SXRET_OK;
 }
+/*
+ * Extract the foreign function with the given name.
+ * Built-in functions are registered once by the private VM holding the
+ * built-in library, and copied to the target VM on first use only.
+ * Likewise, an execution context copies the foreign functions registered
+ * with the program it executes on first use.
+ * Return a pointer to the foreign function on success. NULL otherwise.
+ */
+PH7_PRIVATE ph7_user_func *PH7_VmExtractForeignFunction(
+	ph7_vm *pVm,        /* Target VM */
+	const char *zName,  /* Foreign function name */
+	sxu32 nByte         /* zName length */
+) {
+	ph7_vm *pBuiltin = pVm->pEngine->pBuiltin;
+	ph7_user_func *pFunc;
+	SyHashEntry *pEntry;
+	void *pUserData;
+	ph7_vm *pSrc;
+	sxi32 rc;
+	pEntry = SyHashGet(&pVm->hHostFunction, (const void *)zName, nByte);
+	if(pEntry) {
+		pFunc = (ph7_user_func *)pEntry->pUserData;
+		/* A NULL callback marks a deleted built-in function */
+		return pFunc->xFunc ? pFunc : 0;
+	}
+	pSrc = pVm->pProgram;
+	if(pSrc) {
+		pEntry = SyHashGet(&pSrc->hHostFunction, (const void *)zName, nByte);
+	}
+	if(pEntry == 0) {
+		if(pBuiltin == 0 || pBuiltin == pVm) {
+			return 0;
+		}
+		pSrc = pBuiltin;
+		pEntry = SyHashGet(&pBuiltin->hHostFunction, (const void *)zName, nByte);
+		if(pEntry == 0) {
+			return 0;
+		}
+	}
+	pFunc = (ph7_user_func *)pEntry->pUserData;
+	if(pFunc->xFunc == 0) {
+		return 0;
+	}
+	pUserData = pFunc->pUserData;
+	if(pUserData == (void *)pSrc || pUserData == (void *)pBuiltin) {
+		/* Special functions have access to the underlying VM as their private data */
+		pUserData = (void *)pVm;
+	}
+	rc = PH7_NewForeignFunction(&(*pVm), &pFunc->sName, pFunc->xFunc, pUserData, &pFunc);
+	if(rc != SXRET_OK) {
+		return 0;
+	}
+	rc = SyHashInsert(&pVm->hHostFunction, SyStringData(&pFunc->sName), SyStringLength(&pFunc->sName), pFunc);
+	if(rc != SXRET_OK) {
+		SyMemBackendFree(&pVm->sAllocator, (void *)SyStringData(&pFunc->sName));
+		SyMemBackendPoolFree(&pVm->sAllocator, pFunc);
+		return 0;
+	}
+	return pFunc;
+}
 /*
  * Initialize a VM function.
  */
@@ -200,6 +430,7 @@ PH7_PRIVATE sxi32 PH7_VmInitFuncState(
 	sxi32 iFlags,       /* Configuration flags */
 	void *pUserData     /* Function private data */
 ) {
+	sxu32 iTag;
 	/* Zero the structure */
 	SyZero(pFunc, sizeof(ph7_vm_func));
 	/* Initialize structure fields */
@@ -210,9 +441,14 @@ PH7_PRIVATE sxi32 PH7_VmInitFuncState(
 	/* Bytecode container */
 	SySetInit(&pFunc->aByteCode, &pVm->sAllocator, sizeof(VmInstr));
 	/* Preallocate some instruction slots */
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_BYTECODE, iTag);
 	SySetAlloc(&pFunc->aByteCode, 0x10);
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	/* Closure environment */
 	SySetInit(&pFunc->aClosureEnv, &pVm->sAllocator, sizeof(ph7_vm_func_closure_env));
+	/* Variable slots */
+	SySetInit(&pFunc->aVarSlot, &pVm->sAllocator, sizeof(char *));
+	SySetInit(&pFunc->aSlotType, &pVm->sAllocator, sizeof(sxu32));
 	pFunc->iFlags = iFlags;
 	pFunc->pUserData = pUserData;
 	SyStringInitFromBuf(&pFunc->sName, zName, nByte);
@@ -232,6 +468,8 @@ PH7_PRIVATE sxi32 PH7_VmInstallUserFunction(
 		/* Use the built-in name */
 		pName = &pFunc->sName;
 	}
+	/* Call sites may have cached the previous function list */
+	pVm->nCacheGen++;
 	/* Check for duplicates (functions with the same name) first */
 	pEntry = SyHashGet(&pVm->hFunction, pName->zString, pName->nByte);
 	if(pEntry) {
@@ -280,6 +518,7 @@ PH7_PRIVATE sxi32 PH7_VmEmitInstr(
 	sxu32 *pIndex /* Instruction index. NULL otherwise */
 ) {
 	VmInstr sInstr;
+	sxu32 iTag;
 	sxi32 rc;
 	/* Extract the processed script */
 	SyString *pFile = (SyString *)SySetPeek(&pVm->aFiles);
@@ -292,7 +531,6 @@ PH7_PRIVATE sxi32 PH7_VmEmitInstr(
 	sInstr.iP1 = iP1;
 	sInstr.iP2 = iP2;
 	sInstr.p3  = p3;
-	sInstr.bExec = FALSE;
 	sInstr.pFile = pFile;
 	sInstr.iLine = 1;
 	if(nLine > 0) {
@@ -303,7 +541,9 @@ PH7_PRIVATE sxi32 PH7_VmEmitInstr(
 		*pIndex = SySetUsed(pVm->pByteContainer);
 	}
 	/* Finally,record the instruction */
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_BYTECODE, iTag);
 	rc = SySetPut(pVm->pByteContainer, (const void *)&sInstr);
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	if(rc != SXRET_OK) {
 		PH7_GenCompileError(&pVm->sCodeGen, E_ERROR, 1, "Fatal,Cannot emit instruction due to a memory failure");
 		/* Fall throw */
@@ -365,8 +605,14 @@ PH7_PRIVATE VmInstr *PH7_VmPeekNextInstr(ph7_vm *pVm) {
 	aInstr = (VmInstr *)SySetBasePtr(pVm->pByteContainer);
 	return &aInstr[n - 2];
 }
+/*
+ * Maximum number of released frames kept for reuse.
+ */
+#define VM_FRAME_POOL_SIZE 256
 /*
  * Allocate a new virtual machine frame.
+ * Frames released by previous calls are reused along with their
+ * containers, which are only initialized when the frame is first allocated.
  */
 static VmFrame *VmNewFrame(
 	ph7_vm *pVm,              /* Target VM */
@@ -374,22 +620,34 @@ static VmFrame *VmNewFrame(
 	ph7_class_instance *pThis /* Top most class instance [i.e: Object in the PHP jargon]. NULL otherwise */
 ) {
 	VmFrame *pFrame;
-	/* Allocate a new vm frame */
-	pFrame = (VmFrame *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(VmFrame));
-	if(pFrame == 0) {
-		return 0;
+	pFrame = pVm->pFrameFree;
+	if(pFrame) {
+		/* Reuse a released frame, its containers are already empty */
+		pVm->pFrameFree = pFrame->pParent;
+		pVm->nFrameFree--;
+		pFrame->pParent = 0;
+		pFrame->aVarSlot = 0;
+		pFrame->nVarSlot = 0;
+		pFrame->iFlags = 0;
+		pFrame->iExceptionJump = 0;
+	} else {
+		/* Allocate a new vm frame */
+		pFrame = (VmFrame *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(VmFrame));
+		if(pFrame == 0) {
+			return 0;
+		}
+		/* Zero the structure */
+		SyZero(pFrame, sizeof(VmFrame));
+		pFrame->pVm = pVm;
+		SyHashInit(&pFrame->hConst, &pVm->sAllocator, 0, 0);
+		SyHashInit(&pFrame->hVar, &pVm->sAllocator, 0, 0);
+		SySetInit(&pFrame->sArg, &pVm->sAllocator, sizeof(VmSlot));
+		SySetInit(&pFrame->sLocal, &pVm->sAllocator, sizeof(VmSlot));
+		SySetInit(&pFrame->sRef, &pVm->sAllocator, sizeof(VmSlot));
 	}
-	/* Zero the structure */
-	SyZero(pFrame, sizeof(VmFrame));
 	/* Initialize frame fields */
 	pFrame->pUserData = pUserData;
 	pFrame->pThis = pThis;
-	pFrame->pVm = pVm;
-	SyHashInit(&pFrame->hConst, &pVm->sAllocator, 0, 0);
-	SyHashInit(&pFrame->hVar, &pVm->sAllocator, 0, 0);
-	SySetInit(&pFrame->sArg, &pVm->sAllocator, sizeof(VmSlot));
-	SySetInit(&pFrame->sLocal, &pVm->sAllocator, sizeof(VmSlot));
-	SySetInit(&pFrame->sRef, &pVm->sAllocator, sizeof(VmSlot));
 	return pFrame;
 }
 /*
@@ -416,6 +674,42 @@ static sxi32 VmEnterFrame(
 	}
 	return SXRET_OK;
 }
+/*
+ * Invalidate the variable slots that point into the given loop or
+ * exception frame. The slots array is shared with the enclosing
+ * function frame.
+ */
+static void VmVarSlotForget(VmFrame *pFrame) {
+	sxu32 n;
+	if(SyHashTotalEntry(&pFrame->hVar) < 1) {
+		/* Nothing to forget */
+		return;
+	}
+	for(n = 0 ; n < pFrame->nVarSlot ; ++n) {
+		if(pFrame->aVarSlot[n].pFrame == pFrame) {
+			pFrame->aVarSlot[n].pEntry = 0;
+		}
+	}
+}
+/*
+ * A new variable is about to be installed in the top active frame.
+ * If this is a loop or exception frame nested in a function body,
+ * the new variable may hide a cached one from an enclosing frame.
+ */
+static void VmVarSlotShadow(VmFrame *pFrame, const char *zName, sxu32 nByte) {
+	VmVarSlot *pSlot;
+	sxu32 n;
+	if(pFrame->aVarSlot == 0 || pFrame->pParent == 0 || pFrame->pParent->aVarSlot != pFrame->aVarSlot) {
+		/* Function frame or no slots at all */
+		return;
+	}
+	for(n = 0 ; n < pFrame->nVarSlot ; ++n) {
+		pSlot = &pFrame->aVarSlot[n];
+		if(pSlot->pEntry && pSlot->pEntry->nKeyLen == nByte && SyMemcmp(pSlot->pEntry->pKey, zName, nByte) == 0) {
+			pSlot->pEntry = 0;
+		}
+	}
+}
 /*
  * Leave the top-most active frame.
  */
@@ -424,29 +718,52 @@ static void VmLeaveFrame(ph7_vm *pVm) {
 	if(pFrame) {
 		/* Unlink from the list of active VM frame */
 		pVm->pFrame = pFrame->pParent;
+		if(pFrame->aVarSlot) {
+			if(pFrame->pParent && pFrame->pParent->aVarSlot == pFrame->aVarSlot) {
+				/* Loop or exception frame, forget the variables it holds */
+				VmVarSlotForget(pFrame);
+			} else {
+				/* Function frame, release the slots */
+				SyMemBackendFree(&pVm->sAllocator, pFrame->aVarSlot);
+			}
+		}
 		if(pFrame->pParent && (pFrame->iFlags & VM_FRAME_EXCEPTION) == 0) {
 			VmSlot  *aSlot;
 			sxu32 n;
 			/* Restore local variable to the free pool so that they can be reused again */
 			aSlot = (VmSlot *)SySetBasePtr(&pFrame->sLocal);
 			for(n = 0 ; n < SySetUsed(&pFrame->sLocal) ; ++n) {
-				/* Unset the local variable */
+				/* Unset the local variable. Its own entry is not cached anymore */
+				pVm->pUnsetEntry = (SyHashEntry *)aSlot[n].pUserData;
 				PH7_VmUnsetMemObj(&(*pVm), aSlot[n].nIdx, FALSE);
 			}
+			pVm->pUnsetEntry = 0;
 			/* Remove local reference */
 			aSlot = (VmSlot *)SySetBasePtr(&pFrame->sRef);
 			for(n = 0 ; n < SySetUsed(&pFrame->sRef) ; ++n) {
 				PH7_VmRefObjRemove(&(*pVm), aSlot[n].nIdx, (SyHashEntry *)aSlot[n].pUserData, 0);
 			}
 		}
-		/* Release internal containers */
-		SyHashRelease(&pFrame->hConst);
-		SyHashRelease(&pFrame->hVar);
-		SySetRelease(&pFrame->sArg);
-		SySetRelease(&pFrame->sLocal);
-		SySetRelease(&pFrame->sRef);
-		/* Release the whole structure */
-		SyMemBackendPoolFree(&pVm->sAllocator, pFrame);
+		if(pVm->nFrameFree < VM_FRAME_POOL_SIZE) {
+			/* Empty the internal containers and keep the frame for the next call */
+			SyHashReset(&pFrame->hConst);
+			SyHashReset(&pFrame->hVar);
+			SySetReset(&pFrame->sArg);
+			SySetReset(&pFrame->sLocal);
+			SySetReset(&pFrame->sRef);
+			pFrame->pParent = pVm->pFrameFree;
+			pVm->pFrameFree = pFrame;
+			pVm->nFrameFree++;
+		} else {
+			/* Release internal containers */
+			SyHashRelease(&pFrame->hConst);
+			SyHashRelease(&pFrame->hVar);
+			SySetRelease(&pFrame->sArg);
+			SySetRelease(&pFrame->sLocal);
+			SySetRelease(&pFrame->sRef);
+			/* Release the whole structure */
+			SyMemBackendPoolFree(&pVm->sAllocator, pFrame);
+		}
 	}
 }
 /*
@@ -484,7 +801,8 @@ static ph7_vm_func *VmOverload(
 	ph7_vm *pVm,         /* Target VM */
 	ph7_vm_func *pList,  /* Linked list of candidates for overloading */
 	ph7_value *aArg,     /* Array of passed arguments */
-	int nArg             /* Total number of passed arguments  */
+	int nArg,            /* Total number of passed arguments  */
+	sxbool *pFixed       /* OUT: TRUE if the selection does not depend on the arguments type */
 ) {
 	int iTarget, i, j, iArgs, iCur, iMax;
 	ph7_vm_func *apSet[10];   /* Maximum number of candidates */
@@ -522,8 +840,10 @@ static ph7_vm_func *VmOverload(
 	}
 	if(nArg < 1 || i < 2) {
 		/* Return the only candidate */
+		*pFixed = TRUE;
 		return apSet[0];
 	}
+	*pFixed = FALSE;
 	/* Calculate function signature */
 	SyBlobInit(&sSig, &pVm->sAllocator);
 	for(j = 0 ; j < nArg ; j++) {
@@ -585,6 +905,129 @@ static ph7_vm_func *VmOverload(
 	/* Appropriate function for the current call context */
 	return apSet[iTarget];
 }
+/*
+ * Return the inline cache of the given OP_MEMBER/OP_CALL instruction.
+ * Entries resolved before a class or a function was installed, or left
+ * by another instruction sharing the same slot, are discarded.
+ * Return NULL if the cache table cannot be allocated.
+ */
+static VmInlineCache *VmInlineCacheGet(ph7_vm *pVm, const VmInstr *pInstr) {
+	VmInlineCache *pCache;
+	if(pVm->aInlineCache == 0) {
+		pVm->aInlineCache = (VmInlineCache *)SyMemBackendAlloc(&pVm->sAllocator, VM_INLINE_CACHE_SIZE * sizeof(VmInlineCache));
+		if(pVm->aInlineCache == 0) {
+			return 0;
+		}
+		SyZero(pVm->aInlineCache, VM_INLINE_CACHE_SIZE * sizeof(VmInlineCache));
+	}
+	pCache = &pVm->aInlineCache[((sxuptr)pInstr / sizeof(VmInstr)) & (VM_INLINE_CACHE_SIZE - 1)];
+	if(pCache->pInstr != pInstr || pCache->nGen != pVm->nCacheGen) {
+		pCache->pInstr = pInstr;
+		pCache->nGen = pVm->nCacheGen;
+		pCache->nEntry = 0;
+	}
+	return pCache;
+}
+/*
+ * Look up the entry resolved for the given receiver class and member or function name.
+ * The name is compared rather than trusted, since a call site may compute it at run-time.
+ * Return the entry on success. NULL otherwise.
+ */
+static VmCacheEntry *VmInlineCacheFind(VmInlineCache *pCache, ph7_class *pClass, const SyString *pName) {
+	VmCacheEntry *pEntry;
+	sxu32 n;
+	if(pCache == 0) {
+		return 0;
+	}
+	for(n = 0 ; n < pCache->nEntry ; ++n) {
+		pEntry = &pCache->aEntry[n];
+		if(pEntry->pClass == pClass && pEntry->sName.nByte == pName->nByte &&
+				(pEntry->sName.zString == pName->zString || SyMemcmp(pEntry->sName.zString, pName->zString, pName->nByte) == 0)) {
+			return pEntry;
+		}
+	}
+	return 0;
+}
+/*
+ * Remember what the given receiver class and name resolved to.
+ * Once all the entries are used, the call site is megamorphic and keeps
+ * the receivers seen first.
+ * Return the new entry on success. NULL otherwise.
+ */
+static VmCacheEntry *VmInlineCacheAdd(VmInlineCache *pCache, ph7_class *pClass, const SyString *pName, void *pMember) {
+	VmCacheEntry *pEntry;
+	if(pCache == 0 || pCache->nEntry >= VM_INLINE_CACHE_WAYS) {
+		return 0;
+	}
+	pEntry = &pCache->aEntry[pCache->nEntry++];
+	SyStringDupPtr(&pEntry->sName, pName);
+	pEntry->pClass = pClass;
+	pEntry->pMember = pMember;
+	pEntry->pTarget = 0;
+	pEntry->nPos = 0;
+	return pEntry;
+}
+/*
+ * Return the copy of a compiled record [i.e: static variable, foreach loop cursor]
+ * the given VM writes to while executing the code the record belongs to.
+ * A regular VM executes its own program and uses the record directly, while an
+ * execution context [i.e: ph7_vm_spawn()] shares the program with other contexts
+ * running concurrently, so it works on a private copy created on first use.
+ * This function never fail.
+ */
+PH7_PRIVATE void *PH7_VmPrivateRecord(
+	ph7_vm *pVm,     /* Target VM */
+	void *pRecord,   /* Compiled record */
+	sxu32 nByte      /* Record size */
+) {
+	SyHashEntry *pEntry;
+	unsigned char *zCopy;
+	if(pVm->pProgram == 0) {
+		return pRecord;
+	}
+	pEntry = SyHashGet(&pVm->hPrivate, (const void *)&pRecord, sizeof(void *));
+	if(pEntry) {
+		return pEntry->pUserData;
+	}
+	/* The record address used as the key is stored right after the copy */
+	zCopy = (unsigned char *)SyMemBackendAlloc(&pVm->sAllocator, nByte + sizeof(void *));
+	if(zCopy == 0) {
+		PH7_VmMemoryError(&(*pVm));
+	}
+	SyMemcpy(pRecord, zCopy, nByte);
+	SyMemcpy((const void *)&pRecord, &zCopy[nByte], sizeof(void *));
+	if(SyHashInsert(&pVm->hPrivate, (const void *)&zCopy[nByte], sizeof(void *), zCopy) != SXRET_OK) {
+		PH7_VmMemoryError(&(*pVm));
+	}
+	return zCopy;
+}
+/*
+ * Check whether the given class belongs to the program shared by an
+ * execution context. Such class is linked once for all contexts and its
+ * methods are already installed.
+ */
+static int VmIsProgramClass(ph7_vm *pVm, ph7_class *pClass) {
+	SyHashEntry *pEntry;
+	if(pVm->pProgram == 0) {
+		return FALSE;
+	}
+	pEntry = SyHashGet(&pVm->pProgram->hClass, (const void *)pClass->sName.zString, pClass->sName.nByte);
+	return pEntry && pEntry->pUserData == (void *)pClass;
+}
+/*
+ * Check whether the given class was declared by the built-in library. Such
+ * class is shared by all the VMs created by the engine, which may run on
+ * different threads, so mounting it must not write to it.
+ */
+static int VmIsBuiltinClass(ph7_vm *pVm, ph7_class *pClass) {
+	ph7_vm *pBuiltin = pVm->pEngine->pBuiltin;
+	SyHashEntry *pEntry;
+	if(pBuiltin == 0 || pBuiltin == pVm) {
+		return FALSE;
+	}
+	pEntry = SyHashGet(&pBuiltin->hClass, (const void *)pClass->sName.zString, pClass->sName.nByte);
+	return pEntry && pEntry->pUserData == (void *)pClass;
+}
 /*
  * Mount a compiled class into the freshly created virtual machine so that
  * it can be instanciated from the executed PHP script.
@@ -596,15 +1039,19 @@ static sxi32 VmMountUserClass(
 	ph7_class_method *pMeth;
 	ph7_class_attr *pAttr;
 	SyHashEntry *pEntry;
+	sxbool bBuiltin;
 	sxi32 rc;
-	/* Reset the loop cursor */
-	SyHashResetLoopCursor(&pClass->hAttr);
+	/* Forget the members resolved before the class hierarchy changed */
+	pVm->nCacheGen++;
 	/* Process only static and constant attribute */
-	while((pEntry = SyHashGetNextEntry(&pClass->hAttr)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pClass->hAttr, pEntry)) != 0) {
 		/* Extract the current attribute */
 		pAttr = (ph7_class_attr *)pEntry->pUserData;
 		if(pAttr->iFlags & (PH7_CLASS_ATTR_CONSTANT | PH7_CLASS_ATTR_STATIC)) {
 			ph7_value *pMemObj, *pResult;
+			/* The attribute index is private to this VM */
+			pAttr = (ph7_class_attr *)PH7_VmPrivateRecord(&(*pVm), pAttr, sizeof(ph7_class_attr));
 			/* Reserve a memory object for this constant/static attribute */
 			pMemObj = PH7_ReserveMemObj(&(*pVm));
 			pResult = PH7_ReserveMemObj(&(*pVm));
@@ -641,12 +1088,22 @@ static sxi32 VmMountUserClass(
 		 */
 		return SXRET_OK;
 	}
+	if(VmIsProgramClass(&(*pVm), pClass)) {
+		/* Methods of the shared program are already installed */
+		return SXRET_OK;
+	}
+	bBuiltin = VmIsBuiltinClass(&(*pVm), pClass);
 	/* Install the methods now */
-	SyHashResetLoopCursor(&pClass->hMethod);
-	while((pEntry = SyHashGetNextEntry(&pClass->hMethod)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pClass->hMethod, pEntry)) != 0) {
 		pMeth = (ph7_class_method *)pEntry->pUserData;
 		if((pMeth->iFlags & PH7_CLASS_ATTR_VIRTUAL) == 0) {
-			rc = PH7_VmInstallUserFunction(&(*pVm), &pMeth->sFunc, &pMeth->sVmName);
+			if(bBuiltin) {
+				/* Built-in method names are unique, leave the shared method untouched */
+				rc = SyHashInsert(&pVm->hFunction, SyStringData(&pMeth->sVmName), SyStringLength(&pMeth->sVmName), &pMeth->sFunc);
+			} else {
+				rc = PH7_VmInstallUserFunction(&(*pVm), &pMeth->sFunc, &pMeth->sVmName);
+			}
 			if(rc != SXRET_OK) {
 				return rc;
 			}
@@ -667,8 +1124,8 @@ PH7_PRIVATE sxi32 PH7_VmCreateClassInstanceFrame(
 	SyHashEntry *pEntry;
 	sxi32 rc;
 	/* Install class attribute in the private frame associated with this instance */
-	SyHashResetLoopCursor(&pClass->hAttr);
-	while((pEntry = SyHashGetNextEntry(&pClass->hAttr)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pClass->hAttr, pEntry)) != 0) {
 		VmClassAttr *pVmAttr;
 		/* Extract the current attribute */
 		pAttr = (ph7_class_attr *)pEntry->pUserData;
@@ -702,17 +1159,15 @@ PH7_PRIVATE sxi32 PH7_VmCreateClassInstanceFrame(
 				}
 				pMemObj->x.pOther = pMap;
 			}
-			/* Free up memory */
+			/* Free up memory and give the temporary object back */
 			PH7_MemObjRelease(pResult);
+			PH7_VmRecycleMemObj(&(*pVm), pResult->nIdx);
 			/* Record attribute index */
 			pVmAttr->nIdx = pMemObj->nIdx;
 			rc = SyHashInsert(&pObj->hAttr, SyStringData(&pAttr->sName), SyStringLength(&pAttr->sName), pVmAttr);
 			if(rc != SXRET_OK) {
-				VmSlot sSlot;
 				/* Restore memory object */
-				sSlot.nIdx = pMemObj->nIdx;
-				sSlot.pUserData = 0;
-				SySetPut(&pVm->aFreeObj, (const void *)&sSlot);
+				PH7_VmRecycleMemObj(&(*pVm), pMemObj->nIdx);
 				SyMemBackendPoolFree(&pVm->sAllocator, pVmAttr);
 				return SXERR_MEM;
 			}
@@ -720,7 +1175,7 @@ PH7_PRIVATE sxi32 PH7_VmCreateClassInstanceFrame(
 			PH7_VmRefObjInstall(&(*pVm), pMemObj->nIdx, 0, 0, VM_REF_IDX_KEEP);
 		} else {
 			/* Install static/constant attribute */
-			pVmAttr->nIdx = pAttr->nIdx;
+			pVmAttr->nIdx = ((ph7_class_attr *)PH7_VmPrivateRecord(&(*pVm), pAttr, sizeof(ph7_class_attr)))->nIdx;
 			rc = SyHashInsert(&pObj->hAttr, SyStringData(&pAttr->sName), SyStringLength(&pAttr->sName), pVmAttr);
 			if(rc != SXRET_OK) {
 				SyMemBackendPoolFree(&pVm->sAllocator, pVmAttr);
@@ -759,44 +1214,308 @@ PH7_PRIVATE ph7_value *PH7_ReserveConstObj(ph7_vm *pVm, sxu32 *pIndex) {
 	pObj = (ph7_value *)SySetPeek(&pVm->aLitObj);
 	return pObj;
 }
+#define VM_STRING_FILL_FACTOR 3
 /*
- * Reserve a memory object.
- * Return a pointer to the raw ph7_value on success. NULL on failure.
+ * Grow the interned strings hash table.
+ * The stored hashes are reused, the strings are never hashed again.
  */
-PH7_PRIVATE ph7_value *VmReserveMemObj(ph7_vm *pVm, sxu32 *pIndex) {
-	ph7_value *pObj;
-	sxi32 rc;
-	if(pIndex) {
-		/* Object index in the object table */
-		*pIndex = SySetUsed(&pVm->aMemObj);
+static sxi32 VmGrowStringTable(ph7_vm *pVm) {
+	VmString **apNew, *pStr, *pNext;
+	sxu32 nNew = pVm->nStringSize << 1;
+	sxu32 n;
+	if(nNew < 1) {
+		nNew = 64;
 	}
-	/* Reserve a slot for the new object */
-	rc = SySetPut(&pVm->aMemObj, (const void *)zDummy);
-	if(rc != SXRET_OK) {
-		/* If the supplied memory subsystem is so sick that we are unable to allocate
-		 * a tiny chunk of memory, there is no much we can do here.
-		 */
+	apNew = (VmString **)SyMemBackendAlloc(&pVm->sAllocator, nNew * sizeof(VmString *));
+	if(apNew == 0) {
+		return SXERR_MEM;
+	}
+	SyZero((void *)apNew, nNew * sizeof(VmString *));
+	for(n = 0 ; n < pVm->nStringSize ; ++n) {
+		for(pStr = pVm->apString[n] ; pStr ; pStr = pNext) {
+			pNext = pStr->pNextCollide;
+			pStr->pNextCollide = apNew[pStr->nHash & (nNew - 1)];
+			apNew[pStr->nHash & (nNew - 1)] = pStr;
+		}
+	}
+	if(pVm->apString) {
+		SyMemBackendFree(&pVm->sAllocator, (void *)pVm->apString);
+	}
+	pVm->apString = apNew;
+	pVm->nStringSize = nNew;
+	return SXRET_OK;
+}
+/*
+ * Intern a string in the given VM and take a reference to it.
+ * nHash must be the SyBinHash() value of the string contents.
+ * A string that is already interned is found by pointer first.
+ * Return a pointer to the null terminated interned contents on success,
+ * to be released with [PH7_VmReleaseString()]. NULL on failure.
+ */
+PH7_PRIVATE const char *PH7_VmInternString(ph7_vm *pVm, const char *zString, sxu32 nByte, sxu32 nHash) {
+	VmString *pStr;
+	char *zData;
+	if(pVm->nString >= pVm->nStringSize * VM_STRING_FILL_FACTOR && VmGrowStringTable(&(*pVm)) != SXRET_OK && pVm->apString == 0) {
 		return 0;
 	}
-	pObj = (ph7_value *)SySetPeek(&pVm->aMemObj);
-	return pObj;
+	for(pStr = pVm->apString[nHash & (pVm->nStringSize - 1)] ; pStr ; pStr = pStr->pNextCollide) {
+		zData = (char *)&pStr[1];
+		if(pStr->nHash == nHash && pStr->nByte == nByte && (zData == zString || SyMemcmp(zData, zString, nByte) == 0)) {
+			pStr->nRef++;
+			return zData;
+		}
+	}
+	pStr = (VmString *)SyMemBackendPoolAlloc(&pVm->sAllocator, sizeof(VmString) + nByte + 1);
+	if(pStr == 0) {
+		return 0;
+	}
+	zData = (char *)&pStr[1];
+	SyMemcpy(zString, zData, nByte);
+	zData[nByte] = 0;
+	pStr->nHash = nHash;
+	pStr->nByte = nByte;
+	pStr->nRef = 1;
+	pStr->pNextCollide = pVm->apString[nHash & (pVm->nStringSize - 1)];
+	pVm->apString[nHash & (pVm->nStringSize - 1)] = pStr;
+	pVm->nString++;
+	return zData;
 }
-/* Forward declaration */
-static sxi32 VmEvalChunk(ph7_vm *pVm, ph7_context *pCtx, SyString *pChunk, int iFlags);
 /*
- * Built-in classes/interfaces and some functions that cannot be implemented
- * directly as foreign functions.
+ * Drop a reference to an interned string and release it once unused.
  */
-#define PH7_BUILTIN_LIB \
-	"class Exception { "\
-	"protected string $message = 'Unknown exception';"\
-	"protected int $code = 0;"\
-	"protected string $file;"\
-	"protected int $line;"\
-	"protected mixed[] $trace;"\
-	"protected object $previous;"\
-	"public void __construct(string $message = '', int $code = 0, Exception $previous = null) {"\
-	"   if($message) {"\
+PH7_PRIVATE void PH7_VmReleaseString(ph7_vm *pVm, const char *zString) {
+	VmString *pStr = &((VmString *)zString)[-1];
+	VmString **ppLink;
+	if(--pStr->nRef > 0) {
+		return;
+	}
+	ppLink = &pVm->apString[pStr->nHash & (pVm->nStringSize - 1)];
+	while(*ppLink && *ppLink != pStr) {
+		ppLink = &(*ppLink)->pNextCollide;
+	}
+	if(*ppLink) {
+		*ppLink = pStr->pNextCollide;
+		pVm->nString--;
+	}
+	SyMemBackendPoolFree(&pVm->sAllocator, pStr);
+}
+/*
+ * Replace the contents of the given blob by a read-only view of the same
+ * string interned in the given VM. The interned string is kept for the VM lifetime.
+ */
+PH7_PRIVATE sxi32 PH7_VmInternBlob(ph7_vm *pVm, SyBlob *pBlob) {
+	const char *zData;
+	sxu32 nByte = SyBlobLength(pBlob);
+	if(nByte < 1 || (pBlob->nFlags & SXBLOB_INTERN)) {
+		return SXRET_OK;
+	}
+	zData = PH7_VmInternString(&(*pVm), (const char *)SyBlobData(pBlob), nByte, PH7_VmStringHash(pBlob));
+	if(zData == 0) {
+		return SXERR_MEM;
+	}
+	SyBlobRelease(pBlob);
+	SyBlobReadOnly(pBlob, zData, nByte);
+	pBlob->nFlags |= SXBLOB_INTERN;
+	return SXRET_OK;
+}
+/*
+ * Return the SyBinHash() value of the given blob contents, without
+ * hashing them again when the blob is a view of an interned string.
+ */
+PH7_PRIVATE sxu32 PH7_VmStringHash(const SyBlob *pBlob) {
+	const VmString *pStr;
+	if((pBlob->nFlags & (SXBLOB_RDONLY | SXBLOB_INTERN)) == (SXBLOB_RDONLY | SXBLOB_INTERN) && SyBlobLength(pBlob) > 0) {
+		pStr = &((const VmString *)SyBlobData(pBlob))[-1];
+		if(pStr->nByte == SyBlobLength(pBlob)) {
+			return pStr->nHash;
+		}
+	}
+	return SyBinHash(SyBlobData(pBlob), SyBlobLength(pBlob));
+}
+/*
+ * Allocate a new chunk of memory objects and make it the first chunk
+ * holding free objects. The directory entry of a released chunk is
+ * reused if available.
+ * Return a pointer to the new chunk on success. NULL on failure.
+ */
+static VmObjChunk *VmObjTableGrow(ph7_vm *pVm) {
+	VmObjTable *pTable = &pVm->aMemObj;
+	VmObjChunk *pChunk;
+	sxu32 iChunk, n, iTag;
+	iChunk = pTable->nChunk;
+	if(pTable->nAlloc < pTable->nChunk) {
+		/* Look for a released chunk */
+		for(iChunk = 0 ; iChunk < pTable->nChunk ; ++iChunk) {
+			if(pTable->apChunk[iChunk] == 0) {
+				break;
+			}
+		}
+	} else {
+		VmObjChunk **apNew;
+		sxu32 nNew = pTable->nChunk > 0 ? pTable->nChunk << 1 : 16;
+		/* Grow the chunk directory */
+		SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_VALUES, iTag);
+		apNew = (VmObjChunk **)SyMemBackendRealloc(&pVm->sAllocator, pTable->apChunk, nNew * sizeof(VmObjChunk *));
+		SyMemBackendPopTag(&pVm->sAllocator, iTag);
+		if(apNew == 0) {
+			return 0;
+		}
+		SyZero(&apNew[pTable->nChunk], (nNew - pTable->nChunk) * sizeof(VmObjChunk *));
+		pTable->apChunk = apNew;
+		pTable->nChunk = nNew;
+	}
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_VALUES, iTag);
+	pChunk = (VmObjChunk *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(VmObjChunk));
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
+	if(pChunk == 0) {
+		return 0;
+	}
+	/* Zero the objects, so that a stale index does not point to garbage */
+	SyZero(pChunk, sizeof(VmObjChunk));
+	for(n = 0 ; n < VM_OBJ_CHUNK_SIZE ; ++n) {
+		/* Lowest offsets are reserved first */
+		pChunk->aFree[n] = (sxu16)(VM_OBJ_CHUNK_SIZE - 1 - n);
+	}
+	for(n = 0 ; n < VM_OBJ_CHUNK_SIZE / 32 ; ++n) {
+		pChunk->aFreeMap[n] = 0xFFFFFFFF;
+	}
+	pChunk->nFree = VM_OBJ_CHUNK_SIZE;
+	pChunk->iChunk = iChunk;
+	pTable->apChunk[iChunk] = pChunk;
+	pTable->nAlloc++;
+	pTable->nEmpty++;
+	/* Link to the list of chunks holding free objects */
+	pChunk->pNext = pTable->pFree;
+	if(pTable->pFree) {
+		pTable->pFree->pPrev = pChunk;
+	} else {
+		pTable->pLast = pChunk;
+	}
+	pTable->pFree = pChunk;
+	return pChunk;
+}
+/*
+ * Unlink a chunk from the list of chunks holding free objects.
+ */
+static void VmObjTableUnlink(VmObjTable *pTable, VmObjChunk *pChunk) {
+	if(pChunk->pPrev) {
+		pChunk->pPrev->pNext = pChunk->pNext;
+	} else {
+		pTable->pFree = pChunk->pNext;
+	}
+	if(pChunk->pNext) {
+		pChunk->pNext->pPrev = pChunk->pPrev;
+	} else {
+		pTable->pLast = pChunk->pPrev;
+	}
+	pChunk->pNext = pChunk->pPrev = 0;
+}
+/*
+ * Reserve a memory object.
+ * Return a pointer to the raw (zeroed) ph7_value on success. NULL on failure.
+ */
+PH7_PRIVATE ph7_value *VmReserveMemObj(ph7_vm *pVm, sxu32 *pIndex) {
+	VmObjTable *pTable = &pVm->aMemObj;
+	VmObjChunk *pChunk;
+	ph7_value *pObj;
+	sxu32 iSlot;
+	pChunk = pTable->pFree;
+	if(pChunk == 0) {
+		/* Reserve a new chunk of objects */
+		pChunk = VmObjTableGrow(&(*pVm));
+		if(pChunk == 0) {
+			/* If the supplied memory subsystem is so sick that we are unable to allocate
+			 * a tiny chunk of memory, there is no much we can do here.
+			 */
+			return 0;
+		}
+	}
+	if(pChunk->nFree == VM_OBJ_CHUNK_SIZE) {
+		pTable->nEmpty--;
+	}
+	/* Pop a free object */
+	iSlot = pChunk->aFree[--pChunk->nFree];
+	pChunk->aFreeMap[iSlot >> 5] &= ~(1U << (iSlot & 31));
+	if(pChunk->nFree < 1) {
+		/* Chunk is full */
+		VmObjTableUnlink(pTable, pChunk);
+	}
+	pTable->nLive++;
+	pObj = &pChunk->aObj[iSlot];
+	SyZero(pObj, sizeof(ph7_value));
+	if(pIndex) {
+		/* Object index in the object table */
+		*pIndex = (pChunk->iChunk << VM_OBJ_CHUNK_SHIFT) | iSlot;
+	}
+	return pObj;
+}
+/*
+ * Return a released memory object to the object table.
+ * A chunk left without any object in use is returned to the allocator,
+ * unless it is the only empty chunk, which is kept for the next reservations.
+ * Releasing a free object is a harmless no-op.
+ */
+PH7_PRIVATE void PH7_VmRecycleMemObj(ph7_vm *pVm, sxu32 nIdx) {
+	VmObjTable *pTable = &pVm->aMemObj;
+	VmObjChunk *pChunk;
+	sxu32 iSlot;
+	if((nIdx >> VM_OBJ_CHUNK_SHIFT) >= pTable->nChunk || (pChunk = pTable->apChunk[nIdx >> VM_OBJ_CHUNK_SHIFT]) == 0) {
+		/* No such object */
+		return;
+	}
+	iSlot = nIdx & VM_OBJ_CHUNK_MASK;
+	if(pChunk->aFreeMap[iSlot >> 5] & (1U << (iSlot & 31))) {
+		/* Already free */
+		return;
+	}
+	pChunk->aFreeMap[iSlot >> 5] |= 1U << (iSlot & 31);
+	pChunk->aFree[pChunk->nFree++] = (sxu16)iSlot;
+	pTable->nLive--;
+	if(pChunk->nFree == 1) {
+		/* Partially used chunks come first */
+		pChunk->pNext = pTable->pFree;
+		if(pTable->pFree) {
+			pTable->pFree->pPrev = pChunk;
+		} else {
+			pTable->pLast = pChunk;
+		}
+		pTable->pFree = pChunk;
+	} else if(pChunk->nFree >= VM_OBJ_CHUNK_SIZE) {
+		VmObjTableUnlink(pTable, pChunk);
+		if(pTable->nEmpty > 0) {
+			/* Return the chunk to the allocator */
+			pTable->apChunk[pChunk->iChunk] = 0;
+			pTable->nAlloc--;
+			SyMemBackendFree(&pVm->sAllocator, pChunk);
+			return;
+		}
+		/* Keep it as the last chunk to pick from */
+		pTable->nEmpty++;
+		pChunk->pPrev = pTable->pLast;
+		if(pTable->pLast) {
+			pTable->pLast->pNext = pChunk;
+		} else {
+			pTable->pFree = pChunk;
+		}
+		pTable->pLast = pChunk;
+	}
+}
+/* Forward declaration */
+static sxi32 VmEvalChunk(ph7_vm *pVm, ph7_context *pCtx, SyString *pChunk, int iFlags);
+/*
+ * Built-in classes/interfaces and some functions that cannot be implemented
+ * directly as foreign functions.
+ */
+#define PH7_BUILTIN_LIB \
+	"class Exception { "\
+	"protected string $message = 'Unknown exception';"\
+	"protected int $code = 0;"\
+	"protected string $file;"\
+	"protected int $line;"\
+	"protected mixed[] $trace;"\
+	"protected object $previous;"\
+	"public void __construct(string $message = '', int $code = 0, Exception $previous = null) {"\
+	"   if($message) {"\
 	"	  $this->message = $message;"\
 	"   }"\
 	"   $this->code = $code;"\
@@ -908,32 +1627,42 @@ static sxi32 VmEvalChunk(ph7_vm *pVm, ph7_context *pCtx, SyString *pChunk, int i
 	"}"
 
 /*
- * Initialize a freshly allocated PH7 Virtual Machine so that we can
- * start compiling the target PHP program.
+ * Initialize the fields of a freshly allocated PH7 Virtual Machine
+ * and install the reserved constants.
  */
-PH7_PRIVATE sxi32 PH7_VmInit(
+static sxi32 VmInitCore(
 	ph7_vm *pVm,  /* Initialize this */
 	ph7 *pEngine, /* Master engine */
-	sxbool bDebug /* Debugging */
+	SyMemBackend *pAllocator /* Recycled memory backend to take over, NULL to create one */
 ) {
-	SyString sBuiltin;
 	ph7_value *pObj;
+	sxu32 iTag;
 	sxi32 rc;
 	/* Zero the structure */
 	SyZero(pVm, sizeof(ph7_vm));
 	/* Initialize VM fields */
 	pVm->pEngine = &(*pEngine);
-	SyMemBackendInitFromParent(&pVm->sAllocator, &pEngine->sAllocator);
+	if(pAllocator) {
+		pVm->sAllocator = *pAllocator;
+	} else {
+		SyMemBackendInitFromParent(&pVm->sAllocator, &pEngine->sAllocator);
+		/* A VM is used by one thread at a time, its allocator needs no mutex */
+		SyMemBackendDisableMutexing(&pVm->sAllocator);
+	}
 	/* Instructions containers */
 	SySetInit(&pVm->aInstrSet, &pVm->sAllocator, sizeof(VmInstr));
 	SySetInit(&pVm->aByteCode, &pVm->sAllocator, sizeof(VmInstr));
+	SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_BYTECODE, iTag);
 	SySetAlloc(&pVm->aByteCode, 0xFF);
+	SyMemBackendPopTag(&pVm->sAllocator, iTag);
 	pVm->pByteContainer = &pVm->aByteCode;
 	/* Object containers */
-	SySetInit(&pVm->aMemObj, &pVm->sAllocator, sizeof(ph7_value));
-	SySetAlloc(&pVm->aMemObj, 0xFF);
+	SyZero(&pVm->aMemObj, sizeof(VmObjTable));
 	/* Virtual machine internal containers */
 	SyBlobInit(&pVm->sConsumer, &pVm->sAllocator);
+	SyBlobInit(&pVm->sOutput.sBuf, &pVm->sAllocator);
+	pVm->sConsumer.nFlags |= SXBLOB_IO;
+	pVm->sOutput.sBuf.nFlags |= SXBLOB_IO;
 	SyBlobInit(&pVm->sArgv, &pVm->sAllocator);
 	SySetInit(&pVm->aLitObj, &pVm->sAllocator, sizeof(ph7_value));
 	SySetAlloc(&pVm->aLitObj, 0xFF);
@@ -941,10 +1670,11 @@ PH7_PRIVATE sxi32 PH7_VmInit(
 	SyHashInit(&pVm->hFunction, &pVm->sAllocator, 0, 0);
 	SyHashInit(&pVm->hClass, &pVm->sAllocator, SyStrHash, (int (*)(const void *, const void *, sxu32))((SyStrncmp)));
 	SyHashInit(&pVm->hConstant, &pVm->sAllocator, 0, 0);
+	SyHashInit(&pVm->hConstValue, &pVm->sAllocator, 0, 0);
 	SyHashInit(&pVm->hSuper, &pVm->sAllocator, 0, 0);
 	SyHashInit(&pVm->hDBAL, &pVm->sAllocator, 0, 0);
-	SySetInit(&pVm->aFreeObj, &pVm->sAllocator, sizeof(VmSlot));
 	SySetInit(&pVm->aSelf, &pVm->sAllocator, sizeof(ph7_class *));
+	PH7_GcInit(&(*pVm));
 	SySetInit(&pVm->aAutoLoad, &pVm->sAllocator, sizeof(VmAutoLoadCB));
 	SySetInit(&pVm->aShutdown, &pVm->sAllocator, sizeof(VmShutdownCB));
 	SySetInit(&pVm->aException, &pVm->sAllocator, sizeof(ph7_exception *));
@@ -998,19 +1728,117 @@ PH7_PRIVATE sxi32 PH7_VmInit(
 	}
 	/* VM correctly initialized,set the magic number */
 	pVm->nMagic = PH7_VM_INIT;
+	return SXRET_OK;
+Err:
+	SyMemBackendRelease(&pVm->sAllocator);
+	return rc;
+}
+/* Forward declaration */
+static sxi32 VmRegisterSpecialFunction(ph7_vm *pVm);
+/*
+ * Compile the built-in library once for the given engine.
+ * The result is kept by a private VM along with the built-in functions and
+ * constants. Classes and interfaces it declares are shared read-only by every
+ * VM created later by this engine, while functions and constants are copied
+ * to a VM the first time they are used. This way, neither PH7_BUILTIN_LIB is
+ * compiled again nor the built-in symbols registered again for each VM.
+ */
+PH7_PRIVATE sxi32 PH7_VmInitBuiltin(ph7 *pEngine) {
+	SyString sBuiltin;
+	ph7_vm *pVm;
+	sxi32 rc;
+	/* Allocate the private virtual machine */
+	pVm = (ph7_vm *)SyMemBackendPoolAlloc(&pEngine->sAllocator, sizeof(ph7_vm));
+	if(pVm == 0) {
+		return SXERR_MEM;
+	}
+	rc = VmInitCore(&(*pVm), &(*pEngine), 0);
+	if(rc != SXRET_OK) {
+		SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
+		return rc;
+	}
+	/* Register special functions first [i.e: print, json_encode(), func_get_args(), die, etc.] */
+	rc = VmRegisterSpecialFunction(&(*pVm));
+	if(rc != SXRET_OK) {
+		SyMemBackendRelease(&pVm->sAllocator);
+		SyMemBackendPoolFree(&pEngine->sAllocator, pVm);
+		return rc;
+	}
+	/* Register built-in constants [i.e: PHP_EOL, PHP_OS...] */
+	PH7_RegisterBuiltInConstant(&(*pVm));
+	/* Register built-in functions [i.e: array_diff(), strlen(), etc.] */
+	PH7_RegisterBuiltInFunction(&(*pVm));
 	SyStringInitFromBuf(&sBuiltin, PH7_BUILTIN_LIB, sizeof(PH7_BUILTIN_LIB) - 1);
-	/* Precompile the built-in library */
+	/* Compile the built-in library and resolve class inheritance */
 	VmEvalChunk(&(*pVm), 0, &sBuiltin, PH7_AERSCRIPT_CODE);
+	pEngine->pBuiltin = pVm;
+	return SXRET_OK;
+}
+/*
+ * SyHashForEach() callback used to share a built-in class with a new VM.
+ */
+static sxi32 VmImportBuiltinClass(SyHashEntry *pEntry, void *pUserData) {
+	ph7_vm *pVm = (ph7_vm *)pUserData;
+	return PH7_VmInstallClass(&(*pVm), (ph7_class *)pEntry->pUserData);
+}
+/*
+ * Make the precompiled built-in library available to the given VM.
+ * The built-in bytecode refers to its literals by index, so they are copied
+ * in the same order right after the reserved null/true/false constants.
+ */
+static sxi32 VmImportBuiltin(ph7_vm *pVm, ph7_vm *pBuiltin) {
+	ph7_value *aLit, *pObj;
+	sxu32 n;
+	sxi32 rc;
+	aLit = (ph7_value *)SySetBasePtr(&pBuiltin->aLitObj);
+	for(n = SySetUsed(&pVm->aLitObj) ; n < SySetUsed(&pBuiltin->aLitObj) ; ++n) {
+		pObj = PH7_ReserveConstObj(&(*pVm), 0);
+		if(pObj == 0) {
+			return SXERR_MEM;
+		}
+		PH7_MemObjInit(&(*pVm), pObj);
+		rc = PH7_MemObjStore(&aLit[n], pObj);
+		if(rc != SXRET_OK) {
+			return rc;
+		}
+	}
+	/* Install the built-in classes and interfaces */
+	rc = SyHashForEach(&pBuiltin->hClass, VmImportBuiltinClass, &(*pVm));
+	if(rc != SXRET_OK) {
+		return rc;
+	}
+	/* The built-in library was compiled from memory */
+	return PH7_VmPushFilePath(&(*pVm), "[MEMORY]", -1, TRUE, 0);
+}
+/*
+ * Initialize a freshly allocated PH7 Virtual Machine so that we can
+ * start compiling the target PHP program.
+ */
+PH7_PRIVATE sxi32 PH7_VmInit(
+	ph7_vm *pVm,  /* Initialize this */
+	ph7 *pEngine, /* Master engine */
+	sxbool bDebug, /* Debugging */
+	sxi32 iOptLevel /* Compile-time optimization level */
+) {
+	sxi32 rc;
+	rc = VmInitCore(&(*pVm), &(*pEngine), 0);
+	if(rc != SXRET_OK) {
+		return rc;
+	}
+	/* Import the precompiled built-in library */
+	rc = VmImportBuiltin(&(*pVm), pEngine->pBuiltin);
+	if(rc != SXRET_OK) {
+		SyMemBackendRelease(&pVm->sAllocator);
+		return rc;
+	}
 	if(bDebug) {
 		/* Enable debugging */
 		pVm->bDebug = TRUE;
 	}
+	pVm->iOptLevel = iOptLevel;
 	/* Reset the code generator */
 	PH7_ResetCodeGenerator(&(*pVm), pEngine->xConf.xErr, pEngine->xConf.pErrData);
 	return SXRET_OK;
-Err:
-	SyMemBackendRelease(&pVm->sAllocator);
-	return rc;
 }
 /*
  * Default VM output consumer callback.That is,all VM output is redirected to this
@@ -1033,67 +1861,276 @@ PH7_PRIVATE sxi32 PH7_VmBlobConsumer(
 	rc = SyBlobAppend((SyBlob *)pUserData, pOut, nLen);
 	return rc;
 }
+/* Forward declaration */
+static int VmObConsumer(const void *pData, unsigned int nDataLen, void *pUserData);
+/*
+ * Hand the output coalesced by [VmOutputBufferConsumer()] to the output
+ * consumer callback installed by the host application.
+ */
+PH7_PRIVATE sxi32 PH7_VmOutputFlush(ph7_vm *pVm) {
+	VmOutputBuffer *pOut = &pVm->sOutput;
+	sxi32 rc = SXRET_OK;
+	if(SyBlobLength(&pOut->sBuf) > 0) {
+		rc = pOut->xConsumer(SyBlobData(&pOut->sBuf), SyBlobLength(&pOut->sBuf), pOut->pUserData);
+		SyBlobReset(&pOut->sBuf);
+	}
+	return rc;
+}
+/*
+ * Buffered VM output consumer callback installed by [PH7_VM_CONFIG_OUTPUT_BUFFER].
+ * Small fragments are appended to the output buffer which is flushed once full,
+ * while fragments larger than the buffer are passed through.
+ */
+static int VmOutputBufferConsumer(const void *pData, unsigned int nDataLen, void *pUserData) {
+	ph7_vm *pVm = (ph7_vm *)pUserData;
+	VmOutputBuffer *pOut = &pVm->sOutput;
+	sxi32 rc;
+	if(SyBlobLength(&pOut->sBuf) + nDataLen > pOut->nSize) {
+		/* Not enough room left */
+		rc = PH7_VmOutputFlush(&(*pVm));
+		if(rc == SXERR_ABORT) {
+			return rc;
+		}
+		if(nDataLen >= pOut->nSize) {
+			/* Too large to be buffered */
+			return pOut->xConsumer(pData, nDataLen, pOut->pUserData);
+		}
+	}
+	rc = SyBlobAppend(&pOut->sBuf, pData, nDataLen);
+	if(rc != SXRET_OK) {
+		/* Out of memory, do not lose the output */
+		return pOut->xConsumer(pData, nDataLen, pOut->pUserData);
+	}
+	if(pOut->iPolicy == PH7_OUTPUT_FLUSH_LINE && SyByteFind((const char *)pData, nDataLen, '\n', 0) == SXRET_OK) {
+		/* Line buffered output */
+		return PH7_VmOutputFlush(&(*pVm));
+	}
+	return PH7_OK;
+}
 #define VM_STACK_GUARD 16
+#define VM_STACK_CHUNK 1024 /* Minimum number of memory objects in a call stack chunk */
+/*
+ * Compute the size of the operand stack needed to execute the given
+ * bytecode program.
+ * Only a few instructions push a new element onto the stack and the stack
+ * never grows on successive executions of the same loop, so each element
+ * on the stack was pushed by a different instruction. Thus the number of
+ * such instructions is an upper bound on the maximum stack depth required.
+ * The code generator records the result for each compiled function.
+ */
+PH7_PRIVATE sxu32 PH7_VmStackSize(SySet *pByteCode) {
+	VmInstr *aInstr = (VmInstr *)SySetBasePtr(pByteCode);
+	sxu32 nDepth = 0;
+	sxu32 n;
+	for(n = 0 ; n < SySetUsed(pByteCode) ; ++n) {
+		switch(aInstr[n].iOp) {
+			case PH7_OP_DECLARE:
+			case PH7_OP_LOADC:
+			case PH7_OP_LOADV:
+			case PH7_OP_LOAD_MAP:
+			case PH7_OP_LOAD_CLOSURE:
+			case PH7_OP_INCRV:
+			case PH7_OP_DECRV:
+			case PH7_OP_CMPV_JMPZ:
+			case PH7_OP_ADDV:
+			case PH7_OP_ADDV_STORE:
+			case PH7_OP_LOADV_IDX:
+				nDepth++;
+				break;
+			default:
+				break;
+		}
+	}
+	return nDepth + VM_STACK_GUARD;
+}
+/*
+ * Return the instruction a superinstruction was built from.
+ * A superinstruction keeps the operands of the first instruction of the
+ * sequence it replaces, the following instructions are left untouched.
+ * Other instructions are returned as is.
+ */
+PH7_PRIVATE sxi32 PH7_VmUnfuseInstr(sxi32 iOp) {
+	switch(iOp) {
+		case PH7_OP_INCRV:
+		case PH7_OP_DECRV:
+		case PH7_OP_CMPV_JMPZ:
+		case PH7_OP_ADDV:
+		case PH7_OP_LOADV_IDX:
+			return PH7_OP_LOADV;
+		case PH7_OP_ADDV_STORE:
+			return PH7_OP_LOADC;
+		default:
+			break;
+	}
+	return iOp;
+}
+/*
+ * Check whether the given instruction loads a variable resolved to a frame slot.
+ */
+static int VmIsSlotLoad(const VmInstr *pInstr) {
+	return pInstr->iOp == PH7_OP_LOADV && pInstr->iP1 > 0 && pInstr->p3 != 0;
+}
+/*
+ * Check whether the given instruction loads a plain literal.
+ */
+static int VmIsLiteralLoad(const VmInstr *pInstr) {
+	return pInstr->iOp == PH7_OP_LOADC && pInstr->iP1 == 0;
+}
+/*
+ * Peephole optimizer.
+ * Recognize the most common instruction sequences of a compiled function
+ * body and replace the first instruction of each sequence with a
+ * superinstruction that executes the whole sequence in a single dispatch.
+ * The remaining instructions are left in place so that no jump destination
+ * has to be relocated: the superinstruction skips them when its operands
+ * have the expected type and falls back to the first instruction otherwise.
+ * Jumps to an unconditional jump or to a NOOP are also threaded to their
+ * final destination.
+ */
+PH7_PRIVATE void PH7_VmPeephole(ph7_vm *pVm, SySet *pByteCode) {
+	VmInstr *aInstr = (VmInstr *)SySetBasePtr(pByteCode);
+	sxu32 nInstr = SySetUsed(pByteCode);
+	VmInstr *pInstr;
+	sxu32 nDest, nHop;
+	sxu32 n;
+	if(pVm->iOptLevel < PH7_OPT_FOLD) {
+		return;
+	}
+	for(n = 0 ; n < nInstr ; ++n) {
+		pInstr = &aInstr[n];
+		if(pInstr->iOp == PH7_OP_JMP || pInstr->iOp == PH7_OP_JMPZ || pInstr->iOp == PH7_OP_JMPNZ) {
+			/* Jump threading */
+			nDest = pInstr->iP2;
+			for(nHop = 0 ; nHop < nInstr && nDest < nInstr ; ++nHop) {
+				if(aInstr[nDest].iOp == PH7_OP_NOOP) {
+					nDest++;
+				} else if(aInstr[nDest].iOp == PH7_OP_JMP && aInstr[nDest].iP2 != nDest) {
+					nDest = aInstr[nDest].iP2;
+				} else {
+					break;
+				}
+			}
+			if(nDest != pInstr->iP2 && nDest < nInstr) {
+				pInstr->iP2 = nDest;
+				pVm->nThread++;
+			}
+			continue;
+		}
+		if(VmIsLiteralLoad(pInstr)) {
+			if(n + 3 < nInstr && VmIsSlotLoad(&pInstr[1]) && (pInstr[2].iOp == PH7_OP_ADD_STORE || pInstr[2].iOp == PH7_OP_SUB_STORE)
+					&& pInstr[3].iOp == PH7_OP_POP && pInstr[3].iP1 == 1) {
+				/* $var += literal; */
+				pInstr->iOp = PH7_OP_ADDV_STORE;
+				pVm->nFusion++;
+			}
+			continue;
+		}
+		if(!VmIsSlotLoad(pInstr) || n + 2 >= nInstr) {
+			continue;
+		}
+		if((pInstr[1].iOp == PH7_OP_INCR || pInstr[1].iOp == PH7_OP_DECR || pInstr[1].iOp == PH7_OP_INCR_INT || pInstr[1].iOp == PH7_OP_DECR_INT)
+				&& pInstr[2].iOp == PH7_OP_POP && pInstr[2].iP1 == 1) {
+			/* $var++; */
+			pInstr->iOp = (pInstr[1].iOp == PH7_OP_INCR || pInstr[1].iOp == PH7_OP_INCR_INT) ? PH7_OP_INCRV : PH7_OP_DECRV;
+		} else if(VmIsSlotLoad(&pInstr[1]) == 0 && VmIsLiteralLoad(&pInstr[1]) == 0) {
+			continue;
+		} else if(pInstr[2].iOp == PH7_OP_LOAD_IDX && pInstr[2].iP1 == 1 && pInstr[2].iP2 == 0) {
+			/* $var[$index] */
+			pInstr->iOp = PH7_OP_LOADV_IDX;
+		} else if(n + 3 < nInstr && ((pInstr[2].iOp >= PH7_OP_LT && pInstr[2].iOp <= PH7_OP_NEQ) || (pInstr[2].iOp >= PH7_OP_LT_INT && pInstr[2].iOp <= PH7_OP_NEQ_REAL))
+				  && pInstr[2].iP2 == 0 && pInstr[3].iOp == PH7_OP_JMPZ && pInstr[3].iP1 == 0) {
+			/* if($var < $value) */
+			pInstr->iOp = PH7_OP_CMPV_JMPZ;
+		} else if(n + 4 < nInstr && (pInstr[2].iOp == PH7_OP_ADD || pInstr[2].iOp == PH7_OP_SUB
+				  || pInstr[2].iOp == PH7_OP_ADD_INT || pInstr[2].iOp == PH7_OP_SUB_INT)
+				  && (pInstr[2].iP1 == 0 || pInstr[2].iP1 == 2) && pInstr[2].iP2 == 0 && pInstr[3].iOp == PH7_OP_STORE && pInstr[3].iP1 == pInstr->iP1
+				  && pInstr[3].iP2 == 0 && pInstr[4].iOp == PH7_OP_POP && pInstr[4].iP1 == 1) {
+			/* $var = $var + literal; or $var = $var + $value; */
+			pInstr->iOp = PH7_OP_ADDV;
+		} else {
+			continue;
+		}
+		pVm->nFusion++;
+	}
+}
 /*
  * Allocate a new operand stack so that we can start executing
  * our compiled PHP program.
+ * The stack is carved out of the VM call stack and must be released
+ * in reverse order of allocation using [VmReleaseOperandStack()].
  * Return a pointer to the operand stack (array of ph7_values)
  * on success. NULL (Fatal error) on failure.
  */
 static ph7_value *VmNewOperandStack(
-	ph7_vm *pVm, /* Target VM */
-	sxu32 nInstr /* Total numer of generated byte-code instructions */
+	ph7_vm *pVm,  /* Target VM */
+	sxu32 nValue  /* Stack size [i.e: PH7_VmStackSize()] */
 ) {
+	VmStackChunk *pChunk = pVm->pStackChunk;
 	ph7_value *pStack;
-	/* No instruction ever pushes more than a single element onto the
-	** stack and the stack never grows on successive executions of the
-	** same loop. So the total number of instructions is an upper bound
-	** on the maximum stack depth required.
-	**
-	** Allocation all the stack space we will ever need.
-	*/
-	nInstr += VM_STACK_GUARD;
-	pStack = (ph7_value *)SyMemBackendAlloc(&pVm->sAllocator, nInstr * sizeof(ph7_value));
-	if(pStack == 0) {
-		return 0;
+	sxu32 n, iTag;
+	if(pChunk == 0 || pChunk->nUsed + nValue > pChunk->nSize) {
+		/* Not enough room left, link a new chunk */
+		VmStackChunk *pNew = pVm->pStackSpare;
+		if(pNew && pNew->nSize < nValue) {
+			SyMemBackendFree(&pVm->sAllocator, pNew);
+			pNew = 0;
+		}
+		pVm->pStackSpare = 0;
+		if(pNew == 0) {
+			n = nValue > VM_STACK_CHUNK ? nValue : VM_STACK_CHUNK;
+			SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_VALUES, iTag);
+			pNew = (VmStackChunk *)SyMemBackendAlloc(&pVm->sAllocator, sizeof(VmStackChunk) + n * sizeof(ph7_value));
+			SyMemBackendPopTag(&pVm->sAllocator, iTag);
+			if(pNew == 0) {
+				return 0;
+			}
+			pNew->nSize = n;
+		}
+		pNew->nUsed = 0;
+		pNew->pPrev = pChunk;
+		pVm->pStackChunk = pChunk = pNew;
 	}
+	pStack = &((ph7_value *)&pChunk[1])[pChunk->nUsed];
+	pChunk->nUsed += nValue;
 	/* Initialize the operand stack */
-	while(nInstr > 0) {
-		PH7_MemObjInit(&(*pVm), &pStack[nInstr - 1]);
-		--nInstr;
+	for(n = 0 ; n < nValue ; ++n) {
+		PH7_MemObjInit(&(*pVm), &pStack[n]);
 	}
 	/* Ready for bytecode execution */
 	return pStack;
 }
+/*
+ * Release the given operand stack and any other stack allocated after it.
+ */
+static void VmReleaseOperandStack(
+	ph7_vm *pVm,      /* Target VM */
+	ph7_value *pStack /* Stack returned by [VmNewOperandStack()] */
+) {
+	VmStackChunk *pChunk = pVm->pStackChunk;
+	pChunk->nUsed = (sxu32)(pStack - (ph7_value *)&pChunk[1]);
+	if(pChunk->nUsed < 1 && pChunk->pPrev) {
+		/* Back to the callers chunk, keep this one for the next deep call */
+		pVm->pStackChunk = pChunk->pPrev;
+		if(pVm->pStackSpare) {
+			SyMemBackendFree(&pVm->sAllocator, pVm->pStackSpare);
+		}
+		pVm->pStackSpare = pChunk;
+	}
+}
 /* Forward declaration */
-static sxi32 VmRegisterSpecialFunction(ph7_vm *pVm);
 static int VmInstanceOf(ph7_class *pThis, ph7_class *pClass);
 static int VmClassMemberAccess(ph7_vm *pVm, ph7_class *pClass, sxi32 iProtection);
 /*
- * Prepare the Virtual Machine for byte-code execution.
- * This routine gets called by the PH7 engine after
- * successful compilation of the target PHP program.
+ * Allocate the runtime structures [i.e: operand stack, superglobals...] and
+ * mount the compiled classes so that the VM is ready for bytecode execution.
  */
-PH7_PRIVATE sxi32 PH7_VmMakeReady(
+static sxi32 VmPrepareExec(
 	ph7_vm *pVm /* Target VM */
 ) {
 	SyHashEntry *pEntry;
 	sxi32 rc;
-	if(pVm->nMagic != PH7_VM_INIT) {
-		/* Initialize your VM first */
-		return SXERR_CORRUPT;
-	}
-	/* Mark the VM ready for byte-code execution */
-	pVm->nMagic = PH7_VM_RUN;
-	/* Release the code generator now we have compiled our program */
-	PH7_ResetCodeGenerator(pVm, 0, 0);
-	/* Emit the DONE instruction */
-	rc = PH7_VmEmitInstr(&(*pVm), 0, PH7_OP_DONE, 0, 0, 0, 0);
-	if(rc != SXRET_OK) {
-		return SXERR_MEM;
-	}
 	/* Allocate a new operand stack */
-	pVm->aOps = VmNewOperandStack(&(*pVm), SySetUsed(pVm->pByteContainer));
+	pVm->aOps = VmNewOperandStack(&(*pVm), PH7_VmStackSize(pVm->pByteContainer));
 	if(pVm->aOps == 0) {
 		return SXERR_MEM;
 	}
@@ -1106,31 +2143,256 @@ PH7_PRIVATE sxi32 PH7_VmMakeReady(
 	}
 	/* Zero the reference table */
 	SyZero(pVm->apRefObj, sizeof(VmRefObj *) * pVm->nRefSize);
-	/* Register special functions first [i.e: print, json_encode(), func_get_args(), die, etc.] */
-	rc = VmRegisterSpecialFunction(&(*pVm));
-	if(rc != SXRET_OK) {
-		/* Don't worry about freeing memory, everything will be released shortly */
-		return rc;
-	}
 	/* Create superglobals [i.e: $GLOBALS, $_GET, $_POST...] */
 	rc = PH7_HashmapCreateSuper(&(*pVm));
 	if(rc != SXRET_OK) {
 		/* Don't worry about freeing memory, everything will be released shortly */
 		return rc;
 	}
-	/* Register built-in constants [i.e: PHP_EOL, PHP_OS...] */
-	PH7_RegisterBuiltInConstant(&(*pVm));
-	/* Register built-in functions [i.e: array_diff(), strlen(), etc.] */
-	PH7_RegisterBuiltInFunction(&(*pVm));
+	/* Install the IO streams [i.e: php://, file://] */
+	PH7_RegisterIOStream(&(*pVm));
+	/* Built-in functions and constants are copied from the built-in library on first use */
 	/* Initialize and install static and constants class attributes */
-	SyHashResetLoopCursor(&pVm->hClass);
-	while((pEntry = SyHashGetNextEntry(&pVm->hClass)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pVm->hClass, pEntry)) != 0) {
 		rc = VmMountUserClass(&(*pVm), (ph7_class *)pEntry->pUserData);
 		if(rc != SXRET_OK) {
 			return rc;
 		}
 	}
-	/* VM is ready for bytecode execution */
+	/* VM is ready for bytecode execution */
+	return SXRET_OK;
+}
+/*
+ * Prepare the Virtual Machine for byte-code execution.
+ * This routine gets called by the PH7 engine after
+ * successful compilation of the target PHP program.
+ */
+PH7_PRIVATE sxi32 PH7_VmMakeReady(
+	ph7_vm *pVm /* Target VM */
+) {
+	sxi32 rc;
+	if(pVm->nMagic != PH7_VM_INIT) {
+		/* Initialize your VM first */
+		return SXERR_CORRUPT;
+	}
+	/* Mark the VM ready for byte-code execution */
+	pVm->nMagic = PH7_VM_RUN;
+	/* Release the code generator now we have compiled our program */
+	PH7_ResetCodeGenerator(pVm, 0, 0);
+	/* Emit the DONE instruction */
+	rc = PH7_VmEmitInstr(&(*pVm), 0, PH7_OP_DONE, 0, 0, 0, 0);
+	if(rc != SXRET_OK) {
+		return SXERR_MEM;
+	}
+	/* Allocate the runtime structures */
+	return VmPrepareExec(&(*pVm));
+}
+/*
+ * Process the global scope of a compiled program [i.e: require, import, define,
+ * class inheritance...] once for all the execution contexts sharing it, and
+ * mark the program read-only.
+ */
+static sxi32 VmFreezeProgram(ph7_vm *pProgram) {
+	sxi32 rc;
+	pProgram->nMagic = PH7_VM_EXEC;
+	rc = VmLocalExec(&(*pProgram), pProgram->pByteContainer, 0);
+	if(rc == SXERR_ABORT) {
+		/* Program aborted while processing its declarations */
+		pProgram->nMagic = PH7_VM_STALE;
+		return rc;
+	}
+	/* The program is now read-only */
+	pProgram->nMagic = PH7_VM_SHARED;
+	/* Its arrays and objects may be referenced by concurrent contexts, do not buffer them */
+	pProgram->sGc.bEnabled = FALSE;
+	return SXRET_OK;
+}
+/*
+ * Create a lightweight execution context for a compiled program.
+ * The context shares the program bytecode, classes and functions rather than
+ * compiling or copying them, and owns the runtime state only [i.e: memory
+ * objects, frames, static variables...]. The records a context writes to
+ * are copied on first use [refer to PH7_VmPrivateRecord()], so the contexts
+ * of a given program can execute concurrently.
+ * Once spawned, the program itself can no longer be executed.
+ */
+static sxi32 VmSpawn(
+	ph7_vm *pProgram,        /* Compiled program */
+	ph7_vm *pVm,             /* Context to initialize */
+	SyMemBackend *pAllocator /* Recycled memory backend to take over, NULL to create one */
+) {
+	ph7 *pEngine = pProgram->pEngine;
+	ph7_value *aLit, *pObj;
+	SyHashEntry *pEntry;
+	SyString *aName;
+	ph7_class **apClass;
+	SySet aClass;
+	sxu32 n;
+	sxi32 rc;
+	if(pProgram->nMagic == PH7_VM_RUN) {
+		/* First context, process the program declarations */
+		rc = VmFreezeProgram(&(*pProgram));
+		if(rc != SXRET_OK) {
+			return rc;
+		}
+	} else if(pProgram->nMagic != PH7_VM_SHARED) {
+		/* Compile the program first */
+		return SXERR_CORRUPT;
+	}
+	rc = VmInitCore(&(*pVm), &(*pEngine), pAllocator);
+	if(rc != SXRET_OK) {
+		return rc;
+	}
+	if(pProgram->bArena || pVm->sAllocator.bArena) {
+		/* Contexts of an arena program run in arena mode as well */
+		pVm->bArena = TRUE;
+		SyMemBackendEnableArena(&pVm->sAllocator);
+	}
+	/* Inherit the soft limits of the program */
+	for(n = 0 ; n < PH7_MEM_TAG_COUNT ; ++n) {
+		SyMemBackendSetTagLimit(&pVm->sAllocator, n, pProgram->sAllocator.aTag[n].nLimit);
+	}
+	pVm->pProgram = pProgram;
+	pVm->bDebug = pProgram->bDebug;
+	pVm->bErrReport = pProgram->bErrReport;
+	pVm->iOptLevel = pProgram->iOptLevel;
+	pVm->nFusion = pProgram->nFusion;
+	pVm->nThread = pProgram->nThread;
+	SyHashInit(&pVm->hPrivate, &pVm->sAllocator, 0, 0);
+	/* The bytecode refers to the literals by index, load them in the same order */
+	aLit = (ph7_value *)SySetBasePtr(&pProgram->aLitObj);
+	for(n = SySetUsed(&pVm->aLitObj) ; n < SySetUsed(&pProgram->aLitObj) ; ++n) {
+		pObj = PH7_ReserveConstObj(&(*pVm), 0);
+		if(pObj == 0) {
+			goto Err;
+		}
+		PH7_MemObjInit(&(*pVm), pObj);
+		PH7_MemObjLoad(&aLit[n], pObj);
+	}
+	/* Share the compiled classes in the same order as the program */
+	SySetInit(&aClass, &pVm->sAllocator, sizeof(ph7_class *));
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pProgram->hClass, pEntry)) != 0) {
+		if(SySetPut(&aClass, (const void *)&pEntry->pUserData) != SXRET_OK) {
+			goto Err;
+		}
+	}
+	apClass = (ph7_class **)SySetBasePtr(&aClass);
+	for(n = SySetUsed(&aClass) ; n > 0 ; --n) {
+		if(PH7_VmInstallClass(&(*pVm), apClass[n - 1]) != SXRET_OK) {
+			goto Err;
+		}
+	}
+	SySetRelease(&aClass);
+	/* Share the compiled functions, overloaded ones are already chained */
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pProgram->hFunction, pEntry)) != 0) {
+		if(SyHashInsert(&pVm->hFunction, pEntry->pKey, pEntry->nKeyLen, pEntry->pUserData) != SXRET_OK) {
+			goto Err;
+		}
+	}
+	/* Processed files and import paths */
+	aName = (SyString *)SySetBasePtr(&pProgram->aFiles);
+	for(n = 0 ; n < SySetUsed(&pProgram->aFiles) ; ++n) {
+		SySetPut(&pVm->aFiles, (const void *)&aName[n]);
+	}
+	aName = (SyString *)SySetBasePtr(&pProgram->aIncluded);
+	for(n = 0 ; n < SySetUsed(&pProgram->aIncluded) ; ++n) {
+		SySetPut(&pVm->aIncluded, (const void *)&aName[n]);
+	}
+	aName = (SyString *)SySetBasePtr(&pProgram->aPaths);
+	for(n = 0 ; n < SySetUsed(&pProgram->aPaths) ; ++n) {
+		SySetPut(&pVm->aPaths, (const void *)&aName[n]);
+	}
+	/* Included files are compiled by the context itself */
+	PH7_ResetCodeGenerator(&(*pVm), pEngine->xConf.xErr, pEngine->xConf.pErrData);
+	/* Execute the program bytecode */
+	pVm->pByteContainer = &pProgram->aByteCode;
+	pVm->nMagic = PH7_VM_RUN;
+	rc = VmPrepareExec(&(*pVm));
+	if(rc != SXRET_OK) {
+		SyMemBackendRelease(&pVm->sAllocator);
+		return rc;
+	}
+	pProgram->nContext++;
+	return SXRET_OK;
+Err:
+	SyMemBackendRelease(&pVm->sAllocator);
+	return SXERR_MEM;
+}
+PH7_PRIVATE sxi32 PH7_VmSpawn(
+	ph7_vm *pProgram, /* Compiled program */
+	ph7_vm *pVm       /* Context to initialize */
+) {
+	return VmSpawn(&(*pProgram), &(*pVm), 0);
+}
+/*
+ * Flush any pending output and unload the modules of a Virtual Machine
+ * before its memory is dropped.
+ */
+static void VmShutdown(ph7_vm *pVm) {
+	VmModule *pEntry;
+	/* Flush any pending output */
+	PH7_VmOutputFlush(&(*pVm));
+	/* Iterate through modules list */
+	while(SySetGetNextEntry(&pVm->aModules, (void **)&pEntry) == SXRET_OK) {
+		/* Unload the module */
+#ifdef __WINNT__
+		FreeLibrary(pEntry->pHandle);
+#else
+		dlclose(pEntry->pHandle);
+#endif
+	}
+	/* Free up the heap */
+	SySetRelease(&pVm->aModules);
+}
+/*
+ * Drop the whole runtime state of an execution context running in arena mode
+ * and spawn it again from its program, so it can execute the program once more.
+ * The arena regions are kept for the next run. The output consumer, the output
+ * buffer and the error reporting settings are kept as well, anything else is
+ * configured again by the host application.
+ */
+static sxi32 VmRespawn(ph7_vm *pVm) {
+	ph7_vm *pProgram = pVm->pProgram;
+	ph7_vm *pNext = pVm->pNext;
+	ph7_vm *pPrev = pVm->pPrev;
+	SyMutex *pMutex = pVm->pMutex;
+	sxbool bErrReport = pVm->bErrReport;
+	ph7_output_consumer sCons = pVm->sVmConsumer;
+	VmOutputBuffer sOut = pVm->sOutput;
+	SyMemBackend sAllocator;
+	sxi32 rc;
+	if(sCons.xConsumer == VmObConsumer) {
+		/* Discard any output buffer left by ob_start() */
+		sCons.xConsumer = sCons.xDef;
+		sCons.pUserData = sCons.pDefData;
+	}
+	VmShutdown(&(*pVm));
+	/* Drop everything at once */
+	SyMemBackendRecycle(&pVm->sAllocator);
+	sAllocator = pVm->sAllocator;
+	pProgram->nContext--;
+	rc = VmSpawn(&(*pProgram), &(*pVm), &sAllocator);
+	pVm->pMutex = pMutex;
+	pVm->pNext = pNext;
+	pVm->pPrev = pPrev;
+	if(rc != SXRET_OK) {
+		/* The context is no longer usable and can only be released */
+		pVm->pProgram = 0;
+		pVm->nMagic = PH7_VM_INIT;
+		return rc;
+	}
+	pVm->bErrReport = bErrReport;
+	pVm->sVmConsumer = sCons;
+	if(sCons.xConsumer == VmOutputBufferConsumer) {
+		/* Buffered output, the buffer itself was dropped */
+		pVm->sOutput.xConsumer = sOut.xConsumer;
+		pVm->sOutput.pUserData = sOut.pUserData;
+		pVm->sOutput.nSize = sOut.nSize;
+		pVm->sOutput.iPolicy = sOut.iPolicy;
+	}
 	return SXRET_OK;
 }
 /*
@@ -1140,6 +2402,10 @@ PH7_PRIVATE sxi32 PH7_VmReset(ph7_vm *pVm) {
 	if(pVm->nMagic != PH7_VM_RUN && pVm->nMagic != PH7_VM_EXEC && pVm->nMagic != PH7_VM_INCL) {
 		return SXERR_CORRUPT;
 	}
+	if(pVm->bArena && pVm->pProgram) {
+		/* Start over from the shared program */
+		return VmRespawn(&(*pVm));
+	}
 	/* TICKET 1433-003: As of this version, the VM is automatically reset */
 	SyBlobReset(&pVm->sConsumer);
 	/* Set the ready flag */
@@ -1151,18 +2417,7 @@ PH7_PRIVATE sxi32 PH7_VmReset(ph7_vm *pVm) {
  * Every virtual machine must be destroyed in order to avoid memory leaks.
  */
 PH7_PRIVATE sxi32 PH7_VmRelease(ph7_vm *pVm) {
-	VmModule *pEntry;
-	/* Iterate through modules list */
-	while(SySetGetNextEntry(&pVm->aModules, (void **)&pEntry) == SXRET_OK) {
-		/* Unload the module */
-#ifdef __WINNT__
-		FreeLibrary(pEntry->pHandle);
-#else
-		dlclose(pEntry->pHandle);
-#endif
-	}
-	/* Free up the heap */
-	SySetRelease(&pVm->aModules);
+	VmShutdown(&(*pVm));
 	/* Set the stale magic number */
 	pVm->nMagic = PH7_VM_STALE;
 	/* Release the private memory subsystem */
@@ -1278,22 +2533,12 @@ static void VmPopOperand(
  * Return a pointer to the raw ph7_value on success. NULL on failure.
  */
 PH7_PRIVATE ph7_value *PH7_ReserveMemObj(ph7_vm *pVm) {
-	ph7_value *pObj = 0;
-	VmSlot *pSlot;
+	ph7_value *pObj;
 	sxu32 nIdx;
-	/* Check for a free slot */
-	nIdx = SXU32_HIGH; /* cc warning */
-	pSlot = (VmSlot *)SySetPop(&pVm->aFreeObj);
-	if(pSlot) {
-		pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pSlot->nIdx);
-		nIdx = pSlot->nIdx;
-	}
+	/* Reserve a free memory object */
+	pObj = VmReserveMemObj(&(*pVm), &nIdx);
 	if(pObj == 0) {
-		/* Reserve a new memory object */
-		pObj = VmReserveMemObj(&(*pVm), &nIdx);
-		if(pObj == 0) {
-			return 0;
-		}
+		return 0;
 	}
 	/* Set a null default value */
 	PH7_MemObjInit(&(*pVm), pObj);
@@ -1322,6 +2567,8 @@ static ph7_value *VmCreateMemObj(
 	ph7_value *pObj;
 	VmSlot sLocal;
 	char *zName = (char *)pName->zString;
+	/* Do not let the slots resolve to a hidden variable */
+	VmVarSlotShadow(pVm->pFrame, pName->zString, pName->nByte);
 	/* Reserve a memory object */
 	pObj = PH7_ReserveMemObj(&(*pVm));
 	if(pObj == 0) {
@@ -1329,8 +2576,8 @@ static ph7_value *VmCreateMemObj(
 	}
 	nIdx = pObj->nIdx;
 	if(bDup) {
-		/* Duplicate name */
-		zName = SyMemBackendStrDup(&pVm->sAllocator, pName->zString, pName->nByte);
+		/* Intern the name, so that it is allocated only once */
+		zName = (char *)PH7_VmInternString(&(*pVm), pName->zString, pName->nByte, SyBinHash(pName->zString, pName->nByte));
 		if(zName == 0) {
 			PH7_VmMemoryError(&(*pVm));
 		}
@@ -1340,15 +2587,57 @@ static ph7_value *VmCreateMemObj(
 	if(rc != SXRET_OK) {
 		PH7_VmMemoryError(&(*pVm));
 	}
+	pEntry = SyHashLastEntry(&pVm->pFrame->hVar);
 	/* Register local variable */
 	sLocal.nIdx = nIdx;
+	sLocal.pUserData = pEntry;
 	SySetPut(&pVm->pFrame->sLocal, (const void *)&sLocal);
 	/* Install in the reference table */
-	PH7_VmRefObjInstall(&(*pVm), nIdx, SyHashLastEntry(&pVm->pFrame->hVar), 0, 0);
+	PH7_VmRefObjInstall(&(*pVm), nIdx, pEntry, 0, 0);
 	/* Save object index */
 	pObj->nIdx = nIdx;
 	return pObj;
 }
+/*
+ * Look up a variable in the superglobals table and then in the top active
+ * VM frame(s). Return the hash entry of the variable on success, NULL otherwise.
+ * The frame holding the entry (NULL for a superglobal) is written to ppFrame.
+ */
+static SyHashEntry *VmLookupVar(
+	ph7_vm *pVm,           /* Target VM */
+	const SyString *pName, /* Variable name */
+	VmFrame **ppFrame      /* OUT: Frame holding the variable */
+) {
+	SyHashEntry *pEntry;
+	VmFrame *pFrame;
+	/* Check the superglobals table first */
+	pEntry = SyHashGet(&pVm->hSuper, (const void *)pName->zString, pName->nByte);
+	if(pEntry) {
+		*ppFrame = 0;
+		return pEntry;
+	}
+	/* Point to the top active frame */
+	pFrame = pVm->pFrame;
+	while(pFrame->pParent && (pFrame->iFlags & VM_FRAME_EXCEPTION)) {
+		/* Safely ignore the exception frame */
+		pFrame = pFrame->pParent; /* Parent frame */
+	}
+	for(;;) {
+		/* Query the top active/loop frame(s) */
+		pEntry = SyHashGet(&pFrame->hVar, (const void *)pName->zString, pName->nByte);
+		if(pEntry) {
+			*ppFrame = pFrame;
+			return pEntry;
+		}
+		if(pFrame->pParent && pFrame->iFlags & (VM_FRAME_LOOP | VM_FRAME_EXCEPTION | VM_FRAME_CATCH | VM_FRAME_FINALLY)) {
+			pFrame = pFrame->pParent;
+		} else {
+			break;
+		}
+	}
+	/* No such variable */
+	return 0;
+}
 /*
  * Extract a variable value from the top active VM frame.
  * Return a pointer to the variable value on success.
@@ -1363,14 +2652,7 @@ static ph7_value *VmExtractMemObj(
 	SyHashEntry *pEntry;
 	VmFrame *pFrame;
 	ph7_value *pObj;
-	sxu32 nIdx;
 	SXUNUSED(bDup);
-	/* Point to the top active frame */
-	pFrame = pVm->pFrame;
-	while(pFrame->pParent && (pFrame->iFlags & VM_FRAME_EXCEPTION)) {
-		/* Safely ignore the exception frame */
-		pFrame = pFrame->pParent; /* Parent frame */
-	}
 	/* Perform the lookup */
 	if(pName == 0 || pName->nByte < 1) {
 		static const SyString sAnon = { " ", sizeof(char) };
@@ -1378,35 +2660,137 @@ static ph7_value *VmExtractMemObj(
 		/* Always nullify the object */
 		bNullify = TRUE;
 	}
-	/* Check the superglobals table first */
-	pEntry = SyHashGet(&pVm->hSuper, (const void *)pName->zString, pName->nByte);
+	pEntry = VmLookupVar(&(*pVm), pName, &pFrame);
 	if(pEntry == 0) {
-		for(;;) {
-			/* Query the top active/loop frame(s) */
-			pEntry = SyHashGet(&pFrame->hVar, (const void *)pName->zString, pName->nByte);
-			if(pEntry) {
-				/* Extract variable contents */
-				nIdx = (sxu32)SX_PTR_TO_INT(pEntry->pUserData);
-				pObj = (ph7_value *)SySetAt(&pVm->aMemObj, nIdx);
-				if(bNullify && pObj) {
-					PH7_MemObjRelease(pObj);
-				}
-				break;
-			}
-			if(pFrame->pParent && pFrame->iFlags & (VM_FRAME_LOOP | VM_FRAME_EXCEPTION | VM_FRAME_CATCH | VM_FRAME_FINALLY)) {
-				pFrame = pFrame->pParent;
-			} else {
-				break;
+		/* Variable does not exist, return NULL */
+		return 0;
+	}
+	/* Extract variable contents */
+	pObj = VmObjTableAt(&pVm->aMemObj, (sxu32)SX_PTR_TO_INT(pEntry->pUserData));
+	if(bNullify && pFrame && pObj) {
+		PH7_MemObjRelease(pObj);
+	}
+	return pObj;
+}
+/*
+ * Extract a variable value through the slot it was assigned at compile-time.
+ * The slot remembers the variable entry resolved by name on the first access
+ * and is reused as long as no variable entry was removed from the VM meanwhile.
+ * Return a pointer to the variable value on success. NULL otherwise.
+ */
+static ph7_value *VmExtractSlotMemObj(
+	ph7_vm *pVm,       /* Target VM */
+	sxu32 iSlot,       /* Slot index */
+	const char *zName  /* Variable name */
+) {
+	VmFrame *pFrame = pVm->pFrame;
+	SyHashEntry *pEntry;
+	VmVarSlot *pSlot;
+	SyString sName;
+	if(iSlot >= pFrame->nVarSlot) {
+		/* Not running a function body [i.e: catch/finally blocks], perform a lookup by name */
+		SyStringInitFromBuf(&sName, zName, SyStrlen(zName));
+		return VmExtractMemObj(&(*pVm), &sName, FALSE);
+	}
+	pSlot = &pFrame->aVarSlot[iSlot];
+	if(pSlot->pEntry == 0 || pSlot->nGen != pVm->nVarGen) {
+		/* Resolve the variable by name */
+		SyStringInitFromBuf(&sName, zName, SyStrlen(zName));
+		pEntry = VmLookupVar(&(*pVm), &sName, &pSlot->pFrame);
+		if(pEntry == 0) {
+			pSlot->pEntry = 0;
+			return 0;
+		}
+		pSlot->pEntry = pEntry;
+		pSlot->nGen = pVm->nVarGen;
+	}
+	return VmObjTableAt(&pVm->aMemObj, (sxu32)SX_PTR_TO_INT(pSlot->pEntry->pUserData));
+}
+/*
+ * Check whether the string contents of the given value live in the buffer
+ * owned by the given variable [i.e: the value was loaded from it].
+ * Such contents would be invalidated by an append to the variable buffer.
+ */
+static int VmStringAliases(ph7_value *pVal, ph7_value *pObj) {
+	const char *zData = (const char *)SyBlobData(&pVal->sBlob);
+	const char *zBuf = (const char *)SyBlobData(&pObj->sBlob);
+	return zData != 0 && zData >= zBuf && zData < &zBuf[SyBlobLength(&pObj->sBlob)];
+}
+/*
+ * Prepare the buffer of the given variable for an in-place append.
+ * The append may reallocate the buffer, so the operands of the current stack
+ * [i.e: pStack..pEnd-1] that are still viewing it get their own copy first.
+ * Return SXRET_OK on success. Any other return value indicates that the
+ * variable may also be viewed from the stack of a caller [i.e: reference,
+ * static variable or object attribute] and must not be modified in place.
+ */
+static sxi32 VmStringDetachViews(ph7_vm *pVm, ph7_value *pObj, ph7_value *pStack, ph7_value *pEnd) {
+	VmRefObj *pRef;
+	ph7_value *pCur;
+	pRef = VmRefObjExtract(&(*pVm), pObj->nIdx);
+	if(pRef == 0 || SySetUsed(&pRef->aReference) != 1 || SySetUsed(&pRef->aArrEntries) > 0 || (pRef->iFlags & VM_REF_IDX_KEEP)) {
+		return SXERR_BUSY;
+	}
+	for(pCur = pStack ; pCur < pEnd ; pCur++) {
+		if((pCur->sBlob.nFlags & SXBLOB_RDONLY) && VmStringAliases(pCur, pObj)) {
+			const void *pData = SyBlobData(&pCur->sBlob);
+			sxu32 nLen = SyBlobLength(&pCur->sBlob);
+			SyBlobInit(&pCur->sBlob, &pVm->sAllocator);
+			SyBlobAppend(&pCur->sBlob, pData, nLen);
+		}
+	}
+	return SXRET_OK;
+}
+/*
+ * Maximum number of instructions scanned by [VmConcatTarget()].
+ */
+#define VM_CONCAT_LOOKAHEAD 32
+/*
+ * Check whether the string addition at the given instruction belongs to an
+ * expression of the form $var = $var + ... + ...; where the left operand is
+ * still a view of the variable stored by the trailing STORE instruction and
+ * the remaining operands are literals or other variables.
+ * Return the variable on success so that the operands can be appended to its
+ * buffer in place. NULL otherwise.
+ */
+static ph7_value *VmConcatTarget(ph7_vm *pVm, VmInstr *pInstr, ph7_value *pStack, ph7_value *pLeft) {
+	ph7_value *pObj;
+	sxi32 nDepth = 0;
+	sxu32 n;
+	if(pInstr->iP2 || pLeft->nIdx == SXU32_HIGH || (pLeft->sBlob.nFlags & SXBLOB_RDONLY) == 0) {
+		return 0;
+	}
+	for(n = 1 ; n < VM_CONCAT_LOOKAHEAD ; ++n) {
+		if(pInstr[n].iOp == PH7_OP_LOADC && pInstr[n].iP1 == 0) {
+			nDepth++;
+		} else if(pInstr[n].iOp == PH7_OP_LOADV && pInstr[n].iP1 > 0 && pInstr[n].p3) {
+			nDepth++;
+		} else if(pInstr[n].iOp == PH7_OP_ADD && pInstr[n].iP2 == 0) {
+			nDepth -= pInstr[n].iP1 < 1 ? 1 : pInstr[n].iP1 - 1;
+			if(nDepth < 0) {
+				/* The result is not the left operand of this addition */
+				return 0;
 			}
+		} else {
+			break;
 		}
-		if(pEntry == 0) {
-			/* Variable does not exist, return NULL */
+	}
+	if(nDepth != 0 || pInstr[n].iOp != PH7_OP_STORE || pInstr[n].iP1 < 1 || pInstr[n].iP2 || pInstr[n].p3 == 0) {
+		return 0;
+	}
+	pObj = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr[n].iP1 - 1, (const char *)pInstr[n].p3);
+	if(pObj == 0 || pObj->nIdx != pLeft->nIdx || pObj->iFlags != MEMOBJ_VARIABLE || (pObj->nType & MEMOBJ_STRING) == 0
+			|| SyBlobData(&pLeft->sBlob) != SyBlobData(&pObj->sBlob) || SyBlobLength(&pLeft->sBlob) != SyBlobLength(&pObj->sBlob)) {
+		return 0;
+	}
+	/* The remaining operands must not see the variable modified */
+	while(--n > 0) {
+		if(pInstr[n].iOp == PH7_OP_LOADV && VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr[n].iP1 - 1, (const char *)pInstr[n].p3) == pObj) {
 			return 0;
 		}
-	} else {
-		/* Extract from superglobal */
-		nIdx = (sxu32)SX_PTR_TO_INT(pEntry->pUserData);
-		pObj = (ph7_value *)SySetAt(&pVm->aMemObj, nIdx);
+	}
+	if(VmStringDetachViews(&(*pVm), pObj, pStack, pLeft) != SXRET_OK) {
+		return 0;
 	}
 	return pObj;
 }
@@ -1431,7 +2815,7 @@ static ph7_value *VmExtractSuper(
 	/* Extract the superglobal index in the global object pool */
 	nIdx = SX_PTR_TO_INT(pEntry->pUserData);
 	/* Extract the variable value  */
-	pValue = (ph7_value *)SySetAt(&pVm->aMemObj, nIdx);
+	pValue = VmObjTableAt(&pVm->aMemObj, nIdx);
 	return pValue;
 }
 /*
@@ -1498,11 +2882,58 @@ PH7_PRIVATE sxi32 PH7_VmConfigure(
 					rc = SXERR_CORRUPT;
 					break;
 				}
+				if(pVm->sOutput.nSize > 0) {
+					/* Output is buffered, flush it to the previous consumer */
+					PH7_VmOutputFlush(&(*pVm));
+					pVm->sOutput.xConsumer = xConsumer;
+					pVm->sOutput.pUserData = pUserData;
+					break;
+				}
 				/* Install the output consumer */
 				pVm->sVmConsumer.xConsumer = xConsumer;
 				pVm->sVmConsumer.pUserData = pUserData;
 				break;
 			}
+		case PH7_VM_CONFIG_OUTPUT_BUFFER: {
+				ph7_output_consumer *pCons = &pVm->sVmConsumer;
+				VmOutputBuffer *pOut = &pVm->sOutput;
+				sxu32 nSize = va_arg(ap, sxu32);
+				sxi32 iPolicy = va_arg(ap, sxi32);
+				ProcConsumer *pxConsumer;
+				void **ppUserData;
+				if(iPolicy != PH7_OUTPUT_FLUSH_FULL && iPolicy != PH7_OUTPUT_FLUSH_LINE) {
+					rc = SXERR_CORRUPT;
+					break;
+				}
+				/* The buffer sits below the output buffering stack [i.e: ob_start()] if any */
+				if(pCons->xConsumer == VmObConsumer) {
+					pxConsumer = &pCons->xDef;
+					ppUserData = &pCons->pDefData;
+				} else {
+					pxConsumer = &pCons->xConsumer;
+					ppUserData = &pCons->pUserData;
+				}
+				if(nSize > 0) {
+					if(*pxConsumer != VmOutputBufferConsumer) {
+						/* Redirect the output to the buffer */
+						pOut->xConsumer = *pxConsumer;
+						pOut->pUserData = *ppUserData;
+						*pxConsumer = VmOutputBufferConsumer;
+						*ppUserData = pVm;
+					} else if(SyBlobLength(&pOut->sBuf) > nSize) {
+						PH7_VmOutputFlush(&(*pVm));
+					}
+					pOut->nSize = nSize;
+					pOut->iPolicy = iPolicy;
+				} else if(*pxConsumer == VmOutputBufferConsumer) {
+					/* Flush pending output and restore the consumer */
+					PH7_VmOutputFlush(&(*pVm));
+					*pxConsumer = pOut->xConsumer;
+					*ppUserData = pOut->pUserData;
+					pOut->nSize = 0;
+				}
+				break;
+			}
 		case PH7_VM_CONFIG_IMPORT_PATH: {
 				/* Import path */
 				const char *zPath;
@@ -1521,6 +2952,12 @@ PH7_PRIVATE sxi32 PH7_VmConfigure(
 				/* Remove leading and trailing white spaces */
 				SyStringFullTrim(&sPath);
 				if(sPath.nByte > 0) {
+					/* The given path may live in a transient buffer,make a private copy */
+					sPath.zString = SyMemBackendStrDup(&pVm->sAllocator, sPath.zString, sPath.nByte);
+					if(sPath.zString == 0) {
+						rc = SXERR_MEM;
+						break;
+					}
 					/* Store the path in the corresponding container */
 					rc = SySetPut(&pVm->aPaths, (const void *)&sPath);
 				}
@@ -1530,6 +2967,37 @@ PH7_PRIVATE sxi32 PH7_VmConfigure(
 			/* Run-Time Error report */
 			pVm->bErrReport = 1;
 			break;
+		case PH7_VM_CONFIG_ARENA:
+			/* Carve the runtime state out of large regions and drop it wholesale */
+			pVm->bArena = TRUE;
+			SyMemBackendEnableArena(&pVm->sAllocator);
+			break;
+		case PH7_VM_CONFIG_MEM_STATS: {
+				/* Per subsystem memory usage */
+				ph7_mem_stat *aStat = va_arg(ap, ph7_mem_stat *);
+				sxu32 n;
+				if(aStat == 0) {
+					rc = SXERR_CORRUPT;
+					break;
+				}
+				for(n = 0 ; n < PH7_MEM_TAG_COUNT ; ++n) {
+					aStat[n].nSize = (ph7_int64)pVm->sAllocator.aTag[n].nSize;
+					aStat[n].nPeak = (ph7_int64)pVm->sAllocator.aTag[n].nPeak;
+					aStat[n].nLimit = (ph7_int64)pVm->sAllocator.aTag[n].nLimit;
+				}
+				break;
+			}
+		case PH7_VM_CONFIG_MEM_TAG_LIMIT: {
+				/* Soft limit of a subsystem */
+				int iTag = va_arg(ap, int);
+				ph7_int64 nLimit = va_arg(ap, ph7_int64);
+				if(iTag < 0 || nLimit < 0) {
+					rc = SXERR_CORRUPT;
+					break;
+				}
+				rc = SyMemBackendSetTagLimit(&pVm->sAllocator, (sxu32)iTag, (sxu64)nLimit);
+				break;
+			}
 		case PH7_VM_CONFIG_CREATE_SUPER:
 		case PH7_VM_CONFIG_CREATE_VAR: {
 				/* Create a new superglobal/global variable */
@@ -1555,7 +3023,7 @@ PH7_PRIVATE sxi32 PH7_VmConfigure(
 					/* Variable already installed */
 					nIdx = SX_PTR_TO_INT(pEntry->pUserData);
 					/* Extract contents */
-					pObj = (ph7_value *)SySetAt(&pVm->aMemObj, nIdx);
+					pObj = VmObjTableAt(&pVm->aMemObj, nIdx);
 					if(pObj) {
 						/* Overwrite old contents */
 						PH7_MemObjStore(pValue, pObj);
@@ -1571,10 +3039,13 @@ PH7_PRIVATE sxi32 PH7_VmConfigure(
 					/* Copy value */
 					PH7_MemObjStore(pValue, pObj);
 					if(nOp == PH7_VM_CONFIG_CREATE_SUPER) {
+						/* Superglobals take precedence, invalidate all slots */
+						pVm->nVarGen++;
 						/* Install the superglobal */
 						rc = SyHashInsert(&pVm->hSuper, (const void *)zName, nByte, SX_INT_TO_PTR(nIdx));
 					} else {
 						/* Install in the current frame */
+						VmVarSlotShadow(pVm->pFrame, zName, nByte);
 						rc = SyHashInsert(&pVm->pFrame->hVar, (const void *)zName, nByte, SX_INT_TO_PTR(nIdx));
 					}
 					if(rc == SXRET_OK) {
@@ -1676,6 +3147,8 @@ PH7_PRIVATE sxi32 PH7_VmConfigure(
 					rc = SXERR_CORRUPT;
 					break;
 				}
+				/* Flush any pending output first */
+				PH7_VmOutputFlush(&(*pVm));
 				*ppOut = SyBlobData(&pVm->sConsumer);
 				*pLen  = SyBlobLength(&pVm->sConsumer);
 				break;
@@ -1704,10 +3177,17 @@ PH7_PRIVATE sxi32 PH7_VmConfigure(
 	return rc;
 }
 /* Forward declaration */
-static int VmObConsumer(const void *pData, unsigned int nDataLen, void *pUserData);
 static sxi32 VmExecFinallyBlock(ph7_vm *pVm, ph7_exception *pException);
 static sxi32 VmUncaughtException(ph7_vm *pVm, ph7_class_instance *pThis);
 static sxi32 VmThrowException(ph7_vm *pVm, ph7_class_instance *pThis);
+static sxi32 VmThrowMemoryLimit(ph7_vm *pVm);
+static sxi32 VmMemoryLimitCheckpoint(ph7_vm *pVm, int is_callback, sxu32 *pJump);
+/*
+ * Names of the memory accounting tags [i.e: PH7_MEM_TAG_*].
+ */
+static const char *azMemTag[PH7_MEM_TAG_COUNT] = {
+	"other", "compiler", "bytecode", "values", "hashmaps", "strings", "objects", "io", "modules"
+};
 /*
  * Consume a generated run-time error message by invoking the VM output
  * consumer callback.
@@ -1736,14 +3216,23 @@ PH7_PRIVATE sxi32 PH7_VmMemoryError(
 	SyBlob sWorker;
 	if(pVm->bErrReport) {
 		/* Report OOM problem */
-		VmInstr *pInstr = SySetPeek(&pVm->aInstrSet);
+		static const SyString sFileName = { "[MEMORY]", sizeof("[MEMORY]") - 1};
+		const SyString *pFile = &sFileName;
+		sxu32 nLine = 1;
+		if(pVm->pExec) {
+			/* Extract file name and line number from the running program */
+			pFile = pVm->pExec->pInstr->pFile;
+			nLine = pVm->pExec->pInstr->iLine;
+		}
 		/* Initialize the working buffer */
 		SyBlobInit(&sWorker, &pVm->sAllocator);
 		SyBlobFormat(&sWorker, "Fatal: PH7 Engine is running out of memory. Allocated %u bytes in %z:%u",
-					pVm->sAllocator.pHeap->nSize, pInstr->pFile, pInstr->iLine);
+					(sxu32)SyMemBackendHeapUsage(&pVm->sAllocator, 0), pFile, nLine);
 		/* Consume the error message */
 		VmCallErrorHandler(&(*pVm), &sWorker);
 	}
+	/* Flush any pending output */
+	PH7_VmOutputFlush(&(*pVm));
 	/* Shutdown library and abort script execution */
 	ph7_lib_shutdown();
 	exit(255);
@@ -1787,11 +3276,10 @@ PH7_PRIVATE sxi32 PH7_VmThrowError(
 			SySetGetNextEntry(&pDebug, (void **)&pTrace);
 			pFile = pTrace->pFile;
 			nLine = pTrace->nLine;
-		} else if(SySetUsed(&pVm->aInstrSet) > 0) {
-			/* Extract file name and line number from instructions set */
-			VmInstr *pInstr = SySetPeek(&pVm->aInstrSet);
-			pFile = pInstr->pFile;
-			nLine = pInstr->iLine;
+		} else if(pVm->pExec) {
+			/* Extract file name and line number from the running program */
+			pFile = pVm->pExec->pInstr->pFile;
+			nLine = pVm->pExec->pInstr->iLine;
 		} else {
 			/* Failover to some location in memory */
 			SyStringInitFromBuf(&sFileName, "[MEMORY]", 8);
@@ -1826,12 +3314,35 @@ PH7_PRIVATE sxi32 PH7_VmThrowError(
 		rc = VmCallErrorHandler(&(*pVm), &sWorker);
 	}
 	if(iErr == PH7_CTX_ERR) {
+		/* Flush any pending output */
+		PH7_VmOutputFlush(&(*pVm));
 		/* Shutdown library and abort script execution */
 		ph7_lib_shutdown();
 		exit(255);
 	}
 	return rc;
 }
+/*
+ * Instruction dispatch.
+ * When the compiler supports taking the address of a label (GCC, Clang),
+ * the interpreter jumps straight to the handler of the fetched opcode via
+ * a table of label addresses (threaded code) instead of going through the
+ * switch() range check on every instruction. Each handler still lives in
+ * a case block, so the portable switch() based dispatch is used on other
+ * compilers or when PH7_VM_NO_THREADED_CODE is defined.
+ */
+#if defined(__GNUC__) && !defined(PH7_VM_NO_THREADED_CODE)
+	#define PH7_VM_THREADED_CODE
+	#define VM_CASE(OP) case OP: VmOp_##OP
+	#define VM_LABEL(OP) [OP] = &&VmOp_##OP
+#else
+	#define VM_CASE(OP) case OP
+#endif
+#ifdef PH7_VM_THREADED_CODE
+	/* Label addresses and computed goto are GNU extensions */
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
 /*
  * Execute as much of a PH7 bytecode program as we can then return.
  *
@@ -1854,6 +3365,51 @@ static sxi32 VmByteCodeExec(
 	sxu32 *pLastRef,     /* Last referenced ph7_value index */
 	int is_callback      /* TRUE if we are executing a callback */
 ) {
+#ifdef PH7_VM_THREADED_CODE
+	/* Instruction handlers indexed by opcode */
+	static const void *aDispatch[] = {
+		VM_LABEL(PH7_OP_DONE),           VM_LABEL(PH7_OP_HALT),           VM_LABEL(PH7_OP_IMPORT),
+		VM_LABEL(PH7_OP_INCLUDE),        VM_LABEL(PH7_OP_DECLARE),        VM_LABEL(PH7_OP_LOADV),
+		VM_LABEL(PH7_OP_LOADC),          VM_LABEL(PH7_OP_LOAD_IDX),       VM_LABEL(PH7_OP_LOAD_MAP),
+		VM_LABEL(PH7_OP_LOAD_CLOSURE),   VM_LABEL(PH7_OP_NOOP),           VM_LABEL(PH7_OP_JMP),
+		VM_LABEL(PH7_OP_JMPZ),           VM_LABEL(PH7_OP_JMPNZ),          VM_LABEL(PH7_OP_LF_START),
+		VM_LABEL(PH7_OP_LF_STOP),        VM_LABEL(PH7_OP_POP),            VM_LABEL(PH7_OP_CVT_INT),
+		VM_LABEL(PH7_OP_CVT_STR),        VM_LABEL(PH7_OP_CVT_REAL),       VM_LABEL(PH7_OP_CALL),
+		VM_LABEL(PH7_OP_UMINUS),         VM_LABEL(PH7_OP_UPLUS),          VM_LABEL(PH7_OP_BITNOT),
+		VM_LABEL(PH7_OP_LNOT),           VM_LABEL(PH7_OP_MUL),            VM_LABEL(PH7_OP_DIV),
+		VM_LABEL(PH7_OP_MOD),            VM_LABEL(PH7_OP_ADD),            VM_LABEL(PH7_OP_SUB),
+		VM_LABEL(PH7_OP_SHL),            VM_LABEL(PH7_OP_SHR),            VM_LABEL(PH7_OP_LT),
+		VM_LABEL(PH7_OP_LE),             VM_LABEL(PH7_OP_GT),             VM_LABEL(PH7_OP_GE),
+		VM_LABEL(PH7_OP_EQ),             VM_LABEL(PH7_OP_NEQ),            VM_LABEL(PH7_OP_BAND),
+		VM_LABEL(PH7_OP_BXOR),           VM_LABEL(PH7_OP_BOR),            VM_LABEL(PH7_OP_LAND),
+		VM_LABEL(PH7_OP_LOR),            VM_LABEL(PH7_OP_LXOR),           VM_LABEL(PH7_OP_NULLC),
+		VM_LABEL(PH7_OP_STORE),          VM_LABEL(PH7_OP_STORE_IDX),      VM_LABEL(PH7_OP_CVT_BOOL),
+		VM_LABEL(PH7_OP_CVT_CHAR),       VM_LABEL(PH7_OP_INCR),           VM_LABEL(PH7_OP_DECR),
+		VM_LABEL(PH7_OP_NEW),            VM_LABEL(PH7_OP_CLONE),          VM_LABEL(PH7_OP_ADD_STORE),
+		VM_LABEL(PH7_OP_SUB_STORE),      VM_LABEL(PH7_OP_MUL_STORE),      VM_LABEL(PH7_OP_DIV_STORE),
+		VM_LABEL(PH7_OP_MOD_STORE),      VM_LABEL(PH7_OP_SHL_STORE),      VM_LABEL(PH7_OP_SHR_STORE),
+		VM_LABEL(PH7_OP_BAND_STORE),     VM_LABEL(PH7_OP_BOR_STORE),      VM_LABEL(PH7_OP_BXOR_STORE),
+		VM_LABEL(PH7_OP_CONSUME),        VM_LABEL(PH7_OP_MEMBER),         VM_LABEL(PH7_OP_CVT_OBJ),
+		VM_LABEL(PH7_OP_CVT_CALL),       VM_LABEL(PH7_OP_CVT_RES),        VM_LABEL(PH7_OP_CVT_VOID),
+		VM_LABEL(PH7_OP_CLASS_INIT),     VM_LABEL(PH7_OP_INTERFACE_INIT), VM_LABEL(PH7_OP_FOREACH_INIT),
+		VM_LABEL(PH7_OP_FOREACH_STEP),   VM_LABEL(PH7_OP_IS),             VM_LABEL(PH7_OP_LOAD_EXCEPTION),
+		VM_LABEL(PH7_OP_POP_EXCEPTION),  VM_LABEL(PH7_OP_THROW),          VM_LABEL(PH7_OP_SWITCH),
+		VM_LABEL(PH7_OP_INCRV),          VM_LABEL(PH7_OP_DECRV),          VM_LABEL(PH7_OP_CMPV_JMPZ),
+		VM_LABEL(PH7_OP_ADDV),           VM_LABEL(PH7_OP_ADDV_STORE),     VM_LABEL(PH7_OP_LOADV_IDX),
+		VM_LABEL(PH7_OP_ADD_INT),        VM_LABEL(PH7_OP_SUB_INT),        VM_LABEL(PH7_OP_MUL_INT),
+		VM_LABEL(PH7_OP_ADD_REAL),       VM_LABEL(PH7_OP_SUB_REAL),       VM_LABEL(PH7_OP_MUL_REAL),
+		VM_LABEL(PH7_OP_DIV_REAL),       VM_LABEL(PH7_OP_LT_INT),         VM_LABEL(PH7_OP_LE_INT),
+		VM_LABEL(PH7_OP_GT_INT),         VM_LABEL(PH7_OP_GE_INT),         VM_LABEL(PH7_OP_EQ_INT),
+		VM_LABEL(PH7_OP_NEQ_INT),        VM_LABEL(PH7_OP_LT_REAL),        VM_LABEL(PH7_OP_LE_REAL),
+		VM_LABEL(PH7_OP_GT_REAL),        VM_LABEL(PH7_OP_GE_REAL),        VM_LABEL(PH7_OP_EQ_REAL),
+		VM_LABEL(PH7_OP_NEQ_REAL),       VM_LABEL(PH7_OP_INCR_INT),       VM_LABEL(PH7_OP_DECR_INT),
+		/* Opcodes without a handler are no-ops */
+		[PH7_OP_STORE_IDX_REF] = &&VmOpNext, [PH7_OP_PULL] = &&VmOpNext,
+		[PH7_OP_SWAP] = &&VmOpNext,          [PH7_OP_YIELD] = &&VmOpNext
+	};
+#endif
+	const sxbool bDebug = pVm->bDebug;
+	VmExecState sExec;
 	VmInstr *pInstr;
 	ph7_value *pTos;
 	SySet aArg;
@@ -1867,18 +3423,24 @@ static sxi32 VmByteCodeExec(
 		pTos = &pStack[nTos];
 	}
 	pc = 0;
+	/* Link this program on the stack of running programs */
+	sExec.aInstr = aInstr;
+	sExec.pInstr = aInstr;
+	sExec.pPrev = pVm->pExec;
+	pVm->pExec = &sExec;
 	/* Execute as much as we can */
 	for(;;) {
-		if(!pVm->bDebug) {
-			/* Reset instructions set container */
-			SySetReset(&pVm->aInstrSet);
-		}
 		/* Fetch the instruction to execute */
 		pInstr = &aInstr[pc];
-		pInstr->bExec = TRUE;
-		/* Record executed instruction in global container */
-		SySetPut(&pVm->aInstrSet, (void *)pInstr);
+		sExec.pInstr = pInstr;
+		if(bDebug) {
+			/* Record executed instruction in global container */
+			SySetPut(&pVm->aInstrSet, (void *)pInstr);
+		}
 		rc = SXRET_OK;
+#ifdef PH7_VM_THREADED_CODE
+		goto *aDispatch[pInstr->iOp];
+#endif
 		/*
 		 * What follows here is a massive switch statement where each case implements a
 		 * separate instruction in the virtual machine.  If we follow the usual
@@ -1893,7 +3455,7 @@ static sxi32 VmByteCodeExec(
 			 * Program execution completed: Clean up the mess left behind
 			 * and return immediately.
 			 */
-			case PH7_OP_DONE:
+			VM_CASE(PH7_OP_DONE):
 				if(pInstr->iP1) {
 					if(pTos < pStack) {
 						goto Abort;
@@ -1901,8 +3463,8 @@ static sxi32 VmByteCodeExec(
 					if(pLastRef) {
 						*pLastRef = pTos->nIdx;
 					}
-					/* Ensure we are in active loop. Force abort all loops */
-					if(pVm->pFrame->iFlags & VM_FRAME_LOOP) {
+					/* Ensure we are in active loop. Force abort all loops on return */
+					if(!pInstr->iP2 && pVm->pFrame->iFlags & VM_FRAME_LOOP) {
 						while((pVm->pFrame->iFlags & VM_FRAME_ACTIVE) == 0) {
 							VmLeaveFrame(&(*pVm));
 						}
@@ -1944,7 +3506,7 @@ static sxi32 VmByteCodeExec(
 			 * Program execution aborted: Clean up the mess left behind
 			 * and abort immediately.
 			 */
-			case PH7_OP_HALT:
+			VM_CASE(PH7_OP_HALT):
 				if(pInstr->iP1) {
 					if(pTos < pStack) {
 						goto Abort;
@@ -1975,8 +3537,12 @@ static sxi32 VmByteCodeExec(
 			 * Unconditional jump: The next instruction executed will be
 			 * the one at index P2 from the beginning of the program.
 			 */
-			case PH7_OP_JMP:
+			VM_CASE(PH7_OP_JMP):
 				pc = pInstr->iP2 - 1;
+				if(pc < (sxi32)(pInstr - aInstr) && pVm->sAllocator.iTagPending) {
+					/* Loop back-edge */
+					goto MemoryLimit;
+				}
 				break;
 			/*
 			 * JMPZ: P1 P2 *
@@ -1984,7 +3550,7 @@ static sxi32 VmByteCodeExec(
 			 * Take the jump if the top value is zero (FALSE jump).Pop the top most
 			 * entry in the stack if P1 is zero.
 			 */
-			case PH7_OP_JMPZ:
+			VM_CASE(PH7_OP_JMPZ):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -1999,6 +3565,10 @@ static sxi32 VmByteCodeExec(
 				if(!pInstr->iP1) {
 					VmPopOperand(&pTos, 1);
 				}
+				if(pc < (sxi32)(pInstr - aInstr) && pVm->sAllocator.iTagPending) {
+					/* Loop back-edge */
+					goto MemoryLimit;
+				}
 				break;
 			/*
 			 * JMPNZ: P1 P2 *
@@ -2006,7 +3576,7 @@ static sxi32 VmByteCodeExec(
 			 * Take the jump if the top value is not zero (TRUE jump).Pop the top most
 			 * entry in the stack if P1 is zero.
 			 */
-			case PH7_OP_JMPNZ:
+			VM_CASE(PH7_OP_JMPNZ):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2021,13 +3591,17 @@ static sxi32 VmByteCodeExec(
 				if(!pInstr->iP1) {
 					VmPopOperand(&pTos, 1);
 				}
+				if(pc < (sxi32)(pInstr - aInstr) && pVm->sAllocator.iTagPending) {
+					/* Loop back-edge */
+					goto MemoryLimit;
+				}
 				break;
 			/*
 			 * LF_START: * * *
 			 *
 			 * Creates and enters the jump loop frame on the beginning of each iteration.
 			 */
-			case PH7_OP_LF_START: {
+			VM_CASE(PH7_OP_LF_START): {
 					VmFrame *pFrame = 0;
 					/* Enter the jump loop frame */
 					rc = VmEnterFrame(&(*pVm), pVm->pFrame->pUserData, pVm->pFrame->pThis, &pFrame);
@@ -2035,6 +3609,9 @@ static sxi32 VmByteCodeExec(
 						PH7_VmMemoryError(&(*pVm));
 					}
 					pFrame->iFlags = VM_FRAME_LOOP;
+					/* Share the variable slots with the parent frame */
+					pFrame->aVarSlot = pFrame->pParent->aVarSlot;
+					pFrame->nVarSlot = pFrame->pParent->nVarSlot;
 					break;
 				}
 			/*
@@ -2043,7 +3620,7 @@ static sxi32 VmByteCodeExec(
 			 * Leaves and destroys the jump loop frame at the end of each iteration
 			 * as well as on 'break' and 'continue' instructions.
 			 */
-			case PH7_OP_LF_STOP: {
+			VM_CASE(PH7_OP_LF_STOP): {
 					/* Leave the jump loop frame */
 					if(pVm->pFrame->iFlags & VM_FRAME_LOOP) {
 						VmLeaveFrame(&(*pVm));
@@ -2056,14 +3633,14 @@ static sxi32 VmByteCodeExec(
 			 * Do nothing. This instruction is often useful as a jump
 			 * destination.
 			 */
-			case PH7_OP_NOOP:
+			VM_CASE(PH7_OP_NOOP):
 				break;
 			/*
 			 * POP: P1 * *
 			 *
 			 * Pop P1 elements from the operand stack.
 			 */
-			case PH7_OP_POP: {
+			VM_CASE(PH7_OP_POP): {
 					sxi32 n = pInstr->iP1;
 					if(&pTos[-n + 1] < pStack) {
 						/* TICKET 1433-51 Stack underflow must be handled at run-time */
@@ -2077,7 +3654,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be an integer.
 			 */
-			case PH7_OP_CVT_INT:
+			VM_CASE(PH7_OP_CVT_INT):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2092,7 +3669,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be a real.
 			 */
-			case PH7_OP_CVT_REAL:
+			VM_CASE(PH7_OP_CVT_REAL):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2107,7 +3684,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be a string.
 			 */
-			case PH7_OP_CVT_STR:
+			VM_CASE(PH7_OP_CVT_STR):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2120,7 +3697,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be a boolean.
 			 */
-			case PH7_OP_CVT_BOOL:
+			VM_CASE(PH7_OP_CVT_BOOL):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2133,7 +3710,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be a char.
 			 */
-			case PH7_OP_CVT_CHAR:
+			VM_CASE(PH7_OP_CVT_CHAR):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2148,7 +3725,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be a class instance (Object in the PHP jargon).
 			 */
-			case PH7_OP_CVT_OBJ:
+			VM_CASE(PH7_OP_CVT_OBJ):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2162,7 +3739,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be a callback
 			 */
-			case PH7_OP_CVT_CALL:
+			VM_CASE(PH7_OP_CVT_CALL):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2173,7 +3750,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be a resource
 			 */
-			case PH7_OP_CVT_RES:
+			VM_CASE(PH7_OP_CVT_RES):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2184,7 +3761,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Force the top of the stack to be a void type.
 			 */
-			case PH7_OP_CVT_VOID:
+			VM_CASE(PH7_OP_CVT_VOID):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2198,7 +3775,7 @@ static sxi32 VmByteCodeExec(
 			 * holding a class name or an object).
 			 * Push TRUE on success. FALSE otherwise.
 			 */
-			case PH7_OP_IS: {
+			VM_CASE(PH7_OP_IS): {
 					ph7_value *pNos = &pTos[-1];
 					sxi32 iRes = 0; /* assume false by default */
 					if(pNos < pStack) {
@@ -2251,11 +3828,12 @@ static sxi32 VmByteCodeExec(
 			 * Create a constant if P1 is set, or variable otherwise. It takes the constant/variable name
 			 * from the the P3 operand. P2 operand is used to provide a variable type.
 			 */
-			case PH7_OP_DECLARE: {
+			VM_CASE(PH7_OP_DECLARE): {
 					if(pInstr->iP1) {
 						/* Constant declaration */
 						ph7_constant_info *pConstInfo = (ph7_constant_info *) pInstr->p3;
-						rc = PH7_VmRegisterConstant(&(*pVm), &pConstInfo->pName, PH7_VmExpandConstantValue, pConstInfo->pConsCode, FALSE);
+						rc = PH7_VmRegisterConstant(&(*pVm), &pConstInfo->pName, PH7_VmExpandConstantValue,
+													VmConstantByteCode(&(*pVm), pConstInfo->pConsCode), FALSE);
 						if(rc == SXERR_EXISTS) {
 							PH7_VmThrowError(&(*pVm), PH7_CTX_ERR,
 											"Redeclaration of ‘%z’ constant", &pConstInfo->pName);
@@ -2298,7 +3876,7 @@ static sxi32 VmByteCodeExec(
 			 * Load a constant [i.e: PHP_EOL,PHP_OS,__TIME__,...] indexed at P2 in the constant pool.
 			 * If P1 is set,then this constant is candidate for expansion via user installable callbacks.
 			 */
-			case PH7_OP_LOADC: {
+			VM_CASE(PH7_OP_LOADC): {
 					ph7_value *pObj;
 					/* Reserve a room */
 					pTos++;
@@ -2314,23 +3892,25 @@ static sxi32 VmByteCodeExec(
 								SyHashEntry *pEntry;
 								/* Candidate for expansion via user defined callbacks */
 								for(;;) {
-									pEntry = SyHashGet(&pVm->pFrame->hConst, SyBlobData(&pObj->sBlob), SyBlobLength(&pObj->sBlob));
+									pEntry = SyHashGet(&pFrame->hConst, SyBlobData(&pObj->sBlob), SyBlobLength(&pObj->sBlob));
 									if(pEntry == 0 && pFrame->iFlags & VM_FRAME_LOOP && pFrame->pParent) {
 										pFrame = pFrame->pParent;
 									} else {
 										break;
 									}
 								}
-								if(pEntry == 0) {
-									pEntry = SyHashGet(&pVm->hConstant, SyBlobData(&pObj->sBlob), SyBlobLength(&pObj->sBlob));
-								}
+								ph7_constant *pCons;
 								if(pEntry) {
-									ph7_constant *pCons = (ph7_constant *)pEntry->pUserData;
+									pCons = (ph7_constant *)pEntry->pUserData;
+								} else {
+									pCons = PH7_VmExtractConstant(&(*pVm), (const char *)SyBlobData(&pObj->sBlob), SyBlobLength(&pObj->sBlob));
+								}
+								if(pCons) {
 									/* Set a NULL default value */
 									MemObjSetType(pTos, MEMOBJ_NULL);
 									SyBlobReset(&pTos->sBlob);
 									/* Invoke the callback and deal with the expanded value */
-									pCons->xExpand(pTos, pCons->pUserData);
+									VmExpandConstant(&(*pVm), pCons, pTos);
 									/* Mark as constant */
 									pTos->nIdx = SXU32_HIGH;
 									break;
@@ -2350,15 +3930,213 @@ static sxi32 VmByteCodeExec(
 					break;
 				}
 			/*
-			 * LOADV: * * P3
+			 * INCRV: P1 * P3
+			 * DECRV: P1 * P3
+			 *
+			 * Superinstruction for LOADV, INCR|DECR, POP: increment or decrement the
+			 * integer or float variable assigned the slot P1-1 in place.
+			 */
+			VM_CASE(PH7_OP_INCRV):
+			VM_CASE(PH7_OP_DECRV): {
+					ph7_value *pObj;
+					pObj = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr->iP1 - 1, (const char *)pInstr->p3);
+					if(pObj == 0 || pObj->nIdx == SXU32_HIGH) {
+						goto VmLoadVariable;
+					}
+					if((pObj->nType & MEMOBJ_ALL) == MEMOBJ_INT) {
+						pObj->x.iVal += pInstr->iOp == PH7_OP_INCRV ? 1 : -1;
+					} else if((pObj->nType & MEMOBJ_ALL) == MEMOBJ_REAL) {
+						pObj->x.rVal += pInstr->iOp == PH7_OP_INCRV ? 1 : -1;
+					} else {
+						goto VmLoadVariable;
+					}
+					pc += 2;
+					break;
+				}
+			/*
+			 * CMPV_JMPZ: P1 * P3
+			 *
+			 * Superinstruction for LOADV, LOADV|LOADC, LT..NEQ, JMPZ: compare the variable
+			 * assigned the slot P1-1 with the next operand and jump to the destination
+			 * of the JMPZ instruction if the comparison is false.
+			 */
+			VM_CASE(PH7_OP_CMPV_JMPZ): {
+					ph7_value *pObj, *pNos;
+					pObj = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr->iP1 - 1, (const char *)pInstr->p3);
+					if(pInstr[1].iOp == PH7_OP_LOADC) {
+						pNos = (ph7_value *)SySetAt(&pVm->aLitObj, pInstr[1].iP2);
+					} else {
+						pNos = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr[1].iP1 - 1, (const char *)pInstr[1].p3);
+					}
+					if(pObj == 0 || pNos == 0 || (pObj->nType & MEMOBJ_ALL) != (pNos->nType & MEMOBJ_ALL)) {
+						goto VmLoadVariable;
+					}
+					if((pObj->nType & MEMOBJ_ALL) == MEMOBJ_INT) {
+						rc = pObj->x.iVal < pNos->x.iVal ? -1 : pObj->x.iVal > pNos->x.iVal;
+					} else if((pObj->nType & MEMOBJ_ALL) == MEMOBJ_REAL) {
+						rc = pObj->x.rVal < pNos->x.rVal ? -1 : pObj->x.rVal > pNos->x.rVal;
+					} else {
+						goto VmLoadVariable;
+					}
+					switch(pInstr[2].iOp) {
+						case PH7_OP_LT:
+						case PH7_OP_LT_INT:
+						case PH7_OP_LT_REAL:
+							rc = rc < 0;
+							break;
+						case PH7_OP_LE:
+						case PH7_OP_LE_INT:
+						case PH7_OP_LE_REAL:
+							rc = rc < 1;
+							break;
+						case PH7_OP_GT:
+						case PH7_OP_GT_INT:
+						case PH7_OP_GT_REAL:
+							rc = rc > 0;
+							break;
+						case PH7_OP_GE:
+						case PH7_OP_GE_INT:
+						case PH7_OP_GE_REAL:
+							rc = rc >= 0;
+							break;
+						case PH7_OP_EQ:
+						case PH7_OP_EQ_INT:
+						case PH7_OP_EQ_REAL:
+							rc = rc == 0;
+							break;
+						default:
+							rc = rc != 0;
+							break;
+					}
+					if(rc) {
+						pc += 3;
+					} else {
+						/* Take the jump */
+						pc = pInstr[3].iP2 - 1;
+					}
+					break;
+				}
+			/*
+			 * ADDV: P1 * P3
+			 *
+			 * Superinstruction for LOADV, LOADV|LOADC, ADD|SUB, STORE, POP: add the next
+			 * operand to (or subtract it from) the integer variable assigned the slot P1-1
+			 * in place. A string operand is appended to the buffer of a string variable
+			 * in place so that a concatenation loop runs in amortized linear time.
+			 */
+			VM_CASE(PH7_OP_ADDV): {
+					ph7_value *pObj, *pVal;
+					pObj = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr->iP1 - 1, (const char *)pInstr->p3);
+					if(pInstr[1].iOp == PH7_OP_LOADC) {
+						pVal = (ph7_value *)SySetAt(&pVm->aLitObj, pInstr[1].iP2);
+					} else {
+						pVal = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr[1].iP1 - 1, (const char *)pInstr[1].p3);
+					}
+					if(pObj == 0 || pVal == 0 || pObj->iFlags != MEMOBJ_VARIABLE) {
+						goto VmLoadVariable;
+					}
+					if((pObj->nType & MEMOBJ_ALL) == MEMOBJ_INT && (pVal->nType & MEMOBJ_ALL) == MEMOBJ_INT) {
+						if(pInstr[2].iOp == PH7_OP_ADD || pInstr[2].iOp == PH7_OP_ADD_INT) {
+							pObj->x.iVal += pVal->x.iVal;
+						} else {
+							pObj->x.iVal -= pVal->x.iVal;
+						}
+					} else if(pInstr[2].iOp == PH7_OP_ADD && (pObj->nType & MEMOBJ_ALL) == MEMOBJ_STRING
+							  && (pVal->nType & MEMOBJ_ALL) == MEMOBJ_STRING && !VmStringAliases(pVal, pObj)
+							  && VmStringDetachViews(&(*pVm), pObj, pStack, &pTos[1]) == SXRET_OK) {
+						if(SyBlobLength(&pVal->sBlob) > 0) {
+							SyBlobAppend(&pObj->sBlob, SyBlobData(&pVal->sBlob), SyBlobLength(&pVal->sBlob));
+						}
+					} else {
+						goto VmLoadVariable;
+					}
+					pc += 4;
+					break;
+				}
+			/*
+			 * ADDV_STORE: * P2 *
+			 *
+			 * Superinstruction for LOADC, LOADV, ADD_STORE|SUB_STORE, POP: add the literal
+			 * indexed at P2 to (or subtract it from) the integer variable loaded by the
+			 * next instruction in place.
+			 */
+			VM_CASE(PH7_OP_ADDV_STORE): {
+					ph7_value *pObj, *pLit;
+					pLit = (ph7_value *)SySetAt(&pVm->aLitObj, pInstr->iP2);
+					pObj = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr[1].iP1 - 1, (const char *)pInstr[1].p3);
+					if(pObj == 0 || pLit == 0 || pObj->nIdx == SXU32_HIGH
+							|| (pObj->nType & MEMOBJ_ALL) != MEMOBJ_INT || (pLit->nType & MEMOBJ_ALL) != MEMOBJ_INT) {
+						/* Load the literal and execute the sequence */
+						pTos++;
+						if(pLit) {
+							PH7_MemObjLoad(pLit, pTos);
+						} else {
+							MemObjSetType(pTos, MEMOBJ_NULL);
+						}
+						pTos->nIdx = SXU32_HIGH;
+						break;
+					}
+					if(pInstr[2].iOp == PH7_OP_ADD_STORE) {
+						pObj->x.iVal += pLit->x.iVal;
+					} else {
+						pObj->x.iVal -= pLit->x.iVal;
+					}
+					pc += 3;
+					break;
+				}
+			/*
+			 * LOADV_IDX: P1 * P3
+			 *
+			 * Superinstruction for LOADV, LOADV|LOADC, LOAD_IDX: load the entry of the
+			 * array assigned the slot P1-1 where its integer index is the next operand.
+			 */
+			VM_CASE(PH7_OP_LOADV_IDX): {
+					ph7_hashmap_node *pNode;
+					ph7_value *pObj, *pIdx;
+					pObj = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr->iP1 - 1, (const char *)pInstr->p3);
+					if(pInstr[1].iOp == PH7_OP_LOADC) {
+						pIdx = (ph7_value *)SySetAt(&pVm->aLitObj, pInstr[1].iP2);
+					} else {
+						pIdx = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr[1].iP1 - 1, (const char *)pInstr[1].p3);
+					}
+					if(pObj == 0 || pIdx == 0 || (pObj->nType & MEMOBJ_HASHMAP) == 0 || (pIdx->nType & MEMOBJ_ALL) != MEMOBJ_INT
+							|| PH7_HashmapLookup((ph7_hashmap *)pObj->x.pOther, pIdx, &pNode) != SXRET_OK) {
+						goto VmLoadVariable;
+					}
+					/* Load entry contents */
+					pTos++;
+					pTos->nIdx = pNode->nValIdx;
+					PH7_HashmapExtractNodeValue(pNode, pTos, FALSE);
+					pc += 2;
+					break;
+				}
+			/*
+			 * LOADV: P1 * P3
 			 *
 			 * Load a variable where it's name is taken from the top of the stack or
-			 * from the P3 operand.
+			 * from the P3 operand. If P1 is greater than zero, the variable was
+			 * assigned the slot P1-1 of the running function at compile-time.
 			 */
-			case PH7_OP_LOADV: {
+			VM_CASE(PH7_OP_LOADV):
+VmLoadVariable: {
 					ph7_value *pObj;
 					SyString sName;
-					if(pInstr->p3 == 0) {
+					if(pInstr->iP1 > 0) {
+						/* Reserve a room for the target object */
+						pTos++;
+						/* Extract the memory object through its slot */
+						pObj = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr->iP1 - 1, (const char *)pInstr->p3);
+						if(pObj) {
+							/* Load variable contents */
+							PH7_MemObjLoad(pObj, pTos);
+							pTos->nIdx = pObj->nIdx;
+							break;
+						}
+						SyStringInitFromBuf(&sName, pInstr->p3, SyStrlen((const char *)pInstr->p3));
+						/* Fatal error */
+						PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Variable '$%z' undeclared (first use in this method/closure)", &sName);
+						break;
+					} else if(pInstr->p3 == 0) {
 						/* Take the variable name from the top of the stack */
 						if(pTos < pStack) {
 							goto Abort;
@@ -2392,9 +4170,13 @@ static sxi32 VmByteCodeExec(
 			 * If the P1 operand is greater than zero then pop P1 elements from the
 			 * stack and insert them (key => value pair) in the new hashmap.
 			 */
-			case PH7_OP_LOAD_MAP: {
+			VM_CASE(PH7_OP_LOAD_MAP): {
 					sxi32 nType, pType;
 					ph7_hashmap *pMap;
+					if(SySetUsed(&pVm->sGc.aRoot) >= pVm->sGc.nThreshold) {
+						/* Look for garbage cycles first */
+						PH7_GcCollect(&(*pVm));
+					}
 					/* Allocate a new hashmap instance */
 					pMap = PH7_NewHashmap(&(*pVm), 0, 0);
 					if(pMap == 0) {
@@ -2438,14 +4220,16 @@ static sxi32 VmByteCodeExec(
 			 * from the stack.
 			 * If the index does not refer to a valid element,then push the NULL constant
 			 * instead.
+			 * If the first bit of P2 is set, a missing entry is created. If any bit of P2
+			 * is set, the entry may be modified in place and a shared hashmap is copied first.
 			 */
-			case PH7_OP_LOAD_IDX: {
+			VM_CASE(PH7_OP_LOAD_IDX): {
 					ph7_hashmap_node *pNode = 0; /* cc warning */
 					ph7_hashmap *pMap = 0;
 					ph7_value *pIdx;
 					pIdx = 0;
 					if(pInstr->iP1 == 0) {
-						if(!pInstr->iP2) {
+						if((pInstr->iP2 & 1) == 0) {
 							/* No available index, emit error */
 							PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Attempt to access an undefined array index");
 						}
@@ -2482,11 +4266,15 @@ static sxi32 VmByteCodeExec(
 					if(pTos->nType & MEMOBJ_HASHMAP) {
 						/* Point to the hashmap */
 						pMap = (ph7_hashmap *)pTos->x.pOther;
+						if(pInstr->iP2) {
+							/* Write access, make sure the hashmap is not shared */
+							pMap = PH7_HashmapSeparate(pTos);
+						}
 						if(pIdx) {
 							/* Load the desired entry */
 							rc = PH7_HashmapLookup(pMap, pIdx, &pNode);
 						}
-						if(rc != SXRET_OK && pInstr->iP2) {
+						if(rc != SXRET_OK && (pInstr->iP2 & 1)) {
 							/* Create a new empty entry */
 							rc = PH7_HashmapInsert(pMap, pIdx, 0);
 							if(rc == SXRET_OK) {
@@ -2523,7 +4311,7 @@ static sxi32 VmByteCodeExec(
 			 * Set-up closure environment described by the P3 operand and push the closure
 			 * name in the stack.
 			 */
-			case PH7_OP_LOAD_CLOSURE: {
+			VM_CASE(PH7_OP_LOAD_CLOSURE): {
 					ph7_vm_func *pFunc = (ph7_vm_func *)pInstr->p3;
 					if(pFunc->iFlags & VM_FUNC_CLOSURE) {
 						ph7_vm_func_closure_env *aEnv, *pEnv, sEnv;
@@ -2548,6 +4336,8 @@ static sxi32 VmByteCodeExec(
 						pClosure->aArgs = pFunc->aArgs;
 						pClosure->aByteCode = pFunc->aByteCode;
 						pClosure->aStatic = pFunc->aStatic;
+						pClosure->aVarSlot = pFunc->aVarSlot;
+						pClosure->nStack = pFunc->nStack;
 						pClosure->iFlags = pFunc->iFlags;
 						pClosure->pUserData = pFunc->pUserData;
 						pClosure->sSignature = pFunc->sSignature;
@@ -2579,11 +4369,13 @@ static sxi32 VmByteCodeExec(
 					break;
 				}
 			/*
-			 * STORE * P2 P3
+			 * STORE P1 P2 P3
 			 *
-			 * Perform a store (Assignment) operation.
+			 * Perform a store (Assignment) operation. If P1 is greater than zero,
+			 * the variable named by P3 was assigned the slot P1-1 of the running
+			 * function at compile-time.
 			 */
-			case PH7_OP_STORE: {
+			VM_CASE(PH7_OP_STORE): {
 					ph7_value *pObj;
 					SyString sName;
 					if(pTos < pStack) {
@@ -2600,7 +4392,7 @@ static sxi32 VmByteCodeExec(
 							pTos->nIdx = SXU32_HIGH;
 						} else {
 							/* Point to the desired memory object */
-							pObj = (ph7_value *)SySetAt(&pVm->aMemObj, nIdx);
+							pObj = VmObjTableAt(&pVm->aMemObj, nIdx);
 							if(pObj) {
 								/* Perform the store operation */
 								rc = PH7_MemObjSafeStore(pTos, pObj);
@@ -2623,6 +4415,14 @@ static sxi32 VmByteCodeExec(
 							goto Abort;
 						}
 					} else {
+						if(pInstr->iP1 > 0) {
+							/* Extract the memory object through its slot */
+							pObj = VmExtractSlotMemObj(&(*pVm), (sxu32)pInstr->iP1 - 1, (const char *)pInstr->p3);
+							if(pObj && pObj->iFlags == MEMOBJ_VARIABLE && PH7_MemObjSafeStore(pTos, pObj) == SXRET_OK) {
+								break;
+							}
+							/* Let the lookup by name report the error */
+						}
 						SyStringInitFromBuf(&sName, pInstr->p3, SyStrlen((const char *)pInstr->p3));
 					}
 					/* Extract the desired variable if available */
@@ -2649,7 +4449,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Perfrom a store operation an a hashmap entry.
 			 */
-			case PH7_OP_STORE_IDX: {
+			VM_CASE(PH7_OP_STORE_IDX): {
 					ph7_hashmap *pMap = 0; /* cc  warning */
 					ph7_value *pKey;
 					sxu32 nIdx;
@@ -2662,15 +4462,15 @@ static sxi32 VmByteCodeExec(
 					}
 					nIdx = pTos->nIdx;
 					if(pTos->nType & MEMOBJ_HASHMAP) {
-						/* Hashmap already loaded */
-						pMap = (ph7_hashmap *)pTos->x.pOther;
+						/* Hashmap already loaded, make sure it is not shared */
+						pMap = PH7_HashmapSeparate(pTos);
 						if(pMap->iRef < 2) {
 							/* TICKET 1433-48: Prevent garbage collection */
 							pMap->iRef = 2;
 						}
 					} else {
 						ph7_value *pObj;
-						pObj = (ph7_value *)SySetAt(&pVm->aMemObj, nIdx);
+						pObj = VmObjTableAt(&pVm->aMemObj, nIdx);
 						if(pObj == 0) {
 							if(pKey) {
 								PH7_MemObjRelease(pKey);
@@ -2719,7 +4519,7 @@ static sxi32 VmByteCodeExec(
 								PH7_VmMemoryError(&(*pVm));
 							}
 						}
-						pMap = (ph7_hashmap *)pObj->x.pOther;
+						pMap = PH7_HashmapSeparate(pObj);
 					}
 					sxu32 pArrType = pTos->nType ^ MEMOBJ_HASHMAP;
 					VmPopOperand(&pTos, 1);
@@ -2753,14 +4553,15 @@ static sxi32 VmByteCodeExec(
 			 * If the P1 operand is set then perform a duplication of the top of
 			 * the stack and increment after that.
 			 */
-			case PH7_OP_INCR:
+			VM_CASE(PH7_OP_INCR):
+VmIncrement:
 				if(pTos < pStack) {
 					goto Abort;
 				}
 				if(PH7_MemObjIsNumeric(pTos) && !PH7_MemObjIsHashmap(pTos)) {
 					if(pTos->nIdx != SXU32_HIGH) {
 						ph7_value *pObj;
-						if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+						if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 							if(pObj->nType & MEMOBJ_REAL) {
 								pObj->x.rVal++;
 							} else {
@@ -2794,14 +4595,15 @@ static sxi32 VmByteCodeExec(
 			 * If the P1 operand is set then perform a duplication of the top of the stack
 			 * and decrement after that.
 			 */
-			case PH7_OP_DECR:
+			VM_CASE(PH7_OP_DECR):
+VmDecrement:
 				if(pTos < pStack) {
 					goto Abort;
 				}
 				if(PH7_MemObjIsNumeric(pTos) & !PH7_MemObjIsHashmap(pTos)) {
 					if(pTos->nIdx != SXU32_HIGH) {
 						ph7_value *pObj;
-						if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+						if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 							if(pObj->nType & MEMOBJ_REAL) {
 								pObj->x.rVal--;
 							} else {
@@ -2833,7 +4635,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Perform a unary minus operation.
 			 */
-			case PH7_OP_UMINUS:
+			VM_CASE(PH7_OP_UMINUS):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2851,7 +4653,7 @@ static sxi32 VmByteCodeExec(
 			 *
 			 * Perform a unary plus operation.
 			 */
-			case PH7_OP_UPLUS:
+			VM_CASE(PH7_OP_UPLUS):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2870,7 +4672,7 @@ static sxi32 VmByteCodeExec(
 			 * Interpret the top of the stack as a boolean value.  Replace it
 			 * with its complement.
 			 */
-			case PH7_OP_LNOT:
+			VM_CASE(PH7_OP_LNOT):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2886,7 +4688,7 @@ static sxi32 VmByteCodeExec(
 			 * Interpret the top of the stack as an value.Replace it
 			 * with its ones-complement.
 			 */
-			case PH7_OP_BITNOT:
+			VM_CASE(PH7_OP_BITNOT):
 				if(pTos < pStack) {
 					goto Abort;
 				}
@@ -2902,8 +4704,9 @@ static sxi32 VmByteCodeExec(
 			 * Pop the top two elements from the stack, multiply them together,
 			 * and push the result back onto the stack.
 			 */
-			case PH7_OP_MUL:
-			case PH7_OP_MUL_STORE: {
+			VM_CASE(PH7_OP_MUL):
+			VM_CASE(PH7_OP_MUL_STORE):
+VmMultiply: {
 					ph7_value *pNos = &pTos[-1];
 					/* Force the operand to be numeric */
 					if(pNos < pStack) {
@@ -2941,7 +4744,7 @@ static sxi32 VmByteCodeExec(
 						ph7_value *pObj;
 						if(pTos->nIdx == SXU32_HIGH) {
 							PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Cannot perform assignment on a constant class attribute");
-						} else if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+						} else if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 							PH7_MemObjStore(pNos, pObj);
 						}
 					}
@@ -2953,7 +4756,8 @@ static sxi32 VmByteCodeExec(
 			 * Pop the top two elements from the stack, add them together,
 			 * and push the result back onto the stack.
 			 */
-			case PH7_OP_ADD: {
+			VM_CASE(PH7_OP_ADD):
+VmAdd: {
 					ph7_value *pNos;
 					if(pInstr->iP1 < 1) {
 						pNos = &pTos[-1];
@@ -2965,9 +4769,32 @@ static sxi32 VmByteCodeExec(
 					}
 					if(pInstr->iP2 || pNos->nType & MEMOBJ_STRING || pTos->nType & MEMOBJ_STRING) {
 						/* Perform the string addition */
-						ph7_value *pCur;
+						ph7_value *pCur, *pObj = 0;
 						if((pNos->nType & MEMOBJ_STRING) == 0) {
 							PH7_MemObjToString(pNos);
+						} else if((pObj = VmConcatTarget(&(*pVm), pInstr, pStack, pNos)) != 0) {
+							/* $var = $var + ...; Append to the variable buffer in place */
+							for(pCur = &pNos[1] ; pCur <= pTos ; pCur++) {
+								if((pCur->nType & MEMOBJ_STRING) == 0) {
+									PH7_MemObjToString(pCur);
+								}
+								if(VmStringAliases(pCur, pObj)) {
+									pObj = 0;
+									break;
+								}
+							}
+						}
+						if(pObj) {
+							for(pCur = &pNos[1] ; pCur <= pTos ; pCur++) {
+								if(SyBlobLength(&pCur->sBlob) > 0) {
+									SyBlobAppend(&pObj->sBlob, SyBlobData(&pCur->sBlob), SyBlobLength(&pCur->sBlob));
+								}
+								SyBlobRelease(&pCur->sBlob);
+							}
+							/* The store operation that follows has nothing to copy */
+							PH7_MemObjLoad(pObj, pNos);
+							pTos = pNos;
+							break;
 						}
 						pCur = &pNos[1];
 						while(pCur <= pTos) {
@@ -2994,7 +4821,7 @@ static sxi32 VmByteCodeExec(
 			 * Pop the top two elements from the stack, add them together,
 			 * and push the result back onto the stack.
 			 */
-			case PH7_OP_ADD_STORE: {
+			VM_CASE(PH7_OP_ADD_STORE): {
 					ph7_value *pNos = &pTos[-1];
 					ph7_value *pObj;
 					if(pNos < pStack) {
@@ -3006,6 +4833,20 @@ static sxi32 VmByteCodeExec(
 							/* Force a string cast */
 							PH7_MemObjToString(pNos);
 						}
+						pObj = pTos->nIdx == SXU32_HIGH ? 0 : VmObjTableAt(&pVm->aMemObj, pTos->nIdx);
+						if(pObj && (pObj->nType & MEMOBJ_STRING) && SyBlobData(&pTos->sBlob) == SyBlobData(&pObj->sBlob)
+								&& SyBlobLength(&pTos->sBlob) == SyBlobLength(&pObj->sBlob) && !VmStringAliases(pNos, pObj)
+								&& VmStringDetachViews(&(*pVm), pObj, pStack, pNos) == SXRET_OK) {
+							/* The variable was not modified since it was loaded, append to its buffer
+							 * in place and push a view of the result instead of copying it twice.
+							 */
+							if(SyBlobLength(&pNos->sBlob) > 0) {
+								SyBlobAppend(&pObj->sBlob, SyBlobData(&pNos->sBlob), SyBlobLength(&pNos->sBlob));
+							}
+							PH7_MemObjLoad(pObj, pNos);
+							VmPopOperand(&pTos, 1);
+							break;
+						}
 						/* Perform the concatenation (Reverse order) */
 						if(SyBlobLength(&pNos->sBlob) > 0) {
 							PH7_MemObjStringAppend(pTos, (const char *)SyBlobData(&pNos->sBlob), SyBlobLength(&pNos->sBlob));
@@ -3017,7 +4858,7 @@ static sxi32 VmByteCodeExec(
 					/* Perform the store operation */
 					if(pTos->nIdx == SXU32_HIGH) {
 						PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Cannot perform assignment on a constant class attribute");
-					} else if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+					} else if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 						PH7_MemObjStore(pTos, pObj);
 					}
 					/* Ticket 1433-35: Perform a stack dup */
@@ -3031,7 +4872,8 @@ static sxi32 VmByteCodeExec(
 			 * first (what was next on the stack) from the second (the
 			 * top of the stack) and push the result back onto the stack.
 			 */
-			case PH7_OP_SUB: {
+			VM_CASE(PH7_OP_SUB):
+VmSubtract: {
 					ph7_value *pNos = &pTos[-1];
 					if(pNos < pStack) {
 						goto Abort;
@@ -3070,7 +4912,7 @@ static sxi32 VmByteCodeExec(
 			 * first (what was next on the stack) from the second (the
 			 * top of the stack) and push the result back onto the stack.
 			 */
-			case PH7_OP_SUB_STORE: {
+			VM_CASE(PH7_OP_SUB_STORE): {
 					ph7_value *pNos = &pTos[-1];
 					ph7_value *pObj;
 					if(pNos < pStack) {
@@ -3103,7 +4945,7 @@ static sxi32 VmByteCodeExec(
 					}
 					if(pTos->nIdx == SXU32_HIGH) {
 						PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Cannot perform assignment on a constant class attribute");
-					} else if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+					} else if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 						PH7_MemObjStore(pNos, pObj);
 					}
 					VmPopOperand(&pTos, 1);
@@ -3118,7 +4960,7 @@ static sxi32 VmByteCodeExec(
 			 * onto the stack.
 			 * Note: Only integer arithemtic is allowed.
 			 */
-			case PH7_OP_MOD: {
+			VM_CASE(PH7_OP_MOD): {
 					ph7_value *pNos = &pTos[-1];
 					sxi64 a, b, r;
 					if(pNos < pStack) {
@@ -3155,7 +4997,7 @@ static sxi32 VmByteCodeExec(
 			 * onto the stack.
 			 * Note: Only integer arithemtic is allowed.
 			 */
-			case PH7_OP_MOD_STORE: {
+			VM_CASE(PH7_OP_MOD_STORE): {
 					ph7_value *pNos = &pTos[-1];
 					ph7_value *pObj;
 					sxi64 a, b, r;
@@ -3183,7 +5025,7 @@ static sxi32 VmByteCodeExec(
 					MemObjSetType(pNos, MEMOBJ_INT);
 					if(pTos->nIdx == SXU32_HIGH) {
 						PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Cannot perform assignment on a constant class attribute");
-					} else if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+					} else if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 						PH7_MemObjStore(pNos, pObj);
 					}
 					VmPopOperand(&pTos, 1);
@@ -3197,7 +5039,8 @@ static sxi32 VmByteCodeExec(
 			 * top of the stack) and push the result onto the stack.
 			 * Note: Only floating point arithemtic is allowed.
 			 */
-			case PH7_OP_DIV: {
+			VM_CASE(PH7_OP_DIV):
+VmDivide: {
 					ph7_value *pNos = &pTos[-1];
 					ph7_real a, b, r;
 					if(pNos < pStack) {
@@ -3232,7 +5075,7 @@ static sxi32 VmByteCodeExec(
 			 * top of the stack) and push the result onto the stack.
 			 * Note: Only floating point arithemtic is allowed.
 			 */
-			case PH7_OP_DIV_STORE: {
+			VM_CASE(PH7_OP_DIV_STORE): {
 					ph7_value *pNos = &pTos[-1];
 					ph7_value *pObj;
 					ph7_real a, b, r;
@@ -3260,7 +5103,7 @@ static sxi32 VmByteCodeExec(
 					}
 					if(pTos->nIdx == SXU32_HIGH) {
 						PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Cannot perform assignment on a constant class attribute");
-					} else if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+					} else if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 						PH7_MemObjStore(pNos, pObj);
 					}
 					VmPopOperand(&pTos, 1);
@@ -3284,9 +5127,9 @@ static sxi32 VmByteCodeExec(
 			 * to integers.  Push back onto the stack the bit-wise XOR of the
 			 * two elements.
 			 */
-			case PH7_OP_BAND:
-			case PH7_OP_BOR:
-			case PH7_OP_BXOR: {
+			VM_CASE(PH7_OP_BAND):
+			VM_CASE(PH7_OP_BOR):
+			VM_CASE(PH7_OP_BXOR): {
 					ph7_value *pNos = &pTos[-1];
 					sxi64 a, b, r;
 					if(pNos < pStack) {
@@ -3341,9 +5184,9 @@ static sxi32 VmByteCodeExec(
 			 * to integers.  Push back onto the stack the bit-wise XOR of the
 			 * two elements.
 			 */
-			case PH7_OP_BAND_STORE:
-			case PH7_OP_BOR_STORE:
-			case PH7_OP_BXOR_STORE: {
+			VM_CASE(PH7_OP_BAND_STORE):
+			VM_CASE(PH7_OP_BOR_STORE):
+			VM_CASE(PH7_OP_BXOR_STORE): {
 					ph7_value *pNos = &pTos[-1];
 					ph7_value *pObj;
 					sxi64 a, b, r;
@@ -3380,7 +5223,7 @@ static sxi32 VmByteCodeExec(
 					MemObjSetType(pNos, MEMOBJ_INT);
 					if(pTos->nIdx == SXU32_HIGH) {
 						PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Cannot perform assignment on a constant class attribute");
-					} else if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+					} else if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 						PH7_MemObjStore(pNos, pObj);
 					}
 					VmPopOperand(&pTos, 1);
@@ -3400,8 +5243,8 @@ static sxi32 VmByteCodeExec(
 			 * right by N bits where N is the top element on the stack.
 			 * Note: Only integer arithmetic is allowed.
 			 */
-			case PH7_OP_SHL:
-			case PH7_OP_SHR: {
+			VM_CASE(PH7_OP_SHL):
+			VM_CASE(PH7_OP_SHR): {
 					ph7_value *pNos = &pTos[-1];
 					sxi64 a, r;
 					sxi32 b;
@@ -3443,8 +5286,8 @@ static sxi32 VmByteCodeExec(
 			 * right by N bits where N is the top element on the stack.
 			 * Note: Only integer arithmetic is allowed.
 			 */
-			case PH7_OP_SHL_STORE:
-			case PH7_OP_SHR_STORE: {
+			VM_CASE(PH7_OP_SHL_STORE):
+			VM_CASE(PH7_OP_SHR_STORE): {
 					ph7_value *pNos = &pTos[-1];
 					ph7_value *pObj;
 					sxi64 a, r;
@@ -3472,7 +5315,7 @@ static sxi32 VmByteCodeExec(
 					MemObjSetType(pNos, MEMOBJ_INT);
 					if(pTos->nIdx == SXU32_HIGH) {
 						PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Cannot perform assignment on a constant class attribute");
-					} else if((pObj = (ph7_value *)SySetAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
+					} else if((pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) != 0) {
 						PH7_MemObjStore(pNos, pObj);
 					}
 					VmPopOperand(&pTos, 1);
@@ -3490,8 +5333,8 @@ static sxi32 VmByteCodeExec(
 			 * two values and push the resulting boolean value back onto the
 			 * stack.
 			 */
-			case PH7_OP_LAND:
-			case PH7_OP_LOR: {
+			VM_CASE(PH7_OP_LAND):
+			VM_CASE(PH7_OP_LOR): {
 					ph7_value *pNos = &pTos[-1];
 					sxi32 v1, v2;    /* 0==TRUE, 1==FALSE, 2==UNKNOWN or NULL */
 					if(pNos < pStack) {
@@ -3530,7 +5373,7 @@ static sxi32 VmByteCodeExec(
 			 *  $a xor $b is evaluated to TRUE if either $a or $b is
 			 *  TRUE,but not both.
 			 */
-			case PH7_OP_LXOR: {
+			VM_CASE(PH7_OP_LXOR): {
 					ph7_value *pNos = &pTos[-1];
 					sxi32 v = 0;
 					if(pNos < pStack) {
@@ -3565,8 +5408,8 @@ static sxi32 VmByteCodeExec(
 			 * If P2 is zero, do not jump.  Instead, push a boolean 1 (TRUE) onto the
 			 * stack if the jump would have been taken, or a 0 (FALSE) if not.
 			 */
-			case PH7_OP_EQ:
-			case PH7_OP_NEQ: {
+			VM_CASE(PH7_OP_EQ):
+			VM_CASE(PH7_OP_NEQ): {
 					ph7_value *pNos = &pTos[-1];
 					/* Perform the comparison and act accordingly */
 					if(pNos < pStack) {
@@ -3612,8 +5455,8 @@ static sxi32 VmByteCodeExec(
 			 * stack if the jump would have been taken, or a 0 (FALSE) if not.
 			 *
 			 */
-			case PH7_OP_LT:
-			case PH7_OP_LE: {
+			VM_CASE(PH7_OP_LT):
+			VM_CASE(PH7_OP_LE): {
 					ph7_value *pNos = &pTos[-1];
 					/* Perform the comparison and act accordingly */
 					if(pNos < pStack) {
@@ -3659,8 +5502,8 @@ static sxi32 VmByteCodeExec(
 			 * stack if the jump would have been taken, or a 0 (FALSE) if not.
 			 *
 			 */
-			case PH7_OP_GT:
-			case PH7_OP_GE: {
+			VM_CASE(PH7_OP_GT):
+			VM_CASE(PH7_OP_GE): {
 					ph7_value *pNos = &pTos[-1];
 					/* Perform the comparison and act accordingly */
 					if(pNos < pStack) {
@@ -3688,7 +5531,273 @@ static sxi32 VmByteCodeExec(
 					}
 					break;
 				}
-			case PH7_OP_NULLC: {
+			/*
+			 * ADD_INT, SUB_INT, MUL_INT: * * *
+			 * ADD_REAL, SUB_REAL, MUL_REAL, DIV_REAL: * * *
+			 *
+			 * Integer or float variants of the ADD, SUB, MUL and DIV instructions emitted
+			 * by the code generator when the type of both operands is known at compile-time.
+			 * Fall back to the generic instruction when it is not the type found at run-time.
+			 */
+			VM_CASE(PH7_OP_ADD_INT): {
+					ph7_value *pNos = &pTos[-1];
+					/* Both operands are integers when the union of their types is */
+					if(pNos < pStack || ((pNos->nType | pTos->nType) & MEMOBJ_ALL) != MEMOBJ_INT) {
+						goto VmAdd;
+					}
+					pNos->x.iVal += pTos->x.iVal;
+					VmPopOperand(&pTos, 1);
+					break;
+				}
+			VM_CASE(PH7_OP_SUB_INT): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack || ((pNos->nType | pTos->nType) & MEMOBJ_ALL) != MEMOBJ_INT) {
+						goto VmSubtract;
+					}
+					pNos->x.iVal -= pTos->x.iVal;
+					VmPopOperand(&pTos, 1);
+					break;
+				}
+			VM_CASE(PH7_OP_MUL_INT): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack || ((pNos->nType | pTos->nType) & MEMOBJ_ALL) != MEMOBJ_INT) {
+						goto VmMultiply;
+					}
+					pNos->x.iVal *= pTos->x.iVal;
+					VmPopOperand(&pTos, 1);
+					break;
+				}
+			VM_CASE(PH7_OP_ADD_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack || ((pNos->nType | pTos->nType) & MEMOBJ_ALL) != MEMOBJ_REAL) {
+						goto VmAdd;
+					}
+					pNos->x.rVal += pTos->x.rVal;
+					VmPopOperand(&pTos, 1);
+					break;
+				}
+			VM_CASE(PH7_OP_SUB_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack || ((pNos->nType | pTos->nType) & MEMOBJ_ALL) != MEMOBJ_REAL) {
+						goto VmSubtract;
+					}
+					pNos->x.rVal -= pTos->x.rVal;
+					VmPopOperand(&pTos, 1);
+					break;
+				}
+			VM_CASE(PH7_OP_MUL_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack || ((pNos->nType | pTos->nType) & MEMOBJ_ALL) != MEMOBJ_REAL) {
+						goto VmMultiply;
+					}
+					pNos->x.rVal *= pTos->x.rVal;
+					VmPopOperand(&pTos, 1);
+					break;
+				}
+			VM_CASE(PH7_OP_DIV_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack || ((pNos->nType | pTos->nType) & MEMOBJ_ALL) != MEMOBJ_REAL || pTos->x.rVal == 0) {
+						/* Let the generic instruction report the division by zero */
+						goto VmDivide;
+					}
+					pNos->x.rVal /= pTos->x.rVal;
+					VmPopOperand(&pTos, 1);
+					break;
+				}
+			/*
+			 * LT_INT, LE_INT, GT_INT, GE_INT, EQ_INT, NEQ_INT: * * *
+			 * LT_REAL, LE_REAL, GT_REAL, GE_REAL, EQ_REAL, NEQ_REAL: * * *
+			 *
+			 * Integer or float variants of the comparison instructions. Pop the top two
+			 * elements from the stack and push the boolean result of the comparison.
+			 */
+			VM_CASE(PH7_OP_LT_INT): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_INT) {
+						rc = pNos->x.iVal < pTos->x.iVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+						rc = rc < 0;
+					}
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_LE_INT): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_INT) {
+						rc = pNos->x.iVal <= pTos->x.iVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+						rc = rc < 1;
+					}
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_GT_INT): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_INT) {
+						rc = pNos->x.iVal > pTos->x.iVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+						rc = rc > 0;
+					}
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_GE_INT): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_INT) {
+						rc = pNos->x.iVal >= pTos->x.iVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+						rc = rc >= 0;
+					}
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_EQ_INT): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_INT) {
+						rc = pNos->x.iVal == pTos->x.iVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+						rc = rc == 0;
+					}
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_NEQ_INT): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_INT) {
+						rc = pNos->x.iVal != pTos->x.iVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+						rc = rc != 0;
+					}
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_LT_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_REAL) {
+						/* NaN compares equal to anything, as with PH7_MemObjCmp() */
+						rc = pNos->x.rVal < pTos->x.rVal ? -1 : pNos->x.rVal > pTos->x.rVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+					}
+					rc = rc < 0;
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_LE_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_REAL) {
+						rc = pNos->x.rVal < pTos->x.rVal ? -1 : pNos->x.rVal > pTos->x.rVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+					}
+					rc = rc < 1;
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_GT_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_REAL) {
+						rc = pNos->x.rVal < pTos->x.rVal ? -1 : pNos->x.rVal > pTos->x.rVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+					}
+					rc = rc > 0;
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_GE_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_REAL) {
+						rc = pNos->x.rVal < pTos->x.rVal ? -1 : pNos->x.rVal > pTos->x.rVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+					}
+					rc = rc >= 0;
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_EQ_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_REAL) {
+						rc = pNos->x.rVal < pTos->x.rVal ? -1 : pNos->x.rVal > pTos->x.rVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+					}
+					rc = rc == 0;
+					goto VmPushComparison;
+				}
+			VM_CASE(PH7_OP_NEQ_REAL): {
+					ph7_value *pNos = &pTos[-1];
+					if(pNos < pStack) {
+						goto Abort;
+					}
+					if(((pNos->nType | pTos->nType) & MEMOBJ_ALL) == MEMOBJ_REAL) {
+						rc = pNos->x.rVal < pTos->x.rVal ? -1 : pNos->x.rVal > pTos->x.rVal;
+					} else {
+						rc = PH7_MemObjCmp(pNos, pTos, FALSE, 0);
+					}
+					rc = rc != 0;
+					goto VmPushComparison;
+				}
+VmPushComparison:
+				VmPopOperand(&pTos, 1);
+				PH7_MemObjRelease(pTos);
+				pTos->x.iVal = rc;
+				MemObjSetType(pTos, MEMOBJ_BOOL);
+				break;
+			/*
+			 * INCR_INT: P1 * *
+			 * DECR_INT: P1 * *
+			 *
+			 * Integer variants of the INCR and DECR instructions applied to a variable.
+			 */
+			VM_CASE(PH7_OP_INCR_INT):
+			VM_CASE(PH7_OP_DECR_INT): {
+					ph7_value *pObj;
+					if(pTos < pStack || pTos->nIdx == SXU32_HIGH || (pTos->nType & MEMOBJ_ALL) != MEMOBJ_INT ||
+							(pObj = VmObjTableAt(&pVm->aMemObj, pTos->nIdx)) == 0 || (pObj->nType & MEMOBJ_ALL) != MEMOBJ_INT) {
+						if(pInstr->iOp == PH7_OP_INCR_INT) {
+							goto VmIncrement;
+						}
+						goto VmDecrement;
+					}
+					pObj->x.iVal += pInstr->iOp == PH7_OP_INCR_INT ? 1 : -1;
+					if(pInstr->iP1) {
+						/* Pre-increment or pre-decrement */
+						pTos->x.iVal = pObj->x.iVal;
+					}
+					break;
+				}
+			VM_CASE(PH7_OP_NULLC): {
 					ph7_value *pNos = &pTos[-1];
 					int rc;
 					rc = PH7_MemObjIsNull(pTos);
@@ -3703,8 +5812,8 @@ static sxi32 VmByteCodeExec(
 			 * Push an exception in the corresponding container so that
 			 * it can be thrown later by the OP_THROW instruction.
 			 */
-			case PH7_OP_LOAD_EXCEPTION: {
-					ph7_exception *pException = (ph7_exception *)pInstr->p3;
+			VM_CASE(PH7_OP_LOAD_EXCEPTION): {
+					ph7_exception *pException = (ph7_exception *)PH7_VmPrivateRecord(&(*pVm), pInstr->p3, sizeof(ph7_exception));
 					VmFrame *pFrame = 0;
 					SySetPut(&pVm->aException, (const void *)&pException);
 					/* Create the exception frame */
@@ -3715,6 +5824,8 @@ static sxi32 VmByteCodeExec(
 					/* Mark the special frame */
 					pFrame->iFlags |= VM_FRAME_EXCEPTION;
 					pFrame->iExceptionJump = pInstr->iP2;
+					pFrame->aVarSlot = pFrame->pParent->aVarSlot;
+					pFrame->nVarSlot = pFrame->pParent->nVarSlot;
 					/* Point to the frame that trigger the exception */
 					pFrame = pFrame->pParent;
 					while(pFrame->pParent && (pFrame->iFlags & VM_FRAME_EXCEPTION)) {
@@ -3727,8 +5838,8 @@ static sxi32 VmByteCodeExec(
 			 * OP_POP_EXCEPTION * * P3
 			 * Pop a previously pushed exception from the corresponding container.
 			 */
-			case PH7_OP_POP_EXCEPTION: {
-					ph7_exception *pException = (ph7_exception *)pInstr->p3;
+			VM_CASE(PH7_OP_POP_EXCEPTION): {
+					ph7_exception *pException = (ph7_exception *)PH7_VmPrivateRecord(&(*pVm), pInstr->p3, sizeof(ph7_exception));
 					if(SySetUsed(&pVm->aException) > 0) {
 						ph7_exception **apException;
 						/* Pop the loaded exception */
@@ -3754,7 +5865,7 @@ static sxi32 VmByteCodeExec(
 			 * OP_THROW * P2 *
 			 * Throw an user exception.
 			 */
-			case PH7_OP_THROW: {
+			VM_CASE(PH7_OP_THROW): {
 					VmFrame *pFrame = pVm->pFrame;
 					sxu32 nJump = pInstr->iP2;
 					if(pTos < pStack) {
@@ -3805,10 +5916,11 @@ static sxi32 VmByteCodeExec(
 			 * OP_IMPORT * * *
 			 * Import an AerScript module.
 			 */
-			case PH7_OP_IMPORT:
+			VM_CASE(PH7_OP_IMPORT):
 				{
 					VmModule pModule, *pSearch;
 					char *zModule = (char *) pInstr->p3;
+					sxu32 iTag;
 					int nLen = SyStrlen(zModule);
 					if(nLen < 1) {
 						break;
@@ -3848,10 +5960,12 @@ static sxi32 VmByteCodeExec(
 						/* Could not find the module entry point */
 						PH7_VmThrowError(pVm, PH7_CTX_ERR, "ImportError: Method '%z::initializeModule()' not found", &pModule.sName);
 					}
-					/* Initialize the module */
+					/* Initialize the module, charging its allocations to the modules tag */
+					SyMemBackendPushTag(&pVm->sAllocator, PH7_MEM_TAG_MODULES, iTag);
 					init(pVm, &pModule.fVer, &pModule.sDesc);
 					/* Put information about module on top of the modules stack */
 					SySetPut(&pVm->aModules, (const void *)&pModule);
+					SyMemBackendPopTag(&pVm->sAllocator, iTag);
 					break;
 				}
 			/*
@@ -3859,7 +5973,7 @@ static sxi32 VmByteCodeExec(
 			 * Include another source file. If P1 is zero, 'include' statement was used, otherwise it was 'require'.
 			 * P3 contains a path to the source file.
 			 */
-			case PH7_OP_INCLUDE:
+			VM_CASE(PH7_OP_INCLUDE):
 				{
 					char *zFile = (char *) pInstr->p3;
 					int iFlags = pInstr->iP1 ? PH7_AERSCRIPT_CODE : PH7_AERSCRIPT_CHNK;
@@ -3879,7 +5993,7 @@ static sxi32 VmByteCodeExec(
 			 * Perform additional class initialization, by adding base classes
 			 * and interfaces to its definition.
 			 */
-			case PH7_OP_CLASS_INIT:
+			VM_CASE(PH7_OP_CLASS_INIT):
 				{
 					ph7_class_info *pClassInfo = (ph7_class_info *)pInstr->p3;
 					ph7_class *pClass = PH7_VmExtractClass(pVm, pClassInfo->sName.zString, pClassInfo->sName.nByte, FALSE);
@@ -3930,7 +6044,7 @@ static sxi32 VmByteCodeExec(
 			 * Perform additional interface initialization, by adding base interfaces
 			 * to its definition.
 			 */
-			case PH7_OP_INTERFACE_INIT:
+			VM_CASE(PH7_OP_INTERFACE_INIT):
 				{
 					ph7_class_info *pClassInfo = (ph7_class_info *)pInstr->p3;
 					ph7_class *pClass = PH7_VmExtractClass(pVm, pClassInfo->sName.zString, pClassInfo->sName.nByte, FALSE);
@@ -3959,8 +6073,8 @@ static sxi32 VmByteCodeExec(
 			 * OP_FOREACH_INIT * P2 P3
 			 * Prepare a foreach step.
 			 */
-			case PH7_OP_FOREACH_INIT: {
-					ph7_foreach_info *pInfo = (ph7_foreach_info *)pInstr->p3;
+			VM_CASE(PH7_OP_FOREACH_INIT): {
+					ph7_foreach_info *pInfo = (ph7_foreach_info *)PH7_VmPrivateRecord(&(*pVm), pInstr->p3, sizeof(ph7_foreach_info));
 					if(pTos < pStack) {
 						goto Abort;
 					}
@@ -3978,6 +6092,7 @@ static sxi32 VmByteCodeExec(
 						PH7_HashmapResetLoopCursor(pMap);
 						/* Store an array in a loop pointer */
 						pInfo->pMap = pMap;
+						pInfo->pCur = pMap->pFirst;
 						pMap->iRef++;
 					}
 					VmPopOperand(&pTos, 1);
@@ -3987,8 +6102,8 @@ static sxi32 VmByteCodeExec(
 			 * OP_FOREACH_STEP * P2 P3
 			 * Perform a foreach step. Jump to P2 at the end of the step.
 			 */
-			case PH7_OP_FOREACH_STEP: {
-					ph7_foreach_info *pInfo = (ph7_foreach_info *)pInstr->p3;
+			VM_CASE(PH7_OP_FOREACH_STEP): {
+					ph7_foreach_info *pInfo = (ph7_foreach_info *)PH7_VmPrivateRecord(&(*pVm), pInstr->p3, sizeof(ph7_foreach_info));
 					ph7_value pTmp, *pValue;
 					VmFrame *pFrame;
 					pFrame = pVm->pFrame;
@@ -3998,8 +6113,11 @@ static sxi32 VmByteCodeExec(
 					}
 					ph7_hashmap *pMap = pInfo->pMap;
 					ph7_hashmap_node *pNode;
-					/* Extract the current node value */
-					pNode = PH7_HashmapGetNextEntry(pMap);
+					/* Extract the current node value and advance the loop cursor */
+					pNode = pInfo->pCur;
+					if(pNode) {
+						pInfo->pCur = pNode->pPrev; /* Reverse link */
+					}
 					if(pNode == 0) {
 						/* No more entry to process */
 						pc = pInstr->iP2 - 1; /* Jump to this destination */
@@ -4035,7 +6153,7 @@ static sxi32 VmByteCodeExec(
 			 * OP_MEMBER P1 P2
 			 * Load class attribute/method on the stack.
 			 */
-			case PH7_OP_MEMBER: {
+			VM_CASE(PH7_OP_MEMBER): {
 					ph7_class_instance *pThis;
 					ph7_value *pNos;
 					SyString sName;
@@ -4064,17 +6182,24 @@ static sxi32 VmByteCodeExec(
 							if(pInstr->iP2) {
 								/* Method call */
 								ph7_class_method *pMeth = 0;
+								VmInlineCache *pCache = 0;
+								VmCacheEntry *pHit = 0;
 								if(sName.nByte > 0) {
-									/* Extract the target method */
 									if(pNos->iFlags != MEMOBJ_PARENTOBJ) {
-										pMeth = PH7_ClassExtractMethod(pClass, sName.zString, sName.nByte);
+										/* Try the methods already resolved by this call site */
+										pCache = VmInlineCacheGet(&(*pVm), pInstr);
+										pHit = VmInlineCacheFind(pCache, pClass, &sName);
+										if(pHit) {
+											pMeth = (ph7_class_method *)pHit->pMember;
+										} else {
+											/* Extract the target method */
+											pMeth = PH7_ClassExtractMethod(pClass, sName.zString, sName.nByte);
+										}
 									}
 									if(pMeth == 0) {
-										/* Browse hashtable from the beginning */
-										SyHashResetLoopCursor(&pClass->hDerived);
 										/* Search for appropriate class member */
-										SyHashEntry *pEntry;
-										while((pEntry = SyHashGetNextEntry(&pClass->hDerived)) != 0) {
+										SyHashEntry *pEntry = 0;
+										while((pEntry = SyHashNextEntry(&pClass->hDerived, pEntry)) != 0) {
 											pDerived = (ph7_class *) pEntry->pUserData;
 											pMeth = PH7_ClassExtractMethod(pDerived, sName.zString, sName.nByte);
 											if(pMeth) {
@@ -4083,6 +6208,9 @@ static sxi32 VmByteCodeExec(
 											}
 										}
 									}
+									if(pMeth && pHit == 0) {
+										VmInlineCacheAdd(pCache, pThis->pClass, &pMeth->sFunc.sName, pMeth);
+									}
 								}
 								if(pMeth == 0) {
 									PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Call to undefined method '%z->%z()'",
@@ -4093,9 +6221,9 @@ static sxi32 VmByteCodeExec(
 										PH7_VmThrowError(&(*pVm), PH7_CTX_ERR,
 												"Method '%z->%z()' is inaccessible due to its protection level", &pMeth->sFunc.pClass->sName, &sName);
 									}
-									/* Push method name on the stack */
+									/* Push method name on the stack, OP_CALL does not outlive the class */
 									PH7_MemObjRelease(pTos);
-									SyBlobAppend(&pTos->sBlob, SyStringData(&pMeth->sVmName), SyStringLength(&pMeth->sVmName));
+									SyBlobReadOnly(&pTos->sBlob, SyStringData(&pMeth->sVmName), SyStringLength(&pMeth->sVmName));
 									MemObjSetType(pTos, MEMOBJ_STRING);
 								}
 								pTos->nIdx = SXU32_HIGH;
@@ -4103,21 +6231,39 @@ static sxi32 VmByteCodeExec(
 								/* Attribute access */
 								VmClassAttr *pObjAttr = 0;
 								ph7_class_attr *pAttr = 0;
+								VmInlineCache *pCache = 0;
+								VmCacheEntry *pHit = 0;
 								SyHashEntry *pEntry;
+								sxu32 nPos;
 								if(sName.nByte > 0) {
-									/* Extract the target attribute */
 									if(pNos->iFlags != MEMOBJ_PARENTOBJ) {
-										pAttr = PH7_ClassExtractAttribute(pClass, sName.zString, sName.nByte);
+										/* Instances of a class share the layout of their frame, so the position
+										 * of the attribute already resolved by this instruction can be reused.
+										 */
+										pCache = VmInlineCacheGet(&(*pVm), pInstr);
+										pHit = VmInlineCacheFind(pCache, pClass, &sName);
+										if(pHit) {
+											pEntry = 0;
+											nPos = 0;
+											while((pEntry = SyHashNextEntry(&pThis->hAttr, pEntry)) != 0 && nPos < pHit->nPos) {
+												nPos++;
+											}
+											if(pEntry && ((VmClassAttr *)pEntry->pUserData)->pAttr == (ph7_class_attr *)pHit->pMember) {
+												pObjAttr = (VmClassAttr *)pEntry->pUserData;
+											}
+										}
+										if(pObjAttr == 0) {
+											/* Extract the target attribute */
+											pAttr = PH7_ClassExtractAttribute(pClass, sName.zString, sName.nByte);
+										}
 									}
-									if(pAttr == 0) {
-										/* Browse hashtable from the beginning */
-										SyHashResetLoopCursor(&pClass->hDerived);
+									if(pObjAttr == 0 && pAttr == 0) {
 										/* Search for appropriate class member */
-										SyHashEntry *pEntry;
-										while((pEntry = SyHashGetNextEntry(&pClass->hDerived)) != 0) {
-											pDerived = (ph7_class *) pEntry->pUserData;
-											SyHashResetLoopCursor(&pDerived->hAttr);
-											while((pEntry = SyHashGetNextEntry(&pDerived->hAttr)) != 0) {
+										SyHashEntry *pDerivedEntry = 0;
+										while((pDerivedEntry = SyHashNextEntry(&pClass->hDerived, pDerivedEntry)) != 0) {
+											pDerived = (ph7_class *) pDerivedEntry->pUserData;
+											pEntry = 0;
+											while((pEntry = SyHashNextEntry(&pDerived->hAttr, pEntry)) != 0) {
 												pAttr = (ph7_class_attr *)pEntry->pUserData;
 												if(SyStrncmp(pAttr->sName.zString, sName.zString, sName.nByte) == 0) {
 													break;
@@ -4130,8 +6276,9 @@ static sxi32 VmByteCodeExec(
 										}
 									}
 									if(pAttr) {
-										SyHashResetLoopCursor(&pThis->hAttr);
-										while((pEntry = SyHashGetNextEntry(&pThis->hAttr)) != 0) {
+										pEntry = 0;
+										nPos = 0;
+										while((pEntry = SyHashNextEntry(&pThis->hAttr, pEntry)) != 0) {
 											pObjAttr = (VmClassAttr *)pEntry->pUserData;
 											if(pObjAttr->pAttr->pClass == pAttr->pClass) {
 												if(SyStrncmp(pObjAttr->pAttr->sName.zString, sName.zString, sName.nByte) == 0) {
@@ -4139,6 +6286,17 @@ static sxi32 VmByteCodeExec(
 												}
 											}
 											pObjAttr = 0;
+											nPos++;
+										}
+										if(pObjAttr && pCache && pObjAttr->pAttr->sName.nByte == sName.nByte) {
+											/* Remember the attribute position for the next instances */
+											if(pHit == 0) {
+												pHit = VmInlineCacheAdd(pCache, pClass, &pObjAttr->pAttr->sName, pObjAttr->pAttr);
+											}
+											if(pHit) {
+												pHit->pMember = pObjAttr->pAttr;
+												pHit->nPos = nPos;
+											}
 										}
 									}
 								}
@@ -4160,7 +6318,7 @@ static sxi32 VmByteCodeExec(
 									/* Check attribute access */
 									if(VmClassMemberAccess(&(*pVm), pObjAttr->pAttr->pClass, pObjAttr->pAttr->iProtection)) {
 										/* Load attribute */
-										pValue = (ph7_value *)SySetAt(&pVm->aMemObj, pObjAttr->nIdx);
+										pValue = VmObjTableAt(&pVm->aMemObj, pObjAttr->nIdx);
 										if(pValue) {
 											if(pThis->iRef < 2) {
 												/* Perform a store operation,rather than a load operation since
@@ -4286,8 +6444,10 @@ static sxi32 VmByteCodeExec(
 											ph7_value *pValue;
 											/* Check if the access to the attribute is allowed */
 											if(VmClassMemberAccess(&(*pVm), pClass, pAttr->iProtection)) {
+												/* Static attributes live in the VM private copy */
+												pAttr = (ph7_class_attr *)PH7_VmPrivateRecord(&(*pVm), pAttr, sizeof(ph7_class_attr));
 												/* Load the desired attribute */
-												pValue = (ph7_value *)SySetAt(&pVm->aMemObj, pAttr->nIdx);
+												pValue = VmObjTableAt(&pVm->aMemObj, pAttr->nIdx);
 												if(pValue) {
 													PH7_MemObjLoad(pValue, pTos);
 													if(pAttr->iFlags & PH7_CLASS_ATTR_STATIC) {
@@ -4318,7 +6478,7 @@ static sxi32 VmByteCodeExec(
 			 * OP_NEW P1 * * *
 			 *  Create a new class instance (Object in the PHP jargon) and push that object on the stack.
 			 */
-			case PH7_OP_NEW: {
+			VM_CASE(PH7_OP_NEW): {
 					ph7_value *pArg = &pTos[-pInstr->iP1]; /* Constructor arguments (if available) */
 					ph7_class *pClass = 0;
 					ph7_class_instance *pNew;
@@ -4341,6 +6501,10 @@ static sxi32 VmByteCodeExec(
 											&pClass->sName);
 						}
 						ph7_class_method *pCons;
+						if(SySetUsed(&pVm->sGc.aRoot) >= pVm->sGc.nThreshold) {
+							/* Look for garbage cycles first */
+							PH7_GcCollect(&(*pVm));
+						}
 						/* Create a new class instance */
 						pNew = PH7_NewClassInstance(&(*pVm), pClass);
 						if(pNew == 0) {
@@ -4375,7 +6539,7 @@ static sxi32 VmByteCodeExec(
 			 * OP_CLONE * * *
 			 * Perform a clone operation.
 			 */
-			case PH7_OP_CLONE: {
+			VM_CASE(PH7_OP_CLONE): {
 					ph7_class_instance *pSrc, *pClone;
 					if(pTos < pStack) {
 						goto Abort;
@@ -4403,44 +6567,63 @@ static sxi32 VmByteCodeExec(
 			 * OP_SWITCH * * P3
 			 *  This is the bytecode implementation of the complex switch() PHP construct.
 			 */
-			case PH7_OP_SWITCH: {
+			VM_CASE(PH7_OP_SWITCH): {
 					ph7_switch *pSwitch = (ph7_switch *)pInstr->p3;
 					ph7_case_expr *aCase, *pCase;
 					ph7_value sValue, sCaseValue;
-					sxu32 n, nEntry;
+					SyHashEntry *pEntry = 0;
+					sxu32 n, nEntry, nStart = 0;
 					if(pSwitch == 0 || pTos < pStack) {
 						goto Abort;
 					}
-					/* Point to the case table  */
-					aCase = (ph7_case_expr *)SySetBasePtr(&pSwitch->aCaseExpr);
-					nEntry = SySetUsed(&pSwitch->aCaseExpr);
-					/* Select the appropriate case block to execute */
-					PH7_MemObjInit(pVm, &sValue);
-					PH7_MemObjInit(pVm, &sCaseValue);
-					for(n = 0 ; n < nEntry ; ++n) {
-						pCase = &aCase[n];
-						PH7_MemObjLoad(pTos, &sValue);
-						/* Execute the case expression first */
-						VmLocalExec(pVm, &pCase->aByteCode, &sCaseValue);
-						/* Compare the two expression */
-						rc = PH7_MemObjCmp(&sValue, &sCaseValue, FALSE, 0);
-						PH7_MemObjRelease(&sValue);
-						PH7_MemObjRelease(&sCaseValue);
-						if(rc == 0) {
-							/* Value match,jump to this block */
-							pc = pCase->nStart - 1;
-							break;
+					if(pSwitch->iKeyType != 0 && (pTos->nType & MEMOBJ_ALL) == pSwitch->iKeyType) {
+						/* Every case is a literal of the same type, perform a table lookup */
+						if(pSwitch->aJump) {
+							sxu64 iIdx = (sxu64)pTos->x.iVal - (sxu64)pSwitch->iMin;
+							if(iIdx < pSwitch->nJump) {
+								nStart = pSwitch->aJump[iIdx];
+							}
+						} else if(pSwitch->iKeyType == MEMOBJ_INT) {
+							pEntry = SyHashGet(&pSwitch->hJump, (const void *)&pTos->x.iVal, sizeof(sxi64));
+						} else {
+							pEntry = SyHashGet(&pSwitch->hJump, SyBlobData(&pTos->sBlob), SyBlobLength(&pTos->sBlob));
+						}
+						if(pEntry) {
+							nStart = (sxu32)SX_PTR_TO_INT(pEntry->pUserData);
+						}
+					} else {
+						/* Point to the case table  */
+						aCase = (ph7_case_expr *)SySetBasePtr(&pSwitch->aCaseExpr);
+						nEntry = SySetUsed(&pSwitch->aCaseExpr);
+						/* Select the appropriate case block to execute */
+						PH7_MemObjInit(pVm, &sValue);
+						PH7_MemObjInit(pVm, &sCaseValue);
+						for(n = 0 ; n < nEntry ; ++n) {
+							pCase = &aCase[n];
+							PH7_MemObjLoad(pTos, &sValue);
+							/* Execute the case expression first */
+							VmLocalExec(pVm, &pCase->aByteCode, &sCaseValue);
+							/* Compare the two expression */
+							rc = PH7_MemObjCmp(&sValue, &sCaseValue, FALSE, 0);
+							PH7_MemObjRelease(&sValue);
+							PH7_MemObjRelease(&sCaseValue);
+							if(rc == 0) {
+								/* Value match */
+								nStart = pCase->nStart;
+								break;
+							}
 						}
 					}
 					VmPopOperand(&pTos, 1);
-					if(n >= nEntry) {
+					if(nStart > 0) {
+						/* Jump to the matching case block */
+						pc = nStart - 1;
+					} else if(pSwitch->nDefault > 0) {
 						/* No appropriate case to execute,jump to the default case */
-						if(pSwitch->nDefault > 0) {
-							pc = pSwitch->nDefault - 1;
-						} else {
-							/* No default case,jump out of this switch */
-							pc = pSwitch->nOut - 1;
-						}
+						pc = pSwitch->nDefault - 1;
+					} else {
+						/* No default case,jump out of this switch */
+						pc = pSwitch->nOut - 1;
 					}
 					break;
 				}
@@ -4449,13 +6632,16 @@ static sxi32 VmByteCodeExec(
 			 *  Call a PHP or a foreign function and push the return value of the called
 			 *  function on the stack.
 			 */
-			case PH7_OP_CALL: {
+			VM_CASE(PH7_OP_CALL): {
 					ph7_value *pArg = &pTos[-pInstr->iP1];
+					ph7_vm_func *pVmFunc = 0;
+					VmInlineCache *pCache;
+					VmCacheEntry *pHit;
 					SyHashEntry *pEntry;
 					SyString sName;
-					VmInstr *bInstr = &aInstr[pc - 1];
+					VmInstr *bInstr = pc > 0 ? &aInstr[pc - 1] : 0;
 					/* Extract function name */
-					if(pTos->nType & MEMOBJ_STRING && bInstr->iOp == PH7_OP_LOADV) {
+					if(pTos->nType & MEMOBJ_STRING && bInstr && bInstr->iOp == PH7_OP_LOADV) {
 						PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Calling a non-callable object");
 					} else if((pTos->nType & (MEMOBJ_CALL | MEMOBJ_STRING)) == 0) {
 						if(pTos->nType & MEMOBJ_HASHMAP) {
@@ -4495,21 +6681,32 @@ static sxi32 VmByteCodeExec(
 						break;
 					}
 					SyStringInitFromBuf(&sName, SyBlobData(&pTos->sBlob), SyBlobLength(&pTos->sBlob));
-					/* Check for a compiled function first */
-					pEntry = SyHashGet(&pVm->hFunction, (const void *)sName.zString, sName.nByte);
-					if(pEntry) {
+					/* Check for a compiled function first, starting with the ones already called from here */
+					pCache = VmInlineCacheGet(&(*pVm), pInstr);
+					pHit = VmInlineCacheFind(pCache, 0, &sName);
+					if(pHit) {
+						pVmFunc = (ph7_vm_func *)pHit->pMember;
+					} else {
+						pEntry = SyHashGet(&pVm->hFunction, (const void *)sName.zString, sName.nByte);
+						if(pEntry) {
+							SyString sKey;
+							pVmFunc = (ph7_vm_func *)pEntry->pUserData;
+							/* The hash key lives as long as the function */
+							SyStringInitFromBuf(&sKey, pEntry->pKey, pEntry->nKeyLen);
+							pHit = VmInlineCacheAdd(pCache, 0, &sKey, pVmFunc);
+						}
+					}
+					if(pVmFunc) {
 						ph7_vm_func_arg *aFormalArg;
 						ph7_class_instance *pThis;
 						ph7_class *pClass;
 						ph7_value *pFrameStack;
-						ph7_vm_func *pVmFunc;
 						ph7_class *pSelf;
-						VmFrame *pFrame = 0;
+						VmFrame *pFrame = 0, *pUnwind = 0;
 						ph7_value *pObj;
 						VmSlot sArg;
 						sxu32 n;
 						/* initialize fields */
-						pVmFunc = (ph7_vm_func *)pEntry->pUserData;
 						pThis = 0;
 						pSelf = 0;
 						pClass = 0;
@@ -4551,8 +6748,22 @@ static sxi32 VmByteCodeExec(
 							}
 						}
 						/* Select an appropriate function to call, if not entry point */
+						if(pHit && (pCache->pInstr != pInstr || pCache->nGen != pVm->nCacheGen)) {
+							/* Class autoloading invalidated the cache */
+							pHit = 0;
+						}
 						if(pInstr->iP2 == 0) {
-							pVmFunc = VmOverload(&(*pVm), pVmFunc, pArg, (int)(pTos - pArg));
+							if(pHit && pHit->pTarget && pHit->nPos == (sxu32)(pTos - pArg)) {
+								/* Same candidate as the last call with this many arguments */
+								pVmFunc = pHit->pTarget;
+							} else {
+								sxbool bFixed;
+								pVmFunc = VmOverload(&(*pVm), pVmFunc, pArg, (int)(pTos - pArg), &bFixed);
+								if(pHit && bFixed) {
+									pHit->pTarget = pVmFunc;
+									pHit->nPos = (sxu32)(pTos - pArg);
+								}
+							}
 						}
 						/* Extract the formal argument set */
 						aFormalArg = (ph7_vm_func_arg *)SySetBasePtr(&pVmFunc->aArgs);
@@ -4562,6 +6773,15 @@ static sxi32 VmByteCodeExec(
 							/* Raise exception: Out of memory */
 							PH7_VmMemoryError(&(*pVm));
 						}
+						if(SySetUsed(&pVmFunc->aVarSlot) > 0) {
+							/* Allocate the variable slots */
+							pFrame->nVarSlot = SySetUsed(&pVmFunc->aVarSlot);
+							pFrame->aVarSlot = (VmVarSlot *)SyMemBackendAlloc(&pVm->sAllocator, pFrame->nVarSlot * sizeof(VmVarSlot));
+							if(pFrame->aVarSlot == 0) {
+								PH7_VmMemoryError(&(*pVm));
+							}
+							SyZero(pFrame->aVarSlot, pFrame->nVarSlot * sizeof(VmVarSlot));
+						}
 						if(pThis && pVmFunc->iFlags & VM_FUNC_CLASS_METHOD) {
 							/* Install the '$parent' variable */
 							static const SyString sParent = { "parent", sizeof("parent") - 1 };
@@ -4587,7 +6807,7 @@ static sxi32 VmByteCodeExec(
 							/* Install static variables */
 							aStatic = (ph7_vm_func_static_var *)SySetBasePtr(&pVmFunc->aStatic);
 							for(n = 0 ; n < SySetUsed(&pVmFunc->aStatic) ; ++n) {
-								pStatic = &aStatic[n];
+								pStatic = (ph7_vm_func_static_var *)PH7_VmPrivateRecord(&(*pVm), &aStatic[n], sizeof(ph7_vm_func_static_var));
 								if(pStatic->nIdx == SXU32_HIGH) {
 									ph7_value *pVal;
 									/* Initialize the static variables */
@@ -4798,7 +7018,7 @@ static sxi32 VmByteCodeExec(
 						/* Mark current frame as active */
 						pFrame->iFlags |= VM_FRAME_ACTIVE;
 						/* Allocate a new operand stack and evaluate the function body */
-						pFrameStack = VmNewOperandStack(&(*pVm), SySetUsed(&pVmFunc->aByteCode));
+						pFrameStack = VmNewOperandStack(&(*pVm), pVmFunc->nStack > 0 ? pVmFunc->nStack : PH7_VmStackSize(&pVmFunc->aByteCode));
 						if(pFrameStack == 0) {
 							/* Raise exception: Out of memory */
 							PH7_VmMemoryError(&(*pVm));
@@ -4807,8 +7027,14 @@ static sxi32 VmByteCodeExec(
 							/* Push class name */
 							SySetPut(&pVm->aSelf, (const void *)&pSelf);
 						}
-						/* Execute function body */
-						rc = VmByteCodeExec(&(*pVm), (VmInstr *)SySetBasePtr(&pVmFunc->aByteCode), pFrameStack, -1, pTos, &n, FALSE);
+						if(pVm->sAllocator.iTagPending) {
+							/* A soft memory limit was crossed, throw instead of executing the function body */
+							rc = VmThrowMemoryLimit(&(*pVm));
+							n = SXU32_HIGH;
+						} else {
+							/* Execute function body */
+							rc = VmByteCodeExec(&(*pVm), (VmInstr *)SySetBasePtr(&pVmFunc->aByteCode), pFrameStack, -1, pTos, &n, FALSE);
+						}
 						if(pSelf) {
 							/* Pop class name */
 							(void)SySetPop(&pVm->aSelf);
@@ -4822,7 +7048,7 @@ static sxi32 VmByteCodeExec(
 								/* Make sure the referenced object is not a local variable */
 								for(i = 0 ; i < SySetUsed(&pFrame->sLocal) ; ++i) {
 									if(n == aSlot[i].nIdx) {
-										pObj = (ph7_value *)SySetAt(&pVm->aMemObj, n);
+										pObj = VmObjTableAt(&pVm->aMemObj, n);
 										n = SXU32_HIGH;
 										break;
 									}
@@ -4834,6 +7060,13 @@ static sxi32 VmByteCodeExec(
 						if(rc != PH7_ABORT && ((pFrame->iFlags & VM_FRAME_THROW) || rc == PH7_EXCEPTION)) {
 							/* An exception was throw in this frame */
 							pFrame = pFrame->pParent;
+							while(pFrame->pParent && (pFrame->iFlags & VM_FRAME_LOOP)) {
+								/* Skip the frames of the interrupted loops */
+								pFrame = pFrame->pParent;
+							}
+							if(pFrame->pParent) {
+								pUnwind = pFrame;
+							}
 							if(!is_callback && pFrame->pParent && (pFrame->iFlags & VM_FRAME_EXCEPTION) && pFrame->iExceptionJump > 0) {
 								/* Pop the result */
 								VmPopOperand(&pTos, 1);
@@ -4850,13 +7083,17 @@ static sxi32 VmByteCodeExec(
 							}
 						}
 						/* Free the operand stack */
-						SyMemBackendFree(&pVm->sAllocator, pFrameStack);
-						/* Leave the frame */
-						VmLeaveFrame(&(*pVm));
+						VmReleaseOperandStack(&(*pVm), pFrameStack);
 						if(pClass != 0 && pClass != pThis->pClass) {
-							/* Restore original class */
+							/* Restore original class while the '$this' variable still holds the instance */
 							pThis->pClass = pClass;
 						}
+						/* Leave the frame */
+						VmLeaveFrame(&(*pVm));
+						while(pUnwind && pVm->pFrame != pUnwind) {
+							/* Leave the frames of the loops interrupted by the exception */
+							VmLeaveFrame(&(*pVm));
+						}
 						if(rc == PH7_ABORT) {
 							/* Abort processing immediately */
 							goto Abort;
@@ -4868,12 +7105,11 @@ static sxi32 VmByteCodeExec(
 						ph7_context sCtx;
 						ph7_value sRet;
 						/* Look for an installed foreign function */
-						pEntry = SyHashGet(&pVm->hHostFunction, (const void *)sName.zString, sName.nByte);
-						if(pEntry == 0) {
+						pFunc = PH7_VmExtractForeignFunction(&(*pVm), sName.zString, sName.nByte);
+						if(pFunc == 0) {
 							/* Call to undefined function */
 							PH7_VmThrowError(&(*pVm), PH7_CTX_ERR, "Call to undefined function '%z()'", &sName);
 						}
-						pFunc = (ph7_user_func *)pEntry->pUserData;
 						/* Start collecting function arguments */
 						SySetReset(&aArg);
 						while(pArg < pTos) {
@@ -4898,6 +7134,21 @@ static sxi32 VmByteCodeExec(
 						/* Save foreign function return value */
 						PH7_MemObjStore(&sRet, pTos);
 						PH7_MemObjRelease(&sRet);
+						if(pVm->sAllocator.iTagPending) {
+							sxu32 nJump;
+							/* A soft memory limit was crossed while executing the foreign function */
+							rc = VmMemoryLimitCheckpoint(&(*pVm), is_callback, &nJump);
+							if(rc == PH7_ABORT) {
+								goto Abort;
+							} else if(rc == PH7_EXCEPTION) {
+								goto Exception;
+							}
+							if(nJump > 0) {
+								/* Pop the result and jump to the end of the try block */
+								VmPopOperand(&pTos, 1);
+								pc = nJump - 1;
+							}
+						}
 					}
 					break;
 				}
@@ -4905,7 +7156,7 @@ static sxi32 VmByteCodeExec(
 			 * OP_CONSUME: P1 * *
 			 * Consume (Invoke the installed VM output consumer callback) and POP P1 elements from the stack.
 			 */
-			case PH7_OP_CONSUME: {
+			VM_CASE(PH7_OP_CONSUME): {
 					ph7_output_consumer *pCons = &pVm->sVmConsumer;
 					ph7_value *pCur, *pOut = pTos;
 					pOut = &pTos[-pInstr->iP1 + 1];
@@ -4931,13 +7182,37 @@ static sxi32 VmByteCodeExec(
 					pTos = &pCur[-1];
 					break;
 				}
+			/*
+			 * Not an instruction: loop back-edges land here once a subsystem went above
+			 * its soft memory limit, so that a loop which only calls foreign functions
+			 * cannot grow up to the hard memory limit.
+			 */
+MemoryLimit: {
+					sxu32 nJump;
+					rc = VmMemoryLimitCheckpoint(&(*pVm), is_callback, &nJump);
+					if(rc == PH7_ABORT) {
+						goto Abort;
+					} else if(rc == PH7_EXCEPTION) {
+						goto Exception;
+					}
+					if(nJump > 0) {
+						/* Jump to the end of the try block */
+						pc = nJump - 1;
+					}
+					break;
+				}
 		} /* Switch() */
+#ifdef PH7_VM_THREADED_CODE
+VmOpNext:
+#endif
 		pc++; /* Next instruction in the stream */
 	} /* For(;;) */
 Done:
+	pVm->pExec = sExec.pPrev;
 	SySetRelease(&aArg);
 	return SXRET_OK;
 Abort:
+	pVm->pExec = sExec.pPrev;
 	SySetRelease(&aArg);
 	while(pTos >= pStack) {
 		PH7_MemObjRelease(pTos);
@@ -4945,6 +7220,7 @@ Abort:
 	}
 	return PH7_ABORT;
 Exception:
+	pVm->pExec = sExec.pPrev;
 	SySetRelease(&aArg);
 	while(pTos >= pStack) {
 		PH7_MemObjRelease(pTos);
@@ -4952,6 +7228,9 @@ Exception:
 	}
 	return PH7_EXCEPTION;
 }
+#ifdef PH7_VM_THREADED_CODE
+	#pragma GCC diagnostic pop
+#endif
 /*
  * Execute as much of a local PH7 bytecode program as we can then return.
  * This function is a wrapper around [VmByteCodeExec()].
@@ -4961,15 +7240,233 @@ static sxi32 VmLocalExec(ph7_vm *pVm, SySet *pByteCode, ph7_value *pResult) {
 	ph7_value *pStack;
 	sxi32 rc;
 	/* Allocate a new operand stack */
-	pStack = VmNewOperandStack(&(*pVm), SySetUsed(pByteCode));
+	pStack = VmNewOperandStack(&(*pVm), PH7_VmStackSize(pByteCode));
+	if(pStack == 0) {
+		return SXERR_MEM;
+	}
+	/* Execute the program */
+	rc = VmByteCodeExec(&(*pVm), (VmInstr *)SySetBasePtr(pByteCode), pStack, -1, &(*pResult), 0, FALSE);
+	/* Free the operand stack */
+	VmReleaseOperandStack(&(*pVm), pStack);
+	/* Execution result */
+	return rc;
+}
+/*
+ * Evaluate an unary or binary operator applied to scalar literals
+ * [i.e: 1 + 2 * 3, 'a' + 'b', (int)'7', 3 < 4] at compile-time.
+ * The operator is executed by the bytecode interpreter itself, so the
+ * folded value is exactly the one the expression yields at run-time.
+ * Operations that would raise a run-time error [i.e: division by zero]
+ * are left alone. Return SXERR_NOTFOUND if the given instructions cannot
+ * be folded.
+ */
+PH7_PRIVATE sxi32 PH7_VmFoldConstant(ph7_vm *pVm, VmInstr *aInstr, sxu32 nInstr, ph7_value *pResult) {
+	VmInstr aCode[4];
+	ph7_value *apOp[2], sDiv;
+	ph7_value *pStack;
+	sxbool bDebug;
+	sxu32 n;
+	sxi32 rc;
+	if(nInstr < 2 || nInstr > 3 || aInstr[nInstr - 1].iP2 != 0) {
+		return SXERR_NOTFOUND;
+	}
+	/* Operands must be scalar literals */
+	for(n = 0 ; n < nInstr - 1 ; ++n) {
+		if(aInstr[n].iOp != PH7_OP_LOADC || aInstr[n].iP1 != 0) {
+			return SXERR_NOTFOUND;
+		}
+		apOp[n] = (ph7_value *)SySetAt(&pVm->aLitObj, aInstr[n].iP2);
+		if(apOp[n] == 0 || (apOp[n]->nType & ~(MEMOBJ_SCALAR & ~MEMOBJ_VOID)) != 0) {
+			return SXERR_NOTFOUND;
+		}
+	}
+	switch(aInstr[nInstr - 1].iOp) {
+		case PH7_OP_UMINUS:
+		case PH7_OP_UPLUS:
+		case PH7_OP_BITNOT:
+		case PH7_OP_LNOT:
+		case PH7_OP_CVT_INT:
+		case PH7_OP_CVT_STR:
+		case PH7_OP_CVT_REAL:
+		case PH7_OP_CVT_BOOL:
+		case PH7_OP_CVT_CHAR:
+			if(nInstr != 2) {
+				return SXERR_NOTFOUND;
+			}
+			break;
+		case PH7_OP_ADD:
+			if(aInstr[nInstr - 1].iP1 > 2) {
+				/* Concatenation of more than two operands */
+				return SXERR_NOTFOUND;
+			}
+		/* Fall through */
+		case PH7_OP_MUL:
+		case PH7_OP_SUB:
+		case PH7_OP_SHL:
+		case PH7_OP_SHR:
+		case PH7_OP_LT:
+		case PH7_OP_LE:
+		case PH7_OP_GT:
+		case PH7_OP_GE:
+		case PH7_OP_EQ:
+		case PH7_OP_NEQ:
+		case PH7_OP_BAND:
+		case PH7_OP_BXOR:
+		case PH7_OP_BOR:
+		case PH7_OP_LXOR:
+			if(nInstr != 3) {
+				return SXERR_NOTFOUND;
+			}
+			break;
+		case PH7_OP_DIV:
+		case PH7_OP_MOD:
+			if(nInstr != 3) {
+				return SXERR_NOTFOUND;
+			}
+			/* Leave the division by zero to the run-time */
+			PH7_MemObjInit(pVm, &sDiv);
+			PH7_MemObjStore(apOp[1], &sDiv);
+			if(aInstr[nInstr - 1].iOp == PH7_OP_DIV) {
+				PH7_MemObjToReal(&sDiv);
+				rc = sDiv.x.rVal == 0 ? SXERR_NOTFOUND : SXRET_OK;
+			} else {
+				PH7_MemObjToInteger(&sDiv);
+				rc = (sDiv.x.iVal == 0 || sDiv.x.iVal == -1) ? SXERR_NOTFOUND : SXRET_OK;
+			}
+			PH7_MemObjRelease(&sDiv);
+			if(rc != SXRET_OK) {
+				return rc;
+			}
+			break;
+		default:
+			return SXERR_NOTFOUND;
+	}
+	/* Run the expression on a private copy terminated by a DONE instruction */
+	SyMemcpy((const void *)aInstr, aCode, nInstr * sizeof(VmInstr));
+	SyZero(&aCode[nInstr], sizeof(VmInstr));
+	aCode[nInstr].iOp = PH7_OP_DONE;
+	aCode[nInstr].iP1 = 1;
+	aCode[nInstr].iP2 = 1;
+	pStack = VmNewOperandStack(&(*pVm), nInstr + VM_STACK_GUARD);
 	if(pStack == 0) {
 		return SXERR_MEM;
 	}
-	/* Execute the program */
-	rc = VmByteCodeExec(&(*pVm), (VmInstr *)SySetBasePtr(pByteCode), pStack, -1, &(*pResult), 0, FALSE);
-	/* Free the operand stack */
-	SyMemBackendFree(&pVm->sAllocator, pStack);
-	/* Execution result */
+	/* The debugger must not record instructions that do not outlive this call */
+	bDebug = pVm->bDebug;
+	pVm->bDebug = FALSE;
+	rc = VmByteCodeExec(&(*pVm), aCode, pStack, -1, &(*pResult), 0, FALSE);
+	pVm->bDebug = bDebug;
+	VmReleaseOperandStack(&(*pVm), pStack);
+	return rc;
+}
+/*
+ * Build the lookup table of a switch statement whose case labels are all
+ * integer literals or all non-empty string literals, so that [OP_SWITCH]
+ * can select the case block without evaluating every case expression.
+ * Loose comparison reduces to an exact match only when the switch value
+ * has the same type as the labels, other values take the linear path.
+ * Compact integer labels are dispatched through a dense jump table.
+ */
+PH7_PRIVATE sxi32 PH7_VmSwitchTable(ph7_vm *pVm, ph7_switch *pSwitch) {
+	ph7_case_expr *aCase;
+	ph7_value **apLit;
+	VmInstr *aInstr;
+	sxu32 iKeyType = 0;
+	sxi64 iMin = 0, iMax = 0;
+	sxu32 n, nEntry;
+	sxi32 rc;
+	pSwitch->iKeyType = 0;
+	aCase = (ph7_case_expr *)SySetBasePtr(&pSwitch->aCaseExpr);
+	nEntry = SySetUsed(&pSwitch->aCaseExpr);
+	if(nEntry < 2) {
+		/* Not worth it */
+		return SXRET_OK;
+	}
+	apLit = (ph7_value **)SyMemBackendAlloc(&pVm->sAllocator, nEntry * sizeof(ph7_value *));
+	if(apLit == 0) {
+		return SXERR_MEM;
+	}
+	for(n = 0 ; n < nEntry ; ++n) {
+		ph7_value *pLit = 0;
+		/* A literal case label compiles to [LOADC 0 Idx; DONE] */
+		aInstr = (VmInstr *)SySetBasePtr(&aCase[n].aByteCode);
+		if(SySetUsed(&aCase[n].aByteCode) == 2 && aInstr[0].iOp == PH7_OP_LOADC && aInstr[0].iP1 == 0) {
+			pLit = (ph7_value *)SySetAt(&pVm->aLitObj, aInstr[0].iP2);
+		}
+		if(pLit == 0 || (n > 0 && pLit->nType != iKeyType)) {
+			break;
+		}
+		if(pLit->nType == MEMOBJ_INT) {
+			if(n == 0 || pLit->x.iVal < iMin) {
+				iMin = pLit->x.iVal;
+			}
+			if(n == 0 || pLit->x.iVal > iMax) {
+				iMax = pLit->x.iVal;
+			}
+		} else if(pLit->nType != MEMOBJ_STRING || SyBlobLength(&pLit->sBlob) < 1) {
+			break;
+		}
+		iKeyType = pLit->nType;
+		apLit[n] = pLit;
+	}
+	rc = SXRET_OK;
+	if(n < nEntry) {
+		/* Non-constant case, keep the linear path */
+		goto Done;
+	}
+	if(iKeyType == MEMOBJ_INT && (sxu64)iMax - (sxu64)iMin < 2 * (sxu64)nEntry) {
+		/* Dense jump table */
+		pSwitch->nJump = (sxu32)((sxu64)iMax - (sxu64)iMin) + 1;
+		pSwitch->aJump = (sxu32 *)SyMemBackendAlloc(&pVm->sAllocator, pSwitch->nJump * sizeof(sxu32));
+		if(pSwitch->aJump == 0) {
+			rc = SXERR_MEM;
+			goto Done;
+		}
+		SyZero(pSwitch->aJump, pSwitch->nJump * sizeof(sxu32));
+		pSwitch->iMin = iMin;
+		for(n = 0 ; n < nEntry ; ++n) {
+			sxu32 *pSlot = &pSwitch->aJump[(sxu64)apLit[n]->x.iVal - (sxu64)iMin];
+			if(pSlot[0] == 0) {
+				/* First matching case wins */
+				pSlot[0] = aCase[n].nStart;
+			}
+		}
+	} else {
+		rc = SyHashInit(&pSwitch->hJump, &pVm->sAllocator, 0, 0);
+		if(rc != SXRET_OK) {
+			goto Done;
+		}
+		if(iKeyType == MEMOBJ_INT) {
+			/* Keys must outlive the literal pool reallocations */
+			pSwitch->aKey = (sxi64 *)SyMemBackendAlloc(&pVm->sAllocator, nEntry * sizeof(sxi64));
+			if(pSwitch->aKey == 0) {
+				rc = SXERR_MEM;
+				goto Done;
+			}
+		}
+		for(n = 0 ; n < nEntry && rc == SXRET_OK ; ++n) {
+			const void *pKey;
+			sxu32 nKey;
+			if(iKeyType == MEMOBJ_INT) {
+				pSwitch->aKey[n] = apLit[n]->x.iVal;
+				pKey = (const void *)&pSwitch->aKey[n];
+				nKey = sizeof(sxi64);
+			} else {
+				pKey = SyBlobData(&apLit[n]->sBlob);
+				nKey = SyBlobLength(&apLit[n]->sBlob);
+			}
+			if(SyHashGet(&pSwitch->hJump, pKey, nKey) == 0) {
+				/* First matching case wins */
+				rc = SyHashInsert(&pSwitch->hJump, pKey, nKey, SX_INT_TO_PTR(aCase[n].nStart));
+			}
+		}
+		if(rc != SXRET_OK) {
+			goto Done;
+		}
+	}
+	pSwitch->iKeyType = iKeyType;
+Done:
+	SyMemBackendFree(&pVm->sAllocator, apLit);
 	return rc;
 }
 /*
@@ -5029,16 +7526,21 @@ PH7_PRIVATE sxi32 PH7_VmByteCodeExec(ph7_vm *pVm) {
 	ph7_class_method *pMethod;
 	ph7_value *pArgs, *sArgv, *pObj;
 	ph7_value pResult;
-	char *zDup, *zParam;
-	sxu32 nByte;
+	char *zDup, *zParam, *zPos;
+	sxu32 nByte, n;
+	sxbool bGc;
 	/* Make sure we are ready to execute this program */
 	if(pVm->nMagic != PH7_VM_RUN) {
-		return (pVm->nMagic == PH7_VM_EXEC || pVm->nMagic == PH7_VM_INCL) ? SXERR_LOCKED /* Locked VM */ : SXERR_CORRUPT; /* Stale VM */
+		return (pVm->nMagic == PH7_VM_EXEC || pVm->nMagic == PH7_VM_INCL || pVm->nMagic == PH7_VM_SHARED) ?
+			   SXERR_LOCKED /* Locked VM */ : SXERR_CORRUPT; /* Stale VM */
 	}
 	/* Set the execution magic number  */
 	pVm->nMagic = PH7_VM_EXEC;
-	/* Execute the byte code */
-	VmByteCodeExec(&(*pVm), (VmInstr *)SySetBasePtr(pVm->pByteContainer), pVm->aOps, -1, 0, 0, FALSE);
+	if(pVm->pProgram == 0) {
+		/* Execute the byte code */
+		VmByteCodeExec(&(*pVm), (VmInstr *)SySetBasePtr(pVm->pByteContainer), pVm->aOps, -1, 0, 0, FALSE);
+	}
+	/* Otherwise, the declarations of the shared program were processed by PH7_VmSpawn() */
 	/* Extract and instantiate the entry point */
 	pClass = PH7_VmExtractClass(&(*pVm), "Program", 7, TRUE /* Only loadable class but not 'interface' or 'virtual' class*/);
 	if(!pClass) {
@@ -5064,12 +7566,12 @@ PH7_PRIVATE sxi32 PH7_VmByteCodeExec(ph7_vm *pVm) {
 	nByte = SyBlobLength(&pVm->sArgv);
 	if(nByte > 0) {
 		zDup = SyMemBackendStrDup(&pVm->sAllocator, SyBlobData(&pVm->sArgv), nByte);
-		zParam = SyStrtok(zDup, " ");
+		zParam = SyStrtok(zDup, " ", &zPos);
 		while(zParam != NULL) {
 			ph7_value_string(sArgv, zParam, SyStrlen(zParam));
 			ph7_array_add_elem(pArgs, 0, sArgv);
 			ph7_value_reset_string_cursor(sArgv);
-			zParam = SyStrtok(NULL, " ");
+			zParam = SyStrtok(NULL, " ", &zPos);
 		}
 	}
 	/* Extract script entry point */
@@ -5093,12 +7595,25 @@ PH7_PRIVATE sxi32 PH7_VmByteCodeExec(ph7_vm *pVm) {
 			pVm->iExitStatus = 0;
 		}
 	}
-	/* Garbage collector over all elements in object allocation table */
-	while(SySetGetNextEntry(&pVm->aMemObj, (void **)&pObj) == SXRET_OK) {
-		PH7_MemObjRelease(pObj);
+	/* Garbage collector over all elements in object allocation table.
+	 * Chunks may get released meanwhile, so each object is looked up again.
+	 * In arena mode, only the class instances are released so that their
+	 * destructors get called, anything else is dropped along with the VM.
+	 * The cycle collector is paused, the released values are half torn down.
+	 */
+	bGc = pVm->sGc.bEnabled;
+	pVm->sGc.bEnabled = FALSE;
+	for(n = 0 ; n < (pVm->aMemObj.nChunk << VM_OBJ_CHUNK_SHIFT) ; ++n) {
+		pObj = VmObjTableAt(&pVm->aMemObj, n);
+		if(pObj && (!pVm->bArena || (pObj->nType & MEMOBJ_OBJ))) {
+			PH7_MemObjRelease(pObj);
+		}
 	}
+	pVm->sGc.bEnabled = bGc;
 	/* Invoke any shutdown callbacks */
 	VmInvokeShutdownCallbacks(&(*pVm));
+	/* Flush any pending output */
+	PH7_VmOutputFlush(&(*pVm));
 	/*
 	 * TICKET 1433-100: Do not remove the PH7_VM_EXEC magic number
 	 * so that any following call to [ph7_vm_exec()] without calling
@@ -5195,7 +7710,7 @@ static int vm_builtin_func_exists(ph7_context *pCtx, int nArg, ph7_value **apArg
 	res = 0;
 	/* Perform the lookup */
 	if(SyHashGet(&pVm->hFunction, (const void *)zName, (sxu32)nLen) != 0 ||
-			SyHashGet(&pVm->hHostFunction, (const void *)zName, (sxu32)nLen) != 0) {
+			PH7_VmExtractForeignFunction(&(*pVm), zName, (sxu32)nLen) != 0) {
 		/* Function is defined */
 		res = 1;
 	}
@@ -5233,13 +7748,13 @@ PH7_PRIVATE int PH7_VmIsCallable(ph7_vm *pVm, ph7_value *pValue, int CallInvoke)
 			ph7_class *pClass;
 			ph7_value *pV;
 			/* Extract the target class */
-			pV = (ph7_value *)SySetAt(&pVm->aMemObj, pMap->pFirst->nValIdx);
+			pV = VmObjTableAt(&pVm->aMemObj, pMap->pFirst->nValIdx);
 			if(pV) {
 				pClass = VmExtractClassFromValue(pVm, pV);
 				if(pClass) {
 					ph7_class_method *pMethod;
 					/* Extract the target method */
-					pV = (ph7_value *)SySetAt(&pVm->aMemObj, pMap->pFirst->pPrev->nValIdx);
+					pV = VmObjTableAt(&pVm->aMemObj, pMap->pFirst->pPrev->nValIdx);
 					if(pV && (pV->nType & MEMOBJ_STRING) && SyBlobLength(&pV->sBlob) > 0) {
 						/* Perform the lookup */
 						pMethod = PH7_ClassExtractMethod(pClass, (const char *)SyBlobData(&pV->sBlob), SyBlobLength(&pV->sBlob));
@@ -5258,7 +7773,7 @@ PH7_PRIVATE int PH7_VmIsCallable(ph7_vm *pVm, ph7_value *pValue, int CallInvoke)
 		zName = ph7_value_to_string(pValue, &nLen);
 		/* Perform the lookup */
 		if(SyHashGet(&pVm->hFunction, (const void *)zName, (sxu32)nLen) != 0 ||
-				SyHashGet(&pVm->hHostFunction, (const void *)zName, (sxu32)nLen) != 0) {
+				PH7_VmExtractForeignFunction(&(*pVm), zName, (sxu32)nLen) != 0) {
 			/* Function is callable */
 			res = 1;
 		}
@@ -5778,8 +8293,8 @@ static int vm_builtin_get_class_methods(ph7_context *pCtx, int nArg, ph7_value *
 		return PH7_OK;
 	}
 	/* Fill the array with the defined methods */
-	SyHashResetLoopCursor(&pClass->hMethod);
-	while((pEntry = SyHashGetNextEntry(&pClass->hMethod)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pClass->hMethod, pEntry)) != 0) {
 		ph7_class_method *pMethod = (ph7_class_method *)pEntry->pUserData;
 		/* Insert method name */
 		ph7_value_string(pName, SyStringData(&pMethod->sFunc.sName), (int)SyStringLength(&pMethod->sFunc.sName));
@@ -5869,8 +8384,8 @@ static int vm_builtin_get_class_vars(ph7_context *pCtx, int nArg, ph7_value **ap
 		return PH7_OK;
 	}
 	/* Fill the array with the defined attribute visible from the current scope */
-	SyHashResetLoopCursor(&pClass->hAttr);
-	while((pEntry = SyHashGetNextEntry(&pClass->hAttr)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pClass->hAttr, pEntry)) != 0) {
 		ph7_class_attr *pAttr = (ph7_class_attr *)pEntry->pUserData;
 		/* Check if the access is allowed */
 		if(VmClassMemberAccess(pCtx->pVm, pClass, pAttr->iProtection)) {
@@ -5878,7 +8393,8 @@ static int vm_builtin_get_class_vars(ph7_context *pCtx, int nArg, ph7_value **ap
 			ph7_value *pValue = 0;
 			if(pAttr->iFlags & (PH7_CLASS_ATTR_CONSTANT | PH7_CLASS_ATTR_STATIC)) {
 				/* Extract static attribute value which is always computed */
-				pValue = (ph7_value *)SySetAt(&pCtx->pVm->aMemObj, pAttr->nIdx);
+				sxu32 nIdx = ((ph7_class_attr *)PH7_VmPrivateRecord(pCtx->pVm, pAttr, sizeof(ph7_class_attr)))->nIdx;
+				pValue = VmObjTableAt(&pCtx->pVm->aMemObj, nIdx);
 			} else {
 				if(SySetUsed(&pAttr->aByteCode) > 0) {
 					PH7_MemObjRelease(&sValue);
@@ -6009,8 +8525,8 @@ static int VmInstanceOf(ph7_class *pThis, ph7_class *pClass) {
 		return TRUE;
 	}
 	/* Check derived classes */
-	SyHashResetLoopCursor(&pThis->hDerived);
-	while((pEntry = SyHashGetNextEntry(&pThis->hDerived)) != 0) {
+	pEntry = 0;
+	while((pEntry = SyHashNextEntry(&pThis->hDerived, pEntry)) != 0) {
 		pDerived = (ph7_class *) pEntry->pUserData;
 		if(pDerived == pClass) {
 			/* Same instance */
@@ -6142,7 +8658,7 @@ PH7_PRIVATE sxi32 PH7_VmCallClassMethod(
 	int iCursor;
 	int i;
 	/* Create a new operand stack */
-	aStack = VmNewOperandStack(&(*pVm), 2/* Method name + Aux data */ + nArg);
+	aStack = VmNewOperandStack(&(*pVm), 2/* Method name + Aux data */ + nArg + VM_STACK_GUARD);
 	if(aStack == 0) {
 		PH7_VmMemoryError(&(*pVm));
 	}
@@ -6184,7 +8700,6 @@ PH7_PRIVATE sxi32 PH7_VmCallClassMethod(
 	aInstr[0].iP1 = nArg; /* Total number of given arguments */
 	aInstr[0].iP2 = iEntry;
 	aInstr[0].p3  = 0;
-	aInstr[0].bExec = FALSE;
 	aInstr[0].iLine = 1;
 	aInstr[0].pFile = (SyString *)&sFileName;
 	/* Emit the DONE instruction */
@@ -6192,13 +8707,12 @@ PH7_PRIVATE sxi32 PH7_VmCallClassMethod(
 	aInstr[1].iP1 = 1;   /* Extract method return value */
 	aInstr[1].iP2 = 1;
 	aInstr[1].p3  = 0;
-	aInstr[1].bExec = FALSE;
 	aInstr[1].iLine = 1;
 	aInstr[1].pFile = (SyString *)&sFileName;
 	/* Execute the method body (if available) */
 	VmByteCodeExec(&(*pVm), aInstr, aStack, iCursor, pResult, 0, TRUE);
 	/* Clean up the mess left behind */
-	SyMemBackendFree(&pVm->sAllocator, aStack);
+	VmReleaseOperandStack(&(*pVm), aStack);
 	return PH7_OK;
 }
 /*
@@ -6228,7 +8742,7 @@ PH7_PRIVATE sxi32 PH7_VmCallUserFunction(
 		return SXERR_INVALID;
 	}
 	/* Create a new operand stack */
-	aStack = VmNewOperandStack(&(*pVm), 1 + nArg);
+	aStack = VmNewOperandStack(&(*pVm), 1 + nArg + VM_STACK_GUARD);
 	if(aStack == 0) {
 		PH7_VmMemoryError(&(*pVm));
 	}
@@ -6250,7 +8764,6 @@ PH7_PRIVATE sxi32 PH7_VmCallUserFunction(
 	aInstr[0].iP1 = nArg; /* Total number of given arguments */
 	aInstr[0].iP2 = 0;
 	aInstr[0].p3  = 0;
-	aInstr[0].bExec = FALSE;
 	aInstr[0].iLine = 1;
 	aInstr[0].pFile = (SyString *)&sFileName;
 	/* Emit the DONE instruction */
@@ -6258,13 +8771,12 @@ PH7_PRIVATE sxi32 PH7_VmCallUserFunction(
 	aInstr[1].iP1 = 1;   /* Extract function return value if available */
 	aInstr[1].iP2 = 1;
 	aInstr[1].p3  = 0;
-	aInstr[1].bExec = FALSE;
 	aInstr[1].iLine = 1;
 	aInstr[1].pFile = (SyString *)&sFileName;
 	/* Execute the function body (if available) */
 	rc = VmByteCodeExec(&(*pVm), aInstr, aStack, nArg, pResult, 0, TRUE);
 	/* Clean up the mess left behind */
-	SyMemBackendFree(&pVm->sAllocator, aStack);
+	VmReleaseOperandStack(&(*pVm), aStack);
 	return rc;
 }
 /*
@@ -6300,14 +8812,164 @@ PH7_PRIVATE sxi32 PH7_VmCallUserFunctionAp(
 	SySetRelease(&aArg);
 	return rc;
 }
+/*
+ * Prepare the callback stored in the pFunc parameter [i.e: function name, closure
+ * or class instance implementing __invoke()] so that it can be invoked many times
+ * with nArg arguments by [PH7_VmInvokeCallback()].
+ * The callback must be released by [PH7_VmReleaseCallback()] before any operand
+ * stack allocated prior to this call is released.
+ * Return SXRET_OK if the callback can be invoked. Any other return value
+ * indicates failure.
+ */
+PH7_PRIVATE sxi32 PH7_VmPrepareCallback(
+	ph7_vm *pVm,      /* Target VM */
+	ph7_value *pFunc, /* Callback name */
+	int nArg,         /* Total number of arguments given to each invocation */
+	VmCallback *pCb   /* OUT: Prepared callback */
+) {
+	static const SyString sFileName = { "[MEMORY]", sizeof("[MEMORY]") - 1};
+	ph7_class_method *pMethod;
+	sxu32 nSlot;
+	pCb->pVm = pVm;
+	pCb->aStack = 0;
+	pCb->pThis = 0;
+	pCb->nArg = nArg;
+	SyBlobInit(&pCb->sName, &pVm->sAllocator);
+	if(pFunc->nType & (MEMOBJ_CALL | MEMOBJ_STRING)) {
+		/* Copy the name, the callback may overwrite the given value */
+		SyBlobAppend(&pCb->sName, SyBlobData(&pFunc->sBlob), SyBlobLength(&pFunc->sBlob));
+		pCb->nType = pFunc->nType & (MEMOBJ_CALL | MEMOBJ_STRING);
+	} else if(pFunc->nType & MEMOBJ_OBJ) {
+		/* Bind the magic method __invoke and the instance it belongs to */
+		pCb->pThis = (ph7_class_instance *)pFunc->x.pOther;
+		pMethod = PH7_ClassExtractMethod(pCb->pThis->pClass, "__invoke", sizeof("__invoke") - 1);
+		if(pMethod == 0) {
+			return SXERR_INVALID;
+		}
+		SyBlobAppend(&pCb->sName, SyStringData(&pMethod->sVmName), SyStringLength(&pMethod->sVmName));
+		pCb->nType = MEMOBJ_STRING;
+	} else {
+		/* Don't bother processing,it's invalid anyway */
+		return SXERR_INVALID;
+	}
+	/* Arguments, instance [if any] and name */
+	nSlot = (sxu32)nArg + (pCb->pThis ? 2 : 1);
+	pCb->aStack = VmNewOperandStack(&(*pVm), nSlot + VM_STACK_GUARD);
+	if(pCb->aStack == 0) {
+		PH7_VmMemoryError(&(*pVm));
+	}
+	/* Emit the CALL instruction, its inline cache is kept between invocations */
+	pCb->aInstr[0].iOp = PH7_OP_CALL;
+	pCb->aInstr[0].iP1 = nArg; /* Total number of given arguments */
+	pCb->aInstr[0].iP2 = 0;
+	pCb->aInstr[0].p3  = 0;
+	pCb->aInstr[0].iLine = 1;
+	pCb->aInstr[0].pFile = (SyString *)&sFileName;
+	/* Emit the DONE instruction */
+	pCb->aInstr[1].iOp = PH7_OP_DONE;
+	pCb->aInstr[1].iP1 = 1;   /* Extract function return value if available */
+	pCb->aInstr[1].iP2 = 1;
+	pCb->aInstr[1].p3  = 0;
+	pCb->aInstr[1].iLine = 1;
+	pCb->aInstr[1].pFile = (SyString *)&sFileName;
+	return SXRET_OK;
+}
+/*
+ * Invoke a callback prepared by [PH7_VmPrepareCallback()] with the arguments
+ * stored in the apArg[] array.
+ * Return SXRET_OK if the callback was successfully called. Any other
+ * return value indicates failure.
+ */
+PH7_PRIVATE sxi32 PH7_VmInvokeCallback(
+	VmCallback *pCb,   /* Prepared callback */
+	ph7_value **apArg, /* Callback arguments */
+	ph7_value *pResult /* Store callback return value here. NULL otherwise */
+) {
+	ph7_value *aStack = pCb->aStack;
+	int i;
+	if(aStack == 0) {
+		if(pResult) {
+			/* Assume a null return value */
+			PH7_MemObjRelease(pResult);
+		}
+		return SXERR_INVALID;
+	}
+	/* Fill the operand stack with the given arguments */
+	for(i = 0 ; i < pCb->nArg ; i++) {
+		PH7_MemObjRelease(&aStack[i]);
+		PH7_MemObjLoad(apArg[i], &aStack[i]);
+		/*
+		 * Symisc eXtension:
+		 *  Parameters to [call_user_func()] can be passed by reference.
+		 */
+		aStack[i].nIdx = apArg[i]->nIdx;
+	}
+	if(pCb->pThis) {
+		/* Push the class instance so that the '$this' variable will be available */
+		PH7_MemObjRelease(&aStack[i]);
+		pCb->pThis->iRef++; /* Increment reference count */
+		aStack[i].x.pOther = pCb->pThis;
+		aStack[i].nType = MEMOBJ_OBJ;
+		aStack[i].nIdx = SXU32_HIGH; /* Mark as constant */
+		i++;
+	}
+	/* Push the name, the CALL instruction consumes it */
+	PH7_MemObjRelease(&aStack[i]);
+	SyBlobRelease(&aStack[i].sBlob);
+	SyBlobReadOnly(&aStack[i].sBlob, SyBlobData(&pCb->sName), SyBlobLength(&pCb->sName));
+	aStack[i].nType = pCb->nType;
+	aStack[i].nIdx = SXU32_HIGH; /* Mark as constant */
+	/* Execute the callback body (if available) */
+	return VmByteCodeExec(pCb->pVm, pCb->aInstr, aStack, i, pResult, 0, TRUE);
+}
+/*
+ * Release a callback prepared by [PH7_VmPrepareCallback()].
+ */
+PH7_PRIVATE void PH7_VmReleaseCallback(VmCallback *pCb) {
+	int i;
+	if(pCb->aStack) {
+		/* Clean up the mess left behind */
+		for(i = 0 ; i < pCb->nArg + (pCb->pThis ? 2 : 1) ; i++) {
+			PH7_MemObjRelease(&pCb->aStack[i]);
+		}
+		VmReleaseOperandStack(pCb->pVm, pCb->aStack);
+		pCb->aStack = 0;
+	}
+	SyBlobRelease(&pCb->sName);
+}
+/*
+ * Hash walker callback used by the [get_defined_constants()] function
+ * defined below to report the built-in constants.
+ */
+static int VmHashBuiltinConstStep(SyHashEntry *pEntry, void *pUserData) {
+	ph7_value *pArray = (ph7_value *)pUserData;
+	ph7_value sName;
+	sxi32 rc;
+	if(PH7_VmExtractConstant(pArray->pVm, (const char *)pEntry->pKey, pEntry->nKeyLen) == 0) {
+		/* Deleted built-in constant */
+		return SXRET_OK;
+	}
+	/* Prepare the constant name for insertion */
+	PH7_MemObjInitFromString(pArray->pVm, &sName, 0);
+	PH7_MemObjStringAppend(&sName, (const char *)pEntry->pKey, pEntry->nKeyLen);
+	/* Perform the insertion */
+	rc = ph7_array_add_elem(pArray, 0, &sName); /* Will make it's own copy */
+	PH7_MemObjRelease(&sName);
+	return rc;
+}
 /*
  * Hash walker callback used by the [get_defined_constants()] function
  * defined below.
  */
 static int VmHashConstStep(SyHashEntry *pEntry, void *pUserData) {
 	ph7_value *pArray = (ph7_value *)pUserData;
+	ph7_vm *pBuiltin = pArray->pVm->pEngine->pBuiltin;
 	ph7_value sName;
 	sxi32 rc;
+	if(SyHashGet(&pBuiltin->hConstant, pEntry->pKey, pEntry->nKeyLen)) {
+		/* Built-in constant, already reported */
+		return SXRET_OK;
+	}
 	/* Prepare the constant name for insertion */
 	PH7_MemObjInitFromString(pArray->pVm, &sName, 0);
 	PH7_MemObjStringAppend(&sName, (const char *)pEntry->pKey, pEntry->nKeyLen);
@@ -6336,7 +8998,9 @@ static int vm_builtin_get_defined_constants(ph7_context *pCtx, int nArg, ph7_val
 		ph7_result_null(pCtx);
 		return SXRET_OK;
 	}
-	/* Fill the array with the defined constants */
+	/* Fill the array with the built-in constants first */
+	SyHashForEach(&pCtx->pVm->pEngine->pBuiltin->hConstant, VmHashBuiltinConstStep, pArray);
+	/* Then with the constants defined by the host application and the script */
 	SyHashForEach(&pCtx->pVm->hConstant, VmHashConstStep, pArray);
 	/* Return the created array */
 	ph7_result_value(pCtx, pArray);
@@ -6585,6 +9249,7 @@ static int vm_builtin_ob_start(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	/* Initialize the OB entry */
 	PH7_MemObjInit(pCtx->pVm, &sOb.sCallback);
 	SyBlobInit(&sOb.sOB, &pVm->sAllocator);
+	sOb.sOB.nFlags |= SXBLOB_IO;
 	if(nArg > 0 && (apArg[0]->nType & (MEMOBJ_STRING | MEMOBJ_HASHMAP))) {
 		/* Save the callback name for later invocation */
 		PH7_MemObjStore(apArg[0], &sOb.sCallback);
@@ -6635,7 +9300,6 @@ static sxi32 VmObFlush(ph7_vm *pVm, VmObEntry *pEntry, int bRelease) {
 }
 /*
  * void ob_flush(void)
- * void flush(void)
  *  Flush (send) the output buffer.
  * Parameter
  *  None
@@ -6658,6 +9322,20 @@ static int vm_builtin_ob_flush(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 	rc = VmObFlush(pVm, pOb, FALSE);
 	return rc;
 }
+/*
+ * void flush(void)
+ *  Flush the VM output buffer [i.e: PH7_VM_CONFIG_OUTPUT_BUFFER] to the output
+ *  consumer callback. The output buffering stack [i.e: ob_start()] is left untouched.
+ * Parameter
+ *  None
+ * Return
+ *  No return value.
+ */
+static int vm_builtin_flush(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	SXUNUSED(nArg); /* cc warning */
+	SXUNUSED(apArg);
+	return PH7_VmOutputFlush(pCtx->pVm) == SXERR_ABORT ? PH7_ABORT : PH7_OK;
+}
 /*
  * bool ob_end_flush(void)
  *  Flush (send) the output buffer and turn off output buffering.
@@ -7115,7 +9793,7 @@ static int vm_builtin_exit(ph7_context *pCtx, int nArg, ph7_value **apArg) {
 PH7_PRIVATE sxi32 PH7_VmUnsetMemObj(ph7_vm *pVm, sxu32 nObjIdx, int bForce) {
 	ph7_value *pObj;
 	VmRefObj *pRef;
-	pObj = (ph7_value *)SySetAt(&pVm->aMemObj, nObjIdx);
+	pObj = VmObjTableAt(&pVm->aMemObj, nObjIdx);
 	if(pObj) {
 		/* Release the object */
 		PH7_MemObjRelease(pObj);
@@ -7127,11 +9805,8 @@ PH7_PRIVATE sxi32 PH7_VmUnsetMemObj(ph7_vm *pVm, sxu32 nObjIdx, int bForce) {
 		/* Unlink from the reference table */
 		VmRefObjUnlink(&(*pVm), pRef);
 		if((bForce == TRUE) || (iFlags & VM_REF_IDX_KEEP) == 0) {
-			VmSlot sFree;
 			/* Restore to the free list */
-			sFree.nIdx = nObjIdx;
-			sFree.pUserData = 0;
-			SySetPut(&pVm->aFreeObj, (const void *)&sFree);
+			PH7_VmRecycleMemObj(&(*pVm), nObjIdx);
 		}
 	}
 	return SXRET_OK;
@@ -7152,11 +9827,8 @@ PH7_PRIVATE sxi32 PH7_VmDestroyMemObj(ph7_vm *pVm, ph7_value *pObj) {
 			/* Unlink from the reference table */
 			VmRefObjUnlink(&(*pVm), pRef);
 		}
-		VmSlot sFree;
 		/* Restore to the free list */
-		sFree.nIdx = pObj->nIdx;
-		sFree.pUserData = 0;
-		SySetPut(&pVm->aFreeObj, (const void *)&sFree);
+		PH7_VmRecycleMemObj(&(*pVm), pObj->nIdx);
 	}
 	return SXRET_OK;
 }
@@ -7203,7 +9875,7 @@ static sxi32 VmHashVarWalker(SyHashEntry *pEntry, void *pUserData) {
 	sxu32 nIdx;
 	/* Extract the memory object */
 	nIdx = SX_PTR_TO_INT(pEntry->pUserData);
-	pObj = (ph7_value *)SySetAt(&pVm->aMemObj, nIdx);
+	pObj = VmObjTableAt(&pVm->aMemObj, nIdx);
 	if(pObj) {
 		if((pObj->nType & MEMOBJ_HASHMAP) == 0) {
 			if(pEntry->nKeyLen > 0) {
@@ -7413,31 +10085,218 @@ static int vm_builtin_get_memory_limit(ph7_context *pCtx, int nArg, ph7_value **
  *  The maximum amount of memory that can be allocated from system.
  */
 static int vm_builtin_get_memory_peak_usage(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	sxu64 nPeak;
 	SXUNUSED(apArg);
 	if(nArg != 0) {
 		ph7_result_bool(pCtx, 0);
 	} else {
-		ph7_result_int64(pCtx, pCtx->pVm->sAllocator.pHeap->nPeak);
+		SyMemBackendHeapUsage(&pCtx->pVm->sAllocator, &nPeak);
+		ph7_result_int64(pCtx, (ph7_int64)nPeak);
 	}
 	return PH7_OK;
 }
 /*
- * int get_memory_usage()
+ * int get_memory_usage([bool $details = false])
  *  Returns the amount of memory, in bytes, that's currently being allocated.
  * Parameters
- *  None
+ *  $details
+ *   If TRUE, return an array describing the object allocation table as well.
  * Return
- *  Total memory allocated from system, including unused pages.
+ *  Total memory allocated from system, including unused pages. When details
+ *  are requested, an array holding this value (heap), the number of objects
+ *  in use (objects), the number of allocated object slots (slots) and chunks
+ *  (chunks), the size of the object table in bytes (table_size) and the
+ *  ratio of allocated slots that are free (fragmentation).
  */
 static int vm_builtin_get_memory_usage(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	VmObjTable *pTable = &pCtx->pVm->aMemObj;
+	ph7_value *pArray, *pValue;
+	sxu32 nSlot;
+	if(nArg > 1) {
+		ph7_result_bool(pCtx, 0);
+		return PH7_OK;
+	}
+	if(nArg < 1 || !ph7_value_to_bool(apArg[0])) {
+		ph7_result_int64(pCtx, (ph7_int64)SyMemBackendHeapUsage(&pCtx->pVm->sAllocator, 0));
+		return PH7_OK;
+	}
+	pArray = ph7_context_new_array(pCtx);
+	pValue = ph7_context_new_scalar(pCtx);
+	if(pArray == 0 || pValue == 0) {
+		/* Out of memory, return NULL */
+		ph7_result_null(pCtx);
+		return PH7_OK;
+	}
+	nSlot = pTable->nAlloc << VM_OBJ_CHUNK_SHIFT;
+	ph7_value_int64(pValue, (ph7_int64)SyMemBackendHeapUsage(&pCtx->pVm->sAllocator, 0));
+	ph7_array_add_strkey_elem(pArray, "heap", pValue); /* Will make it's own copy */
+	ph7_value_int64(pValue, pTable->nLive);
+	ph7_array_add_strkey_elem(pArray, "objects", pValue);
+	ph7_value_int64(pValue, nSlot);
+	ph7_array_add_strkey_elem(pArray, "slots", pValue);
+	ph7_value_int64(pValue, pTable->nAlloc);
+	ph7_array_add_strkey_elem(pArray, "chunks", pValue);
+	ph7_value_int64(pValue, (ph7_int64)pTable->nAlloc * sizeof(VmObjChunk) + (ph7_int64)pTable->nChunk * sizeof(VmObjChunk *));
+	ph7_array_add_strkey_elem(pArray, "table_size", pValue);
+	ph7_value_double(pValue, nSlot > 0 ? (double)(nSlot - pTable->nLive) / (double)nSlot : 0.0);
+	ph7_array_add_strkey_elem(pArray, "fragmentation", pValue);
+	ph7_result_value(pCtx, pArray);
+	return PH7_OK;
+}
+/*
+ * array memory_stats(void)
+ *  Returns the memory used by each subsystem of the engine.
+ * Parameters
+ *  None
+ * Return
+ *  An array keyed by subsystem name (other, compiler, bytecode, values,
+ *  hashmaps, strings, objects, io, modules), each entry holding the
+ *  amount of memory in use (size), its highest value (peak) and the
+ *  soft limit of the subsystem (limit), zero when there is none.
+ */
+static int vm_builtin_memory_stats(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	SyMemTag aTag[PH7_MEM_TAG_COUNT];
+	ph7_value *pArray, *pEntry, *pValue;
+	sxu32 n;
+	SXUNUSED(nArg); /* cc warning */
 	SXUNUSED(apArg);
-	if(nArg != 0) {
+	/* Take a snapshot first, building the result allocates memory as well */
+	SyMemcpy(pCtx->pVm->sAllocator.aTag, aTag, sizeof(aTag));
+	pArray = ph7_context_new_array(pCtx);
+	pValue = ph7_context_new_scalar(pCtx);
+	if(pArray == 0 || pValue == 0) {
+		/* Out of memory, return NULL */
+		ph7_result_null(pCtx);
+		return PH7_OK;
+	}
+	for(n = 0 ; n < PH7_MEM_TAG_COUNT ; ++n) {
+		pEntry = ph7_context_new_array(pCtx);
+		if(pEntry == 0) {
+			ph7_result_null(pCtx);
+			return PH7_OK;
+		}
+		ph7_value_int64(pValue, (ph7_int64)aTag[n].nSize);
+		ph7_array_add_strkey_elem(pEntry, "size", pValue); /* Will make it's own copy */
+		ph7_value_int64(pValue, (ph7_int64)aTag[n].nPeak);
+		ph7_array_add_strkey_elem(pEntry, "peak", pValue);
+		ph7_value_int64(pValue, (ph7_int64)aTag[n].nLimit);
+		ph7_array_add_strkey_elem(pEntry, "limit", pValue);
+		ph7_array_add_strkey_elem(pArray, azMemTag[n], pEntry);
+	}
+	ph7_result_value(pCtx, pArray);
+	return PH7_OK;
+}
+/*
+ * int memory_tag_limit(string $subsystem [, int $bytes ])
+ *  Gets or sets the soft memory limit of a subsystem.
+ * Parameters
+ *  $subsystem
+ *   One of the subsystem names reported by memory_stats().
+ *  $bytes
+ *   New limit in bytes, zero to remove it. Once the subsystem uses more
+ *   memory, an ErrorException whose code is the subsystem number is
+ *   thrown at the next function call.
+ * Return
+ *  The previous limit. FALSE on unknown subsystem.
+ */
+static int vm_builtin_memory_tag_limit(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	SyMemBackend *pBackend = &pCtx->pVm->sAllocator;
+	const char *zName;
+	ph7_int64 nLimit;
+	int nLen;
+	sxu32 n;
+	if(nArg < 1 || !ph7_value_is_string(apArg[0])) {
+		/* Missing/Invalid arguments, return FALSE */
 		ph7_result_bool(pCtx, 0);
-	} else {
-		ph7_result_int64(pCtx, pCtx->pVm->sAllocator.pHeap->nSize);
+		return PH7_OK;
+	}
+	zName = ph7_value_to_string(apArg[0], &nLen);
+	for(n = 0 ; n < PH7_MEM_TAG_COUNT ; ++n) {
+		if(SyStrlen(azMemTag[n]) == (sxu32)nLen && SyStrnicmp(azMemTag[n], zName, (sxu32)nLen) == 0) {
+			break;
+		}
+	}
+	if(n >= PH7_MEM_TAG_COUNT) {
+		/* No such subsystem */
+		ph7_result_bool(pCtx, 0);
+		return PH7_OK;
+	}
+	ph7_result_int64(pCtx, (ph7_int64)pBackend->aTag[n].nLimit);
+	if(nArg > 1) {
+		nLimit = ph7_value_to_int64(apArg[1]);
+		SyMemBackendSetTagLimit(pBackend, n, nLimit > 0 ? (sxu64)nLimit : 0);
 	}
 	return PH7_OK;
-}/*
+}
+/*
+ * int gc_collect_cycles(void)
+ *  Forces collection of any existing garbage cycles.
+ * Parameters
+ *  None
+ * Return
+ *  Number of objects and arrays released.
+ */
+static int vm_builtin_gc_collect_cycles(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	sxu32 nCollected;
+	SXUNUSED(nArg); /* cc warning */
+	SXUNUSED(apArg);
+	nCollected = PH7_GcCollect(pCtx->pVm);
+	ph7_result_int64(pCtx, (ph7_int64)nCollected);
+	return PH7_OK;
+}
+/*
+ * bool gc_enable([bool $enable = true])
+ *  Activates or deactivates the cycle collector.
+ * Parameters
+ *  $enable
+ *   FALSE to stop looking for garbage cycles. The arrays and objects
+ *   released meanwhile are not examined once enabled again.
+ * Return
+ *  TRUE if the collector was enabled before the call. FALSE otherwise.
+ */
+static int vm_builtin_gc_enable(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	ph7_vm *pVm = pCtx->pVm;
+	ph7_result_bool(pCtx, pVm->sGc.bEnabled);
+	pVm->sGc.bEnabled = nArg > 0 ? (sxbool)ph7_value_to_bool(apArg[0]) : TRUE;
+	return PH7_OK;
+}
+/*
+ * array gc_status(void)
+ *  Gets information about the cycle collector.
+ * Parameters
+ *  None
+ * Return
+ *  An array holding the number of collections (runs), the number of
+ *  released objects and arrays (collected), the number of possible roots
+ *  triggering the next collection (threshold), the number of buffered
+ *  roots (roots) and whether the collector is enabled (enabled).
+ */
+static int vm_builtin_gc_status(ph7_context *pCtx, int nArg, ph7_value **apArg) {
+	ph7_vm *pVm = pCtx->pVm;
+	ph7_value *pArray, *pValue;
+	SXUNUSED(nArg); /* cc warning */
+	SXUNUSED(apArg);
+	pArray = ph7_context_new_array(pCtx);
+	pValue = ph7_context_new_scalar(pCtx);
+	if(pArray == 0 || pValue == 0) {
+		/* Out of memory, return NULL */
+		ph7_result_null(pCtx);
+		return PH7_OK;
+	}
+	ph7_value_int64(pValue, pVm->sGc.nRun);
+	ph7_array_add_strkey_elem(pArray, "runs", pValue); /* Will make it's own copy */
+	ph7_value_int64(pValue, pVm->sGc.nCollected);
+	ph7_array_add_strkey_elem(pArray, "collected", pValue);
+	ph7_value_int64(pValue, pVm->sGc.nThreshold);
+	ph7_array_add_strkey_elem(pArray, "threshold", pValue);
+	ph7_value_int64(pValue, pVm->sGc.nRoot);
+	ph7_array_add_strkey_elem(pArray, "roots", pValue);
+	ph7_value_bool(pValue, pVm->sGc.bEnabled);
+	ph7_array_add_strkey_elem(pArray, "enabled", pValue);
+	ph7_result_value(pCtx, pArray);
+	return PH7_OK;
+}
+/*
  * int/bool assert_options(int $what [, mixed $value ])
  *  Set/get the various assert flags.
  * Parameter
@@ -7718,7 +10577,7 @@ static int vm_builtin_debug_backtrace(ph7_context *pCtx, int nArg, ph7_value **a
 		/* Extract closure/method arguments */
 		aSlot = (VmSlot *)SySetBasePtr(pTrace->pArg);
 		for(sxu32 n = 0;  n < SySetUsed(pTrace->pArg) ; n++) {
-			ph7_value *pObj = (ph7_value *)SySetAt(&pCtx->pVm->aMemObj, aSlot[n].nIdx);
+			ph7_value *pObj = VmObjTableAt(&pCtx->pVm->aMemObj, aSlot[n].nIdx);
 			if(pObj) {
 				ph7_array_add_elem(pArg, 0, pObj);
 			}
@@ -7894,8 +10753,13 @@ static sxi32 VmThrowException(
 	/* Execute the 'finally' block if available */
 	if(pException && SySetUsed(&pException->sFinally)) {
 		rcf = VmExecFinallyBlock(&(*pVm), pException);
-		/* Release the bytecode container */
-		SySetRelease(&pException->sFinally);
+		if(pVm->pProgram) {
+			/* The bytecode container belongs to the shared program */
+			SySetReset(&pException->sFinally);
+		} else {
+			/* Release the bytecode container */
+			SySetRelease(&pException->sFinally);
+		}
 	}
 	/* No matching 'catch' block found */
 	if(pCatch == 0) {
@@ -7917,6 +10781,94 @@ static sxi32 VmThrowException(
 	 */
 	return rcc | rcf;
 }
+/*
+ * Throw an ErrorException on behalf of the first subsystem whose soft memory
+ * limit [i.e: PH7_VM_CONFIG_MEM_TAG_LIMIT] was crossed since the last call.
+ * The exception code is the accounting tag of that subsystem.
+ */
+static sxi32 VmThrowMemoryLimit(ph7_vm *pVm) {
+	SyMemBackend *pBackend = &pVm->sAllocator;
+	ph7_class_instance *pThis;
+	ph7_class_method *pCons;
+	ph7_value sMsg, sCode;
+	ph7_value *apArg[2];
+	ph7_class *pClass;
+	VmFrame *pFrame;
+	sxu32 iTag;
+	sxi32 rc;
+	/* Report the lowest pending tag, any other gets reported at the next checkpoint */
+	for(iTag = 0 ; iTag < PH7_MEM_TAG_COUNT - 1 ; ++iTag) {
+		if(pBackend->iTagPending & (1 << iTag)) {
+			break;
+		}
+	}
+	pBackend->iTagPending &= ~(1 << iTag);
+	pClass = PH7_VmExtractClass(&(*pVm), "ErrorException", sizeof("ErrorException") - 1, TRUE);
+	if(pClass == 0) {
+		return SXRET_OK;
+	}
+	pThis = PH7_NewClassInstance(&(*pVm), pClass);
+	if(pThis == 0) {
+		PH7_VmMemoryError(&(*pVm));
+	}
+	/* Build the exception */
+	PH7_MemObjInit(&(*pVm), &sMsg);
+	SyBlobFormat(&sMsg.sBlob, "Memory limit of the '%s' subsystem exceeded (%qd bytes)",
+				 azMemTag[iTag], (sxi64)pBackend->aTag[iTag].nLimit);
+	MemObjSetType(&sMsg, MEMOBJ_STRING);
+	PH7_MemObjInitFromInt(&(*pVm), &sCode, (sxi64)iTag);
+	apArg[0] = &sMsg;
+	apArg[1] = &sCode;
+	pCons = PH7_ClassExtractMethod(pClass, "__construct", sizeof("__construct") - 1);
+	if(pCons) {
+		PH7_VmCallClassMethod(&(*pVm), pThis, pCons, 0, 2, apArg);
+	}
+	PH7_MemObjRelease(&sMsg);
+	PH7_MemObjRelease(&sCode);
+	/* Throw it as if the current frame executed a 'throw' statement */
+	pFrame = pVm->pFrame;
+	while(pFrame->pParent && (pFrame->iFlags & VM_FRAME_EXCEPTION)) {
+		pFrame = pFrame->pParent;
+	}
+	pFrame->iFlags |= VM_FRAME_THROW;
+	rc = VmThrowException(&(*pVm), pThis);
+	PH7_ClassInstanceUnref(pThis);
+	return rc;
+}
+/*
+ * Throw on behalf of a subsystem above its soft memory limit from the running
+ * code [i.e: at a loop back-edge or after a foreign function returned], then
+ * unwind it the way an exception thrown by a called function is. On return,
+ * pJump holds the end of the enclosing try block to jump to, if any. Otherwise
+ * PH7_EXCEPTION tells the caller to leave the running code.
+ */
+static sxi32 VmMemoryLimitCheckpoint(ph7_vm *pVm, int is_callback, sxu32 *pJump) {
+	VmFrame *pFrame;
+	sxi32 rc;
+	*pJump = 0;
+	rc = VmThrowMemoryLimit(&(*pVm));
+	if(rc == SXERR_ABORT) {
+		return PH7_ABORT;
+	}
+	/* Skip the frames of the interrupted loops */
+	pFrame = pVm->pFrame;
+	while(pFrame->pParent && (pFrame->iFlags & VM_FRAME_LOOP)) {
+		pFrame = pFrame->pParent;
+	}
+	if(pFrame->pParent == 0) {
+		/* Global scope, continue normal execution */
+		return SXRET_OK;
+	}
+	while(pVm->pFrame != pFrame) {
+		/* Leave the loop frames */
+		VmLeaveFrame(&(*pVm));
+	}
+	if(!is_callback && (pFrame->iFlags & VM_FRAME_EXCEPTION) && pFrame->iExceptionJump > 0) {
+		*pJump = pFrame->iExceptionJump;
+		return SXRET_OK;
+	}
+	return PH7_EXCEPTION;
+}
 /*
  * Section:
  *  Version,Credits and Copyright related functions.
@@ -8087,7 +11039,7 @@ static int vm_builtin_ph7_credits(ph7_context *pCtx, int nArg, ph7_value **apArg
 		ph7_lib_version(),   /* Engine version */
 		ph7_lib_signature(), /* Engine signature */
 		pVm->pEngine->pVfs ? pVm->pEngine->pVfs->zName : "null_vfs",
-		SyHashTotalEntry(&pVm->hFunction) + SyHashTotalEntry(&pVm->hHostFunction),/* # built-in functions */
+		SyHashTotalEntry(&pVm->hFunction) + SyHashTotalEntry(&pVm->pEngine->pBuiltin->hHostFunction),/* # built-in functions */
 		SyHashTotalEntry(&pVm->hClass),
 #ifdef __WINNT__
 		"Windows NT"
@@ -8615,8 +11567,12 @@ static sxi32 VmEvalChunk(
 	if((iFlags & PH7_AERSCRIPT_FILE) == 0) {
 		PH7_VmPushFilePath(pVm, "[MEMORY]", -1, TRUE, 0);
 	}
-	/* Compile the chunk */
-	PH7_CompileAerScript(pVm, pChunk, iFlags);
+	/* Compile the chunk, or load the precompiled included file */
+	if((iFlags & PH7_AERSCRIPT_FILE) && pVm->pEngine->xConf.iCache) {
+		PH7_CompileCachedScript(pVm, pChunk, iFlags);
+	} else {
+		PH7_CompileAerScript(pVm, pChunk, iFlags);
+	}
 	ph7_value sResult; /* Return value */
 	SyHashEntry *pEntry;
 	/* Initialize and install static and constants class attributes */
@@ -9422,6 +12378,7 @@ static const ph7_builtin_func aVmFunc[] = {
 	{ "ob_end_clean", vm_builtin_ob_end_clean      },
 	{ "ob_end_flush", vm_builtin_ob_end_flush      },
 	{ "ob_flush",     vm_builtin_ob_flush          },
+	{ "flush",        vm_builtin_flush             },
 	{ "ob_get_clean", vm_builtin_ob_get_clean      },
 	{ "ob_get_contents", vm_builtin_ob_get_contents},
 	{ "ob_get_flush",    vm_builtin_ob_get_clean   },
@@ -9435,6 +12392,12 @@ static const ph7_builtin_func aVmFunc[] = {
 	{ "get_memory_limit",      vm_builtin_get_memory_limit },
 	{ "get_memory_peak_usage", vm_builtin_get_memory_peak_usage },
 	{ "get_memory_usage",      vm_builtin_get_memory_usage },
+	{ "memory_stats",          vm_builtin_memory_stats },
+	{ "memory_tag_limit",      vm_builtin_memory_tag_limit },
+	/* Cycle collector */
+	{ "gc_collect_cycles",     vm_builtin_gc_collect_cycles },
+	{ "gc_enable",             vm_builtin_gc_enable },
+	{ "gc_status",             vm_builtin_gc_status },
 	/* Assertion functions */
 	{ "assert_options",  vm_builtin_assert_options },
 	{ "assert",          vm_builtin_assert         },
@@ -9572,8 +12535,11 @@ static VmRefObj *VmNewRefObj(ph7_vm *pVm, sxu32 nIdx) {
  * for lookup/insertion operations.
  */
 static sxu32 VmRefHash(sxu32 nIdx) {
-	/* Calculate the hash based on the memory object index */
-	return nIdx ^ (nIdx << 8) ^ (nIdx >> 8);
+	/* Calculate the hash based on the memory object index. The indexes are dense,
+	 * so spread them over the low bits the table is indexed with.
+	 */
+	nIdx *= 0x9E3779B1;
+	return nIdx ^ (nIdx >> 16);
 }
 /*
  * Check if a memory object [i.e: a variable] is already installed
@@ -9608,6 +12574,36 @@ static VmRefObj *VmRefObjExtract(ph7_vm *pVm, sxu32 nObjIdx) {
 	/* No such entry, return NULL */
 	return 0;
 }
+/*
+ * Check whether a memory object is shared, that is referenced by a variable
+ * or by more array entries than the given number [i.e: $x = &$a[0]; $b[] = &$a[0]; ].
+ * Used by the cycle collector, which does not account a shared memory object
+ * to the hashmap or the class instance holding it.
+ */
+PH7_PRIVATE int PH7_VmRefObjIsShared(ph7_vm *pVm, sxu32 nIdx, sxu32 nArrEntries) {
+	ph7_hashmap_node **apNode;
+	SyHashEntry **apEntry;
+	VmRefObj *pRef;
+	sxu32 n, nUsed;
+	pRef = VmRefObjExtract(&(*pVm), nIdx);
+	if(pRef == 0) {
+		return FALSE;
+	}
+	apEntry = (SyHashEntry **)SySetBasePtr(&pRef->aReference);
+	for(n = 0 ; n < SySetUsed(&pRef->aReference) ; ++n) {
+		if(apEntry[n]) {
+			return TRUE;
+		}
+	}
+	apNode = (ph7_hashmap_node **)SySetBasePtr(&pRef->aArrEntries);
+	nUsed = 0;
+	for(n = 0 ; n < SySetUsed(&pRef->aArrEntries) ; ++n) {
+		if(apNode[n]) {
+			nUsed++;
+		}
+	}
+	return nUsed > nArrEntries;
+}
 /*
  * Install a memory object [i.e: a variable] in the reference table.
  *
@@ -9687,6 +12683,10 @@ static sxi32 VmRefObjUnlink(ph7_vm *pVm, VmRefObj *pRef) {
 	/* Unlink the entry from the reference table */
 	for(n = 0 ; n < SySetUsed(&pRef->aReference) ; n++) {
 		if(apEntry[n]) {
+			if(apEntry[n] != pVm->pUnsetEntry) {
+				/* The entry may be cached in a variable slot */
+				pVm->nVarGen++;
+			}
 			SyHashDeleteEntry2(apEntry[n]);
 		}
 	}
@@ -87,6 +87,7 @@ typedef struct ph7_value ph7_value;
 typedef struct ph7_vfs ph7_vfs;
 typedef struct ph7_vm ph7_vm;
 typedef struct ph7 ph7;
+typedef struct ph7_mem_stat ph7_mem_stat;
 /* Symisc public definitions */
 #if defined (_WIN32) || defined (WIN32) || defined(__MINGW32__) || defined (_MSC_VER) || defined (_WIN32_WCE)
 	/* Windows Systems */
@@ -285,6 +286,36 @@ typedef sxi64 ph7_int64;
 #define PH7_CONFIG_ERR_ABORT     2  /* RESERVED FOR FUTURE USE */
 #define PH7_CONFIG_ERR_LOG       3  /* TWO ARGUMENTS: const char **pzBuf,int *pLen */
 #define PH7_CONFIG_MEM_LIMIT	 4  /* ONE ARGUMENT: char *nMemLimit */
+#define PH7_CONFIG_BYTECODE_CACHE 5 /* ONE ARGUMENT: int iMode */
+/*
+ * Bytecode cache modes.
+ *
+ * The following flags are passed to [ph7_config()] together with the
+ * PH7_CONFIG_BYTECODE_CACHE verb. When enabled, the compiled form of each
+ * script file is stored next to it [i.e: script.aer -> script.aerc] and
+ * reused as long as the source file contents did not change.
+ */
+#define PH7_CACHE_READ  0x01 /* Load up-to-date precompiled files */
+#define PH7_CACHE_WRITE 0x02 /* Store the freshly compiled files */
+/*
+ * Compile-time optimization levels.
+ *
+ * The following constants are passed as the last argument to the [ph7_vm_init()]
+ * interface and control the optimization pass run by the code generator.
+ * PH7_OPT_FOLD evaluates the operators applied to literals [i.e: 1 + 2 * 3,
+ * 'a' + 'b', (int)'7', 3 < 4] and drops the if/else branches whose condition
+ * is a literal. It also runs a peephole pass over each compiled function body,
+ * which fuses the most common instruction sequences into superinstructions and
+ * threads jumps to jumps, and specializes the arithmetic and comparison operators
+ * applied to integer or float variables and literals. PH7_OPT_CONSTANTS also replaces the constants created by the
+ * 'define' statement and the public class constants which hold a literal value
+ * [i.e: LIMIT, Config::MAX] by that value. It assumes that such a constant is not
+ * shadowed by a local 'const' statement compiled later on, nor redefined by the
+ * host application once the script is compiled.
+ */
+#define PH7_OPT_NONE      0 /* No optimization */
+#define PH7_OPT_FOLD      1 /* Constant folding, dead-branch elimination and peephole pass (default) */
+#define PH7_OPT_CONSTANTS 2 /* PH7_OPT_FOLD plus constant inlining */
 /*
  * Virtual Machine Configuration Commands.
  *
@@ -318,6 +349,68 @@ typedef sxi64 ph7_int64;
 #define PH7_VM_CONFIG_IO_STREAM       15  /* ONE ARGUMENT: const ph7_io_stream *pStream */
 #define PH7_VM_CONFIG_ARGV_ENTRY      16  /* ONE ARGUMENT: const char *zValue */
 #define PH7_VM_CONFIG_EXTRACT_OUTPUT  17  /* TWO ARGUMENTS: const void **ppOut,unsigned int *pOutputLen */
+#define PH7_VM_CONFIG_OUTPUT_BUFFER   18  /* TWO ARGUMENTS: unsigned int nSize,int iFlushPolicy */
+#define PH7_VM_CONFIG_ARENA           19  /* NO ARGUMENTS: Drop the runtime state wholesale, see below */
+#define PH7_VM_CONFIG_MEM_STATS       20  /* ONE ARGUMENT: ph7_mem_stat *aStat */
+#define PH7_VM_CONFIG_MEM_TAG_LIMIT   21  /* TWO ARGUMENTS: int iTag,ph7_int64 nLimit */
+/*
+ * Output buffer flush policies.
+ *
+ * The following constants are passed as the last argument to the [ph7_vm_config()]
+ * interface with a configuration verb set to PH7_VM_CONFIG_OUTPUT_BUFFER.
+ * The buffered output is handed to the output consumer callback when the buffer is
+ * full, when the script calls flush() or writes to php://stdout or php://stderr, and
+ * when the script terminates (including exit() and fatal errors). A buffer size
+ * of 0 (zero) flushes any pending output and disables buffering.
+ */
+#define PH7_OUTPUT_FLUSH_FULL 1 /* Flush only under the conditions above */
+#define PH7_OUTPUT_FLUSH_LINE 2 /* Also flush each time a new line is output [i.e: interactive terminal] */
+/*
+ * Arena mode.
+ *
+ * A virtual machine or an execution context configured with PH7_VM_CONFIG_ARENA
+ * carves its memory out of large regions, so it can drop its whole runtime state
+ * at once. When the script terminates, only the class instances still alive are
+ * released, so that their destructors get called, while the other values are
+ * dropped along with the VM by [ph7_vm_release()]. The contexts spawned from a
+ * program configured this way run in arena mode as well, and [ph7_vm_reset()]
+ * drops the runtime state of such a context and makes it ready to execute the
+ * program again without spawning a new one. It keeps the output consumer, the
+ * output buffer and the error reporting settings, anything else must be
+ * configured again.
+ */
+/*
+ * Memory accounting tags.
+ *
+ * Each chunk allocated by a virtual machine is charged to the subsystem it was
+ * allocated for. The host application retrieves the live and peak amount of
+ * memory held by each subsystem with the PH7_VM_CONFIG_MEM_STATS verb, which
+ * fills an array of PH7_MEM_TAG_COUNT ph7_mem_stat structures indexed by the
+ * following constants. The counted size of a chunk includes its allocator header,
+ * anything else in use by the VM [i.e: unused slab chunks and pool buckets] is
+ * not charged to any subsystem.
+ * PH7_VM_CONFIG_MEM_TAG_LIMIT sets a soft limit in bytes on one subsystem (0 for
+ * no limit). A script exceeding it gets an ErrorException, whose code is the
+ * subsystem tag, on its next call to a user-defined function. Unlike the hard limit set with
+ * PH7_CONFIG_MEM_LIMIT, the allocation itself succeeds and the exception is
+ * raised again only once the subsystem went below its limit meanwhile. The
+ * contexts spawned from a program inherit its soft limits.
+ */
+#define PH7_MEM_TAG_OTHER     0 /* Runtime structures not listed below [i.e: frames, symbol tables] */
+#define PH7_MEM_TAG_COMPILER  1 /* Tokens, syntax trees and declarations */
+#define PH7_MEM_TAG_BYTECODE  2 /* Compiled instructions */
+#define PH7_MEM_TAG_VALUES    3 /* Variables, array values and operand stacks */
+#define PH7_MEM_TAG_HASHMAPS  4 /* Arrays and their entries */
+#define PH7_MEM_TAG_STRINGS   5 /* String buffers */
+#define PH7_MEM_TAG_OBJECTS   6 /* Class instances and their attribute tables */
+#define PH7_MEM_TAG_IO        7 /* Stream and output buffers */
+#define PH7_MEM_TAG_MODULES   8 /* Allocations made while loading a module */
+#define PH7_MEM_TAG_COUNT     9
+struct ph7_mem_stat {
+	ph7_int64 nSize;  /* Live bytes */
+	ph7_int64 nPeak;  /* Peak live bytes */
+	ph7_int64 nLimit; /* Soft limit, 0 when unlimited */
+};
 /*
  * Global Library Configuration Commands.
  *
@@ -519,7 +612,7 @@ struct ph7_io_stream {
 PH7_APIEXPORT int ph7_init(ph7 **ppEngine);
 PH7_APIEXPORT int ph7_config(ph7 *pEngine, int nConfigOp, ...);
 PH7_APIEXPORT int ph7_release(ph7 *pEngine);
-PH7_APIEXPORT int ph7_vm_init(ph7 *pEngine, ph7_vm **ppOutVm, int bDebug);
+PH7_APIEXPORT int ph7_vm_init(ph7 *pEngine, ph7_vm **ppOutVm, int bDebug, int iOptLevel);
 /* Compile Interfaces */
 PH7_APIEXPORT int ph7_compile_code(ph7 *pEngine, const char *zSource, int nLen, ph7_vm **ppOutVm);
 PH7_APIEXPORT int ph7_compile_file(ph7 *pEngine, const char *zFilePath, ph7_vm **ppOutVm);
@@ -528,6 +621,7 @@ PH7_APIEXPORT int ph7_vm_config(ph7_vm *pVm, int iConfigOp, ...);
 PH7_APIEXPORT int ph7_vm_exec(ph7_vm *pVm, int *pExitStatus);
 PH7_APIEXPORT int ph7_vm_reset(ph7_vm *pVm);
 PH7_APIEXPORT int ph7_vm_release(ph7_vm *pVm);
+PH7_APIEXPORT int ph7_vm_spawn(ph7_vm *pProgram, ph7_vm **ppOutVm);
 PH7_APIEXPORT int ph7_vm_dump(ph7_vm *pVm, int (*xConsumer)(const void *, unsigned int, void *), void *pUserData);
 /* In-process Extending Interfaces */
 PH7_APIEXPORT int ph7_create_function(ph7_vm *pVm, const char *zName, int (*xFunc)(ph7_context *, int, ph7_value **), void *pUserData);
@@ -34,6 +34,18 @@
 	#define SMALLEST_INT64 (((sxi64)-1) - LARGEST_INT64)
 #endif
 
+/*
+ * Reentrant broken-down time conversion. Concurrent VMs must never share the
+ * static buffer returned by localtime() and gmtime() on UNIX systems.
+ */
+#ifdef __WINNT__
+	#define SyLocalTime(pTime, pTm) ((void)(pTm), localtime(pTime))
+	#define SyGmTime(pTime, pTm)    ((void)(pTm), gmtime(pTime))
+#else
+	#define SyLocalTime(pTime, pTm) localtime_r(pTime, pTm)
+	#define SyGmTime(pTime, pTm)    gmtime_r(pTime, pTm)
+#endif
+
 /* Forward declaration of private structures */
 typedef struct ph7_class_instance ph7_class_instance;
 typedef struct ph7_foreach_info   ph7_foreach_info;
@@ -206,6 +218,8 @@ struct SyBlob {
 #define SXBLOB_LOCKED	0x01	/* Blob is locked [i.e: Cannot auto grow] */
 #define SXBLOB_STATIC	0x02	/* Not allocated from heap   */
 #define SXBLOB_RDONLY   0x04    /* Read-Only data */
+#define SXBLOB_INTERN   0x08    /* Read-Only view of an interned string [i.e: PH7_VmInternString()] */
+#define SXBLOB_IO       0x10    /* Stream or output buffer, charged to PH7_MEM_TAG_IO */
 
 #define SyBlobFreeSpace(BLOB)	 ((BLOB)->mByte - (BLOB)->nByte)
 #define SyBlobLength(BLOB)	     ((BLOB)->nByte)
@@ -218,30 +232,93 @@ struct SyBlob {
 #define SXMEM_POOL_NBUCKETS		12
 #define SXMEM_BACKEND_MAGIC	0xBAC3E67D
 #define SXMEM_BACKEND_CORRUPT(BACKEND)	(BACKEND == 0 || BACKEND->nMagic != SXMEM_BACKEND_MAGIC)
+/*
+ * Chunks of up to SXMEM_SLAB_MAXALLOC bytes are served from slabs holding
+ * chunks of a single size class, one class per 8 bytes.
+ */
+#define SXMEM_SLAB_INCR			3
+#define SXMEM_SLAB_MAXALLOC		512
+#define SXMEM_SLAB_NCLASS		(SXMEM_SLAB_MAXALLOC >> SXMEM_SLAB_INCR)
 
 #define SXMEM_BACKEND_RETRY	3
 /* A memory backend subsystem is defined by an instance of the following structures */
-typedef union SyMemHeader SyMemHeader;
+typedef struct SyMemHeader SyMemHeader;
 typedef struct SyMemBlock SyMemBlock;
+typedef struct SyMemSlab SyMemSlab;
+typedef struct SyMemSlabClass SyMemSlabClass;
+typedef struct SyMemArena SyMemArena;
 struct SyMemBlock {
 	SyMemBlock *pNext, *pPrev; /* Chain of allocated memory blocks */
+	sxu32 iTag;               /* Accounting tag [i.e: PH7_MEM_TAG_VALUES] or SXMEM_TAG_NONE,
+							   * also keeps nGuard right before the chunk on all platforms.
+							   */
 	sxu32 nGuard;             /* magic number associated with each valid block,so we
 							   * can detect misuse.
 							   */
 };
 /*
- * Header associated with each valid memory pool block.
+ * Header associated with each valid memory pool or slab chunk. A released
+ * chunk holds a pointer to the next free chunk of its list instead of data.
+ */
+struct SyMemHeader {
+	sxu16 nBucket;      /* Bucket index in apPool[] or offset of the chunk in its slab */
+	sxu16 iTag;         /* Accounting tag */
+	sxu32 nGuard;       /* Pool or slab magic number */
+};
+/*
+ * A slab is a memory block divided into chunks of the same size class.
+ * Slabs having free chunks are linked to the list of their class, fully
+ * used slabs are unlinked and fully free ones are given back to the
+ * backend, except one per class kept for reuse.
+ */
+struct SyMemSlab {
+	SyMemSlab *pNext, *pPrev; /* Slabs of the same class having free chunks */
+	SyMemBackend *pBackend;   /* Backend owning this slab */
+	void *pFree;              /* List of released chunks */
+	sxu32 nCarved;            /* Chunks handed out at least once so far */
+	sxu32 nChunk;             /* Total number of chunks */
+	sxu32 nUsed;              /* Chunks in use */
+	sxu32 iClass;             /* Size class index */
+};
+/* Slabs of a single size class */
+struct SyMemSlabClass {
+	SyMemSlab *pSlab;         /* Slabs having free chunks */
+	sxu32 nSlab;              /* Total number of slabs */
+	sxu32 nEmpty;             /* Fully free slabs */
+};
+/*
+ * Large region the slabs and pool buckets of a backend in arena mode are
+ * carved out of.
  */
-union SyMemHeader {
-	SyMemHeader *pNext; /* Next chunk of size 1 << (nBucket + SXMEM_POOL_INCR) in the list */
-	sxu32 nBucket;      /* Bucket index in aPool[] */
+struct SyMemArena {
+	SyMemArena *pNext;        /* Next region */
+	sxu32 nSize;              /* Usable region size */
+	sxu32 nReserved;          /* Unused, keeps the region 8 bytes aligned */
 };
+/*
+ * Memory accounting
+ * Each chunk handed out by a backend records the tag it is charged to, so it
+ * is credited back to the same subsystem when freed. Reallocated chunks keep
+ * their tag. The blocks holding slabs and pool buckets are not charged to any
+ * tag (SXMEM_TAG_NONE).
+ */
+#define SXMEM_TAG_NONE 0xFFFF
+typedef struct SyMemTag SyMemTag;
+struct SyMemTag {
+	sxu64 nSize;   /* Live bytes */
+	sxu64 nPeak;   /* Peak live bytes */
+	sxu64 nLimit;  /* Soft limit, 0 when unlimited */
+};
+/* Charge the chunks allocated next from a backend to the given tag, saving the current one */
+#define SyMemBackendPushTag(BACKEND, TAG, SAVE) ((SAVE) = (BACKEND)->iTag, (BACKEND)->iTag = (TAG))
+#define SyMemBackendPopTag(BACKEND, SAVE)       ((BACKEND)->iTag = (SAVE))
 /* Heap allocation control structure */
 typedef struct SyMemHeap SyMemHeap;
 struct SyMemHeap {
        sxu64 nSize;      /* Current memory usage */
        sxu64 nPeak;      /* Peak memory usage */
        sxu64 nLimit;     /* Memory limit */
+       sxbool bThreadSafe; /* TRUE if the counters are updated by several threads */
 };
 /* Memory allocation backend container */
 struct SyMemBackend {
@@ -255,6 +332,17 @@ struct SyMemBackend {
 	SyMutex *pMutex;               /* Per instance mutex */
 	sxu32 nMagic;                  /* Sanity check against misuse */
 	SyMemHeader *apPool[SXMEM_POOL_NBUCKETS + SXMEM_POOL_INCR]; /* Pool of memory chunks */
+	SyMemSlabClass aSlab[SXMEM_SLAB_NCLASS]; /* Slab lists, one per size class */
+	SyMemArena *pArena;            /* Arena regions in use, the current one first */
+	SyMemArena *pArenaFree;        /* Arena regions kept for reuse [i.e: SyMemBackendRecycle()] */
+	char *zArena;                  /* Free space left in the current arena region */
+	char *zArenaEnd;               /* End of the current arena region */
+	sxu32 nArena;                  /* Total number of arena regions allocated so far */
+	sxbool bArena;                 /* TRUE if slabs and pool buckets are carved out of arena regions */
+	sxu32 iTag;                    /* Tag charged with the chunks allocated next [i.e: PH7_MEM_TAG_COMPILER] */
+	sxu32 iTagOver;                /* Tags above their soft limit, one bit per tag */
+	sxu32 iTagPending;             /* Tags which went above their soft limit since the last check */
+	SyMemTag aTag[PH7_MEM_TAG_COUNT]; /* Per subsystem accounting */
 };
 /* Mutex types */
 #define SXMUTEX_TYPE_FAST	1
@@ -265,6 +353,9 @@ struct SyMemBackend {
 #define SXMUTEX_TYPE_STATIC_4	6
 #define SXMUTEX_TYPE_STATIC_5	7
 #define SXMUTEX_TYPE_STATIC_6	8
+/* Threading levels [refer to ph7_lib_config()] */
+#define PH7_THREAD_LEVEL_SINGLE 1
+#define PH7_THREAD_LEVEL_MULTI  2
 
 #define SyMutexGlobalInit(METHOD){\
 		if( (METHOD)->xGlobalInit ){\
@@ -673,6 +764,19 @@ struct ph7_output_consumer {
 	ProcConsumer xDef;      /* Default output consumer routine */
 	void *pDefData;         /* Third argument to xDef() */
 };
+/*
+ * When enabled via the [PH7_VM_CONFIG_OUTPUT_BUFFER] configuration directive,
+ * the VM output is coalesced in an instance of the following structure and
+ * handed to the output consumer callback in large chunks.
+ */
+typedef struct VmOutputBuffer VmOutputBuffer;
+struct VmOutputBuffer {
+	SyBlob sBuf;            /* Pending output */
+	ProcConsumer xConsumer; /* Output consumer routine the buffer is flushed to */
+	void *pUserData;        /* Third argument to xConsumer() */
+	sxu32 nSize;            /* Buffer size, 0 (zero) when buffering is disabled */
+	sxi32 iPolicy;          /* Flush policy [i.e: PH7_OUTPUT_FLUSH_FULL or PH7_OUTPUT_FLUSH_LINE] */
+};
 /*
  * PH7 engine [i.e: ph7 instance] configuration is stored in
  * an instance of the following structure.
@@ -683,6 +787,7 @@ struct ph7_conf {
 	ProcConsumer xErr;   /* Compile-time error consumer callback */
 	void *pErrData;      /* Third argument to xErr() */
 	SyBlob sErrConsumer; /* Default error consumer */
+	sxi32 iCache;        /* Bytecode cache mode (PH7_CACHE_READ|PH7_CACHE_WRITE) */
 };
 /*
  * Signature of the C function responsible of expanding constant values.
@@ -708,7 +813,11 @@ struct ph7_constant {
 	SyString sName;        /* Constant name */
 	ProcConstant xExpand;  /* Function responsible of expanding constant value */
 	void *pUserData;       /* Last argument to xExpand() */
+	ph7_value *pValue;     /* Memoized value, NULL if not yet evaluated [refer to VmExpandConstant()] */
+	sxi32 iFlags;          /* Constant flags [i.e: PH7_CONST_VOLATILE] */
 };
+/* Constant flags */
+#define PH7_CONST_VOLATILE 0x01 /* Constant must be expanded on each access */
 typedef struct ph7_aux_data ph7_aux_data;
 /*
  * Auxiliary data associated with each foreign function is stored
@@ -751,6 +860,16 @@ struct ph7_context {
 	ph7_vm *pVm;            /* Virtual machine that own this context */
 	sxi32 iFlags;           /* Call flags */
 };
+/*
+ * Cycle collector bookkeeping of a hashmap or a class instance.
+ * Refer to the implementation of the cycle collector in 'gc.c' for more information.
+ */
+typedef struct VmGcNode VmGcNode;
+struct VmGcNode {
+	sxi32 iRef;   /* Reference count left once the references from the visited containers are subtracted */
+	sxu32 nRoot;  /* 1-based index in the buffer of possible roots, 0 when not buffered */
+	sxi32 iColor; /* Color assigned by the running collection [i.e: GC_BLACK] */
+};
 /*
  * Each hashmap entry [i.e: array(4,5,6)] is recorded in an instance
  * of the following structure.
@@ -774,7 +893,7 @@ struct ph7_hashmap_node {
  */
 struct ph7_hashmap {
 	ph7_vm *pVm;                  /* VM that own this instance */
-	ph7_hashmap_node **apBucket;  /* Hash bucket */
+	ph7_hashmap_node **apBucket;  /* Hash bucket, or nodes indexed by key when packed */
 	ph7_hashmap_node *pFirst;     /* First inserted entry */
 	ph7_hashmap_node *pLast;      /* Last inserted entry */
 	ph7_hashmap_node *pCur;       /* Current entry */
@@ -784,7 +903,12 @@ struct ph7_hashmap {
 	sxu32(*xBlobHash)(const void *, sxu32); /* Hash function for blob_keys */
 	sxi64 iNextIdx;               /* Next available automatically assigned index */
 	sxi32 iRef;                   /* Reference count */
+	sxi32 iFlags;                 /* Control flags [i.e: HASHMAP_PACKED] */
+	VmGcNode sGc;                 /* Cycle collector bookkeeping */
 };
+/* Hashmap control flags */
+#define HASHMAP_PACKED 0x01 /* Keys are 0..nEntry-1 integers, apBucket is a vector indexed by key */
+#define HASHMAP_BUSY   0x02 /* Entries being released or sorted, left alone by the cycle collector */
 /* An instance of the following structure is the context
  * for the FOREACH_STEP/FOREACH_INIT VM instructions.
  * Those instructions are used to implement the 'foreach'
@@ -796,6 +920,7 @@ struct ph7_foreach_info {
 	SyString sKey;      /* Key name. Empty otherwise*/
 	SyString sValue;    /* Value name */
 	ph7_hashmap *pMap;  /* Hashmap iteration */
+	ph7_hashmap_node *pCur; /* Loop cursor, the hashmap may be shared with other loops */
 };
 /*
  * Each PH7 engine is identified by an instance of the following structure.
@@ -808,6 +933,8 @@ struct ph7 {
 	ph7_conf xConf;              /* Configuration */
 	ph7_vm *pVms;      /* List of active VM */
 	sxi32 iVm;         /* Total number of active VM */
+	ph7_vm *pBuiltin;  /* Private VM holding the compiled built-in library */
+	SyMutex *pMutex;   /* Engine mutex [i.e: multi-thread mode only] */
 	ph7 *pNext, *pPrev; /* List of active engines */
 	sxu32 nMagic;      /* Sanity check against misuse */
 };
@@ -882,6 +1009,8 @@ struct ph7_gen_state {
 	SyHash hLiteral;     /* Constant string Literals table */
 	SyHash hNumLiteral;  /* Numeric literals table */
 	SyHash hVar;         /* Collected variable hashtable */
+	SyHash hConst;       /* Names declared by the 'const' statement */
+	SyHash hLocal;       /* Constants and classes defined by the compiled script */
 	GenBlock *pCurrent;  /* Current processed block */
 	GenBlock sGlobal;    /* Global block */
 	ProcConsumer xErr;   /* Error consumer callback */
@@ -895,6 +1024,9 @@ struct ph7_gen_state {
 	SyToken *pRawIn;     /* Current processed raw token */
 	SyToken *pRawEnd;    /* Last raw token in the stream */
 	SySet   *pTokenSet;  /* Token containers */
+	sxu32 nDiag;         /* Number of compile-time diagnostics emitted so far */
+	sxu32 nForeign;      /* Number of values inlined from another script so far */
+	sxu32 nClosure;      /* Number of closure names generated so far */
 };
 /* Forward references */
 typedef struct ph7_vm_func_closure_env ph7_vm_func_closure_env;
@@ -902,6 +1034,7 @@ typedef struct ph7_vm_func_static_var  ph7_vm_func_static_var;
 typedef struct ph7_vm_func_arg ph7_vm_func_arg;
 typedef struct ph7_vm_func ph7_vm_func;
 typedef struct VmFrame VmFrame;
+typedef struct VmStackChunk VmStackChunk;
 /*
  * Each collected function argument is recorded in an instance
  * of the following structure.
@@ -986,6 +1119,9 @@ struct ph7_vm_func {
 	ph7_class *pClass;   /* Class the method was declared */
 	SySet aByteCode;     /* Compiled function body */
 	SySet aClosureEnv;   /* Closure environment (ph7_vm_func_closure_env instace) */
+	SySet aVarSlot;      /* Variables resolved to a frame slot at compile-time (char * interned names) */
+	SySet aSlotType;     /* Declared type of each variable slot, used by the code generator only (sxu32 MEMOBJ_* flags) */
+	sxu32 nStack;        /* Operand stack size computed by the code generator [refer to PH7_VmStackSize()] */
 	sxi32 iFlags;        /* VM function configuration */
 	sxu32 nType;         /* Return data type expected by this function */
 	SyString sSignature; /* Function signature used to implement function overloading
@@ -1098,8 +1234,12 @@ struct ph7_class_instance {
 	ph7_class *pClass;  /* Object is an instance of this class */
 	SyHash hAttr;       /* Hashtable of active class members */
 	sxi32 iRef;         /* Reference count */
-	sxi32 iFlags;       /* Control flags */
+	sxi32 iFlags;       /* Control flags [i.e: CLASS_INSTANCE_DESTROYED] */
+	VmGcNode sGc;       /* Cycle collector bookkeeping */
 };
+/* Class instance control flags */
+#define CLASS_INSTANCE_DESTROYED 0x001 /* Instance is released */
+#define CLASS_INSTANCE_FINALIZED 0x002 /* Destructor already invoked by the cycle collector */
 /*
  * A single instruction of the virtual machine has an opcode
  * and as many as three operands.
@@ -1112,10 +1252,38 @@ struct VmInstr {
 	sxi32 iP1;       /* First operand */
 	sxu32 iP2;       /* Second operand (Often the jump destination) */
 	void *p3;        /* Third operand (Often Upper layer private data) */
-	sxbool bExec;    /* Whether the instruction has been already executed or not */
 	SyString *pFile; /* File name */
 	sxu32 iLine;     /* Line number */
 };
+/*
+ * Each running instance of the bytecode interpreter links an instance
+ * of the following structure on the VM, so the debugger and the error
+ * reporting routines can locate the instruction being executed by
+ * every active function without any per-instruction bookkeeping.
+ */
+typedef struct VmExecState VmExecState;
+struct VmExecState {
+	VmInstr *aInstr;    /* Bytecode program being executed */
+	VmInstr *pInstr;    /* Instruction being executed */
+	VmExecState *pPrev; /* Caller execution state */
+};
+/*
+ * A callback invoked many times by the same built-in function [i.e: usort(), array_map()]
+ * is prepared once using [PH7_VmPrepareCallback()] so that each invocation only
+ * loads its arguments before running the CALL instruction that is kept in the following
+ * structure. The operand stack is carved out of the VM call stack and released by
+ * [PH7_VmReleaseCallback()].
+ */
+typedef struct VmCallback VmCallback;
+struct VmCallback {
+	ph7_vm *pVm;               /* Target VM */
+	ph7_value *aStack;         /* Operand stack reused by each invocation, NULL if not callable */
+	ph7_class_instance *pThis; /* Bound instance [i.e: $this] if any */
+	VmInstr aInstr[2];         /* CALL,DONE program reused by each invocation */
+	SyBlob sName;              /* Function, closure or method name */
+	sxu32 nType;               /* Name type [i.e: MEMOBJ_STRING or MEMOBJ_CALL] */
+	int nArg;                  /* Total number of arguments */
+};
 /* Each active class instance attribute is represented by an instance
  * of the following structure.
  */
@@ -1124,6 +1292,31 @@ struct VmClassAttr {
 	ph7_class_attr *pAttr; /* Class attribute */
 	sxu32 nIdx;            /* Memory object index */
 };
+/*
+ * Method calls and attribute accesses [i.e: OP_MEMBER, OP_CALL] remember
+ * what they resolved to for the last few receiver classes, so a call site
+ * hit again with an already seen class skips the member name lookups and
+ * the overload selection. The bytecode may be shared by several execution
+ * contexts, so the caches are owned by the VM and indexed by the address
+ * of the instruction rather than stored in it.
+ */
+#define VM_INLINE_CACHE_SIZE 128 /* Total number of cached instructions, must be a power of two */
+#define VM_INLINE_CACHE_WAYS 4   /* Receivers remembered per instruction */
+typedef struct VmCacheEntry VmCacheEntry;
+struct VmCacheEntry {
+	SyString sName;        /* Member name [OP_MEMBER] or function key [OP_CALL] */
+	ph7_class *pClass;     /* Receiver class [OP_MEMBER only] */
+	void *pMember;         /* Resolved ph7_class_method, ph7_class_attr or ph7_vm_func */
+	ph7_vm_func *pTarget;  /* Selected overload [OP_CALL only]. NULL when it depends on the arguments type */
+	sxu32 nPos;            /* Attribute position in the instance frame [OP_MEMBER] or arguments count [OP_CALL] */
+};
+typedef struct VmInlineCache VmInlineCache;
+struct VmInlineCache {
+	const VmInstr *pInstr; /* Instruction owning this cache */
+	sxu32 nGen;            /* Value of ph7_vm.nCacheGen when the entries were resolved */
+	sxu32 nEntry;          /* Total number of used entries */
+	VmCacheEntry aEntry[VM_INLINE_CACHE_WAYS];
+};
 /* Forward reference */
 typedef struct VmRefObj VmRefObj;
 /*
@@ -1167,6 +1360,81 @@ struct ph7_switch {
 	SySet aCaseExpr;  /* Compile case block */
 	sxu32 nOut;       /* First instruction to execute after this statement */
 	sxu32 nDefault;   /* First instruction to execute in the default block */
+	sxu32 iKeyType;   /* MEMOBJ_INT or MEMOBJ_STRING when every case is a literal of that type */
+	SyHash hJump;     /* Case literal to first instruction lookup table */
+	sxi64 *aKey;      /* Integer keys referenced by hJump */
+	sxu32 *aJump;     /* Dense jump table for compact integer cases (0: no match) */
+	sxu32 nJump;      /* aJump[] length */
+	sxi64 iMin;       /* Smallest integer case, aJump[0] */
+};
+/*
+ * Strings shared by the hashmap keys, the literals and the variable names
+ * are interned in a per-VM table. Each interned string is represented by
+ * an instance of the following structure, immediately followed by the
+ * string contents. The hash is computed once [i.e: SyBinHash()] and reused
+ * by the hashmaps looking up an interned key.
+ */
+typedef struct VmString VmString;
+struct VmString {
+	VmString *pNextCollide; /* Collision chain */
+	sxu32 nHash;            /* String hash */
+	sxu32 nByte;            /* String length */
+	sxu32 nRef;             /* Reference count */
+};
+/*
+ * All variables and array values of a VM live in its object allocation table,
+ * where they are identified by their index [i.e: ph7_value.nIdx]. The table is
+ * made of fixed size chunks, so that reserving an object never moves the others,
+ * and each chunk keeps the stack of its free objects. The chunks holding free
+ * objects are linked together, the partially used ones first, and a chunk that
+ * becomes completely unused is returned to the allocator unless it is the only
+ * empty chunk left.
+ */
+#define VM_OBJ_CHUNK_SHIFT 9
+#define VM_OBJ_CHUNK_SIZE  (1 << VM_OBJ_CHUNK_SHIFT) /* Memory objects per chunk */
+#define VM_OBJ_CHUNK_MASK  (VM_OBJ_CHUNK_SIZE - 1)
+typedef struct VmObjChunk VmObjChunk;
+typedef struct VmObjTable VmObjTable;
+struct VmObjChunk {
+	ph7_value aObj[VM_OBJ_CHUNK_SIZE];        /* Memory objects */
+	sxu32 aFreeMap[VM_OBJ_CHUNK_SIZE / 32];   /* Bitmap of the free objects */
+	sxu16 aFree[VM_OBJ_CHUNK_SIZE];           /* Stack of the free objects offsets */
+	sxu32 nFree;                              /* Total number of free objects */
+	sxu32 iChunk;                             /* Chunk index in the directory */
+	VmObjChunk *pNext, *pPrev;                /* Chunks holding free objects */
+};
+struct VmObjTable {
+	VmObjChunk **apChunk; /* Chunk directory. NULL entries are released chunks */
+	sxu32 nChunk;         /* apChunk[] size */
+	sxu32 nAlloc;         /* Total number of allocated chunks */
+	sxu32 nEmpty;         /* Allocated chunks holding no object */
+	sxu32 nLive;          /* Total number of objects in use */
+	VmObjChunk *pFree;    /* First chunk holding free objects */
+	VmObjChunk *pLast;    /* Last chunk holding free objects */
+};
+/* Point to the memory object at the given index or return NULL if there is none */
+#define VmObjTableAt(TABLE, IDX) (((IDX) >> VM_OBJ_CHUNK_SHIFT) < (TABLE)->nChunk && (TABLE)->apChunk[(IDX) >> VM_OBJ_CHUNK_SHIFT] ? \
+		&(TABLE)->apChunk[(IDX) >> VM_OBJ_CHUNK_SHIFT]->aObj[(IDX) & VM_OBJ_CHUNK_MASK] : (ph7_value *)0)
+/*
+ * Objects and arrays referring to each other are released by the cycle collector
+ * implemented in 'gc.c'. The hashmaps and class instances whose reference count
+ * is decremented to a nonzero value are buffered as possible roots of a garbage
+ * cycle, and the roots are examined once their number reaches the threshold.
+ */
+typedef struct VmGcRoot VmGcRoot;
+typedef struct VmGc VmGc;
+struct VmGcRoot {
+	void *pObj;   /* Hashmap or class instance. NULL once released */
+	sxu32 nType;  /* MEMOBJ_HASHMAP or MEMOBJ_OBJ */
+};
+struct VmGc {
+	SySet aRoot;       /* Possible roots (VmGcRoot instances) */
+	sxu32 nRoot;       /* Total number of buffered roots */
+	sxu32 nThreshold;  /* Collect once that many roots are buffered */
+	sxu32 nRun;        /* Total number of collections */
+	sxi64 nCollected;  /* Total number of hashmaps and class instances released by the collector */
+	sxbool bEnabled;   /* TRUE when roots are buffered [i.e: gc_enable()] */
+	sxbool bRunning;   /* TRUE while a collection is in progress */
 };
 /* Assertion flags */
 #define PH7_ASSERT_DISABLE    0x01  /* Disable assertion */
@@ -1182,17 +1450,30 @@ struct ph7_switch {
 struct ph7_vm {
 	SyMemBackend sAllocator;	/* Memory backend */
 	ph7 *pEngine;               /* Interpreter that own this VM */
+	SyMutex *pMutex;            /* VM mutex [i.e: multi-thread mode only] */
 	SySet aInstrSet;            /* Instructions debugging container */
+	VmExecState *pExec;         /* Stack of running bytecode programs */
+	sxu32 nVarGen;              /* Variable slots generation, bumped when a cached entry may be stale */
+	VmStackChunk *pStackChunk;  /* Call stack the operand stacks are bump-allocated from */
+	VmStackChunk *pStackSpare;  /* Call stack chunk released by the last deep call */
+	VmFrame *pFrameFree;        /* Released frames ready for reuse */
+	sxu32 nFrameFree;           /* Total number of released frames */
+	VmInlineCache *aInlineCache; /* OP_MEMBER/OP_CALL inline caches, allocated on first use */
+	sxu32 nCacheGen;            /* Inline caches generation, bumped when classes or functions are installed */
+	SyHashEntry *pUnsetEntry;   /* Variable entry being released along with its frame */
 	SySet aByteCode;            /* Default bytecode container */
 	SySet *pByteContainer;      /* Current bytecode container */
 	VmFrame *pFrame;            /* Stack of active frames */
 	SyPRNGCtx sPrng;            /* PRNG context */
-	SySet aMemObj;              /* Object allocation table */
+	VmObjTable aMemObj;         /* Object allocation table */
 	SySet aLitObj;              /* Literals allocation table */
+	VmString **apString;        /* Interned strings hash table */
+	sxu32 nStringSize;          /* apString[] size */
+	sxu32 nString;              /* Total number of interned strings */
 	ph7_value *aOps;            /* Operand stack */
-	SySet aFreeObj;             /* Stack of free memory objects */
 	SyHash hClass;              /* Compiled classes container */
 	SyHash hConstant;           /* Host-application and user defined constants container */
+	SyHash hConstValue;         /* Memoized values (ph7_value *) of the constant expressions without side effects */
 	SyHash hHostFunction;       /* Host-application installable functions */
 	SyHash hFunction;           /* Compiled functions */
 	SyHash hSuper;              /* Superglobals hashtable */
@@ -1215,10 +1496,14 @@ struct ph7_vm {
 	void *pStderr;             /* STDERR IO stream */
 	sxbool bDebug;             /* TRUE to enable debugging */
 	sxbool bErrReport;         /* TRUE to report all runtime Error/Warning/Notice/Deprecated */
+	sxi32 iOptLevel;           /* Compile-time optimization level [i.e: PH7_OPT_FOLD] */
+	sxu32 nFusion;             /* Superinstructions emitted by the peephole optimizer */
+	sxu32 nThread;             /* Jumps threaded by the peephole optimizer */
 	int nExceptDepth;          /* Exception depth */
 	int closure_cnt;           /* Loaded closures counter */
 	int json_rc;               /* JSON return status [refer to json_encode()/json_decode()] */
 	ph7_output_consumer sVmConsumer; /* Registered output consumer callback */
+	VmOutputBuffer sOutput;          /* Output buffer [i.e: PH7_VM_CONFIG_OUTPUT_BUFFER] */
 	int iAssertFlags;          /* Assertion flags */
 	ph7_value sAssertCallback; /* Callback to call on failed assertions */
 	VmRefObj **apRefObj;       /* Hashtable of referenced object */
@@ -1228,6 +1513,11 @@ struct ph7_vm {
 	SySet aSelf;               /* 'self' stack used for static member access [i.e: self::MyConstant] */
 	sxi32 iExitStatus;         /* Script exit status */
 	ph7_gen_state sCodeGen;    /* Code generator module */
+	ph7_vm *pProgram;          /* Shared program executed by this context [i.e: ph7_vm_spawn()]. NULL otherwise */
+	SyHash hPrivate;           /* Private copies of the program records this context writes to */
+	sxu32 nContext;            /* Total number of active contexts executing this program */
+	sxbool bArena;             /* TRUE if the runtime state is dropped wholesale [i.e: PH7_VM_CONFIG_ARENA] */
+	VmGc sGc;                  /* Cycle collector */
 	ph7_vm *pNext, *pPrev;     /* List of active VMs */
 	sxu32 nMagic;              /* Sanity check against misuse */
 };
@@ -1235,6 +1525,30 @@ struct ph7_vm {
  * Each active virtual machine frame is represented by an instance of the following
  * structure. VM Frame hold local variables and other stuff related to function call.
  */
+/*
+ * Variables referenced by name in a function body are assigned a slot at
+ * compile-time. At run-time each slot caches the hash entry the variable
+ * resolved to, so LOADV and STORE do not have to hash the variable name
+ * and walk the frame chain on each access.
+ */
+typedef struct VmVarSlot VmVarSlot;
+/*
+ * The operand stacks of the active function calls are carved out of
+ * a per-VM call stack made of one or more chunks of initialized memory
+ * objects. A call bumps the top of the current chunk and the return
+ * pops it back, so no allocation is performed unless the call is
+ * deeper than any previous one.
+ */
+struct VmStackChunk {
+	VmStackChunk *pPrev; /* Chunk holding the stacks of the callers */
+	sxu32 nSize;         /* Total number of memory objects following this header */
+	sxu32 nUsed;         /* Memory objects in use */
+};
+struct VmVarSlot {
+	SyHashEntry *pEntry; /* Resolved variable entry. NULL if not yet resolved */
+	VmFrame *pFrame;     /* Frame holding the entry. NULL for superglobals */
+	sxu32 nGen;          /* Value of ph7_vm.nVarGen when the entry was resolved */
+};
 struct VmFrame {
 	VmFrame *pParent; /* Parent frame or NULL if global scope */
 	void *pUserData;  /* Upper layer private data associated with this frame */
@@ -1245,6 +1559,8 @@ struct VmFrame {
 	SyHash hVar;      /* Variable hashtable for fast lookup */
 	SySet sArg;       /* Function arguments container */
 	SySet sRef;       /* Local reference table (VmSlot instance) */
+	VmVarSlot *aVarSlot; /* Variable slots of the running function (shared with loop and exception frames) */
+	sxu32 nVarSlot;   /* Total number of variable slots */
 	sxi32 iFlags;     /* Frame configuration flags (See below) */
 	sxu32 iExceptionJump; /* Exception jump destination */
 };
@@ -1353,6 +1669,7 @@ struct VmShutdownCB {
 #define PH7_VM_RUN    0xEA271285  /* VM ready to execute PH7 bytecode */
 #define PH7_VM_EXEC   0xCAFE2DAD  /* VM executing PH7 bytecode */
 #define PH7_VM_STALE  0xBAD1DEAD  /* Stale VM */
+#define PH7_VM_SHARED 0x5A4EDC0D  /* Read-only program executed by contexts */
 /*
  * Error codes in the Aer language
  */
@@ -1456,6 +1773,34 @@ enum ph7_vm_op {
 	PH7_OP_POP_EXCEPTION, /* POP an exception */
 	PH7_OP_THROW,         /* Throw exception */
 	PH7_OP_SWITCH,        /* Switch operation */
+	/* Superinstructions emitted by the peephole optimizer [refer to PH7_VmPeephole()] */
+	PH7_OP_INCRV,         /* Increment a variable: LOADV, INCR, POP */
+	PH7_OP_DECRV,         /* Decrement a variable: LOADV, DECR, POP */
+	PH7_OP_CMPV_JMPZ,     /* Compare and jump on false: LOADV, LOADV|LOADC, LT..NEQ, JMPZ */
+	PH7_OP_ADDV,          /* Add a constant to a variable: LOADV, LOADC, ADD|SUB, STORE, POP */
+	PH7_OP_ADDV_STORE,    /* Add a constant to a variable: LOADC, LOADV, ADD_STORE|SUB_STORE, POP */
+	PH7_OP_LOADV_IDX,     /* Load array entry: LOADV, LOADV|LOADC, LOAD_IDX */
+	PH7_OP_ADD_INT,       /* Integer add '+' */
+	PH7_OP_SUB_INT,       /* Integer sub '-' */
+	PH7_OP_MUL_INT,       /* Integer multiplication '*' */
+	PH7_OP_ADD_REAL,      /* Float add '+' */
+	PH7_OP_SUB_REAL,      /* Float sub '-' */
+	PH7_OP_MUL_REAL,      /* Float multiplication '*' */
+	PH7_OP_DIV_REAL,      /* Float division '/' */
+	PH7_OP_LT_INT,        /* Integer less than '<' */
+	PH7_OP_LE_INT,        /* Integer less or equal '<=' */
+	PH7_OP_GT_INT,        /* Integer greater than '>' */
+	PH7_OP_GE_INT,        /* Integer greater or equal '>=' */
+	PH7_OP_EQ_INT,        /* Integer equal '==' */
+	PH7_OP_NEQ_INT,       /* Integer not equal '!=' */
+	PH7_OP_LT_REAL,       /* Float less than '<' */
+	PH7_OP_LE_REAL,       /* Float less or equal '<=' */
+	PH7_OP_GT_REAL,       /* Float greater than '>' */
+	PH7_OP_GE_REAL,       /* Float greater or equal '>=' */
+	PH7_OP_EQ_REAL,       /* Float equal '==' */
+	PH7_OP_NEQ_REAL,      /* Float not equal '!=' */
+	PH7_OP_INCR_INT,      /* Integer increment ++ */
+	PH7_OP_DECR_INT,      /* Integer decrement -- */
 };
 /* -- END-OF INSTRUCTIONS -- */
 /*
@@ -1653,9 +1998,15 @@ PH7_PRIVATE void PH7_VmReleaseContextValue(ph7_context *pCtx, ph7_value *pValue)
 PH7_PRIVATE sxi32 PH7_VmInitFuncState(ph7_vm *pVm, ph7_vm_func *pFunc, const char *zName, sxu32 nByte,
 									  sxi32 iFlags, void *pUserData);
 PH7_PRIVATE sxi32 PH7_VmInstallUserFunction(ph7_vm *pVm, ph7_vm_func *pFunc, SyString *pName);
+PH7_PRIVATE sxu32 PH7_VmStackSize(SySet *pByteCode);
+PH7_PRIVATE sxi32 PH7_VmSwitchTable(ph7_vm *pVm, ph7_switch *pSwitch);
+PH7_PRIVATE sxi32 PH7_VmFoldConstant(ph7_vm *pVm, VmInstr *aInstr, sxu32 nInstr, ph7_value *pResult);
+PH7_PRIVATE void PH7_VmPeephole(ph7_vm *pVm, SySet *pByteCode);
+PH7_PRIVATE sxi32 PH7_VmUnfuseInstr(sxi32 iOp);
 PH7_PRIVATE sxi32 PH7_VmCreateClassInstanceFrame(ph7_vm *pVm, ph7_class_instance *pObj);
 PH7_PRIVATE sxi32 PH7_VmRefObjRemove(ph7_vm *pVm, sxu32 nIdx, SyHashEntry *pEntry, ph7_hashmap_node *pMapEntry);
 PH7_PRIVATE sxi32 PH7_VmRefObjInstall(ph7_vm *pVm, sxu32 nIdx, SyHashEntry *pEntry, ph7_hashmap_node *pMapEntry, sxi32 iFlags);
+PH7_PRIVATE int PH7_VmRefObjIsShared(ph7_vm *pVm, sxu32 nIdx, sxu32 nArrEntries);
 PH7_PRIVATE sxi32 PH7_VmPushFilePath(ph7_vm *pVm, const char *zPath, int nLen, sxu8 bMain, sxi32 *pNew);
 PH7_PRIVATE ph7_class *PH7_VmExtractClass(ph7_vm *pVm, const char *zName, sxu32 nByte, sxi32 iLoadable);
 PH7_PRIVATE sxi32 PH7_VmRegisterConstant(ph7_vm *pVm, const SyString *pName, ProcConstant xExpand, void *pUserData, sxbool bGlobal);
@@ -1663,20 +2014,31 @@ PH7_PRIVATE sxi32 PH7_VmInstallForeignFunction(ph7_vm *pVm, const SyString *pNam
 PH7_PRIVATE sxi32 PH7_VmInstallClass(ph7_vm *pVm, ph7_class *pClass);
 PH7_PRIVATE sxi32 PH7_VmBlobConsumer(const void *pSrc, unsigned int nLen, void *pUserData);
 PH7_PRIVATE ph7_value *PH7_ReserveMemObj(ph7_vm *pVm);
+PH7_PRIVATE void PH7_VmRecycleMemObj(ph7_vm *pVm, sxu32 nIdx);
 PH7_PRIVATE ph7_value *PH7_ReserveConstObj(ph7_vm *pVm, sxu32 *pIndex);
+PH7_PRIVATE const char *PH7_VmInternString(ph7_vm *pVm, const char *zString, sxu32 nByte, sxu32 nHash);
+PH7_PRIVATE void PH7_VmReleaseString(ph7_vm *pVm, const char *zString);
+PH7_PRIVATE sxi32 PH7_VmInternBlob(ph7_vm *pVm, SyBlob *pBlob);
+PH7_PRIVATE sxu32 PH7_VmStringHash(const SyBlob *pBlob);
 PH7_PRIVATE sxi32 PH7_VmOutputConsume(ph7_vm *pVm, SyString *pString);
+PH7_PRIVATE sxi32 PH7_VmOutputFlush(ph7_vm *pVm);
 PH7_PRIVATE sxi32 PH7_VmOutputConsumeAp(ph7_vm *pVm, const char *zFormat, va_list ap);
 PH7_PRIVATE sxi32 PH7_VmMemoryError(ph7_vm *pVm);
 PH7_PRIVATE sxi32 PH7_VmThrowError(ph7_vm *pVm, sxi32 iErr, const char *zMessage, ...);
 PH7_PRIVATE void  PH7_VmExpandConstantValue(ph7_value *pVal, void *pUserData);
 PH7_PRIVATE sxi32 VmExtractDebugTrace(ph7_vm *pVm, SySet *pDebugTrace);
 PH7_PRIVATE sxi32 PH7_VmDump(ph7_vm *pVm, ProcConsumer xConsumer, void *pUserData);
-PH7_PRIVATE sxi32 PH7_VmInit(ph7_vm *pVm, ph7 *pEngine, sxbool bDebug);
+PH7_PRIVATE sxi32 PH7_VmInitBuiltin(ph7 *pEngine);
+PH7_PRIVATE ph7_user_func *PH7_VmExtractForeignFunction(ph7_vm *pVm, const char *zName, sxu32 nByte);
+PH7_PRIVATE ph7_constant *PH7_VmExtractConstant(ph7_vm *pVm, const char *zName, sxu32 nByte);
+PH7_PRIVATE sxi32 PH7_VmInit(ph7_vm *pVm, ph7 *pEngine, sxbool bDebug, sxi32 iOptLevel);
 PH7_PRIVATE sxi32 PH7_VmConfigure(ph7_vm *pVm, sxi32 nOp, va_list ap);
 PH7_PRIVATE sxi32 PH7_VmByteCodeExec(ph7_vm *pVm);
 PH7_PRIVATE sxi32 PH7_VmRelease(ph7_vm *pVm);
 PH7_PRIVATE sxi32 PH7_VmReset(ph7_vm *pVm);
 PH7_PRIVATE sxi32 PH7_VmMakeReady(ph7_vm *pVm);
+PH7_PRIVATE sxi32 PH7_VmSpawn(ph7_vm *pProgram, ph7_vm *pVm);
+PH7_PRIVATE void *PH7_VmPrivateRecord(ph7_vm *pVm, void *pRecord, sxu32 nByte);
 PH7_PRIVATE sxu32 PH7_VmInstrLength(ph7_vm *pVm);
 PH7_PRIVATE VmInstr *PH7_VmPopInstr(ph7_vm *pVm);
 PH7_PRIVATE VmInstr *PH7_VmPeekInstr(ph7_vm *pVm);
@@ -1690,6 +2052,9 @@ PH7_PRIVATE sxi32 PH7_VmCallClassMethod(ph7_vm *pVm, ph7_class_instance *pThis,
 										ph7_value *pResult, int nArg, ph7_value **apArg);
 PH7_PRIVATE sxi32 PH7_VmCallUserFunction(ph7_vm *pVm, ph7_value *pFunc, int nArg, ph7_value **apArg, ph7_value *pResult);
 PH7_PRIVATE sxi32 PH7_VmCallUserFunctionAp(ph7_vm *pVm, ph7_value *pFunc, ph7_value *pResult, ...);
+PH7_PRIVATE sxi32 PH7_VmPrepareCallback(ph7_vm *pVm, ph7_value *pFunc, int nArg, VmCallback *pCb);
+PH7_PRIVATE sxi32 PH7_VmInvokeCallback(VmCallback *pCb, ph7_value **apArg, ph7_value *pResult);
+PH7_PRIVATE void PH7_VmReleaseCallback(VmCallback *pCb);
 PH7_PRIVATE sxi32 PH7_VmUnsetMemObj(ph7_vm *pVm, sxu32 nObjIdx, int bForce);
 PH7_PRIVATE sxi32 PH7_VmDestroyMemObj(ph7_vm *pVm, ph7_value *pObj);
 PH7_PRIVATE void PH7_VmRandomString(ph7_vm *pVm, char *zBuf, int nLen);
@@ -1719,6 +2084,13 @@ PH7_PRIVATE sxi32 PH7_InitCodeGenerator(ph7_vm *pVm, ProcConsumer xErr, void *pE
 PH7_PRIVATE sxi32 PH7_ResetCodeGenerator(ph7_vm *pVm, ProcConsumer xErr, void *pErrData);
 PH7_PRIVATE sxi32 PH7_GenCompileError(ph7_gen_state *pGen, sxi32 nErrType, sxu32 nLine, const char *zFormat, ...);
 PH7_PRIVATE sxi32 PH7_CompileAerScript(ph7_vm *pVm, SyString *pScript, sxi32 iFlags);
+/* cache.c function prototypes */
+PH7_PRIVATE sxi32 PH7_CompileCachedScript(ph7_vm *pVm, SyString *pScript, sxi32 iFlags);
+/* gc.c function prototypes */
+PH7_PRIVATE void PH7_GcInit(ph7_vm *pVm);
+PH7_PRIVATE void PH7_GcAddRoot(ph7_vm *pVm, void *pObj, sxu32 nType);
+PH7_PRIVATE void PH7_GcRemoveRoot(ph7_vm *pVm, VmGcNode *pNode);
+PH7_PRIVATE sxu32 PH7_GcCollect(ph7_vm *pVm);
 /* constant.c function prototypes */
 PH7_PRIVATE void PH7_RegisterBuiltInConstant(ph7_vm *pVm);
 /* builtin.c function prototypes */
@@ -1733,6 +2105,7 @@ PH7_PRIVATE sxi32 PH7_HashmapInsert(ph7_hashmap *pMap, ph7_value *pKey, ph7_valu
 PH7_PRIVATE sxi32 PH7_HashmapUnion(ph7_hashmap *pLeft, ph7_hashmap *pRight);
 PH7_PRIVATE void PH7_HashmapUnlinkNode(ph7_hashmap_node *pNode, int bRestore);
 PH7_PRIVATE sxi32 PH7_HashmapDup(ph7_hashmap *pSrc, ph7_hashmap *pDest);
+PH7_PRIVATE ph7_hashmap *PH7_HashmapSeparate(ph7_value *pValue);
 PH7_PRIVATE sxi32 PH7_HashmapCmp(ph7_hashmap *pLeft, ph7_hashmap *pRight, int bStrict);
 PH7_PRIVATE void PH7_HashmapResetLoopCursor(ph7_hashmap *pMap);
 PH7_PRIVATE ph7_hashmap_node *PH7_HashmapGetNextEntry(ph7_hashmap *pMap);
@@ -1783,6 +2156,8 @@ PH7_PRIVATE sxi32 PH7_StreamReadWholeFile(void *pHandle, const ph7_io_stream *pS
 PH7_PRIVATE void PH7_StreamCloseHandle(const ph7_io_stream *pStream, void *pHandle);
 PH7_PRIVATE const char *PH7_ExtractDirName(const char *zPath, int nByte, int *pLen);
 PH7_PRIVATE sxi32 PH7_RegisterIORoutine(ph7_vm *pVm);
+PH7_PRIVATE sxi32 PH7_RegisterIOStream(ph7_vm *pVm);
+PH7_PRIVATE const ph7_io_stream *PH7_ExportFileStream(void);
 PH7_PRIVATE const ph7_vfs *PH7_ExportBuiltinVfs(void);
 PH7_PRIVATE void *PH7_ExportStdin(ph7_vm *pVm);
 PH7_PRIVATE void *PH7_ExportStdout(ph7_vm *pVm);
@@ -1831,12 +2206,15 @@ PH7_PRIVATE SyHashEntry *SyHashLastEntry(SyHash *pHash);
 PH7_PRIVATE sxi32 SyHashInsert(SyHash *pHash, const void *pKey, sxu32 nKeyLen, void *pUserData);
 PH7_PRIVATE sxi32 SyHashForEach(SyHash *pHash, sxi32(*xStep)(SyHashEntry *, void *), void *pUserData);
 PH7_PRIVATE SyHashEntry *SyHashGetNextEntry(SyHash *pHash);
+PH7_PRIVATE SyHashEntry *SyHashNextEntry(SyHash *pHash, SyHashEntry *pEntry);
 PH7_PRIVATE sxi32 SyHashResetLoopCursor(SyHash *pHash);
 PH7_PRIVATE sxi32 SyHashDeleteEntry2(SyHashEntry *pEntry);
 PH7_PRIVATE sxi32 SyHashDeleteEntry(SyHash *pHash, const void *pKey, sxu32 nKeyLen, void **ppUserData);
 PH7_PRIVATE SyHashEntry *SyHashGet(SyHash *pHash, const void *pKey, sxu32 nKeyLen);
 PH7_PRIVATE sxi32 SyHashRelease(SyHash *pHash);
+PH7_PRIVATE sxi32 SyHashReset(SyHash *pHash);
 PH7_PRIVATE sxi32 SyHashInit(SyHash *pHash, SyMemBackend *pAllocator, ProcHash xHash, ProcCmp xCmp);
+PH7_PRIVATE sxu32 SyBinHash(const void *pSrc, sxu32 nLen);
 PH7_PRIVATE sxu32 SyStrHash(const void *pSrc, sxu32 nLen);
 PH7_PRIVATE void *SySetAt(SySet *pSet, sxu32 nIdx);
 PH7_PRIVATE void *SySetPop(SySet *pSet);
@@ -1848,9 +2226,9 @@ PH7_PRIVATE sxi32 SySetGetNextEntry(SySet *pSet, void **ppEntry);
 PH7_PRIVATE void *SySetPeekCurrentEntry(SySet *pSet);
 PH7_PRIVATE sxi32 SySetTruncate(SySet *pSet, sxu32 nNewSize);
 PH7_PRIVATE sxi32 SySetAlloc(SySet *pSet, sxi32 nItem);
+PH7_PRIVATE sxi32 SySetReserve(SySet *pSet, sxu32 nItem);
 PH7_PRIVATE sxi32 SySetPut(SySet *pSet, const void *pItem);
 PH7_PRIVATE sxi32 SySetInit(SySet *pSet, SyMemBackend *pAllocator, sxu32 ElemSize);
-PH7_PRIVATE sxi32 SyBlobSearch(const void *pBlob, sxu32 nLen, const void *pPattern, sxu32 pLen, sxu32 *pOfft);
 PH7_PRIVATE sxi32 SyBlobRelease(SyBlob *pBlob);
 PH7_PRIVATE sxi32 SyBlobReset(SyBlob *pBlob);
 PH7_PRIVATE sxi32 SyBlobCmp(SyBlob *pLeft, SyBlob *pRight);
@@ -1866,6 +2244,13 @@ PH7_PRIVATE sxi32 SyMemBackendRelease(SyMemBackend *pBackend);
 PH7_PRIVATE sxi32 SyMemBackendInitFromOthers(SyMemBackend *pBackend, const SyMemMethods *pMethods, ProcMemError xMemErr, void *pUserData);
 PH7_PRIVATE sxi32 SyMemBackendInit(SyMemBackend *pBackend, ProcMemError xMemErr, void *pUserData);
 PH7_PRIVATE sxi32 SyMemBackendInitFromParent(SyMemBackend *pBackend, SyMemBackend *pParent);
+PH7_PRIVATE sxi32 SyMemBackendMakeThreadSafe(SyMemBackend *pBackend, const SyMutexMethods *pMethods);
+PH7_PRIVATE sxi32 SyMemBackendDisableMutexing(SyMemBackend *pBackend);
+PH7_PRIVATE sxi32 SyMemBackendEnableArena(SyMemBackend *pBackend);
+PH7_PRIVATE sxi32 SyMemBackendRecycle(SyMemBackend *pBackend);
+PH7_PRIVATE sxi32 SyMemBackendSetTagLimit(SyMemBackend *pBackend, sxu32 iTag, sxu64 nLimit);
+PH7_PRIVATE sxu64 SyMemBackendHeapUsage(SyMemBackend *pBackend, sxu64 *pPeak);
+PH7_PRIVATE const SyMutexMethods *SyMutexExportMethods(void);
 PH7_PRIVATE void *SyMemBackendPoolRealloc(SyMemBackend *pBackend, void *pOld, sxu32 nByte);
 PH7_PRIVATE sxi32 SyMemBackendPoolFree(SyMemBackend *pBackend, void *pChunk);
 PH7_PRIVATE void *SyMemBackendPoolAlloc(SyMemBackend *pBackend, sxu32 nBytes);
@@ -1878,11 +2263,15 @@ PH7_PRIVATE void SyZero(void *pSrc, sxu32 nSize);
 PH7_PRIVATE sxi32 SyStrnicmp(const char *zLeft, const char *zRight, sxu32 SLen);
 PH7_PRIVATE sxi32 SyStrnmicmp(const void *pLeft, const void *pRight, sxu32 SLen);
 PH7_PRIVATE sxi32 SyStrncmp(const char *zLeft, const char *zRight, sxu32 nLen);
+PH7_PRIVATE sxi32 SyBlobSearchNoCase(const void *pBlob, sxu32 nLen, const void *pPattern, sxu32 pLen, sxu32 *pOfft);
+PH7_PRIVATE sxi32 SyBlobSearch(const void *pBlob, sxu32 nLen, const void *pPattern, sxu32 pLen, sxu32 *pOfft);
+PH7_PRIVATE sxu32 SyByteCount(const char *zStr, sxu32 nLen, sxi32 c);
 PH7_PRIVATE sxi32 SyByteListFind(const char *zSrc, sxu32 nLen, const char *zList, sxu32 *pFirstPos);
 PH7_PRIVATE sxi32 SyByteFind2(const char *zStr, sxu32 nLen, sxi32 c, sxu32 *pPos);
 PH7_PRIVATE sxi32 SyByteFind(const char *zStr, sxu32 nLen, sxi32 c, sxu32 *pPos);
 PH7_PRIVATE sxu32 SyStrlen(const char *zSrc);
+PH7_PRIVATE void SyStrInitSimd(void);
 PH7_PRIVATE sxu32 Systrcpy(char *zDest, sxu32 nDestLen, const char *zSrc, sxu32 nLen);
-PH7_PRIVATE char *SyStrtok(char *str, const char *sep);
+PH7_PRIVATE char *SyStrtok(char *str, const char *sep, char **pzSave);
 PH7_PRIVATE sxi32 SyAsciiToHex(sxi32 c);
 #endif /* __PH7INT_H__ */
@@ -385,6 +385,7 @@ static int vm_builtin_json_last_error(ph7_context *pCtx, int nArg, ph7_value **a
 static sxi32 VmJsonTokenize(SyStream *pStream, SyToken *pToken, void *pUserData, void *pCtxData) {
 	int *pJsonErr = (int *)pUserData;
 	SyString *pStr;
+	sxu32 nPos;
 	int c;
 	/* Ignore leading white spaces */
 	while(pStream->zText < pStream->zEnd && pStream->zText[0] < 0xc0 && SyisSpace(pStream->zText[0])) {
@@ -440,6 +441,11 @@ static sxi32 VmJsonTokenize(SyStream *pStream, SyToken *pToken, void *pUserData,
 		pStr->zString++;
 		/* Delimit the string */
 		while(pStream->zText < pStream->zEnd) {
+			if(SyByteListFind((const char *)pStream->zText, (sxu32)(pStream->zEnd - pStream->zText), "\"\n", &nPos) != SXRET_OK) {
+				pStream->zText = pStream->zEnd;
+				break;
+			}
+			pStream->zText += nPos;
 			if(pStream->zText[0] == '"' && pStream->zText[-1] != '\\') {
 				break;
 			}
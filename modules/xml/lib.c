@@ -8,6 +8,24 @@
  */
 #include "lib.h"
 
+/*
+ * Advance the stream cursor to the next occurrence of the given delimiter,
+ * or to the last nDelim - 1 bytes of the input when there is none, updating
+ * the line counter on the way.
+ */
+static void XML_SkipTo(SyStream *pStream, const char *zDelim, sxu32 nDelim) {
+	const unsigned char *zPtr = pStream->zText;
+	sxu32 nOfft;
+	if(XLEX_IN_LEN(pStream) < nDelim) {
+		return;
+	}
+	if(SyBlobSearch(pStream->zText, XLEX_IN_LEN(pStream), zDelim, nDelim, &nOfft) == SXRET_OK) {
+		pStream->zText += nOfft;
+	} else {
+		pStream->zText = pStream->zEnd - (nDelim - 1);
+	}
+	pStream->nLine += SyByteCount((const char *)zPtr, (sxu32)(pStream->zText - zPtr), '\n');
+}
 /* Tokenize an entire XML input */
 static sxi32 XML_Tokenize(SyStream *pStream, SyToken *pToken, void *pUserData, void *pUnused2) {
 	SyXMLParser *pParse = (SyXMLParser *)pUserData;
@@ -54,14 +72,7 @@ static sxi32 XML_Tokenize(SyStream *pStream, SyToken *pToken, void *pUserData, v
 			pStream->zText++;
 			pStr->zString++;
 			pToken->nType = SXML_TOK_PI;
-			while(XLEX_IN_LEN(pStream) >= sizeof("?>") - 1 &&
-					SyMemcmp((const void *)pStream->zText, "?>", sizeof("?>") - 1) != 0) {
-				if(pStream->zText[0] == '\n') {
-					/* Increment line counter */
-					pStream->nLine++;
-				}
-				pStream->zText++;
-			}
+			XML_SkipTo(pStream, "?>", sizeof("?>") - 1);
 			/* Record token length */
 			pStr->nByte = (sxu32)((const char *)pStream->zText - pStr->zString);
 			if(XLEX_IN_LEN(pStream) < sizeof("?>") - 1) {
@@ -79,14 +90,7 @@ static sxi32 XML_Tokenize(SyStream *pStream, SyToken *pToken, void *pUserData, v
 			if(XLEX_IN_LEN(pStream) >= sizeof("--") - 1 && pStream->zText[0] == '-' && pStream->zText[1] == '-') {
 				/* Comment */
 				pStream->zText += sizeof("--") - 1;
-				while(XLEX_IN_LEN(pStream) >= sizeof("-->") - 1 &&
-						SyMemcmp((const void *)pStream->zText, "-->", sizeof("-->") - 1) != 0) {
-					if(pStream->zText[0] == '\n') {
-						/* Increment line counter */
-						pStream->nLine++;
-					}
-					pStream->zText++;
-				}
+				XML_SkipTo(pStream, "-->", sizeof("-->") - 1);
 				pStream->zText += sizeof("-->") - 1;
 				/* Tell the lexer to ignore this token */
 				return SXERR_CONTINUE;
@@ -95,14 +99,7 @@ static sxi32 XML_Tokenize(SyStream *pStream, SyToken *pToken, void *pUserData, v
 				/* CDATA */
 				pStream->zText += sizeof("[CDATA[") - 1;
 				pStr->zString = (const char *)pStream->zText;
-				while(XLEX_IN_LEN(pStream) >= sizeof("]]>") - 1 &&
-						SyMemcmp((const void *)pStream->zText, "]]>", sizeof("]]>") - 1) != 0) {
-					if(pStream->zText[0] == '\n') {
-						/* Increment line counter */
-						pStream->nLine++;
-					}
-					pStream->zText++;
-				}
+				XML_SkipTo(pStream, "]]>", sizeof("]]>") - 1);
 				/* Record token type and length */
 				pStr->nByte = (sxu32)((const char *)pStream->zText - pStr->zString);
 				pToken->nType = SXML_TOK_CDATA;
@@ -139,14 +136,7 @@ static sxi32 XML_Tokenize(SyStream *pStream, SyToken *pToken, void *pUserData, v
 					SyStringInitFromBuf(&sDelim, "]>", sizeof("]>") - 1);
 				}
 				if(c != '>') {
-					while(XLEX_IN_LEN(pStream) >= sDelim.nByte &&
-							SyMemcmp((const void *)pStream->zText, sDelim.zString, sDelim.nByte) != 0) {
-						if(pStream->zText[0] == '\n') {
-							/* Increment line counter */
-							pStream->nLine++;
-						}
-						pStream->zText++;
-					}
+					XML_SkipTo(pStream, sDelim.zString, sDelim.nByte);
 				}
 				/* Record token type and length */
 				pStr->nByte = (sxu32)((const char *)pStream->zText - pStr->zString);
@@ -259,23 +249,21 @@ static sxi32 XML_Tokenize(SyStream *pStream, SyToken *pToken, void *pUserData, v
 			}
 		}
 	} else {
-		/* Raw input */
+		sxu32 nOfft;
+		/* Raw input. Neither '<' nor a new line can appear inside a UTF-8 sequence */
 		while(pStream->zText < pStream->zEnd) {
-			c = pStream->zText[0];
-			if(c < 0xc0) {
-				if(c == '<') {
-					break;
-				} else if(c == '\n') {
-					/* Increment line counter */
-					pStream->nLine++;
-				}
-				/* Advance the stream cursor */
-				pStream->zText++;
-			} else {
-				/* UTF-8 stream */
-				pStream->zText++;
-				SX_JMP_UTF8(pStream->zText, pStream->zEnd);
+			if(SyByteListFind((const char *)pStream->zText, XLEX_IN_LEN(pStream), "<\n", &nOfft) != SXRET_OK) {
+				pStream->zText = pStream->zEnd;
+				break;
 			}
+			pStream->zText += nOfft;
+			if(pStream->zText[0] == '<') {
+				break;
+			}
+			/* Increment line counter */
+			pStream->nLine++;
+			/* Advance the stream cursor */
+			pStream->zText++;
 		}
 		/* Record token type,length */
 		pToken->nType = SXML_TOK_RAW;
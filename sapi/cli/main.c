@@ -35,10 +35,14 @@ static const char zBanner[] = {
  */
 static void Help(void) {
 	puts(zBanner);
-	puts("aer [-h|-r|-d] path/to/aer_file [script args]");
+	puts("aer [-h|-r|-d|-c|-O<level>] path/to/aer_file [script args]");
+	puts("aer -p path/to/directory");
+	puts("\t-c: Use and refresh the precompiled byte-code (.aerc) files");
 	puts("\t-d: Dump PH7 Engine byte-code instructions");
+	puts("\t-p: Precompile all AER files found in the given directory");
 	puts("\t-r: Report run-time errors");
 	puts("\t-m: Set memory limit");
+	puts("\t-O: Set optimization level [0: none, 1: constant folding and superinstructions (default), 2: constant inlining]");
 	puts("\t-h: Display this message an exit");
 	/* Exit immediately */
 	exit(0);
@@ -48,6 +52,9 @@ static void Help(void) {
 #else
 	/* Assume UNIX */
 	#include <unistd.h>
+	#include <dirent.h>
+	#include <sys/stat.h>
+	#include <sys/wait.h>
 #endif
 /*
  * The following define is used by the UNIX built and have
@@ -56,6 +63,11 @@ static void Help(void) {
 #ifndef STDOUT_FILENO
 	#define STDOUT_FILENO	1
 #endif
+/*
+ * Size of the VM output buffer. The script output is written to STDOUT in
+ * chunks of up to this size rather than once per echoed value.
+ */
+#define OUTPUT_BUFFER_SIZE 65536
 /*
  * VM output consumer callback.
  * Each time the virtual machine generates some outputs,the following
@@ -85,6 +97,115 @@ static int Output_Consumer(const void *pOutput, unsigned int nOutputLen, void *p
 	/* All done,VM output was redirected to STDOUT */
 	return PH7_OK;
 }
+/*
+ * Compile a single AER file and store its byte-code next to it.
+ * A compile-time error terminates the whole process, thus on UNIX systems
+ * each file is compiled in a child process so that the remaining files
+ * still get precompiled.
+ * Return the number of files that failed to compile.
+ */
+static int PrecompileFile(ph7 *pEngine, const char *zPath, int iOptLevel) {
+	ph7_vm *pVm;
+	int rc;
+#ifndef __WINNT__
+	pid_t pid;
+	int status;
+	/* Do not let the child flush our pending output a second time */
+	fflush(stdout);
+	pid = fork();
+	if(pid > 0) {
+		if(waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			printf("Failed to precompile: %s\n", zPath);
+			fflush(stdout);
+			return 1;
+		}
+		return 0;
+	}
+	/* Compile in the current process if fork() failed */
+#endif /* __WINNT__ */
+	rc = ph7_vm_init(pEngine, &pVm, 0, iOptLevel);
+	if(rc != PH7_OK) {
+		Fatal("VM initialization error");
+	}
+	ph7_vm_config(pVm, PH7_VM_CONFIG_OUTPUT, Output_Consumer, 0);
+	rc = ph7_compile_file(pEngine, zPath, &pVm);
+	ph7_vm_release(pVm);
+#ifndef __WINNT__
+	if(pid == 0) {
+		/* Child process, report the result to the parent */
+		_exit(rc == PH7_OK ? 0 : 1);
+	}
+#endif /* __WINNT__ */
+	if(rc != PH7_OK) {
+		printf("Failed to precompile: %s\n", zPath);
+		return 1;
+	}
+	return 0;
+}
+/*
+ * Walk the given directory recursively and precompile all AER files found there.
+ * Return the number of files that failed to compile.
+ */
+static int PrecompileDirectory(ph7 *pEngine, const char *zDir, int iOptLevel) {
+	char zPath[4096];
+	int nErr = 0;
+	int nLen;
+#ifdef __WINNT__
+	WIN32_FIND_DATAA sEntry;
+	HANDLE hFind;
+	snprintf(zPath, sizeof(zPath), "%s\\*", zDir);
+	hFind = FindFirstFileA(zPath, &sEntry);
+	if(hFind == INVALID_HANDLE_VALUE) {
+		return 0;
+	}
+	do {
+		const char *zName = sEntry.cFileName;
+		if(zName[0] == '.') {
+			/* Skip '.', '..' and hidden entries */
+			continue;
+		}
+		snprintf(zPath, sizeof(zPath), "%s\\%s", zDir, zName);
+		if(sEntry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			nErr += PrecompileDirectory(pEngine, zPath, iOptLevel);
+			continue;
+		}
+		nLen = (int)SyStrlen(zName);
+		if(nLen > 4 && SyStrnicmp(&zName[nLen - 4], ".aer", sizeof(".aer") - 1) == 0) {
+			nErr += PrecompileFile(pEngine, zPath, iOptLevel);
+		}
+	} while(FindNextFileA(hFind, &sEntry));
+	FindClose(hFind);
+#else
+	struct dirent *pEntry;
+	struct stat sStat;
+	DIR *pDir;
+	pDir = opendir(zDir);
+	if(pDir == 0) {
+		return 0;
+	}
+	while((pEntry = readdir(pDir)) != 0) {
+		const char *zName = pEntry->d_name;
+		if(zName[0] == '.') {
+			/* Skip '.', '..' and hidden entries */
+			continue;
+		}
+		snprintf(zPath, sizeof(zPath), "%s/%s", zDir, zName);
+		if(stat(zPath, &sStat) != 0) {
+			continue;
+		}
+		if(S_ISDIR(sStat.st_mode)) {
+			nErr += PrecompileDirectory(pEngine, zPath, iOptLevel);
+			continue;
+		}
+		nLen = (int)SyStrlen(zName);
+		if(S_ISREG(sStat.st_mode) && nLen > 4 && SyStrnicmp(&zName[nLen - 4], ".aer", sizeof(".aer") - 1) == 0) {
+			nErr += PrecompileFile(pEngine, zPath, iOptLevel);
+		}
+	}
+	closedir(pDir);
+#endif /* __WINNT__ */
+	return nErr;
+}
 /*
  * Main program: Compile and execute the PHP file.
  */
@@ -92,8 +213,12 @@ int main(int argc, char **argv) {
 	ph7 *pEngine; /* PH7 engine */
 	ph7_vm *pVm;  /* Compiled PHP program */
 	char *sLimitArg = NULL; /* Memory limit */
+	const char *zPrecompile = NULL; /* Directory to precompile */
 	int dump_vm = 0;    /* Dump VM instructions if TRUE */
+	int cache = 0;      /* Use the byte-code cache if TRUE */
 	int err_report = 0; /* Report run-time errors if TRUE */
+	int opt_level = PH7_OPT_FOLD; /* Compile-time optimization level */
+	int flush_policy;   /* VM output buffer flush policy */
 	int n;              /* Script arguments */
 	int status = 0;     /* Script exit code */
 	int rc;
@@ -111,14 +236,23 @@ int main(int argc, char **argv) {
 		} else if(c == 'r' || c == 'R') {
 			/* Report run-time errors */
 			err_report = 1;
+		} else if(c == 'c' || c == 'C') {
+			/* Load and store the precompiled byte-code */
+			cache = 1;
+		} else if((c == 'p' || c == 'P') && n + 1 < argc) {
+			/* Precompile a whole directory */
+			zPrecompile = argv[++n];
 		} else if((c == 'm' || c == 'M') && SyStrlen(argv[n]) > 2) {
 			sLimitArg = argv[n] + 2;
+		} else if((c == 'o' || c == 'O') && argv[n][2] >= '0' + PH7_OPT_NONE && argv[n][2] <= '0' + PH7_OPT_CONSTANTS && argv[n][3] == 0) {
+			/* Compile-time optimization level */
+			opt_level = argv[n][2] - '0';
 		} else {
 			/* Display a help message and exit */
 			Help();
 		}
 	}
-	if(n >= argc) {
+	if(n >= argc && zPrecompile == NULL) {
 		puts("Missing AER file to compile");
 		Help();
 	}
@@ -142,8 +276,19 @@ int main(int argc, char **argv) {
 			   Output_Consumer, /* Error log consumer */
 			   0 /* NULL: Callback Private data */
 			  );
+	if(zPrecompile) {
+		/* Compile all scripts and store their byte-code, nothing gets executed */
+		ph7_config(pEngine, PH7_CONFIG_BYTECODE_CACHE, PH7_CACHE_WRITE);
+		status = PrecompileDirectory(pEngine, zPrecompile, opt_level) > 0 ? 1 : 0;
+		ph7_release(pEngine);
+		return status;
+	}
+	if(cache) {
+		/* Load up-to-date byte-code and refresh the outdated one */
+		ph7_config(pEngine, PH7_CONFIG_BYTECODE_CACHE, PH7_CACHE_READ | PH7_CACHE_WRITE);
+	}
 	/* Initialize the VM */
-	rc = ph7_vm_init(pEngine, &pVm, dump_vm);
+	rc = ph7_vm_init(pEngine, &pVm, dump_vm, opt_level);
 	if(rc != PH7_OK) {
 		if(rc == PH7_NOMEM) {
 			Fatal("Out of memory");
@@ -164,6 +309,16 @@ int main(int argc, char **argv) {
 	if(rc != PH7_OK) {
 		Fatal("Error while installing the VM output consumer callback");
 	}
+	/* Coalesce the output, but keep it line buffered on a terminal */
+#ifdef __WINNT__
+	flush_policy = GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) == FILE_TYPE_CHAR ? PH7_OUTPUT_FLUSH_LINE : PH7_OUTPUT_FLUSH_FULL;
+#else
+	flush_policy = isatty(STDOUT_FILENO) ? PH7_OUTPUT_FLUSH_LINE : PH7_OUTPUT_FLUSH_FULL;
+#endif
+	rc = ph7_vm_config(pVm, PH7_VM_CONFIG_OUTPUT_BUFFER, OUTPUT_BUFFER_SIZE, flush_policy);
+	if(rc != PH7_OK) {
+		Fatal("Error while configuring the VM output buffer");
+	}
 	rc = ph7_vm_config(pVm, PH7_VM_CONFIG_ERR_REPORT, 1, 0);
 	if(rc != PH7_OK) {
 		Fatal("Error while configuring the VM error reporting");